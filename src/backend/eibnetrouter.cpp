@@ -22,6 +22,7 @@
 #include "emi.h"
 #include "config.h"
 #include "cm_tp1.h"
+#include "ldataview.h"
 
 EIBNetIPRouter::EIBNetIPRouter (const LinkConnectPtr_& c, IniSectionPtr& s)
   : BusDriver(c,s)
@@ -43,6 +44,7 @@ EIBNetIPRouter::start()
   baddr.sin_port = htons (port);
   baddr.sin_addr.s_addr = htonl (INADDR_ANY);
   sock = new EIBNetIPSocket (baddr, 1, t);
+  sock->set_batch (recv_batch, send_batch);
   if (!sock->init ())
     goto err_out;
   sock->on_recv.set<EIBNetIPRouter,&EIBNetIPRouter::read_cb>(this);
@@ -109,6 +111,8 @@ EIBNetIPRouter::setup()
   port = cfg->value("port",3671);
   interface = cfg->value("interface","");
   monitor = cfg->value("monitor",false);
+  recv_batch = cfg->value("recv-batch",16);
+  send_batch = cfg->value("send-batch",16);
   return true;
 }
 
@@ -116,7 +120,8 @@ void
 EIBNetIPRouter::send_L_Data (LDataPtr l)
 {
   EIBNetIPPacket p;
-  p.data = L_Data_ToCEMI (0x29, l);
+  p.data.resize (L_Data_CEMI_size (*l));
+  L_Data_ToCEMI (0x29, *l, p.data.data(), p.data.size());
   p.service = ROUTING_INDICATION;
   sock->Send (p);
   send_Next();
@@ -144,17 +149,26 @@ EIBNetIPRouter::read_cb(EIBNetIPPacket *p)
       return;
     }
 
-  LDataPtr c = CEMI_to_L_Data (p->data, t);
-  delete p;
-  if (c)
+  LDataView v (p->data, LDataView::CEMI);
+  if (!v.complete ())
+    {
+      t->TracePacket (7, "incomplete L_Data", p->data);
+      delete p;
+      return;
+    }
+  if (monitor)
     {
-      if (!monitor)
+      /* straight to TP1, without decoding */
+      LBusmonPtr p1 = LBusmonPtr(new L_Busmon_PDU ());
+      p1->lpdu.resize (v.CM_TP1_size ());
+      if (v.to_CM_TP1 (p1->lpdu.data(), p1->lpdu.size()))
+        recv_L_Busmonitor (std::move(p1));
+    }
+  else
+    {
+      LDataPtr c = LDataPtr(new L_Data_PDU ());
+      if (v.to_L_Data (*c))
         recv_L_Data (std::move(c));
-      else
-        {
-          LBusmonPtr p1 = LBusmonPtr(new L_Busmon_PDU ());
-          p1->lpdu = L_Data_to_CM_TP1 (c);
-          recv_L_Busmonitor (std::move(p1));
-        }
     }
+  delete p;
 }
@@ -33,6 +33,8 @@ DRIVER(EIBNetIPRouter,ip)
   std::string multicastaddr;
   uint16_t port;
   bool monitor;
+  unsigned recv_batch;
+  unsigned send_batch;
 
   void read_cb(EIBNetIPPacket *p);
   void stop_();
@@ -20,10 +20,19 @@
 #include "eibnettunnel.h"
 #include "emi.h"
 #include "cm_tp1.h"
+#include "ldataview.h"
 
 #define NO_MAP
 #include "nat.h"
 
+/** Send a request at most this often. Repeats follow the measured RTT;
+ * the last copy waits the full timeout. */
+#define ACK_MAX_SENDS 5
+
+/** With several channels, a channel which went down is reconnected
+ * after this many seconds while the others carry the traffic. */
+#define RECONNECT_DELAY 10
+
 EIBNetIPTunnel::EIBNetIPTunnel (const LinkConnectPtr_& c, IniSectionPtr& s)
   : BusDriver(c,s)
 {
@@ -32,18 +41,21 @@ EIBNetIPTunnel::EIBNetIPTunnel (const LinkConnectPtr_& c, IniSectionPtr& s)
 
 EIBNetIPTunnel::~EIBNetIPTunnel ()
 {
-  TRACEPRINTF (t, 2, "Close");
   // restart();
   is_stopped();
+  for (IptChannel *ch : chans)
+    delete ch;
 }
 
 void EIBNetIPTunnel::is_stopped()
 {
-  timeout.stop();
-  conntimeout.stop();
-  trigger.stop();
-  delete sock;
-  sock = nullptr;
+  for (IptChannel *ch : chans)
+    {
+      ch->close();
+      ch->out.clear();
+    }
+  queued = 0;
+  stalled = false;
 }
 
 void EIBNetIPTunnel::stop()
@@ -72,6 +84,7 @@ EIBNetIPTunnel::setup()
   sport = cfg->value("src-port",0);
   NAT = cfg->value("nat",false);
   monitor = cfg->value("monitor",false);
+  tcp = cfg->value("tcp",false);
   if(NAT)
     {
       srcip = cfg->value("nat-ip","");
@@ -79,6 +92,36 @@ EIBNetIPTunnel::setup()
     }
   heartbeat_time = cfg->value("heartbeat-timer",30);
   heartbeat_limit = cfg->value("heartbeat-retries",3);
+  recv_batch = cfg->value("recv-batch",16);
+  send_batch = cfg->value("send-batch",16);
+  {
+    int lo = cfg->value("ack-timeout-min",50);
+    int hi = cfg->value("ack-timeout-max",1000);
+    if (lo < 1 || hi < lo)
+      {
+        ERRORPRINTF (t, E_ERROR | 148, "%s: need 0 < ack-timeout-min <= ack-timeout-max", cfg->name);
+        return false;
+      }
+    ack_min = lo / 1000.;
+    ack_max = hi / 1000.;
+  }
+
+  int n = cfg->value("channels",1);
+  if (n < 1 || n > 16)
+    {
+      ERRORPRINTF (t, E_ERROR | 150, "%s: 'channels' must be between 1 and 16", cfg->name);
+      return false;
+    }
+  for (int i = 0; i < n; i++)
+    {
+      TracePtr tr = t;
+      if (n > 1)
+        {
+          tr = TracePtr(new Trace(*t, t->name + '#' + std::to_string(i + 1)));
+          tr->setAuxName("ipt");
+        }
+      chans.push_back(new IptChannel (this, i, tr));
+    }
   return true;
 }
 
@@ -86,32 +129,275 @@ void
 EIBNetIPTunnel::start()
 {
   TRACEPRINTF (t, 2, "Open");
+  up = false;
+  addr = 0;
+  for (IptChannel *ch : chans)
+    if (!ch->start())
+      {
+        is_stopped();
+        stopped();
+        return;
+      }
+  TRACEPRINTF (t, 2, "Opened");
+}
 
-  timeout.set <EIBNetIPTunnel,&EIBNetIPTunnel::timeout_cb> (this);
-  conntimeout.set <EIBNetIPTunnel,&EIBNetIPTunnel::conntimeout_cb> (this);
-  trigger.set <EIBNetIPTunnel,&EIBNetIPTunnel::trigger_cb> (this);
+void
+EIBNetIPTunnel::restart()
+{
+  for (IptChannel *ch : chans)
+    ch->restart();
+}
 
-  trigger.start();
+IptChannel *
+EIBNetIPTunnel::primary()
+{
+  for (IptChannel *ch : chans)
+    if (ch->connected())
+      return ch;
+  return nullptr;
+}
+
+IptChannel *
+EIBNetIPTunnel::pick(uint32_t dest, IptChannel *skip)
+{
+  // Telegrams to one destination must not overtake each other,
+  // so stay on the channel which still has some queued
+  for (IptChannel *ch : chans)
+    if (ch != skip && ch->connected())
+      for (IptChannel::Frame &f : ch->out)
+        if (f.dest == dest)
+          return ch;
+
+  size_t n = chans.size();
+  for (size_t i = 0; i < n; i++)
+    {
+      IptChannel *ch = chans[(dest + i) % n];
+      if (ch != skip && ch->connected())
+        return ch;
+    }
+  // nothing is connected: wait for our own channel to come back
+  IptChannel *ch = chans[dest % n];
+  if (ch == skip)
+    ch = chans[(dest + 1) % n];
+  return ch;
+}
+
+void
+EIBNetIPTunnel::set_address()
+{
+  IptChannel *ch = primary();
+  if (ch == nullptr)
+    return;
+  addr = ch->addr;
+  auto cn = std::dynamic_pointer_cast<LinkConnect>(conn.lock());
+  if (cn != nullptr)
+    cn->setAddress(addr);
+  auto f = findFilter("single");
+  if (f != nullptr)
+    std::dynamic_pointer_cast<NatL2Filter>(f)->setAddress(addr);
+}
+
+void
+EIBNetIPTunnel::channel_up(IptChannel *ch)
+{
+  if (chans.size() > 1)
+    TRACEPRINTF (ch->t, 2, "Channel up, address %s", FormatEIBAddr (ch->addr));
+  if (ch == primary())
+    set_address();
+  if (!up)
+    {
+      up = true;
+      BusDriver::start();
+    }
+  else if (stalled && room())
+    {
+      // more channels, more telegrams in flight
+      stalled = false;
+      send_Next();
+    }
+}
+
+bool
+EIBNetIPTunnel::channel_down(IptChannel *ch)
+{
+  bool others = false;
+  for (IptChannel *c : chans)
+    if (c != ch && c->active())
+      others = true;
+  if (!others)
+    {
+      is_stopped();
+      errored();
+      return false;
+    }
+
+  TRACEPRINTF (ch->t, 2, "Channel down, moving %d telegrams", ch->out.size());
+  while (!ch->out.empty())
+    {
+      IptChannel *n = pick(ch->out.front().dest, ch);
+      n->out.push_back(std::move(ch->out.front()));
+      ch->out.pop_front();
+      n->send_next();
+    }
+  if (ch->addr == addr)
+    set_address();
+  return true;
+}
+
+void
+EIBNetIPTunnel::channel_sent(IptChannel *)
+{
+  queued--;
+  if (stalled && room())
+    {
+      stalled = false;
+      send_Next();
+    }
+}
+
+bool
+EIBNetIPTunnel::room()
+{
+  // With one channel, wait for the ACK. Otherwise keep one telegram per
+  // channel, on average, so that one busy destination can't hold up the
+  // others for long.
+  unsigned n = 0;
+  for (IptChannel *ch : chans)
+    if (ch->connected())
+      n++;
+  return queued < n;
+}
+
+bool
+EIBNetIPTunnel::accept_from(IptChannel *ch, eibaddr_t src)
+{
+  // every channel sees every telegram on the bus
+  if (ch != primary())
+    return false;
+  // the server reports what we sent on the other channels
+  for (IptChannel *c : chans)
+    if (c != ch && c->connected() && c->addr == src)
+      return false;
+  return true;
+}
+
+void
+EIBNetIPTunnel::send_L_Data (LDataPtr l)
+{
+  IptChannel::Frame f;
+  f.cemi = L_Data_ToCEMI (0x11, l);
+  f.dest = l->destination_address;
+  if (l->address_type == GroupAddress)
+    f.dest |= 0x10000;
+  IptChannel *ch = pick(f.dest);
+  ch->out.push_back(std::move(f));
+  ch->send_next();
+  queued++;
+  if (room())
+    send_Next();
+  else
+    stalled = true;
+}
+
+std::string
+EIBNetIPTunnel::info(int verbose)
+{
+  std::string res = BusDriver::info(verbose);
+  for (IptChannel *ch : chans)
+    res += " " + ch->info();
+  return res;
+}
+
+IptChannel::IptChannel (EIBNetIPTunnel *d, int i, TracePtr tr)
+  : index(i), t(tr), drv(d)
+{
+  rtt.set_limits (drv->ack_min, drv->ack_max);
+  timeout.set <IptChannel,&IptChannel::timeout_cb> (this);
+  conntimeout.set <IptChannel,&IptChannel::conntimeout_cb> (this);
+  trigger.set <IptChannel,&IptChannel::trigger_cb> (this);
+}
+
+IptChannel::~IptChannel ()
+{
+  TRACEPRINTF (t, 2, "Close: %s", rtt.info());
+  close();
+}
 
+void
+IptChannel::close()
+{
+  timeout.stop();
+  conntimeout.stop();
+  trigger.stop();
+  delete sock;
   sock = nullptr;
-  if (!GetHostIP (t, &caddr, dest))
-    goto ex;
-  caddr.sin_port = htons (port);
+  delete stream;
+  stream = nullptr;
+  sending.reset();
+  stalled = false;
+  mod = 0;
+}
+
+EIBnet_ConnectRequest
+IptChannel::get_creq()
+{
+  EIBnet_ConnectRequest creq;
+
+  creq.nat = saddr.sin_addr.s_addr == 0;
+  creq.tcp = drv->tcp;
+  creq.caddr = saddr;
+  creq.daddr = saddr;
+  creq.CRI.resize (3);
+  creq.CRI[0] = 0x04;
+  creq.CRI[1] = 0x02;
+  creq.CRI[2] = 0x00;
+  return creq;
+}
+
+bool
+IptChannel::start()
+{
+  // several channels can't share a fixed port
+  uint16_t sport = drv->sport ? drv->sport + index : 0;
+
+  trigger.start();
+  channel = -1;
+  mod = 0;
+  failed = false;
+  if (!GetHostIP (t, &caddr, drv->dest))
+    return false;
+  caddr.sin_port = htons (drv->port);
+  support_busmonitor = true;
+  connect_busmonitor = false;
+  if (drv->tcp)
+    {
+      stream = EIBNetIPStream::connect (caddr, t);
+      if (!stream)
+        return false;
+      stream->on_recv.set<IptChannel,&IptChannel::read_cb>(this);
+      stream->on_error.set<IptChannel,&IptChannel::error_cb>(this);
+      stream->on_next.set<IptChannel,&IptChannel::drained_cb>(this);
+      stream->start();
+      memset (&saddr, 0, sizeof (saddr));
+      NAT = false;
+      goto send_connect;
+    }
   if (!GetSourceAddress (t, &caddr, &raddr))
-    goto ex;
+    return false;
   raddr.sin_port = htons (sport);
   NAT = false;
   sock = new EIBNetIPSocket (raddr, (sport != 0), t);
+  sock->set_batch (drv->recv_batch, drv->send_batch);
   if (!sock->init ())
-    goto ex;
+    return false;
   raddr.sin_port = sock->port();
-  sock->on_recv.set<EIBNetIPTunnel,&EIBNetIPTunnel::read_cb>(this);
-  sock->on_error.set<EIBNetIPTunnel,&EIBNetIPTunnel::error_cb>(this);
+  sock->on_recv.set<IptChannel,&IptChannel::read_cb>(this);
+  sock->on_error.set<IptChannel,&IptChannel::error_cb>(this);
 
-  if (srcip.size())
+  if (drv->srcip.size())
     {
-      if (!GetHostIP (t, &saddr, srcip))
-        goto ex;
+      if (!GetHostIP (t, &saddr, drv->srcip))
+        return false;
       saddr.sin_port = htons (sport);
       NAT = true;
     }
@@ -120,39 +406,37 @@ EIBNetIPTunnel::start()
   sock->sendaddr = caddr;
   sock->recvaddr = caddr;
   sock->recvall = 0;
-  support_busmonitor = true;
-  connect_busmonitor = false;
 
+send_connect:
   {
     EIBnet_ConnectRequest creq = get_creq();
-    EIBNetIPPacket p = creq.ToPacket ();
-    sock->sendaddr = caddr;
-    sock->Send (p);
+    send (creq.ToPacket (), caddr);
   }
   conntimeout.start(CONNECT_REQUEST_TIMEOUT,0);
-
-  TRACEPRINTF (t, 2, "Opened");
-  out.clear();
-  return;
-ex:
-  if (sock)
-    {
-      delete sock;
-      sock = nullptr;
-    }
-  is_stopped();
-  stopped();
+  return true;
 }
 
 void
-EIBNetIPTunnel::error_cb ()
+IptChannel::error_cb ()
 {
   ERRORPRINTF (t, E_ERROR | 20, "Communication error: %s", strerror(errno));
-  errored();
+  // don't delete the socket from within its callback
+  failed = true;
+  mod = 0;
+  conntimeout.start(0,0);
 }
 
 void
-EIBNetIPTunnel::read_cb (EIBNetIPPacket *p1)
+IptChannel::send (const EIBNetIPBuf& b, struct sockaddr_in addr)
+{
+  if (stream)
+    stream->Send (b);
+  else
+    sock->Send (b, addr);
+}
+
+void
+IptChannel::read_cb (EIBNetIPPacket *p1)
 {
   LDataPtr c;
 
@@ -171,7 +455,7 @@ EIBNetIPTunnel::read_cb (EIBNetIPPacket *p1)
       if (cresp.status != 0)
         {
           TRACEPRINTF (t, 1, "Connect failed with error %02X", cresp.status);
-          if (cresp.status == 0x23 && support_busmonitor && monitor)
+          if (cresp.status == 0x23 && support_busmonitor && drv->monitor)
             {
               TRACEPRINTF (t, 1, "Disable busmonitor support");
               restart();
@@ -195,13 +479,7 @@ EIBNetIPTunnel::read_cb (EIBNetIPPacket *p1)
           break;
         }
 
-      auto cn = std::dynamic_pointer_cast<LinkConnect>(conn.lock());
-      if (cn != nullptr)
-        cn->setAddress((cresp.CRD[1] << 8) | cresp.CRD[2]);
-      auto f = findFilter("single");
-      if (f != nullptr)
-        std::dynamic_pointer_cast<NatL2Filter>(f)->setAddress((cresp.CRD[1] << 8) | cresp.CRD[2]);
-
+      addr = (cresp.CRD[1] << 8) | cresp.CRD[2];
       // TODO else reject
       daddr = cresp.daddr;
       if (!cresp.nat)
@@ -209,8 +487,8 @@ EIBNetIPTunnel::read_cb (EIBNetIPPacket *p1)
           if (NAT)
             {
               daddr.sin_addr = caddr.sin_addr;
-              if (dataport != 0)
-                daddr.sin_port = htons (dataport);
+              if (drv->dataport != 0)
+                daddr.sin_port = htons (drv->dataport);
             }
         }
       channel = cresp.channel;
@@ -218,12 +496,16 @@ EIBNetIPTunnel::read_cb (EIBNetIPPacket *p1)
       trigger.send();
       sno = 0;
       rno = 0;
-      sock->recvaddr2 = daddr;
-      sock->recvall = 3;
-      if (heartbeat_time)
-        conntimeout.start(heartbeat_time,0);
+      retry = 0;
+      if (sock)
+        {
+          sock->recvaddr2 = daddr;
+          sock->recvall = 3;
+        }
+      if (drv->heartbeat_time)
+        conntimeout.start(drv->heartbeat_time,0);
       heartbeat = 0;
-      BusDriver::start();
+      drv->channel_up(this);
       break;
     }
     case TUNNEL_REQUEST:
@@ -246,13 +528,14 @@ EIBNetIPTunnel::read_cb (EIBNetIPPacket *p1)
         }
       if (((treq.seqno + 1) & 0xff) == rno)
         {
+          if (stream)
+            break;
           EIBnet_TunnelACK tresp;
           tresp.status = 0;
           tresp.channel = channel;
           tresp.seqno = treq.seqno;
 
-          EIBNetIPPacket p = tresp.ToPacket ();
-          sock->Send (p, daddr);
+          sock->Send (tresp.Encode (), daddr);
           sock->recvall = 0;
           break;
         }
@@ -269,13 +552,15 @@ EIBNetIPTunnel::read_cb (EIBNetIPPacket *p1)
       rno++;
       if (rno > 0xff)
         rno = 0;
-      EIBnet_TunnelACK tresp;
-      tresp.status = 0;
-      tresp.channel = channel;
-      tresp.seqno = treq.seqno;
+      if (!stream)
+        {
+          EIBnet_TunnelACK tresp;
+          tresp.status = 0;
+          tresp.channel = channel;
+          tresp.seqno = treq.seqno;
 
-      EIBNetIPPacket p = tresp.ToPacket ();
-      sock->Send (p, daddr);
+          sock->Send (tresp.Encode (), daddr);
+        }
 
       //Confirmation
       if (treq.CEMI[0] == 0x2E)
@@ -289,8 +574,10 @@ EIBNetIPTunnel::read_cb (EIBNetIPPacket *p1)
         }
       if (treq.CEMI[0] == 0x2B)
         {
-          LBusmonPtr l2 = CEMI_to_Busmonitor (treq.CEMI, std::dynamic_pointer_cast<Driver>(shared_from_this()));
-          recv_L_Busmonitor (std::move(l2));
+          if (drv->primary() != this)
+            break;
+          LBusmonPtr l2 = CEMI_to_Busmonitor (treq.CEMI, std::dynamic_pointer_cast<Driver>(drv->shared_from_this()));
+          drv->recv_L_Busmonitor (std::move(l2));
           break;
         }
       if (treq.CEMI[0] != 0x29)
@@ -299,20 +586,44 @@ EIBNetIPTunnel::read_cb (EIBNetIPPacket *p1)
                        treq.CEMI[0]);
           break;
         }
-      c = CEMI_to_L_Data (treq.CEMI, t);
-      if (c)
+      {
+        /* every channel gets every frame, so look before decoding it */
+        LDataView v (treq.CEMI, LDataView::CEMI);
+        if (v.complete ())
+          {
+            if (!drv->accept_from (this, v.source ()))
+              break;
+            if (drv->monitor)
+              {
+                LBusmonPtr p1 = LBusmonPtr(new L_Busmon_PDU ());
+                p1->lpdu.resize (v.CM_TP1_size ());
+                if (v.to_CM_TP1 (p1->lpdu.data(), p1->lpdu.size()))
+                  drv->recv_L_Busmonitor (std::move(p1));
+                break;
+              }
+            c = CEMI_to_L_Data (treq.CEMI, t);
+          }
+        else
+          {
+            /* the view doesn't cover it, the decoder may */
+            c = CEMI_to_L_Data (treq.CEMI, t);
+            if (c && !drv->accept_from (this, c->source_address))
+              break;
+          }
+      }
+      if (!c)
+        {
+          TRACEPRINTF (t, 1, "Unknown CEMI");
+          break;
+        }
+      if (drv->monitor)
         {
-          if (!monitor)
-            recv_L_Data (std::move(c));
-          else
-            {
-              LBusmonPtr p1 = LBusmonPtr(new L_Busmon_PDU ());
-              p1->lpdu = L_Data_to_CM_TP1 (c);
-              recv_L_Busmonitor (std::move(p1));
-            }
+          LBusmonPtr p1 = LBusmonPtr(new L_Busmon_PDU ());
+          p1->lpdu = L_Data_to_CM_TP1 (c);
+          drv->recv_L_Busmonitor (std::move(p1));
           break;
         }
-      TRACEPRINTF (t, 1, "Unknown CEMI");
+      drv->recv_L_Data (std::move(c));
       break;
     }
     case TUNNEL_RESPONSE:
@@ -346,14 +657,17 @@ EIBNetIPTunnel::read_cb (EIBNetIPPacket *p1)
         }
       if (mod == 2)
         {
+          if (!retry) // Karn: a repeated request's ACK is ambiguous
+            rtt.sample (ev_time () - sent_at);
           sno++;
           if (sno > 0xff)
             sno = 0;
-          out.clear();
-          send_Next();
+          out.pop_front();
+          sending.reset();
           mod = 1;
-          trigger.send();
           retry = 0;
+          drv->channel_sent(this);
+          trigger.send();
         }
       else
         TRACEPRINTF (t, 1, "Unexpected ACK mod=%d",mod);
@@ -390,7 +704,7 @@ EIBNetIPTunnel::read_cb (EIBNetIPPacket *p1)
       else
         {
           TRACEPRINTF (t, 1, "Connection State Response Error %02x", csresp.status);
-          errored();
+          restart();
         }
       break;
     }
@@ -419,8 +733,9 @@ EIBNetIPTunnel::read_cb (EIBNetIPPacket *p1)
 
       EIBNetIPPacket p = dresp.ToPacket ();
       t->TracePacket (1, "SendDis", p.data);
-      sock->Send (p, caddr);
-      sock->recvall = 0;
+      send (p, caddr);
+      if (sock)
+        sock->recvall = 0;
       mod = 0;
       conntimeout.start(0.1,0);
       break;
@@ -444,7 +759,8 @@ EIBNetIPTunnel::read_cb (EIBNetIPPacket *p1)
           break;
         }
       mod = 0;
-      sock->recvall = 0;
+      if (sock)
+        sock->recvall = 0;
       TRACEPRINTF (t, 1, "Disconnected");
       restart();
       conntimeout.start(0.1,0);
@@ -457,48 +773,65 @@ err:
   delete p1;
 }
 
-void
-EIBNetIPTunnel::send_L_Data (LDataPtr l)
+void IptChannel::trigger_cb(ev::async &, int)
 {
-  assert(out.size() == 0);
-  out = L_Data_ToCEMI (0x11, l);
-  trigger.send();
+  while (mod == 1 && !out.empty())
+    {
+      if (stream && stream->pending() >= STREAM_BACKLOG)
+        {
+          stalled = true;
+          return;
+        }
+
+      // a repeated request is the same datagram
+      if (!retry || !sending)
+        sending = EIBnet_TunnelRequest::Encode (channel, sno, out.front().cemi);
+      t->TracePacket (1, "SendTunnel", sending.size() - 6, sending.data() + 6);
+      send (sending, daddr);
+      if (!stream)
+        break;
+
+      // TCP is reliable, there is no ACK to wait for
+      sno = (sno + 1) & 0xff;
+      out.pop_front();
+      sending.reset();
+      drv->channel_sent(this);
+    }
+  if (stream || mod != 1 || out.empty())
+    return;
+  if (!retry)
+    sent_at = ev_time ();
+  mod = 2;
+  timeout.start(retry + 1 < ACK_MAX_SENDS ? rtt.rto () : TUNNELING_REQUEST_TIMEOUT,0);
 }
 
-void EIBNetIPTunnel::trigger_cb(ev::async &, int)
+void
+IptChannel::drained_cb ()
 {
-  if (mod != 1 || out.size() == 0)
+  if (!stalled)
     return;
-
-  EIBnet_TunnelRequest treq;
-  treq.channel = channel;
-  treq.seqno = sno;
-  treq.CEMI = out;
-
-  EIBNetIPPacket p = treq.ToPacket ();
-  t->TracePacket (1, "SendTunnel", p.data);
-  sock->Send (p, daddr);
-  mod = 2;
-  timeout.start(1,0);
+  stalled = false;
+  trigger.send();
 }
 
-void EIBNetIPTunnel::conntimeout_cb(ev::timer &, int)
+void IptChannel::conntimeout_cb(ev::timer &, int)
 {
   if (mod)
     {
-      if (heartbeat < heartbeat_limit)
+      if (heartbeat < drv->heartbeat_limit)
         {
           EIBnet_ConnectionStateRequest csreq;
           csreq.nat = saddr.sin_addr.s_addr == 0;
+          csreq.tcp = drv->tcp;
           csreq.caddr = saddr;
           csreq.channel = channel;
 
           EIBNetIPPacket p = csreq.ToPacket ();
           TRACEPRINTF (t, 1, "Heartbeat");
-          sock->Send (p, caddr);
+          send (p, caddr);
           heartbeat++;
-          if (heartbeat_time)
-            conntimeout.start(heartbeat_time,0);
+          if (drv->heartbeat_time)
+            conntimeout.start(drv->heartbeat_time,0);
         }
       else
         {
@@ -506,11 +839,13 @@ void EIBNetIPTunnel::conntimeout_cb(ev::timer &, int)
           restart();
         }
     }
-  else
+  else if (active())
     {
-      TRACEPRINTF (t, 1, "Connect timed out");
-      is_stopped();
-      errored();
+      if (!failed)
+        TRACEPRINTF (t, 1, "Connect timed out");
+      close();
+      if (drv->channel_down(this))
+        conntimeout.start(RECONNECT_DELAY,0);
       // EIBnet_ConnectRequest creq = get_creq();
       // creq.CRI[1] =
       // ((connect_busmonitor && support_busmonitor) ? 0x80 : 0x02);
@@ -520,42 +855,65 @@ void EIBNetIPTunnel::conntimeout_cb(ev::timer &, int)
       // sock->Send (p, caddr);
       // conntimeout.start(10,0);
     }
+  else
+    {
+      TRACEPRINTF (t, 1, "Reconnecting");
+      if (!start())
+        {
+          close();
+          if (drv->channel_down(this))
+            conntimeout.start(RECONNECT_DELAY,0);
+        }
+    }
 }
 
 void
-EIBNetIPTunnel::restart()
+IptChannel::restart()
 {
   if (mod == 0)
     return;
   TRACEPRINTF (t, 1, "Disconnecting");
   EIBnet_DisconnectRequest dreq;
   dreq.caddr = saddr;
+  dreq.tcp = drv->tcp;
   dreq.channel = channel;
 
   if (channel != -1)
     {
       EIBNetIPPacket p = dreq.ToPacket ();
-      sock->Send (p, caddr);
+      send (p, caddr);
     }
-  sock->recvall = 0;
+  if (sock)
+    sock->recvall = 0;
   mod = 0;
   conntimeout.start(0.1,0);
 }
 
 void
-EIBNetIPTunnel::timeout_cb(ev::timer &, int)
+IptChannel::timeout_cb(ev::timer &, int)
 {
   if (mod != 2)
     return;
-  if (retry++ > 3)
+  rtt.backoff ();
+  if (++retry >= ACK_MAX_SENDS)
     {
-      out.clear();
+      retry = 0;
       TRACEPRINTF (t, 1, "Too many retransmits, disconnecting");
       restart();
+      out.pop_front();
+      sending.reset();
+      drv->channel_sent(this);
+      return;
     }
-  else
-    TRACEPRINTF (t, 1, "Retry");
+  TRACEPRINTF (t, 1, "Retry %d, timeout %.3f", retry, rtt.rto ());
   mod = 1;
   trigger.send();
 }
 
+std::string
+IptChannel::info()
+{
+  if (drv->chans.size() == 1)
+    return rtt.info();
+  return t->name + (connected() ? " " + FormatEIBAddr (addr) : " down") + ": " + rtt.info();
+}
@@ -20,25 +20,69 @@
 #ifndef EIBNET_TUNNEL_H
 #define EIBNET_TUNNEL_H
 
+#include <deque>
+#include <vector>
+
 #include "link.h"
 #include "eibnetip.h"
 
-DRIVER(EIBNetIPTunnel,ipt)
+class EIBNetIPTunnel;
+
+/** One tunnel connection of an ipt driver */
+class IptChannel
 {
-  EIBNetIPSocket *sock;
+public:
+  IptChannel (EIBNetIPTunnel *drv, int index, TracePtr tr);
+  ~IptChannel ();
+
+  /** an outgoing telegram */
+  struct Frame
+  {
+    CArray cemi;
+    /** destination address; group addresses have bit 16 set */
+    uint32_t dest;
+  };
+  /** telegrams for this channel; when mod==2, the first one is in flight */
+  std::deque<Frame> out;
+
+  /** the individual address the server assigned to this channel */
+  eibaddr_t addr = 0;
+  int index;
+  TracePtr t;
+
+  /** open the socket and send a CONNECT_REQUEST */
+  bool start();
+  /** disconnect from the server */
+  void restart();
+  /** close the socket and stop the timers */
+  void close();
+
+  bool connected() const
+  {
+    return mod != 0;
+  }
+  /** connecting or connected */
+  bool active() const
+  {
+    return sock != nullptr || stream != nullptr;
+  }
+  void send_next()
+  {
+    trigger.send();
+  }
+  std::string info();
+
+private:
+  EIBNetIPTunnel *drv;
+
+  EIBNetIPSocket *sock = nullptr;
+  /** used instead of sock when tunnelling over TCP */
+  EIBNetIPStream *stream = nullptr;
   struct sockaddr_in caddr;
   struct sockaddr_in daddr;
   struct sockaddr_in saddr;
   struct sockaddr_in raddr;
-
-  CArray out;
   bool NAT;
-  bool monitor;
-  std::string dest;
-  uint16_t port;
-  uint16_t sport;
-  std::string srcip;
-  uint16_t dataport;
 
 // main loop internal vars
   int channel = -1;
@@ -46,9 +90,17 @@ DRIVER(EIBNetIPTunnel,ipt)
   int rno = 0;
   int sno = 0;
   int heartbeat = 0;
-  int heartbeat_time;
-  int heartbeat_limit;
   int retry = 0;
+  /** TUNNEL_ACK timeout */
+  RttEstimator rtt;
+  /** when the current request was first sent */
+  ev_tstamp sent_at = 0;
+  /** the current request, encoded once for all its repetitions */
+  EIBNetIPBuf sending;
+  /** TCP: wait for the stream to drain */
+  bool stalled = false;
+  /** the socket failed; don't report a connect timeout */
+  bool failed = false;
 
   ev::timer timeout;
   void timeout_cb(ev::timer &w, int revents);
@@ -61,21 +113,60 @@ DRIVER(EIBNetIPTunnel,ipt)
   bool connect_busmonitor;
   void read_cb(EIBNetIPPacket *p);
   void error_cb();
-
-  inline EIBnet_ConnectRequest get_creq()
+  void drained_cb();
+  void send(const EIBNetIPBuf& b, struct sockaddr_in addr);
+  void send(const EIBNetIPPacket& p, struct sockaddr_in addr)
   {
-    EIBnet_ConnectRequest creq;
-
-    creq.nat = saddr.sin_addr.s_addr == 0;
-    creq.caddr = saddr;
-    creq.daddr = saddr;
-    creq.CRI.resize (3);
-    creq.CRI[0] = 0x04;
-    creq.CRI[1] = 0x02;
-    creq.CRI[2] = 0x00;
-    return creq;
+    send (p.Encode (), addr);
   }
 
+  EIBnet_ConnectRequest get_creq();
+};
+
+DRIVER(EIBNetIPTunnel,ipt)
+{
+  friend class IptChannel;
+
+  bool NAT;
+  bool monitor;
+  bool tcp;
+  std::string dest;
+  uint16_t port;
+  uint16_t sport;
+  std::string srcip;
+  uint16_t dataport;
+
+  int heartbeat_time;
+  int heartbeat_limit;
+  unsigned recv_batch;
+  unsigned send_batch;
+  ev_tstamp ack_min, ack_max;
+
+  std::vector<IptChannel *> chans;
+  /** telegrams queued on all channels */
+  unsigned queued = 0;
+  /** send_L_Data is waiting for a channel to accept more */
+  bool stalled = false;
+  /** BusDriver::start() has been called */
+  bool up = false;
+  /** the address we told the router about */
+  eibaddr_t addr = 0;
+
+  /** the channel which passes incoming telegrams on */
+  IptChannel *primary();
+  /** the channel for telegrams to @dest */
+  IptChannel *pick(uint32_t dest, IptChannel *skip = nullptr);
+  /** may send_L_Data be called again? */
+  bool room();
+  void set_address();
+
+  /* callbacks from the channels */
+  void channel_up(IptChannel *ch);
+  /** returns false if the whole driver has failed */
+  bool channel_down(IptChannel *ch);
+  void channel_sent(IptChannel *ch);
+  bool accept_from(IptChannel *ch, eibaddr_t src);
+
 public:
   EIBNetIPTunnel (const LinkConnectPtr_& c, IniSectionPtr& s);
   virtual ~EIBNetIPTunnel ();
@@ -86,6 +177,7 @@ public:
   void restart();
 
   void send_L_Data (LDataPtr  l);
+  std::string info(int verbose);
 };
 
 
@@ -17,17 +17,75 @@
     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#include <algorithm>
 #include "fpace.h"
 
+/* TP1 runs at 9600 bit/s. A frame follows at least 50 bit times of idle
+ * bus, each octet takes 13 bit times including the gap, and the ACK
+ * comes 15 bit times after the frame. */
+ev_tstamp
+BusLoad::frame_time (const LDataPtr &l)
+{
+  unsigned octets = l->lsdu.size () + (l->lsdu.size () > 16 ? 8 : 7);
+  return (50 + 13 * octets + 15 + 13) / 9600.;
+}
+
+void
+BusLoad::set_window (ev_tstamp window)
+{
+  slot_len = window / SLOTS;
+}
+
+void
+BusLoad::advance (ev_tstamp now)
+{
+  if (now - slot_start >= SLOTS * slot_len)
+    {
+      for (unsigned i = 0; i < SLOTS; i++)
+        busy[i] = busy_in[i] = 0;
+      cur = 0;
+      slot_start = now;
+      return;
+    }
+  while (now >= slot_start + slot_len)
+    {
+      cur = (cur + 1) % SLOTS;
+      busy[cur] = busy_in[cur] = 0;
+      slot_start += slot_len;
+    }
+}
+
+void
+BusLoad::add (ev_tstamp t, bool incoming, ev_tstamp now)
+{
+  advance (now);
+  busy[cur] += t;
+  if (incoming)
+    busy_in[cur] += t;
+}
+
+float
+BusLoad::load (ev_tstamp now, bool incoming_only)
+{
+  advance (now);
+  float sum = 0;
+  for (unsigned i = 0; i < SLOTS; i++)
+    sum += incoming_only ? busy_in[i] : busy[i];
+  ev_tstamp span = (SLOTS - 1) * slot_len + (now - slot_start);
+  return span > 0 ? sum / span : 0;
+}
+
 PaceFilter::PaceFilter (const LinkConnectPtr_& c, IniSectionPtr& s) : Filter(c,s)
 {
   timer.set<PaceFilter, &PaceFilter::timer_cb>(this);
+  report_timer.set<PaceFilter, &PaceFilter::report_timer_cb>(this);
   state = P_DOWN;
 }
 
 PaceFilter::~PaceFilter()
 {
   timer.stop();
+  report_timer.stop();
 }
 
 bool
@@ -56,6 +114,31 @@ PaceFilter::setup()
       ERRORPRINTF(t, E_ERROR | 2, "The factor for incoming packets must be >=0");
       return false;
     }
+  max_load = cfg->value("max-load",0)/100.;
+  if (max_load < 0 || max_load > 1)
+    {
+      ERRORPRINTF(t, E_ERROR | 164, "max-load must be between 0 and 100");
+      return false;
+    }
+  burst = cfg->value("burst",200)/1000.;
+  if (burst < 0)
+    {
+      ERRORPRINTF(t, E_ERROR | 165, "The burst must be >=0");
+      return false;
+    }
+  float window = cfg->value("window",10);
+  if (window <= 0)
+    {
+      ERRORPRINTF(t, E_ERROR | 166, "The window must be >0");
+      return false;
+    }
+  load.set_window(window);
+  report = cfg->value("report",0);
+  if (report < 0)
+    {
+      ERRORPRINTF(t, E_ERROR | 167, "The report interval must be >=0");
+      return false;
+    }
   return true;
 }
 
@@ -64,6 +147,10 @@ PaceFilter::start()
 {
   nr_in = 0;
   size_in = 0;
+  tokens = burst;
+  last_fill = ev_now(EV_DEFAULT);
+  if (report > 0)
+    report_timer.start(report, report);
   Filter::start();
 }
 
@@ -90,6 +177,7 @@ PaceFilter::stopped()
   state = P_DOWN;
   want_next = false;
   timer.stop();
+  report_timer.stop();
   Filter::stopped();
 }
 
@@ -104,9 +192,23 @@ PaceFilter::send_Next()
     case P_IDLE:
     {
       float this_delay;
+      if (max_load > 0)
+        {
+          this_delay = wait_time();
+          if (this_delay <= 0)
+            {
+              Filter::send_Next();
+              break;
+            }
+          paced++;
+          TRACEPRINTF (t, 2, "load %.0f%%: delay for %.3f sec", load.load(ev_now(EV_DEFAULT))*100, this_delay);
+        }
+      else
+        {
+          this_delay = last_len*byte_delay + delay;
+          TRACEPRINTF (t, 2, "out 1/%d: delay for %.3f sec", last_len, this_delay);
+        }
       state = P_BUSY;
-      this_delay = last_len*byte_delay + delay;
-      TRACEPRINTF (t, 2, "out 1/%d: delay for %.3f sec", last_len, this_delay);
       timer.start(this_delay);
     }
     break;
@@ -124,7 +226,18 @@ PaceFilter::timer_cb (ev::timer &, int)
       TRACEPRINTF (t, 2, "state: not busy ??");
       return;
     }
-  if (factor_in > 0 && nr_in > 0)
+  if (max_load > 0)
+    {
+      /* incoming packets may have used up the bus meanwhile */
+      ev_tstamp this_delay = wait_time();
+      if (this_delay > 0)
+        {
+          TRACEPRINTF (t, 2, "in: delay more, for %.3f sec", this_delay);
+          timer.start(this_delay);
+          return;
+        }
+    }
+  else if (factor_in > 0 && nr_in > 0)
     {
       float this_delay = (size_in*byte_delay + nr_in*delay) * factor_in;
       TRACEPRINTF (t, 2, "in %d/%d %f/%f/%f: delay more, for %.3f sec", nr_in,size_in, delay,byte_delay,factor_in, this_delay);
@@ -142,6 +255,7 @@ void
 PaceFilter::send_L_Data (LDataPtr l)
 {
   last_len = l->lsdu.size();
+  use(BusLoad::frame_time(l), false);
   Filter::send_L_Data(std::move(l));
 }
 
@@ -150,6 +264,52 @@ PaceFilter::recv_L_Data (LDataPtr l)
 {
   nr_in += 1;
   size_in = l->lsdu.size();
+  use(BusLoad::frame_time(l), true);
   Filter::recv_L_Data(std::move(l));
 }
 
+void
+PaceFilter::use (ev_tstamp busy, bool incoming)
+{
+  ev_tstamp now = ev_now(EV_DEFAULT);
+  load.add(busy, incoming, now);
+  wait_time();
+  float left = tokens - busy;
+  /* other devices' traffic may delay us by at most the burst; otherwise
+   * a busy stretch would stall our own sends long after it is over */
+  if (incoming && left < -burst)
+    left = std::min (tokens, -burst);
+  tokens = left;
+}
+
+ev_tstamp
+PaceFilter::wait_time ()
+{
+  if (max_load <= 0)
+    return 0;
+  ev_tstamp now = ev_now(EV_DEFAULT);
+  tokens += (now - last_fill) * max_load;
+  if (tokens > burst)
+    tokens = burst;
+  last_fill = now;
+  return tokens >= 0 ? 0 : -tokens / max_load;
+}
+
+void
+PaceFilter::report_timer_cb (ev::timer &, int)
+{
+  ev_tstamp now = ev_now(EV_DEFAULT);
+  ERRORPRINTF (t, E_INFO | 168, "bus load %.0f%%, %.0f%% received",
+               load.load(now)*100, load.load(now, true)*100);
+}
+
+std::string
+PaceFilter::info(int verbose)
+{
+  ev_tstamp now = ev_now(EV_DEFAULT);
+  char buf[100];
+  snprintf (buf, sizeof (buf), " load %.0f%% (%.0f%% received), paced %lu",
+            load.load(now)*100, load.load(now, true)*100, paced);
+  return Filter::info(verbose) + buf;
+}
+
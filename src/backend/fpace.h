@@ -30,12 +30,41 @@ and signals send_Next some time after a packet is sent.
 
 If there is no queue in front of this filter, the rate limit acts globally.
 This is probably not intentional, and thus warned about.
+
+The filter also measures how busy the bus is, from the length of the
+packets passing through in either direction. With "max-load", that
+measurement replaces the fixed delays: sending is paced by a token bucket
+of bus time which fills at the configured share of the bus, so that
+incoming traffic leaves less room for ours.
 */
 
 #ifndef FPACE_H
 #define FPACE_H
 #include "link.h"
 
+/** Bus occupancy in a sliding window */
+class BusLoad
+{
+public:
+  /** time a TP1 frame with this LSDU occupies the bus, ACK included */
+  static ev_tstamp frame_time (const LDataPtr &l);
+
+  void set_window (ev_tstamp window);
+  void add (ev_tstamp busy, bool incoming, ev_tstamp now);
+  /** share of the window the bus was busy, 0…1 */
+  float load (ev_tstamp now, bool incoming_only = false);
+
+private:
+  static const unsigned SLOTS = 16;
+  float busy[SLOTS] = {};
+  float busy_in[SLOTS] = {};
+  unsigned cur = 0;
+  ev_tstamp slot_len = 1;
+  ev_tstamp slot_start = 0;
+
+  void advance (ev_tstamp now);
+};
+
 enum PSTATE
 {
   P_DOWN,    // not running, not marked as requiring a Pace
@@ -56,6 +85,23 @@ FILTER(PaceFilter,pace)
   ev::timer timer;
   void timer_cb(ev::timer &w, int revents);
 
+  BusLoad load;
+  /** adaptive pacing: highest share of the bus to use, 0: off */
+  float max_load;
+  /** bus time we may still use, sec; negative: wait */
+  float tokens;
+  float burst;
+  ev_tstamp last_fill;
+  /** account for a frame on the bus */
+  void use(ev_tstamp busy, bool incoming);
+  /** how long to wait until sending is OK again */
+  ev_tstamp wait_time();
+  unsigned long paced = 0;
+
+  ev::timer report_timer;
+  void report_timer_cb(ev::timer &w, int revents);
+  float report;
+
 public:
   PaceFilter (const LinkConnectPtr_& c, IniSectionPtr& s);
   virtual ~PaceFilter ();
@@ -69,6 +115,8 @@ public:
   virtual void started();
   virtual void stopped();
 
+  virtual std::string info(int verbose = 0);
+
 };
 
 #endif
@@ -29,6 +29,9 @@ QueueFilter::QueueFilter (const LinkConnectPtr_& c, IniSectionPtr& s) : Filter(c
 QueueFilter::~QueueFilter()
 {
   trigger.stop();
+  /* the router outlives its links, and thus their filters */
+  if (router)
+    set_congested (false);
 }
 
 bool
@@ -47,9 +50,28 @@ QueueFilter::setup()
   if (!Filter::setup())
     return false;
   // XXX options?
+
+  /* A tunnel client that can't keep up is its own problem; a bus that
+   * can't keep up is everybody's. */
+  auto c = conn.lock();
+  if (c != nullptr && std::dynamic_pointer_cast<LinkConnectClient>(c) == nullptr)
+    router = &static_cast<Router &>(c->router);
   return true;
 }
 
+void
+QueueFilter::set_congested (bool on)
+{
+  if (on == congested)
+    return;
+  congested = on;
+  if (on)
+    router->congested_links++;
+  else
+    router->congested_links--;
+  TRACEPRINTF (t, 5, "%s, %d queued", on ? "congested" : "no longer congested", buf.size());
+}
+
 void
 QueueFilter::started()
 {
@@ -69,6 +91,8 @@ void
 QueueFilter::stopped()
 {
   buf.clear();
+  if (router)
+    set_congested (false);
   state = Q_DOWN;
   Filter::stopped();
 }
@@ -102,6 +126,8 @@ QueueFilter::trigger_cb (ev::async &, int)
       LDataPtr l = buf.get();
       Filter::send_L_Data(std::move(l));
     }
+  if (router && buf.size() <= router->busy_queue / 2)
+    set_congested (false);
   if (state == Q_SENDING)
     state = Q_BUSY;
 }
@@ -116,7 +142,15 @@ QueueFilter::send_L_Data (LDataPtr l)
       trigger.send();
     case Q_BUSY:
     case Q_SENDING:
-      buf.emplace(std::move(l));
+      if (router && router->max_queue && buf.size() >= router->max_queue)
+        {
+          router->lost++;
+          TRACEPRINTF (t, 3, "discard (full) %s", l->Decode (t));
+        }
+      else
+        buf.emplace(std::move(l));
+      if (router && router->busy_queue && buf.size() >= router->busy_queue)
+        set_congested (true);
       Filter::send_Next();
       break;
     default:
@@ -28,6 +28,7 @@ supports it.
 #define FQUEUE_H
 #include "link.h"
 #include "queue.h"
+#include "router.h"
 
 enum QSTATE
 {
@@ -44,6 +45,11 @@ FILTER(QueueFilter,queue)
   ev::async trigger;
   void trigger_cb (ev::async &w, int revents);
 
+  /** flow control, for driver links only; see Router::congested() */
+  Router *router = nullptr;
+  bool congested = false;
+  void set_congested (bool on);
+
 public:
   QueueFilter (const LinkConnectPtr_& c, IniSectionPtr& s);
   virtual ~QueueFilter ();
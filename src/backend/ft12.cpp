@@ -87,7 +87,8 @@ FT12Driver::make_EMI()
 bool
 FT12Driver::setup()
 {
-  iface = new FT12wrap(this, cfg);
+  wrap = new FT12wrap(this, cfg);
+  iface = wrap;
 
   if (t->ShowPrint(0))
     iface = new LLlog (this,cfg, iface);
@@ -104,6 +105,15 @@ ex1:
   return false;
 }
 
+std::string
+FT12Driver::info(int verbose)
+{
+  std::string res = LowLevelAdapter::info(verbose);
+  if (wrap)
+    res += " " + wrap->stats_info();
+  return res;
+}
+
 FT12wrap::FT12wrap (LowLevelIface* c, IniSectionPtr& s, LowLevelDriver *i) : LowLevelFilter(c,s,i)
 {
   t->setAuxName("ft12wrap");
@@ -112,28 +122,35 @@ FT12wrap::FT12wrap (LowLevelIface* c, IniSectionPtr& s, LowLevelDriver *i) : Low
 bool
 FT12wrap::setup()
 {
-  if (cfg->value("device","").length() > 0)
+  ack_timeout = cfg->value("ack-timeout",200) / 1000.;
+  ack_retries = cfg->value("ack-retries",3);
+
+  /* ft12check passes in a simulated device */
+  if (iface == nullptr)
     {
-      if (cfg->value("ip-address","").length() > 0 ||
-          cfg->value("port",-1) != -1)
+      if (cfg->value("device","").length() > 0)
         {
-          ERRORPRINTF (t, E_ERROR | 5, "Don't specify both device and IP options!");
-          return false;
+          if (cfg->value("ip-address","").length() > 0 ||
+              cfg->value("port",-1) != -1)
+            {
+              ERRORPRINTF (t, E_ERROR | 5, "Don't specify both device and IP options!");
+              return false;
+            }
+          iface = new FT12serial(this, cfg);
         }
-      iface = new FT12serial(this, cfg);
-    }
-  else
-    {
-      if (cfg->value("baudrate",-1) != -1)
+      else
         {
-          ERRORPRINTF (t, E_ERROR | 6, "Don't specify both device and IP options!");
-          return false;
+          if (cfg->value("baudrate",-1) != -1)
+            {
+              ERRORPRINTF (t, E_ERROR | 6, "Don't specify both device and IP options!");
+              return false;
+            }
+          iface = new LLtcp(this, cfg);
         }
-      iface = new LLtcp(this, cfg);
-    }
 
-  if (t->ShowPrint(0))
-    iface = new LLlog (this,cfg, iface);
+      if (t->ShowPrint(0))
+        iface = new LLlog (this,cfg, iface);
+    }
 
   if (!iface->setup())
     return false;
@@ -151,11 +168,14 @@ FT12wrap::start()
 
   sendflag = false;
   recvflag = false;
-  next_free = true;
-  send_wait = false;
+  out = Frame();
+  sent = false;
+  next_wait = false;
+  akt.clear();
+  akt_len = 0;
+  pending.clear();
   in_reader = false;
 
-  repeatcount = 0;
   TRACEPRINTF (t, 1, "Opened");
   LowLevelFilter::start();
   return;
@@ -169,6 +189,8 @@ FT12wrap::setup_buffers()
 
   trigger.set<FT12wrap,&FT12wrap::trigger_cb>(this);
   trigger.start();
+
+  akt.reserve (255 + 6);
 }
 
 void
@@ -184,7 +206,7 @@ FT12wrap::stop_()
 void
 FT12wrap::stop()
 {
-  TRACEPRINTF (t, 1, "Close");
+  TRACEPRINTF (t, 1, "Close: %s", stats_info());
 
   stop_();
   LowLevelFilter::stop();
@@ -195,6 +217,15 @@ FT12wrap::~FT12wrap ()
   stop_ ();
 }
 
+std::string
+FT12wrap::stats_info()
+{
+  char buf[100];
+  snprintf (buf, sizeof (buf), "%lu frames, %lu retransmitted, %lu dropped, ",
+            n_frames, n_retransmit, n_dropped);
+  return buf + rtt.info(false);
+}
+
 void
 FT12wrap::send_Data (CArray& l)
 {
@@ -204,226 +235,298 @@ FT12wrap::send_Data (CArray& l)
 void
 FT12wrap::do_send_Local (CArray& l, int raw)
 {
-  if(out.size() > 0)
+  if (out.data.size())
     {
       ERRORPRINTF (t, E_ERROR | 36, "Send while data");
       return;
     }
+  out.tries = 0;
+  CArray &f = out.data;
   if (!raw)
     {
       uint8_t c;
       unsigned i;
 
-      out.resize (l.size() + 7);
-      out[0] = 0x68;
-      out[1] = l.size() + 1;
-      out[2] = l.size() + 1;
-      out[3] = 0x68;
+      f.resize (l.size() + 7);
+      f[0] = 0x68;
+      f[1] = l.size() + 1;
+      f[2] = l.size() + 1;
+      f[3] = 0x68;
+      /* each frame toggles the frame count bit, so that the device can
+       * tell a repeated frame from the next one */
       if (sendflag)
-        out[4] = 0x53;
+        f[4] = 0x53;
       else
-        out[4] = 0x73;
+        f[4] = 0x73;
       sendflag = !sendflag;
 
-      out.setpart (l.data(), 5, l.size());
-      c = out[4];
+      f.setpart (l.data(), 5, l.size());
+      c = f[4];
       for (i = 0; i < l.size(); i++)
         c += l[i];
-      out[out.size() - 2] = c;
-      out[out.size() - 1] = 0x16;
+      f[f.size() - 2] = c;
+      f[f.size() - 1] = 0x16;
     }
   else
     {
       assert (raw == 1);
-      out = l;
+      f = l;
     }
 
-  if (!send_wait)
-    trigger.send();
+  next_wait = true;
+  trigger.send();
 }
 
 void
 FT12wrap::recv_Data(CArray &c)
 {
-  uint8_t *buf = c.data();
-  size_t len = c.size();
-
-  akt.setpart (buf, akt.size(), len);
-  process_read(false);
+  process_read(c.data(), c.size());
 }
 
 void
 FT12wrap::timer_cb(ev::timer &, int)
 {
-  process_read(true);
+  t->TracePacket (1, "Incomplete frame", akt);
+  /* its start octet may have been a stray one: look for a frame, or an
+   * ACK, in the rest instead of dropping all of it */
+  CArray rest (akt.data() + 1, akt.size() - 1);
+  akt.clear();
+  akt_len = 0;
+  process_read (rest.data(), rest.size());
 }
 
+/* the serial line doesn't confirm writes; the device's ACK does */
 void
 FT12wrap::do_send_Next()
 {
-  next_free = true;
-  if (akt.size() > 0)
-    {
-      process_read(false);
-      if (!next_free)
-        return;
-    }
-  if (send_wait)
+}
+
+void
+FT12wrap::release_next()
+{
+  if (next_wait && !out.data.size())
     {
-      send_wait = false;
-      trigger.send();
+      next_wait = false;
+      LowLevelFilter::do_send_Next();
     }
 }
 
 void
-FT12wrap::do__send_Next()
+FT12wrap::recv_ack()
 {
-  out.clear();
+  if (!sent)
+    {
+      TRACEPRINTF (t, 0, "Spurious ACK");
+      return;
+    }
+  /* only a frame sent once tells how long the ACK takes */
+  if (out.tries == 1)
+    rtt.sample (ev_time () - out.sent_at);
+  if (out.data[0] == 0x68)
+    n_frames++;
+  out.data.clear();
+  sent = false;
   sendtimer.stop();
-  LowLevelFilter::do_send_Next();
+  release_next();
 }
 
 void
-FT12wrap::process_read(bool is_timeout)
+FT12wrap::process_read(const uint8_t *data, size_t len)
 {
   if (in_reader)
-    return;
+    {
+      pending.insert (pending.end(), data, data + len);
+      return;
+    }
   in_reader = true;
-  timer.stop();
 
-  t->TracePacket (1, "Processing", akt);
-  while (akt.size() > 0 && next_free)
+  t->TracePacket (1, "Processing", len, data);
+  for (size_t i = 0; i < len; i++)
+    process_byte (data[i]);
+  while (pending.size())
     {
-      if (akt[0] == 0xE5 && send_wait)
-        {
-          akt.deletepart (0, 1);
-          send_wait = false;
-          do__send_Next();
-          repeatcount = 0;
-        }
-      else if (akt[0] == 0xE5)
-        {
-          TRACEPRINTF (t, 0, "Spurious ACK");
-          akt.deletepart (0, 1);
-        }
-      else if (akt[0] == 0x10)
+      CArray p;
+      p.swap (pending);
+      for (size_t i = 0; i < p.size(); i++)
+        process_byte (p[i]);
+    }
+
+  if (akt.size())
+    timer.start(0.15,0);
+  else
+    timer.stop();
+  in_reader = false;
+}
+
+/*
+ * Frames are assembled octet by octet, so a frame which arrives in
+ * pieces is looked at once, not again with each piece.
+ */
+void
+FT12wrap::process_byte(uint8_t c)
+{
+  if (akt.size() == 0)
+    {
+      switch (c)
         {
-          if (akt.size() < 4)
-            break;
-          if (akt[1] == akt[2] && akt[3] == 0x16)
-            {
-              uint8_t c1 = 0xE5;
-              iface->send_Data(c1);
-              if ((akt[1] == 0xF3 && !recvflag) ||
-                  (akt[1] == 0xD3 && recvflag))
-                {
-                  //correct sequence number
-                  recvflag = !recvflag;
-                }
-              if ((akt[1] & 0x0f) == 0)
-                {
-                  const uint8_t reset[1] = { 0xA0 };
-                  CArray c = CArray (reset, sizeof (reset));
-                  t->TracePacket (0, "RecvReset", c);
-                  LowLevelFilter::recv_Data (c);
-                }
-              akt.deletepart (0, 4);
-            }
-          else
-            {
-              akt.deletepart (0, 1);
-            }
+        case 0xE5:
+          recv_ack();
+          return;
+        case 0x10:
+          akt_len = 4;
+          break;
+        case 0x68:
+          /* known after the header */
+          akt_len = 0;
+          akt_sum = 0;
+          break;
+        default:
+          /* an unknown octet: drop it. */
+          TRACEPRINTF (t, 1, "Dropping %02x", c);
+          return;
         }
-      else if (akt[0] == 0x68)
+      akt.push_back (c);
+      return;
+    }
+
+  akt.push_back (c);
+  size_t n = akt.size();
+  if (akt[0] == 0x68)
+    {
+      if (n == 4)
         {
-          int len;
-          uint8_t c1;
-          if (akt.size() < 7)
-            break;
-          if (akt[1] != akt[2] || akt[3] != 0x68)
+          if (akt[1] != akt[2] || akt[3] != 0x68 || akt[1] == 0)
             {
-              akt.deletepart (0, 1);
               //receive error, try to resume
-              goto err_out;
-            }
-          if (akt.size() < akt[1] + 6U)
-            break;
-
-          c1 = 0;
-          for (unsigned int i = 4; i < akt[1] + 4U; i++)
-            c1 += akt[i];
-          len = akt[1] + 6;
-          if (akt[akt[1] + 4] != c1 || akt[akt[1] + 5] != 0x16)
-            {
-              //Forget wrong short frame
-              akt.deletepart (0, len);
-              continue;
+              resync();
+              return;
             }
+          akt_len = akt[1] + 6;
+        }
+      else if (n > 4 && n <= akt[1] + 4U)
+        akt_sum += c;
+    }
+
+  if (akt_len && n == akt_len)
+    process_frame();
+}
 
-          c1 = 0xE5;
-          iface->send_Data (c1);
+void
+FT12wrap::resync()
+{
+  CArray rest (akt.data() + 1, akt.size() - 1);
+  akt.clear();
+  akt_len = 0;
+  for (unsigned i = 0; i < rest.size(); i++)
+    process_byte (rest[i]);
+}
 
-          if (akt[4] == (recvflag ? 0xF3 : 0xD3))
-            {
-              // repeat packet?
-              if (CArray (akt.data() + 5, akt[1] - 1) != last)
-                {
-                  TRACEPRINTF (t, 0, "Sequence jump");
-                  recvflag = !recvflag;
-                }
-              else
-                TRACEPRINTF (t, 0, "Wrong Sequence");
-            }
-          else if (akt[4] == (recvflag ? 0xD3 : 0xF3))
-            {
-              recvflag = !recvflag;
-              CArray *c = new CArray;
-              c->setpart (akt.data() + 5, 0, len - 7);
-              last = *c;
-              LowLevelFilter::recv_Data (*c);
-            }
-          akt.deletepart (0, len);
+void
+FT12wrap::process_frame()
+{
+  uint8_t c1 = 0xE5;
+
+  if (akt[0] == 0x10)
+    {
+      if (akt[1] != akt[2] || akt[3] != 0x16)
+        {
+          resync();
+          return;
         }
-      else
+      iface->send_Data(c1);
+      if ((akt[1] == 0xF3 && !recvflag) ||
+          (akt[1] == 0xD3 && recvflag))
         {
-          /* if timeout OR an unknown byte, drop it. */
-          if (false)
-            {
-err_out:
-              if (!is_timeout)
-                break;
-            }
-          akt.deletepart (0, 1);
+          //correct sequence number
+          recvflag = !recvflag;
         }
+      if ((akt[1] & 0x0f) == 0)
+        {
+          const uint8_t reset[1] = { 0xA0 };
+          CArray c = CArray (reset, sizeof (reset));
+          t->TracePacket (0, "RecvReset", c);
+          LowLevelFilter::recv_Data (c);
+        }
+      akt.clear();
+      akt_len = 0;
+      return;
     }
 
-  if (akt.size())
+  if (akt[akt_len - 2] != akt_sum || akt[akt_len - 1] != 0x16)
     {
-      t->TracePacket (1, "Processing: left", akt);
-      timer.start(0.15,0);
+      //Forget wrong frame
+      t->TracePacket (1, "Bad frame", akt);
+      akt.clear();
+      akt_len = 0;
+      return;
     }
-  in_reader = false;
+
+  iface->send_Data (c1);
+
+  if (akt[4] == (recvflag ? 0xF3 : 0xD3))
+    {
+      // repeat packet?
+      if (CArray (akt.data() + 5, akt[1] - 1) != last)
+        {
+          TRACEPRINTF (t, 0, "Sequence jump");
+          recvflag = !recvflag;
+        }
+      else
+        TRACEPRINTF (t, 0, "Wrong Sequence");
+    }
+  else if (akt[4] == (recvflag ? 0xD3 : 0xF3))
+    {
+      recvflag = !recvflag;
+      last.set (akt.data() + 5, akt_len - 7);
+      CArray c (last);
+      LowLevelFilter::recv_Data (c);
+    }
+  akt.clear();
+  akt_len = 0;
 }
 
+/* no ACK in time: send the frame again, with its frame count bit
+ * unchanged, so that the device can tell if it's a repeat */
 void
 FT12wrap::sendtimer_cb(ev::timer &, int)
 {
-  send_wait = false;
+  if (!sent)
+    return;
+  sent = false;
+  if (out.tries > ack_retries)
+    {
+      if (out.data[0] == 0x10)
+        {
+          ERRORPRINTF (t, E_ERROR | 184, "No ACK for reset");
+          out.data.clear();
+          errored();
+          return;
+        }
+      ERRORPRINTF (t, E_WARNING | 171, "No ACK, frame dropped");
+      n_dropped++;
+      /* The device may or may not have got it, so it may or may not
+       * take the next frame for a repeat. Reset the frame count bit. */
+      const uint8_t reset[] = { 0x10, 0x40, 0x40, 0x16 };
+      out.data.set (reset, sizeof (reset));
+      out.tries = 0;
+      sendflag = false;
+    }
   trigger.send();
 }
 
 void
 FT12wrap::trigger_cb (ev::async &, int)
 {
-  if (send_wait || !next_free)
-    return;
-  if (out.size() == 0)
+  if (sent || !out.data.size())
     return;
 
-  repeatcount++;
-  iface->send_Data(out.data(), out.size());
-  send_wait = true;
-  timer.start(0.2, 0);
+  sent = true;
+  if (out.tries++)
+    n_retransmit++;
+  else
+    out.sent_at = ev_time ();
+  sendtimer.start(ack_timeout, 0);
+  iface->send_Data(out.data.data(), out.data.size());
 }
 
 void FT12wrap::sendReset()
@@ -28,6 +28,7 @@
 #include "lowlatency.h"
 #include "link.h"
 #include "cemi.h"
+#include "rtt.h"
 
 /** FT12-specific CEMI backend (separate commands for setup) */
 class FT12CEMIDriver : public CEMIDriver
@@ -41,6 +42,8 @@ public:
   virtual ~FT12CEMIDriver ();
 };
 
+class FT12wrap;
+
 /** FT1.2 lowlevel driver*/
 DRIVER_(FT12Driver,LowLevelAdapter,ft12)
 {
@@ -56,8 +59,10 @@ public:
   {
     return vEMI2;
   }
+  std::string info(int verbose);
 private:
   bool make_EMI();
+  FT12wrap *wrap = nullptr;
 };
 
 DRIVER_(FT12cemiDriver, FT12Driver, ft12cemi)
@@ -82,22 +87,48 @@ class FT12wrap : public LowLevelFilter
   /** receive msg sequence 1-bit counter */
   bool recvflag;
 
-  /** packet send buffer */
-  CArray out;
+  /*
+   * The frame count bit is the only sequence number, and the ACK is a
+   * single octet without one, so there is just one frame in flight: an
+   * ACK for the second of two frames can't be told from a late one for
+   * the first.
+   */
+  struct Frame
+  {
+    CArray data;
+    /** first transmission */
+    ev_tstamp sent_at = 0;
+    unsigned tries = 0;
+  };
+  /** the frame to send; empty if there's none */
+  Frame out;
+  /** it has been sent and waits for its ACK */
+  bool sent = false;
+  /** the upper layer waits for send_Next */
+  bool next_wait = false;
+
+  ev_tstamp ack_timeout = 0.2;
+  unsigned ack_retries = 3;
+
   /** frame in receiving */
   CArray akt;
+  /** its length, once known */
+  size_t akt_len = 0;
+  /** checksum of its user data so far */
+  uint8_t akt_sum = 0;
+  /** data which arrived while processing */
+  CArray pending;
   /** last received frame */
   CArray last;
-  /** repeatcount of the transmitting frame */
-  int repeatcount;
 
-  /** waiting for ACK */
-  bool send_wait;
-  /** send_Next received */
-  bool next_free = true;
   /** protect against recursive call of process_read() */
   bool in_reader = false;
 
+  RttEstimator rtt;
+  unsigned long n_frames = 0;
+  unsigned long n_retransmit = 0;
+  unsigned long n_dropped = 0;
+
   /** set up send and recv buffers, timers, etc. */
   void setup_buffers();
 
@@ -108,9 +139,15 @@ class FT12wrap : public LowLevelFilter
   ev::timer sendtimer;
   void sendtimer_cb (ev::timer &w, int revents);
   /** process incoming data */
-  void process_read (bool is_timeout);
+  void process_read (const uint8_t *data, size_t len);
+  void process_byte (uint8_t c);
+  /** a complete frame is in akt */
+  void process_frame ();
+  /** drop akt's first octet and look for a frame in the rest */
+  void resync ();
+  void recv_ack ();
+  void release_next ();
   void do_send_Next ();
-  void do__send_Next ();
   void stop_ ();
 
 public:
@@ -125,6 +162,8 @@ public:
   void do_send_Local (CArray& l, int raw = 0);
 
   void sendReset();
+  /** latency and retransmission counters */
+  std::string stats_info ();
 };
 
 #endif
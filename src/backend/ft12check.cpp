@@ -0,0 +1,328 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Check of the FT1.2 driver's repetitions against a simulated device.
+ *
+ * The device discards a frame whose frame count bit isn't the one it
+ * expects, like a real one does, and ACKs every frame it gets. Frames
+ * and ACKs are lost on the way as each case says; every frame must
+ * still arrive exactly once and in order, unless the driver gave up on
+ * it before the device got it. The driver's counters must match what
+ * was lost. A stray octet from the device must cost a delay, not the
+ * frame or ACK behind it.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include <vector>
+#include "inifile.h"
+#include "ft12.h"
+
+/** aborts program with a printf like message */
+void
+die (const char *msg, ...)
+{
+  va_list ap;
+  va_start (ap, msg);
+  vprintf (msg, ap);
+  printf ("\n");
+  va_end (ap);
+
+  exit (1);
+}
+
+LOOP_RESULT loop;
+
+static TracePtr t;
+static unsigned errors = 0;
+
+/** the device at the other end of the serial line */
+class Device : public LowLevelDriver
+{
+public:
+  /** lose every n-th frame, or the ACK of every n-th frame; 0: don't */
+  unsigned lose_frame = 0;
+  unsigned lose_ack = 0;
+  /** lose frames number @mute_at … @mute_at + @mute_len - 1, or only
+   * their ACKs if @mute_ack is set */
+  unsigned mute_at = 0;
+  unsigned mute_len = 0;
+  bool mute_ack = false;
+  /** send a stray start octet before the ACK of transmission @stray_at */
+  unsigned stray_at = 0;
+
+  /** transmissions seen, and how many of them were resets */
+  unsigned n_rx = 0;
+  unsigned n_reset = 0;
+  /** the frames' payload, repetitions discarded */
+  std::vector<CArray> got;
+
+  Device (LowLevelIface* parent, IniSectionPtr& s) : LowLevelDriver (parent, s)
+  {
+    ack_timer.set<Device,&Device::ack_timer_cb> (this);
+  }
+  virtual ~Device ()
+  {
+    ack_timer.stop ();
+  }
+
+  void send_Data (CArray& c)
+  {
+    bool reset = (c.size () == 4 && c[0] == 0x10 && c[1] == 0x40);
+    if (!reset && (c.size () < 7 || c[0] != 0x68))
+      {
+        printf ("unexpected frame from the driver\n");
+        errors++;
+        return;
+      }
+    unsigned n = ++n_rx;
+    if (lose_frame && n % lose_frame == 0)
+      return;
+    bool mute = (n >= mute_at && n < mute_at + mute_len);
+    if (mute && !mute_ack)
+      return;
+
+    if (reset)
+      {
+        n_reset++;
+        fcb = true;
+      }
+    else if (!!(c[4] & 0x20) == fcb)
+      {
+        got.push_back (CArray (c.data () + 5, c.size () - 7));
+        fcb = !fcb;
+      }
+
+    if (mute || (lose_ack && n % lose_ack == 0))
+      return;
+    acks++;
+    stray = (n == stray_at);
+    ack_timer.start (0.002, 0);
+  }
+
+private:
+  /** the frame count bit of the next new frame */
+  bool fcb = true;
+  unsigned acks = 0;
+  bool stray = false;
+  ev::timer ack_timer;
+  void ack_timer_cb (ev::timer &, int)
+  {
+    if (stray)
+      master->recv_Data (0x10);
+    stray = false;
+    while (acks)
+      {
+        acks--;
+        master->recv_Data (0xE5);
+      }
+  }
+};
+
+/** the EMI layer above the driver: sends frames, one after the other */
+class Upper : public LowLevelIface
+{
+public:
+  FT12wrap *wrap = nullptr;
+  std::vector<CArray> sent;
+  unsigned count = 0;
+  bool done = false;
+  bool failed = false;
+
+  Upper ()
+  {
+    timeout.set<Upper,&Upper::timeout_cb> (this);
+  }
+  virtual ~Upper ()
+  {
+    timeout.stop ();
+  }
+
+  TracePtr tr ()
+  {
+    return t;
+  }
+  void started ()
+  {
+    timeout.start (30, 0);
+    next ();
+  }
+  void stopped () {}
+  void errored ()
+  {
+    failed = true;
+    finish ();
+  }
+  void recv_Data (CArray&) {}
+  void send_Data (CArray&) {}
+  void send_L_Data (LDataPtr) {}
+  void recv_L_Data (LDataPtr) {}
+  void recv_L_Busmonitor (LBusmonPtr) {}
+  FilterPtr findFilter (std::string)
+  {
+    return nullptr;
+  }
+  bool checkAddress (eibaddr_t)
+  {
+    return false;
+  }
+  bool checkGroupAddress (eibaddr_t)
+  {
+    return false;
+  }
+  bool checkSysAddress (eibaddr_t)
+  {
+    return false;
+  }
+  bool checkSysGroupAddress (eibaddr_t)
+  {
+    return false;
+  }
+
+private:
+  ev::timer timeout;
+  void timeout_cb (ev::timer &, int)
+  {
+    printf ("stalled after %zu frames\n", sent.size ());
+    errors++;
+    finish ();
+  }
+  void finish ()
+  {
+    done = true;
+    timeout.stop ();
+    ev_break (EV_DEFAULT_ EVBREAK_ALL);
+  }
+  void next ()
+  {
+    if (sent.size () == count)
+      {
+        finish ();
+        return;
+      }
+    /* a GroupValue_Write; the counter tells the frames apart */
+    uint8_t f[] = { 0x11, 0xbc, 0x11, 0x05, 0x0a, 0x04, 0xe2, 0x00, 0x80,
+                    (uint8_t) (sent.size () >> 8), (uint8_t) sent.size () };
+    CArray c (f, sizeof (f));
+    sent.push_back (c);
+    wrap->send_Data (c);
+  }
+  void do_send_Next ()
+  {
+    next ();
+  }
+};
+
+/**
+ * Send @count frames. The driver must give up on @dropped of them; all
+ * but frame @missing must arrive. If @gone is set, the driver must fail
+ * instead of sending them all. With @stray, a stray octet precedes the
+ * ACK of transmission @stray; nothing may be repeated because of it.
+ */
+static void
+check (const char *name, unsigned count, unsigned lose_frame, unsigned lose_ack,
+       unsigned mute_at, unsigned mute_len, bool mute_ack,
+       unsigned dropped, int missing, bool gone = false, unsigned stray = 0)
+{
+  IniData ini;
+  IniSectionPtr &s = ini["ft12"];
+  /* the stray octet holds up the ACK until the partial frame times out */
+  s->add ("ack-timeout", stray ? "500" : "20");
+  s->add ("ack-retries", "3");
+
+  Upper up;
+  up.count = count;
+  Device *dev = new Device (&up, s);
+  dev->lose_frame = lose_frame;
+  dev->lose_ack = lose_ack;
+  dev->mute_at = mute_at;
+  dev->mute_len = mute_len;
+  dev->mute_ack = mute_ack;
+  dev->stray_at = stray;
+  FT12wrap *wrap = new FT12wrap (&up, s, dev);
+  up.wrap = wrap;
+
+  if (!wrap->setup ())
+    die ("%s: setup failed", name);
+  wrap->start ();
+  if (!up.done)
+    ev_run (EV_DEFAULT_ 0);
+
+  std::vector<CArray> want;
+  for (unsigned i = 0; i < up.sent.size (); i++)
+    if ((int) i != missing)
+      want.push_back (up.sent[i]);
+
+  unsigned long frames, retransmit, n_dropped;
+  std::string info = wrap->stats_info ();
+  if (sscanf (info.c_str (), "%lu frames, %lu retransmitted, %lu dropped",
+              &frames, &retransmit, &n_dropped) != 3)
+    die ("%s: can't parse '%s'", name, info.c_str ());
+
+  bool ok = true;
+  if (up.failed != gone)
+    {
+      printf ("%s: the driver %s\n", name, gone ? "didn't fail" : "failed");
+      ok = false;
+    }
+  if (dev->got != want)
+    {
+      printf ("%s: the device got %zu frames, not %zu\n", name,
+              dev->got.size (), want.size ());
+      ok = false;
+    }
+  if (frames != up.sent.size () - dropped || n_dropped != dropped ||
+      (!gone && retransmit + count + dev->n_reset != dev->n_rx) ||
+      (stray && retransmit))
+    {
+      printf ("%s: wrong counters: %s; %u transmissions\n", name, info.c_str (),
+              dev->n_rx);
+      ok = false;
+    }
+  if (!ok)
+    errors++;
+  printf ("%-28s %s\n", name, info.c_str ());
+
+  wrap->stop ();
+  delete wrap;
+}
+
+int
+main (int, char *[])
+{
+  loop = EV_DEFAULT;
+  IniData ini;
+  t = TracePtr (new Trace (ini["main"], "ft12check"));
+
+  check ("no loss", 50, 0, 0, 0, 0, false, 0, -1);
+  check ("every 3rd ACK lost", 50, 0, 3, 0, 0, false, 0, -1);
+  check ("every 4th frame lost", 50, 4, 0, 0, 0, false, 0, -1);
+  /* transmissions 11…14 are frame #10's, all lost: it's given up */
+  check ("one frame lost 4 times", 20, 0, 0, 11, 4, false, 1, 10);
+  /* as above, but only the ACKs are lost: it's there once */
+  check ("one frame's ACK lost 4 times", 20, 0, 0, 11, 4, true, 1, -1);
+  /* ... and the reset which follows: the device is gone */
+  check ("device gone", 20, 0, 0, 11, 100, false, 1, 10, true);
+  check ("stray octet before an ACK", 10, 0, 0, 0, 0, false, 0, -1, false, 5);
+
+  printf ("%u errors\n", errors);
+  return errors != 0;
+}
@@ -25,7 +25,10 @@
 class NCN5120wrap : public TPUARTwrap
 {
 public:
-  NCN5120wrap (LowLevelIface* parent, IniSectionPtr& s, LowLevelDriver* i = nullptr) : TPUARTwrap(parent,s,i) {}
+  NCN5120wrap (LowLevelIface* parent, IniSectionPtr& s, LowLevelDriver* i = nullptr) : TPUARTwrap(parent,s,i)
+  {
+    frame_end = true;
+  }
   virtual ~NCN5120wrap() = default;
 
 protected:
@@ -77,7 +80,7 @@ NCN5120wrap::create_serial(LowLevelIface* parent, IniSectionPtr& s)
 
 void NCN5120wrap::RecvLPDU (const uint8_t * data, int len)
 {
-  skip_char = true;
+  in.skip_next = true;
   TPUARTwrap::RecvLPDU (data, len);
 }
 
@@ -0,0 +1,601 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "tpsim.h"
+
+#include "cm_tp1.h"
+#include "tpdu.h"
+
+/* bus timing, in bit times */
+#define GAP_BITS 50
+#define OCTET_BITS 13
+#define ACK_WAIT_BITS 15
+#define BUSY_BITS 150
+
+/* frames a simulated device can buffer */
+#define DEVICE_QUEUE 8
+
+TPSimDriver::TPSimDriver (const LinkConnectPtr_& c, IniSectionPtr& s) : BusDriver(c,s)
+{
+  t->setAuxName("tpsim");
+  timer.set<TPSimDriver, &TPSimDriver::timer_cb>(this);
+  resume.set<TPSimDriver, &TPSimDriver::resume_cb>(this);
+}
+
+TPSimDriver::~TPSimDriver ()
+{
+  timer.stop();
+  resume.stop();
+}
+
+bool
+TPSimDriver::setup()
+{
+  if (!BusDriver::setup())
+    return false;
+
+  speed = cfg->value("speed",1.0);
+  if (speed <= 0)
+    {
+      ERRORPRINTF (t, E_ERROR | 172, "speed must be >0");
+      return false;
+    }
+
+  int rep = cfg->value("max-repeat",3);
+  if (rep < 0 || rep > 7)
+    {
+      ERRORPRINTF (t, E_ERROR | 173, "max-repeat must be between 0 and 7");
+      return false;
+    }
+  max_repeat = rep;
+
+  int n = cfg->value("devices",0);
+  int g = cfg->value("groups",1);
+  int p = cfg->value("payload",1);
+  if (n < 0 || g < 1 || p < 1 || p > 64)
+    {
+      ERRORPRINTF (t, E_ERROR | 174, "devices must be >=0, groups >0 and payload between 1 and 64");
+      return false;
+    }
+  n_devices = n;
+  groups_per_device = g;
+  payload = p;
+
+  std::string da = cfg->value("device-address","1.1.1");
+  int x, y, z;
+  if (sscanf (da.c_str(), "%d.%d.%d", &x, &y, &z) != 3)
+    {
+      ERRORPRINTF (t, E_ERROR | 175, "'%s' is not a device address. Use X.Y.Z format.", da);
+      return false;
+    }
+  dev_addr = ((x & 0x0f) << 12) | ((y & 0x0f) << 8) | (z & 0xff);
+  std::string ga = cfg->value("group-address","1/0/1");
+  if (sscanf (ga.c_str(), "%d/%d/%d", &x, &y, &z) != 3)
+    {
+      ERRORPRINTF (t, E_ERROR | 176, "'%s' is not a group address. Use X/Y/Z format.", ga);
+      return false;
+    }
+  group_addr = ((x & 0x1f) << 11) | ((y & 0x07) << 8) | (z & 0xff);
+  if (dev_addr + n_devices > 0x10000
+      || group_addr + n_devices * groups_per_device > 0x10000)
+    {
+      ERRORPRINTF (t, E_ERROR | 177, "Too many devices for the address range");
+      return false;
+    }
+
+  interval = cfg->value("interval",0.0);
+  response_delay = cfg->value("response-delay",10)/1000.;
+  nack_rate = cfg->value("nack-rate",0.0)/100.;
+  busy_rate = cfg->value("busy-rate",0.0)/100.;
+  if (interval < 0 || response_delay < 0 || nack_rate < 0 || busy_rate < 0
+      || nack_rate + busy_rate > 1)
+    {
+      ERRORPRINTF (t, E_ERROR | 178, "interval, response-delay, nack-rate and busy-rate must be >=0, the rates at most 100 together");
+      return false;
+    }
+  seed = cfg->value("seed",1);
+  return true;
+}
+
+void
+TPSimDriver::start()
+{
+  /* the simulated time goes on where it stopped */
+  wall0 = ev_now(EV_DEFAULT) - sim_now / speed;
+  frozen = false;
+  /* xorshift starts slowly from small numbers; spread the bits */
+  rnd_state = (seed ? seed : 1) * 0x9e3779b9u;
+
+  devices.clear();
+  values.clear();
+  for (unsigned i = 0; i < n_devices; i++)
+    {
+      devices.emplace_back();
+      Device &d = devices.back();
+      d.addr = dev_addr + i;
+      d.group = group_addr + i * groups_per_device;
+      d.n_groups = groups_per_device;
+      for (unsigned j = 0; j < groups_per_device; j++)
+        {
+          values.push_back(CArray());
+          values.back().resize(payload);
+        }
+      /* spread the first periodic write over the interval */
+      if (interval > 0)
+        schedule(sim_now + interval * rnd(), E_WRITE, i);
+    }
+
+  state = B_IDLE;
+  idle_since = sim_now;
+  started_at = sim_now;
+  BusDriver::start();
+  run();
+}
+
+void
+TPSimDriver::stop()
+{
+  TRACEPRINTF (t, 1, "Close: %s", stats_info());
+  timer.stop();
+  resume.stop();
+  frozen = false;
+  while (!events.empty())
+    events.pop();
+  out.clear();
+  devices.clear();
+  state = B_IDLE;
+  BusDriver::stop();
+}
+
+std::string
+TPSimDriver::info(int verbose)
+{
+  return BusDriver::info(verbose) + " " + stats_info();
+}
+
+std::string
+TPSimDriver::stats_info()
+{
+  char buf[400];
+  ev_tstamp run = sim_time() - started_at;
+  snprintf (buf, sizeof (buf),
+            "%lu sent, %lu received, %lu from devices, %lu repeats, "
+            "%lu NACK, %lu BUSY, %lu no ACK, %lu dropped, %lu lost arbitration, "
+            "%lu overruns, bus load %.1f%%, latency avg %.1f ms max %.1f ms",
+            n_sent, n_recv, n_dev_sent, n_repeat, n_nack, n_busy, n_noack,
+            n_dropped, n_lost_arb, n_overrun,
+            run > 0 ? busy_time * 100 / run : 0.,
+            n_sent ? lat_sum * 1000 / n_sent : 0., lat_max * 1000);
+  return buf;
+}
+
+float
+TPSimDriver::rnd()
+{
+  /* xorshift32 */
+  rnd_state ^= rnd_state << 13;
+  rnd_state ^= rnd_state >> 17;
+  rnd_state ^= rnd_state << 5;
+  return (rnd_state >> 8) / 16777216.f;
+}
+
+void
+TPSimDriver::send_L_Data (LDataPtr l)
+{
+  /* too long for a TP1 frame */
+  if (l->lsdu.size() > 0xff)
+    {
+      n_dropped++;
+      send_Next();
+      return;
+    }
+  sim_now = sim_time();
+  Frame f;
+  f.l = std::move(l);
+  f.queued = sim_now;
+  out.push_back(std::move(f));
+  kick();
+  rearm();
+}
+
+ev_tstamp
+TPSimDriver::sim_time()
+{
+  if (frozen)
+    return sim_now;
+  ev_tstamp now = (ev_now(EV_DEFAULT) - wall0) * speed;
+  if (!events.empty() && events.top().at < now)
+    now = events.top().at;
+  return now > sim_now ? now : sim_now;
+}
+
+void
+TPSimDriver::schedule (ev_tstamp at, EventKind kind, unsigned dev, eibaddr_t group)
+{
+  events.push(Event{at, n_events++, kind, dev, group});
+}
+
+void
+TPSimDriver::rearm()
+{
+  if (frozen)
+    return;
+  timer.stop();
+  if (events.empty())
+    return;
+  ev_tstamp wait = wall0 + events.top().at / speed - ev_now(EV_DEFAULT);
+  timer.start(wait > 0 ? wait : 0, 0);
+}
+
+void
+TPSimDriver::run()
+{
+  timer.stop();
+  frozen = true;
+  while (!events.empty())
+    {
+      if (wall0 + events.top().at / speed > ev_now(EV_DEFAULT))
+        break;
+      Event e = events.top();
+      events.pop();
+      sim_now = e.at;
+      handle(e);
+      if (resume.is_active())
+        return;
+    }
+  frozen = false;
+  rearm();
+}
+
+/* Idle watchers only run when nothing else is pending, so whatever knxd
+ * does in response is done when we go on. */
+void
+TPSimDriver::yield()
+{
+  resume.start();
+}
+
+void
+TPSimDriver::resume_cb (ev::idle &, int)
+{
+  resume.stop();
+  run();
+}
+
+void
+TPSimDriver::timer_cb (ev::timer &, int)
+{
+  run();
+}
+
+void
+TPSimDriver::handle (const Event &e)
+{
+  switch (e.kind)
+    {
+    case E_BUS:
+      switch (state)
+        {
+        case B_GAP:
+          arbitrate();
+          break;
+        case B_FRAME:
+          frame_done();
+          break;
+        case B_ACK:
+          ack_done();
+          break;
+        default:
+          break;
+        }
+      break;
+    case E_RESPONSE:
+      device_send(e.dev, e.group, true);
+      break;
+    case E_WRITE:
+    {
+      Device &d = devices[e.dev];
+      eibaddr_t g = d.group + d.next_group;
+      d.next_group = (d.next_group + 1) % d.n_groups;
+      device_send(e.dev, g, false);
+      schedule(e.at + interval, E_WRITE, e.dev);
+      break;
+    }
+    }
+}
+
+TPSimDriver::Frame &
+TPSimDriver::current()
+{
+  return sender < 0 ? out.front() : devices[sender].out.front();
+}
+
+void
+TPSimDriver::kick()
+{
+  if (state != B_IDLE)
+    return;
+
+  bool any = false;
+  ev_tstamp first = 0;
+  auto consider = [&](const std::deque<Frame> &q)
+  {
+    if (q.empty())
+      return;
+    if (!any || q.front().not_before < first)
+      first = q.front().not_before;
+    any = true;
+  };
+  consider(out);
+  for (auto &d : devices)
+    consider(d.out);
+  if (!any)
+    return;
+
+  ev_tstamp at = idle_since + GAP_BITS * bit;
+  if (first > at)
+    at = first;
+  if (sim_now > at)
+    at = sim_now;
+  state = B_GAP;
+  schedule(at, E_BUS);
+}
+
+/* Compare two TP1 frames, as sent at the same time. Octets go out LSB
+ * first, and a zero bit overrides a one: the first frame to send a
+ * zero where the other sends a one wins. */
+static bool
+wins (const uint8_t *a, size_t alen, const uint8_t *b, size_t blen)
+{
+  size_t n = alen < blen ? alen : blen;
+  for (size_t i = 0; i < n; i++)
+    {
+      uint8_t x = a[i] ^ b[i];
+      if (x)
+        return !(a[i] & x & -x);
+    }
+  return alen <= blen;
+}
+
+void
+TPSimDriver::arbitrate()
+{
+  ev_tstamp now = sim_now;
+  uint8_t best[CM_TP1_MAX_FRAME], cur[CM_TP1_MAX_FRAME];
+  size_t best_len = 0;
+  unsigned candidates = 0;
+
+  auto compete = [&](std::deque<Frame> &q, int who)
+  {
+    if (q.empty() || q.front().not_before > now + bit)
+      return;
+    Frame &f = q.front();
+    f.l->repeated = f.tries > 0;
+    size_t len = L_Data_to_CM_TP1 (*f.l, cur, sizeof (cur));
+    if (!len)
+      return;
+    candidates++;
+    if (candidates == 1 || wins (cur, len, best, best_len))
+      {
+        memcpy (best, cur, len);
+        best_len = len;
+        sender = who;
+      }
+  };
+  compete(out, -1);
+  for (unsigned i = 0; i < devices.size(); i++)
+    compete(devices[i].out, i);
+
+  if (!candidates)
+    {
+      /* somebody waits after BUSY */
+      state = B_IDLE;
+      kick();
+      return;
+    }
+  n_lost_arb += candidates - 1;
+
+  ev_tstamp len = best_len * OCTET_BITS * bit;
+  busy_time += len;
+  state = B_FRAME;
+  schedule(sim_now + len, E_BUS);
+}
+
+void
+TPSimDriver::frame_done()
+{
+  Frame &f = current();
+  const L_Data_PDU &l = *f.l;
+
+  /* Receivers ignore repeats of a frame they already got. */
+  bool to_knxd = (f.tries == 0 && sender >= 0);
+  if (f.tries == 0)
+    {
+      if (to_knxd)
+        {
+          n_recv++;
+          recv_L_Data (LDataPtr(new L_Data_PDU (l)));
+        }
+      receive (l, sender);
+    }
+
+  /* knxd acknowledges every frame from the bus, like a TP-UART in
+   * router mode does. */
+  if (sender >= 0 || listener (l))
+    {
+      float r = rnd();
+      if (r < nack_rate)
+        answer = A_NACK;
+      else if (r < nack_rate + busy_rate)
+        answer = A_BUSY;
+      else
+        answer = A_ACK;
+      busy_time += OCTET_BITS * bit;
+    }
+  else
+    answer = A_NONE;
+
+  state = B_ACK;
+  schedule(sim_now + (ACK_WAIT_BITS + OCTET_BITS) * bit, E_BUS);
+  if (to_knxd)
+    yield();
+}
+
+void
+TPSimDriver::ack_done()
+{
+  ev_tstamp now = sim_now;
+  Frame &f = current();
+  idle_since = now;
+  state = B_IDLE;
+
+  if (answer != A_ACK)
+    {
+      switch (answer)
+        {
+        case A_NACK:
+          n_nack++;
+          break;
+        case A_BUSY:
+          n_busy++;
+          f.not_before = now + BUSY_BITS * bit;
+          break;
+        default:
+          n_noack++;
+          break;
+        }
+      if (f.tries < max_repeat)
+        {
+          f.tries++;
+          n_repeat++;
+          kick();
+          return;
+        }
+      n_dropped++;
+      TRACEPRINTF (t, 2, "No ACK for %s, dropped", f.l->Decode (t));
+    }
+
+  if (sender < 0)
+    {
+      if (answer == A_ACK)
+        {
+          ev_tstamp lat = now - f.queued;
+          n_sent++;
+          lat_sum += lat;
+          if (lat > lat_max)
+            lat_max = lat;
+        }
+      out.pop_front();
+      send_Next();
+      kick();
+      yield();
+      return;
+    }
+  else
+    {
+      if (answer == A_ACK)
+        n_dev_sent++;
+      devices[sender].out.pop_front();
+    }
+  kick();
+}
+
+bool
+TPSimDriver::listener (const L_Data_PDU &l)
+{
+  if (!n_devices)
+    return true;
+  if (l.address_type == GroupAddress)
+    return l.destination_address == 0
+           || (l.destination_address >= group_addr
+               && l.destination_address - group_addr < n_devices * groups_per_device);
+  return l.destination_address >= dev_addr
+         && l.destination_address - dev_addr < n_devices;
+}
+
+void
+TPSimDriver::receive (const L_Data_PDU &l, int from)
+{
+  if (l.address_type != GroupAddress || l.lsdu.size() < 2 || (l.lsdu[0] & 0xfc))
+    return;
+  unsigned idx = l.destination_address - group_addr;
+  if (l.destination_address < group_addr || idx >= values.size())
+    return;
+
+  APDUBuf buf;
+  APDU *a = APDU::decode (l.lsdu, buf, t);
+  switch (a->getType())
+    {
+    case A_GroupValue_Read:
+    {
+      unsigned owner = idx / groups_per_device;
+      if ((int)owner != from)
+        schedule(sim_now + response_delay, E_RESPONSE, owner,
+                 l.destination_address);
+      break;
+    }
+    case A_GroupValue_Write:
+      values[idx] = static_cast<A_GroupValue_Write_PDU *>(a)->data;
+      break;
+    case A_GroupValue_Response:
+      values[idx] = static_cast<A_GroupValue_Response_PDU *>(a)->data;
+      break;
+    default:
+      break;
+    }
+}
+
+void
+TPSimDriver::device_send (unsigned d, eibaddr_t group, bool response)
+{
+  Device &dev = devices[d];
+  if (dev.out.size() >= DEVICE_QUEUE)
+    {
+      n_overrun++;
+      return;
+    }
+
+  CArray &value = values[group - group_addr];
+  LDataPtr l = LDataPtr(new L_Data_PDU ());
+  l->source_address = dev.addr;
+  l->destination_address = group;
+  l->address_type = GroupAddress;
+  T_Data_Group_PDU tpdu;
+  if (response)
+    {
+      A_GroupValue_Response_PDU a;
+      a.data = value;
+      tpdu.ToPacket (a, l->lsdu);
+    }
+  else
+    {
+      /* a sensor whose value changes every time */
+      if (!value.empty())
+        value[0]++;
+      A_GroupValue_Write_PDU a;
+      a.data = value;
+      tpdu.ToPacket (a, l->lsdu);
+    }
+
+  Frame f;
+  f.l = std::move(l);
+  f.queued = sim_now;
+  dev.out.push_back(std::move(f));
+  kick();
+}
@@ -0,0 +1,230 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+
+This module simulates a TP1 bus segment, so that routing, pacing and
+queueing can be exercised and measured without hardware.
+
+The bus runs at 9600 bit/s. A frame is sent after the bus was idle for 50
+bit times; every octet takes 13 bit times. The receivers answer with an
+ACK, NACK or BUSY octet 15 bit times after the frame, or not at all. A
+frame which isn't ACKed is repeated, with the repeat flag cleared, up to
+"max-repeat" times.
+
+knxd's frames compete for the bus with those of a population of simulated
+devices. When several senders start at the same time, the frame with the
+first dominant (zero) bit wins, like on the real bus: the priority
+decides first, then a repeated frame wins, then the addresses decide.
+The others try again when the bus is free.
+
+Each simulated device owns a range of group addresses. It answers
+GroupValue_Read requests for them, stores the values written to them and
+optionally sends a GroupValue_Write every "interval" seconds.
+
+The simulation runs on a clock of its own and processes its events
+strictly in time order. The real clock only paces it, "speed" times as
+fast. When the simulation hands a frame to knxd, or lets knxd send its
+next one, it waits until knxd has nothing else to do, so that knxd's
+immediate reaction happens at the same simulated time. A frame which
+knxd sends on its own is stamped with the simulated time that matches
+the real one, but never later than the next pending event.
+
+Random decisions (starting phases, injected NACK and BUSY answers) come
+from a seeded generator. A run is thus repeated exactly, no matter the
+speed or the load of the machine, as long as knxd doesn't send frames on
+its own, e.g. for clients.
+*/
+
+#ifndef TPSIM_H
+#define TPSIM_H
+
+#include <deque>
+#include <functional>
+#include <queue>
+#include "link.h"
+
+/** simulated TP1 bus with simulated devices on it */
+DRIVER(TPSimDriver,tpsim)
+{
+  /** a frame which waits for the bus */
+  /* times are simulated, in seconds */
+  struct Frame
+  {
+    LDataPtr l;
+    /** when it was handed to us */
+    ev_tstamp queued = 0;
+    /** don't send before this, e.g. after BUSY */
+    ev_tstamp not_before = 0;
+    unsigned tries = 0;
+  };
+
+  struct Device
+  {
+    eibaddr_t addr;
+    /** first group address, and how many */
+    eibaddr_t group;
+    unsigned n_groups;
+    /** the group the next periodic write goes to */
+    unsigned next_group = 0;
+    std::deque<Frame> out;
+  };
+
+  enum EventKind
+  {
+    E_BUS,      // the bus changes state
+    E_WRITE,    // a device's periodic write
+    E_RESPONSE, // a device answers a read
+  };
+  /** something which happens later */
+  struct Event
+  {
+    ev_tstamp at;
+    /** events at the same time happen in the order they were scheduled */
+    unsigned long seq;
+    EventKind kind;
+    unsigned dev;
+    eibaddr_t group;
+    bool operator> (const Event &e) const
+    {
+      return at > e.at || (at == e.at && seq > e.seq);
+    }
+  };
+
+  enum BusState
+  {
+    B_IDLE,   // nothing to send
+    B_GAP,    // waiting for the bus to be free
+    B_FRAME,  // a frame is being sent
+    B_ACK,    // waiting for its acknowledgement
+  };
+  enum Answer
+  {
+    A_NONE, A_ACK, A_NACK, A_BUSY,
+  };
+
+  /* configuration */
+  float speed;
+  unsigned max_repeat;
+  unsigned n_devices;
+  eibaddr_t dev_addr;
+  eibaddr_t group_addr;
+  unsigned groups_per_device;
+  float interval;
+  float response_delay;
+  unsigned payload;
+  float nack_rate;
+  float busy_rate;
+  uint32_t seed;
+
+  /** duration of one bit */
+  ev_tstamp bit = 1 / 9600.;
+
+  std::deque<Device> devices;
+  /** current value of each group address a device owns */
+  std::vector<CArray> values;
+  /** the frame knxd wants to send */
+  std::deque<Frame> out;
+
+  BusState state = B_IDLE;
+  /** the sender of the frame on the bus: a device, or -1 for knxd */
+  int sender;
+  Answer answer;
+  /** when the bus went idle */
+  ev_tstamp idle_since = 0;
+
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event> > events;
+  unsigned long n_events = 0;
+  /** the simulated time */
+  ev_tstamp sim_now = 0;
+  /** the real time which corresponds to simulated time 0 */
+  ev_tstamp wall0 = 0;
+  /** the simulated time doesn't follow the real one: we're processing
+   * events, or waiting for knxd to react to one */
+  bool frozen = false;
+  /** wakes us when the next event is due */
+  ev::timer timer;
+  void timer_cb (ev::timer &w, int revents);
+  /** continues after yield() */
+  ev::idle resume;
+  void resume_cb (ev::idle &w, int revents);
+
+  /** process the events which are due */
+  void run ();
+  /** let knxd react before going on */
+  void yield ();
+  /** start the timer for the next event */
+  void rearm ();
+  void handle (const Event &e);
+  void schedule (ev_tstamp at, EventKind kind, unsigned dev = 0, eibaddr_t group = 0);
+  /** the simulated time, as far as knxd is concerned */
+  ev_tstamp sim_time ();
+
+  uint32_t rnd_state;
+  /** uniformly distributed in [0,1) */
+  float rnd ();
+
+  /** bus is idle: wait for the gap, if anybody wants to send */
+  void kick ();
+  /** bus is free: pick the frame that wins the arbitration and send it */
+  void arbitrate ();
+  /** the frame has been sent: show it to everybody, decide the answer */
+  void frame_done ();
+  /** the answer has been sent: done, or repeat */
+  void ack_done ();
+  /** does a device listen to this frame? */
+  bool listener (const L_Data_PDU &l);
+  /** let the devices react to a frame */
+  void receive (const L_Data_PDU &l, int from);
+  /** device @d sends a GroupValue_Write or _Response */
+  void device_send (unsigned d, eibaddr_t group, bool response);
+  Frame &current ();
+
+  unsigned long n_sent = 0;
+  unsigned long n_recv = 0;
+  unsigned long n_dev_sent = 0;
+  unsigned long n_repeat = 0;
+  unsigned long n_dropped = 0;
+  unsigned long n_lost_arb = 0;
+  unsigned long n_nack = 0;
+  unsigned long n_busy = 0;
+  unsigned long n_noack = 0;
+  unsigned long n_overrun = 0;
+  /** time the bus was busy */
+  ev_tstamp busy_time = 0;
+  ev_tstamp started_at = 0;
+  /** from send_L_Data to the ACK of knxd's frames */
+  ev_tstamp lat_sum = 0;
+  ev_tstamp lat_max = 0;
+
+  std::string stats_info ();
+
+public:
+  TPSimDriver (const LinkConnectPtr_& c, IniSectionPtr& s);
+  virtual ~TPSimDriver ();
+
+  bool setup();
+  void start();
+  void stop();
+  void send_L_Data (LDataPtr l);
+
+  virtual std::string info(int verbose = 0);
+};
+
+#endif
@@ -0,0 +1,198 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Check of the tpsim driver.
+ *
+ * A busy simulated bus, with NACKs and BUSYs, is run at several speeds.
+ * In its place, knxd answers every fifth frame from the bus with a
+ * GroupValue_Read, and stops after a number of frames. The frames knxd
+ * got, in order, and the driver's statistics must be the same every
+ * time; the reads must have been sent and answered.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include "inifile.h"
+#include "tpsim.h"
+#include "tpdu.h"
+
+/** aborts program with a printf like message */
+void
+die (const char *msg, ...)
+{
+  va_list ap;
+  va_start (ap, msg);
+  vprintf (msg, ap);
+  printf ("\n");
+  va_end (ap);
+
+  exit (1);
+}
+
+LOOP_RESULT loop;
+
+static unsigned errors = 0;
+
+class CheckRouter : public BaseRouter
+{
+public:
+  CheckRouter (IniData &i) : BaseRouter (i)
+  {
+    t = TracePtr (new Trace (i["main"], "tpsimcheck"));
+  }
+};
+
+/** knxd, as far as the driver is concerned */
+class Upper : public LinkConnect_
+{
+public:
+  /** what knxd saw, in order */
+  std::string log;
+  unsigned stop_after = 0;
+  unsigned n_recv = 0;
+  unsigned n_reads = 0;
+  unsigned n_answers = 0;
+  eibaddr_t groups = 0;
+  bool failed = false;
+
+  Upper (BaseRouter &r, IniSectionPtr &s, TracePtr tr) : LinkConnect_ (r, s, tr) {}
+
+  void recv_L_Data (LDataPtr l)
+  {
+    log += l->Decode (t);
+    log += "\n";
+    if (l->lsdu.size () >= 2 && (l->lsdu[1] & 0xC0) == 0x40)
+      n_answers++;
+    if (++n_recv == stop_after)
+      {
+        ev_break (EV_DEFAULT_ EVBREAK_ALL);
+        return;
+      }
+    if (n_recv % 5 == 0)
+      {
+        pending++;
+        send_read ();
+      }
+  }
+  void send_Next ()
+  {
+    log += "next\n";
+    busy = false;
+    send_read ();
+  }
+  void recv_L_Busmonitor (LBusmonPtr) {}
+  void started () {}
+  void stopped () {}
+  void errored ()
+  {
+    failed = true;
+  }
+  bool checkSysAddress (eibaddr_t)
+  {
+    return false;
+  }
+  bool checkSysGroupAddress (eibaddr_t)
+  {
+    return false;
+  }
+
+private:
+  unsigned pending = 0;
+  bool busy = false;
+  void send_read ()
+  {
+    if (busy || !pending)
+      return;
+    pending--;
+    busy = true;
+    LDataPtr l = LDataPtr (new L_Data_PDU ());
+    l->source_address = 0x1001;
+    l->destination_address = 0x0801 + n_reads++ % groups;
+    l->address_type = GroupAddress;
+    A_GroupValue_Read_PDU a;
+    T_Data_Group_PDU tpdu;
+    tpdu.ToPacket (a, l->lsdu);
+    LinkConnect_::send_L_Data (std::move (l));
+  }
+};
+
+/** run the simulation at @speed; @return what knxd saw, and the statistics */
+static std::string
+run (const char *speed, unsigned frames)
+{
+  IniData ini;
+  IniSectionPtr &s = ini["sim"];
+  s->add ("driver", "tpsim");
+  s->add ("devices", "20");
+  s->add ("groups", "2");
+  s->add ("group-address", "1/0/1");
+  s->add ("interval", "0.5");
+  s->add ("payload", "2");
+  s->add ("nack-rate", "2.5");
+  s->add ("busy-rate", "2.5");
+  s->add ("speed", speed);
+
+  CheckRouter r (ini);
+  auto up = std::make_shared<Upper> (r, s, r.t);
+  up->stop_after = frames;
+  up->groups = 40;
+  auto drv = std::make_shared<TPSimDriver> (up, s);
+  up->set_driver (drv);
+  if (!drv->setup ())
+    die ("setup failed");
+
+  drv->start ();
+  ev_run (EV_DEFAULT_ 0);
+  std::string res = up->log + drv->info ();
+  drv->stop ();
+
+  if (up->failed)
+    {
+      printf ("speed %s: the driver failed\n", speed);
+      errors++;
+    }
+  if (up->n_recv != frames || !up->n_reads || up->n_answers < up->n_reads * 3 / 4)
+    {
+      printf ("speed %s: %u frames, %u reads, %u answers\n", speed,
+              up->n_recv, up->n_reads, up->n_answers);
+      errors++;
+    }
+  return res;
+}
+
+int
+main (int, char *[])
+{
+  loop = EV_DEFAULT;
+
+  std::string ref = run ("25", 500);
+  printf ("%s\n", ref.substr (ref.rfind ('\n') + 1).c_str ());
+  const char *speeds[] = { "10", "100" };
+  for (auto sp : speeds)
+    if (run (sp, 500) != ref)
+      {
+        printf ("speed %s: different result\n", sp);
+        errors++;
+      }
+
+  printf ("%u errors\n", errors);
+  return errors != 0;
+}
@@ -106,7 +106,9 @@ static const char* SN(enum TSTATE s)
 bool
 TPUART::setup()
 {
-  iface = create_wrapper(this, cfg);
+  wrap = static_cast<TPUARTwrap *>(create_wrapper(this, cfg));
+  iface = wrap;
+  wrap->set_ackmap_src(this);
 
   if (t->ShowPrint(0))
     iface = new LLlog (this,cfg, iface);
@@ -117,12 +119,41 @@ TPUART::setup()
   return true;
 }
 
+std::string
+TPUART::info(int verbose)
+{
+  std::string res = LowLevelAdapter::info(verbose);
+  if (wrap)
+    res += " " + wrap->ack_info();
+  return res;
+}
+
 bool
 TPUARTwrap::setup()
 {
   ackallgroup = cfg->value("ack-group",false);
   ackallindividual = cfg->value("ack-individual",false);
   monitor = cfg->value("monitor",false);
+  bool ack_thread = cfg->value("ack-thread",false);
+  int priority = cfg->value("ack-thread-priority",50);
+
+  if (ack_thread)
+    {
+#ifndef HAVE_PTHREAD
+      ERRORPRINTF (t, E_ERROR | 155, "ack-thread: knxd was built without thread support");
+      return false;
+#endif
+      if (cfg->value("device","").length() == 0)
+        {
+          ERRORPRINTF (t, E_ERROR | 156, "ack-thread requires a serial device");
+          return false;
+        }
+      if (priority < 0 || priority > 99)
+        {
+          ERRORPRINTF (t, E_ERROR | 157, "ack-thread-priority must be between 0 and 99");
+          return false;
+        }
+    }
 
   if (cfg->value("device","").length() > 0)
     {
@@ -132,7 +163,18 @@ TPUARTwrap::setup()
           ERRORPRINTF (t, E_ERROR | 25, "Don't specify both device and IP options!");
           return false;
         }
-      iface = create_serial(this, cfg);
+      FDdriver *ser = create_serial(this, cfg);
+      if (ack_thread)
+        {
+          thread = new TPUARTthread(t);
+          thread->priority = priority;
+          thread->frame_end = frame_end;
+          thread->ackallgroup = ackallgroup;
+          thread->ackallindividual = ackallindividual;
+          thread->on_recv.set<TPUARTwrap,&TPUARTwrap::recv_thread>(this);
+          ser->thread = thread;
+        }
+      iface = ser;
     }
   else
     {
@@ -163,17 +205,35 @@ TPUARTwrap::setup()
 
 TPUARTwrap::~TPUARTwrap ()
 {
-  TRACEPRINTF (t, 2, "Close");
+  TRACEPRINTF (t, 2, "Close: %s", ack_info());
 
   timer.stop();
   sendtimer.stop();
+  ackmap_timer.stop();
+  /* the thread must be gone before the serial driver is */
+  delete iface;
+  iface = nullptr;
+  delete thread;
+}
+
+std::string
+TPUARTwrap::ack_info()
+{
+  if (!thread)
+    return latency.info();
+
+  char buf[100];
+  snprintf (buf, sizeof (buf), ", ACK map fixed %lu times, %lu events lost",
+            ackmap_stale, __atomic_load_n (&thread->lost, __ATOMIC_RELAXED));
+  return thread->latency.info() + buf;
 }
 
 void
 TPUARTwrap::send_L_Data (LDataPtr l)
 {
   assert(out.size() == 0);
-  out = L_Data_to_CM_TP1 (l);
+  out.resize (L_Data_CM_TP1_size (*l));
+  L_Data_to_CM_TP1 (*l, out.data(), out.size());
 
   send_again();
 }
@@ -194,6 +254,8 @@ void
 TPUARTwrap::do__send_Next()
 {
   out.clear();
+  if (thread)
+    thread->set_echo(out);
   send_retry = 0;
   sendtimer.stop();
   LowLevelFilter::do_send_Next();
@@ -222,6 +284,8 @@ TPUARTwrap::send_again()
         }
       z = (z - 1) * 2;
       w[z] = (w[z] & 0x3f) | 0x40;
+      if (thread)
+        thread->set_echo(out);
       LowLevelFilter::send_Data(w);
       sendtimer.start(2,0);
 
@@ -237,6 +301,13 @@ TPUARTwrap::send_again()
 void
 TPUARTwrap::started()
 {
+  in.reset();
+  if (thread)
+    {
+      ackmap_pos = 0;
+      ackmap_filling = true;
+      ackmap_timer.start(0, 0);
+    }
   setstate(T_new);
   setstate(T_start);
 }
@@ -244,6 +315,7 @@ TPUARTwrap::started()
 void
 TPUARTwrap::stopped()
 {
+  ackmap_timer.stop();
   setstate(T_new);
 
   LowLevelFilter::stopped();
@@ -261,16 +333,13 @@ TPUARTwrap::RecvLPDU (const uint8_t * data, int len)
     }
   else if (state > T_start)
     {
-      LPDUPtr l = CM_TP1_to_L_Data (CArray (data, len), t);
-      if (l->getType () != L_Data)
-        TRACEPRINTF (t, 1, "dropping packet: type %d", l->getType ());
+      LDataPtr l = LDataPtr(new L_Data_PDU ());
+      if (!CM_TP1_to_L_Data (data, len, *l))
+        TRACEPRINTF (t, 1, "dropping packet: unparseable");
+      else if (l->valid_checksum)
+        recv_L_Data (std::move(l));
       else
-        {
-          if (((L_Data_PDU *)(&*l))->valid_checksum)
-            recv_L_Data (dynamic_unique_cast<L_Data_PDU>(std::move(l)));
-          else
-            TRACEPRINTF (t, 1, "dropping packet: invalid");
-        }
+        TRACEPRINTF (t, 1, "dropping packet: invalid");
     }
 }
 
@@ -278,6 +347,7 @@ TPUARTwrap::TPUARTwrap(LowLevelIface* parent, IniSectionPtr& s, LowLevelDriver*
 {
   timer.set <TPUARTwrap,&TPUARTwrap::timer_cb> (this);
   sendtimer.set <TPUARTwrap,&TPUARTwrap::sendtimer_cb> (this);
+  ackmap_timer.set <TPUARTwrap,&TPUARTwrap::ackmap_timer_cb> (this);
 }
 
 void
@@ -335,8 +405,12 @@ TPUARTwrap::timer_cb(ev::timer &, int)
       setstate(T_wait_keepalive);
       break;
     case T_wait_more:
-      t->TracePacket (8, "Incomplete packet", in);
-      in.clear();
+      /* the thread drops incomplete frames itself */
+      if (!thread)
+        {
+          t->TracePacket (8, "Incomplete packet", in.size(), in.data());
+          in.reset();
+        }
       setstate(T_wait);
       break;
     case T_wait_keepalive:
@@ -354,172 +428,255 @@ TPUARTwrap::timer_cb(ev::timer &, int)
 }
 
 void
-TPUARTwrap::in_check()
+TPUARTwrap::recv_header(const uint8_t *in, bool ext)
 {
-  bool ext = !(in[0] & 0x80);
+  if (acked || recvecho || my_addr != 0 || state < T_is_online || state >= T_busmonitor)
+    return;
 
-  if (in.size () >= 6u+ext)
+  if (out.size() >= 6u+ext && !((in[0]^out[0])&~0x20) && !memcmp(in+1,out.data()+1,5+ext))
+    recvecho = true;
+  else
     {
-
-      if (!acked && !recvecho && my_addr == 0 && state >= T_is_online && state < T_busmonitor)
+      uint8_t c = 0x10;
+      if ((in[ext ? 1 : 5] & 0x80) == 0)
         {
-          if (out.size() >= 6u+ext && !((in[0]^out[0])&~0x20) && !memcmp(in.data()+1,out.data()+1,5+ext))
-            recvecho = true;
-          else
-            {
-              uint8_t c = 0x10;
-              if ((in[ext ? 1 : 5] & 0x80) == 0)
-                {
-                  if (ackallindividual || checkSysAddress ((in[3+ext] << 8) | in[4+ext]))
-                    c |= 0x1;
-                }
-              else
-                {
-                  if (ackallgroup || checkSysGroupAddress ((in[3+ext] << 8) | in[4+ext]))
-                    c |= 0x1;
-                }
-              TRACEPRINTF (t, 0, "SendAck %02X", c);
-              LowLevelIface::send_Data(c);
-              acked = true;
-            }
+          if (ackallindividual || checkSysAddress ((in[3+ext] << 8) | in[4+ext]))
+            c |= 0x1;
+        }
+      else
+        {
+          if (ackallgroup || checkSysGroupAddress ((in[3+ext] << 8) | in[4+ext]))
+            c |= 0x1;
         }
+      TRACEPRINTF (t, 0, "SendAck %02X", c);
+      LowLevelIface::send_Data(c);
+      acked = true;
+      if (RxTime::current)
+        {
+          uint64_t dt = rx_clock() - RxTime::current;
+          latency.sample(dt, dt > AckLatency::deadline(in, ext));
+        }
+    }
+}
+
+void
+TPUARTwrap::recv_Data(CArray &c)
+{
+  bool online = state > T_is_online && state < T_busmonitor;
+
+  if (state < T_start)
+    {
+      t->TracePacket (0, "ReadDrop", c);
+      return; // discard
+    }
 
-      unsigned len = ext ? in[6] : (in[5] & 0x0f);
-      len += 6 + ext + 2;
+  in.feed (c.data(), c.size());
+  while (true)
+    switch (in.next ())
+      {
+      case TPUARTparser::NEED_MORE:
+        if (online && in.busy())
+          setstate(T_wait_more);
+        return;
+      case TPUARTparser::CONTROL:
+        recv_control (in.control);
+        online = state > T_is_online && state < T_busmonitor;
+        break;
+      case TPUARTparser::HEADER:
+        recv_header (in.data(), in.extended());
+        break;
+      case TPUARTparser::FRAME:
+        if (!recvecho)
+          RecvLPDU (in.data(), in.size());
+        if (online)
+          setstate(T_wait);
+        break;
+      }
+}
 
-      if (in.size() > len)
-        TRACEPRINTF (t, 8, "Datalen %d has len %d?", len, in.size());
+/* the ACK thread has read something */
+void
+TPUARTwrap::recv_thread()
+{
+  TPUARTthread::Event *e;
+  while ((e = thread->next_event()) != nullptr)
+    {
+      RxTime rt(e->rx);
+      bool online = state > T_is_online && state < T_busmonitor;
 
-      if (in.size() >= len)
+      if (e->type == TPUARTthread::E_ERROR)
         {
-          if (!recvecho)
-            RecvLPDU (in.data(), in.size());
-          in.clear();
+          ERRORPRINTF (t, E_ERROR | 162, "Communication error: %s", strerror(e->len));
+          thread->done_event();
+          errored();
+          return;
         }
+      if (state < T_start)
+        t->TracePacket (0, "ReadDrop", e->len, e->data);
+      else
+        switch (e->type)
+          {
+          case TPUARTthread::E_CONTROL:
+            recv_control (e->data[0]);
+            break;
+          case TPUARTthread::E_PARTIAL:
+            if (online)
+              setstate(T_wait_more);
+            break;
+          case TPUARTthread::E_FRAME:
+            if (!e->echo)
+              {
+                RecvLPDU (e->data, e->len);
+                check_ackmap (e->data, e->len);
+              }
+            if (online)
+              setstate(T_wait);
+            break;
+          case TPUARTthread::E_INCOMPLETE:
+            t->TracePacket (8, "Incomplete packet", e->len, e->data);
+            if (online)
+              setstate(T_wait);
+            break;
+          default:
+            break;
+          }
+      thread->done_event();
+    }
+
+  unsigned long lost = __atomic_load_n (&thread->lost, __ATOMIC_RELAXED);
+  if (lost != ack_lost)
+    {
+      ERRORPRINTF (t, E_WARNING | 163, "ACK thread: %lu events lost, the main loop is too slow", lost - ack_lost);
+      ack_lost = lost;
     }
+}
 
-  if (state > T_is_online && state < T_busmonitor)
+/* @from and @count run over individual addresses, then group addresses */
+void
+TPUARTwrap::fill_ackmap(unsigned from, unsigned count)
+{
+  for (unsigned i = from; i < from + count; i++)
     {
-      if (in.size() == 0)
-        setstate(T_wait);
+      eibaddr_t a = i & 0xFFFF;
+      if (i & 0x10000)
+        thread->set_address(a, true, ackmap_src->checkSysGroupAddress(a));
       else
-        setstate(T_wait_more);
+        thread->set_address(a, false, ackmap_src->checkSysAddress(a));
     }
 }
 
 void
-TPUARTwrap::recv_Data(CArray &c)
+TPUARTwrap::ackmap_timer_cb(ev::timer &, int)
 {
-  uint8_t *buf = c.data();
-  size_t len = c.size();
+  fill_ackmap(ackmap_pos, 0x800);
+  ackmap_pos = (ackmap_pos + 0x800) & 0x1FFFF;
+  if (ackmap_pos == 0)
+    ackmap_filling = false;
+  /* after a start, don't hold up the loop with all 128k addresses at
+   * once; once complete, refresh all of it every 6.4 seconds */
+  ackmap_timer.start(ackmap_filling ? 0 : 0.1, 0);
+}
 
-  if (state < T_start)
+/* A frame's destination may have been ACKed wrongly because the bitmap
+ * was out of date; fix it, the frame will be repeated if it matters. */
+void
+TPUARTwrap::check_ackmap(const uint8_t *d, unsigned len)
+{
+  bool ext = !(d[0] & 0x80);
+  if (len < 6u + ext)
+    return;
+  bool group = d[ext ? 1 : 5] & 0x80;
+  eibaddr_t dest = (d[3+ext] << 8) | d[4+ext];
+  bool ok = group ? checkSysGroupAddress(dest) : checkSysAddress(dest);
+  if (thread->set_address(dest, group, ok))
     {
-      t->TracePacket (0, "ReadDrop", len, buf);
-      return; // discard
+      ackmap_stale++;
+      TRACEPRINTF (t, 8, "ACK map: %s %s now %s", group ? "group" : "address",
+                   group ? FormatGroupAddr(dest) : FormatEIBAddr(dest),
+                   ok ? "accepted" : "rejected");
     }
+}
 
-  while(len--)
+void
+TPUARTwrap::recv_control(uint8_t c)
+{
+  if (c == 0x03) // RESET
     {
-      uint8_t c = *buf++;
-      if (in.size() > 0)
-        {
-          in.setpart (&c, in.size(), 1);
-          in_check();
-          continue;
-        }
-      if (skip_char)
-        {
-          skip_char = false;
-          continue;
-        }
-
-      if (c == 0x03) // RESET
+      if (state == T_in_reset)
         {
-          if (state == T_in_reset)
-            {
-              TRACEPRINTF (t, 8, "RESET_ACK");
-              setstate(T_in_setaddr);
-            }
-          else
-            TRACEPRINTF (t, 8, "spurious RESET_ACK");
+          TRACEPRINTF (t, 8, "RESET_ACK");
+          setstate(T_in_setaddr);
         }
-      else if (c == 0x8B) // L_DataConfirm positive
+      else
+        TRACEPRINTF (t, 8, "spurious RESET_ACK");
+    }
+  else if (c == 0x8B) // L_DataConfirm positive
+    {
+      if (out.size() == 0 || state < T_is_online)
         {
-          if (out.size() == 0 || state < T_is_online)
-            {
-              TRACEPRINTF (t, 8, "ACK: but not sending");
-              continue;
-            }
-          do__send_Next();
-          continue;
+          TRACEPRINTF (t, 8, "ACK: but not sending");
+          return;
         }
-      else if (c == 0xCB) // frame end, NCN5120
-        { }
-      else if (c == 0x0B) // L_DataConfirm negative
+      do__send_Next();
+    }
+  else if (c == 0xCB) // frame end, NCN5120
+    { }
+  else if (c == 0x0B) // L_DataConfirm negative
+    {
+      if (out.size() == 0 || state < T_is_online)
         {
-          if (out.size() == 0 || state < T_is_online)
-            {
-              TRACEPRINTF (t, 8, "NACK: but not sending");
-              continue;
-            }
-          do__send_Next();
-          continue;
+          TRACEPRINTF (t, 8, "NACK: but not sending");
+          return;
         }
-      else if ((c & 0x17) == 0x13) // frame state indication, NCN5120
-        { }
-      else if ((c & 0x07) == 0x07) // state indication
-        {
-          TRACEPRINTF (t, 8, "State: %02X", c);
-          if (c != 0x07)
-            ERRORPRINTF (t, E_WARNING | 116, "TPUART error state x%02X", c);
-
-          switch(state)
-            {
-            case T_wait_keepalive:
-              setstate(T_wait);
-              break;
-            case T_in_reset:
-              // setstate(T_in_reset); // do not immediately retry
-              break;
-            case T_in_setaddr:
-              // if (c == 0x47)
-              //   {
-              //     ERRORPRINTF (t, E_ERROR | 62, "TPUART detected. Hardware ACK not supported.");
-              //     my_addr = 0;
-              //   }
-              setstate(T_in_getstate);
-              break;
-            case T_in_getstate:
-              setstate(T_is_online);
-              break;
+      do__send_Next();
+    }
+  else if ((c & 0x17) == 0x13) // frame state indication, NCN5120
+    { }
+  else if ((c & 0x07) == 0x07) // state indication
+    {
+      TRACEPRINTF (t, 8, "State: %02X", c);
+      if (c != 0x07)
+        ERRORPRINTF (t, E_WARNING | 116, "TPUART error state x%02X", c);
 
-            default:
-              ERRORPRINTF (t, E_WARNING | 117, "TPUART state %s should not happen", SN(state));
-              break;
-            }
-        }
-      /*
-        * 0xCC acknowledge frame
-        * 0x0C NotAcknowledge frame
-        * 0xC0 Busy Frame
-        */
-      else if (c == 0xCC || c == 0xC0 || c == 0x0C)
+      switch(state)
         {
-          RecvLPDU (in.data(), 1);
-        }
-      else if ((c & 0x50) == 0x10) // Matches KNX control byte L_Data_Standard/Extended Frame
-        {
-          assert(!in.size());
-          in.setpart (&c, in.size(), 1);
-        }
-      else
-        {
-          acked = false;
-          TRACEPRINTF (t, 0, "unknown %02X", c);
+        case T_wait_keepalive:
+          setstate(T_wait);
+          break;
+        case T_in_reset:
+          // setstate(T_in_reset); // do not immediately retry
+          break;
+        case T_in_setaddr:
+          // if (c == 0x47)
+          //   {
+          //     ERRORPRINTF (t, E_ERROR | 62, "TPUART detected. Hardware ACK not supported.");
+          //     my_addr = 0;
+          //   }
+          setstate(T_in_getstate);
+          break;
+        case T_in_getstate:
+          setstate(T_is_online);
+          break;
+
+        default:
+          ERRORPRINTF (t, E_WARNING | 117, "TPUART state %s should not happen", SN(state));
+          break;
         }
     }
-  return;
+  /*
+    * 0xCC acknowledge frame
+    * 0x0C NotAcknowledge frame
+    * 0xC0 Busy Frame
+    */
+  else if (c == 0xCC || c == 0xC0 || c == 0x0C)
+    {
+      RecvLPDU (&c, 1);
+    }
+  else
+    {
+      acked = false;
+      TRACEPRINTF (t, 0, "unknown %02X", c);
+    }
 }
 
 void
@@ -624,4 +781,6 @@ TPUARTwrap::setstate(enum TSTATE new_state)
       break;
     }
   state = new_state;
+  if (thread)
+    thread->set_acking(my_addr == 0 && state >= T_is_online && state < T_busmonitor);
 }
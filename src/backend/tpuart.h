@@ -24,6 +24,8 @@
 #include "link.h"
 #include "lpdu.h"
 #include "lowlevel.h"
+#include "tpuartparse.h"
+#include "tpuartack.h"
 
 // also update SN() in tpuart.cpp
 enum TSTATE
@@ -41,6 +43,8 @@ enum TSTATE
   T_busmonitor = 30,
 };
 
+class TPUARTwrap;
+
 DRIVER_(TPUART,LowLevelAdapter,tpuart)
 {
 public:
@@ -51,8 +55,10 @@ public:
   virtual ~TPUART() = default;
 
   bool setup();
+  std::string info(int verbose = 0);
 protected:
   virtual LowLevelFilter * create_wrapper(LowLevelIface* parent, IniSectionPtr& s, LowLevelDriver* i = nullptr);
+  TPUARTwrap *wrap = nullptr;
 };
 
 class TPUARTwrap : public LowLevelFilter
@@ -61,11 +67,38 @@ public:
   TPUARTwrap (LowLevelIface* parent, IniSectionPtr& s, LowLevelDriver* i = nullptr);
   virtual ~TPUARTwrap();
 
+  /** ACK statistics */
+  std::string ack_info();
+  /** where to ask about addresses in bulk, bypassing LLlog */
+  void set_ackmap_src(LowLevelIface *src)
+  {
+    ackmap_src = src;
+  }
+
 protected:
   void recv_Data(CArray &c);
 
   bool ackallgroup;
   bool ackallindividual;
+  /** the device sends an extra octet after each frame (NCN5120) */
+  bool frame_end = false;
+
+  /** reads the device and sends ACKs, if ack-thread is set */
+  TPUARTthread *thread = nullptr;
+  void recv_thread();
+  /** main-loop ACKs, if there's no thread */
+  AckLatency latency;
+  /** the thread's idea which addresses to ACK */
+  void fill_ackmap(unsigned from, unsigned count);
+  void check_ackmap(const uint8_t *data, unsigned len);
+  ev::timer ackmap_timer;
+  void ackmap_timer_cb(ev::timer &w, int revents);
+  unsigned ackmap_pos = 0;
+  /** building the table after a start, a chunk per loop iteration */
+  bool ackmap_filling = false;
+  LowLevelIface *ackmap_src = this;
+  unsigned long ackmap_stale = 0;
+  unsigned long ack_lost = 0;
 
   /** process a received frame */
   virtual void RecvLPDU (const uint8_t * data, int len);
@@ -73,7 +106,10 @@ protected:
   virtual void do_send_Next();
   void do__send_Next();
   void send_again();
-  void in_check();
+  /** a service octet from the TPUART */
+  void recv_control(uint8_t c);
+  /** a frame's header has arrived: ACK it if it's for us */
+  void recv_header(const uint8_t *in, bool ext);
 
   /** OK to send next packet */
   bool next_free = true;
@@ -87,12 +123,12 @@ protected:
   void sendtimer_cb(ev::timer &w, int revents);
 
   LPDUPtr sending;
-  CArray in, out;
+  TPUARTparser in;
+  CArray out;
   unsigned int retry = 0;
   unsigned int send_retry = 0;
   bool acked = false;
   bool recvecho = false;
-  bool skip_char = false;
   bool monitor = false;
   eibaddr_t my_addr = 0;
 
@@ -0,0 +1,422 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include "tpuartack.h"
+#include "lpdu.h"
+
+/* one octet on TP1: 13 bit times at 9600 baud, in nsec */
+#define TP1_OCTET_NS 1354167
+
+uint64_t
+AckLatency::deadline (const uint8_t *hdr, bool ext)
+{
+  unsigned len = ext ? hdr[6] : (hdr[5] & 0x0f);
+  return (len + 2) * (uint64_t) TP1_OCTET_NS;
+}
+
+void
+AckLatency::sample (uint64_t ns, bool is_late)
+{
+  uint64_t us = ns / 1000;
+  unsigned i = 0;
+  while (us > 1 && i < BUCKETS - 1)
+    {
+      us >>= 1;
+      i++;
+    }
+  __atomic_add_fetch (&hist[i], 1, __ATOMIC_RELAXED);
+  if (is_late)
+    __atomic_add_fetch (&late, 1, __ATOMIC_RELAXED);
+  /* there's only one writer */
+  if (ns > __atomic_load_n (&max, __ATOMIC_RELAXED))
+    __atomic_store_n (&max, ns, __ATOMIC_RELAXED);
+}
+
+std::string
+AckLatency::info () const
+{
+  unsigned long h[BUCKETS];
+  unsigned long n = 0;
+  for (unsigned i = 0; i < BUCKETS; i++)
+    n += h[i] = __atomic_load_n (&hist[i], __ATOMIC_RELAXED);
+  if (!n)
+    return "no ACKs";
+
+  /* upper bounds of the buckets holding the percentiles */
+  unsigned long p[3];
+  const unsigned long want[3] = { (n + 1) / 2, (n * 9 + 9) / 10, (n * 99 + 99) / 100 };
+  unsigned long sum = 0;
+  unsigned j = 0;
+  for (unsigned i = 0; i < BUCKETS && j < 3; i++)
+    {
+      sum += h[i];
+      while (j < 3 && sum >= want[j])
+        p[j++] = 2UL << i;
+    }
+
+  char buf[200];
+  snprintf (buf, sizeof (buf),
+            "ack usec p50 <%lu p90 <%lu p99 <%lu max %lu (%lu acks), %lu late",
+            p[0], p[1], p[2],
+            (unsigned long) (__atomic_load_n (&max, __ATOMIC_RELAXED) / 1000),
+            n, __atomic_load_n (&late, __ATOMIC_RELAXED));
+  return buf;
+}
+
+TPUARTthread::TPUARTthread (TracePtr tr) : t(tr)
+{
+  memset (ind_ok, 0, sizeof (ind_ok));
+  memset (grp_ok, 0, sizeof (grp_ok));
+  notify.set <TPUARTthread,&TPUARTthread::notify_cb> (this);
+}
+
+TPUARTthread::~TPUARTthread ()
+{
+  stop ();
+}
+
+bool
+TPUARTthread::start (int dev)
+{
+#ifdef HAVE_PTHREAD
+  fd = dev;
+  quit = false;
+  in.reset ();
+  in.skip_next = false;
+
+  if (pipe (wake) < 0)
+    {
+      ERRORPRINTF (t, E_ERROR | 158, "ACK thread: pipe: %s", strerror (errno));
+      return false;
+    }
+  fcntl (wake[0], F_SETFL, O_NONBLOCK);
+  fcntl (wake[1], F_SETFL, O_NONBLOCK);
+  notify.start ();
+
+  pthread_attr_t attr;
+  pthread_attr_init (&attr);
+  if (priority)
+    {
+      struct sched_param sp;
+      sp.sched_priority = priority;
+      pthread_attr_setinheritsched (&attr, PTHREAD_EXPLICIT_SCHED);
+      pthread_attr_setschedpolicy (&attr, SCHED_FIFO);
+      pthread_attr_setschedparam (&attr, &sp);
+    }
+  int e = pthread_create (&thr, &attr, run_, this);
+  pthread_attr_destroy (&attr);
+  if (e == EPERM && priority)
+    {
+      ERRORPRINTF (t, E_WARNING | 159, "ACK thread: no permission for real-time priority %d, using normal scheduling", priority);
+      e = pthread_create (&thr, nullptr, run_, this);
+    }
+  if (e)
+    {
+      ERRORPRINTF (t, E_ERROR | 160, "ACK thread: %s", strerror (e));
+      notify.stop ();
+      close (wake[0]);
+      close (wake[1]);
+      wake[0] = wake[1] = -1;
+      return false;
+    }
+  running = true;
+  TRACEPRINTF (t, 2, "ACK thread started, priority %d", priority);
+  return true;
+#else
+  return false;
+#endif
+}
+
+void
+TPUARTthread::stop ()
+{
+  if (!running)
+    return;
+#ifdef HAVE_PTHREAD
+  __atomic_store_n (&quit, true, __ATOMIC_RELEASE);
+  if (write (wake[1], "", 1) < 0)
+    { }
+  pthread_join (thr, nullptr);
+#endif
+  running = false;
+  notify.stop ();
+  close (wake[0]);
+  close (wake[1]);
+  wake[0] = wake[1] = -1;
+  fd = -1;
+
+  CArray **c;
+  while ((c = tx.front ()))
+    {
+      delete *c;
+      tx.pop ();
+    }
+  while (rx.front ())
+    rx.pop ();
+  echo_key = 0;
+  acking = false;
+  TRACEPRINTF (t, 2, "ACK thread stopped: %s", latency.info ());
+}
+
+void
+TPUARTthread::send (CArray *c)
+{
+  CArray **slot = running ? tx.back () : nullptr;
+  if (!slot)
+    {
+      ERRORPRINTF (t, E_ERROR | 161, "ACK thread: can't send, dropped %d octets", c->size ());
+      delete c;
+      return;
+    }
+  *slot = c;
+  tx.push ();
+  if (write (wake[1], "", 1) < 0)
+    { } // the pipe is full, thus the thread will look anyway
+}
+
+void
+TPUARTthread::set_acking (bool on)
+{
+  __atomic_store_n (&acking, on, __ATOMIC_RELEASE);
+}
+
+void
+TPUARTthread::set_echo (const CArray &out)
+{
+  uint64_t k = 0;
+  if (out.size () >= 6 && out.size () >= 6u + !(out[0] & 0x80))
+    k = key (out.data (), !(out[0] & 0x80));
+  __atomic_store_n (&echo_key, k, __ATOMIC_RELEASE);
+}
+
+uint64_t
+TPUARTthread::key (const uint8_t *hdr, bool ext)
+{
+  uint64_t k = hdr[0] & ~0x20;
+  for (unsigned i = 1; i < 6u + ext; i++)
+    k |= (uint64_t) hdr[i] << (8 * i);
+  return k | ((uint64_t) (6 + ext) << 56);
+}
+
+bool
+TPUARTthread::set_address (eibaddr_t addr, bool group, bool accept)
+{
+  uint32_t *w = &(group ? grp_ok : ind_ok)[addr / 32];
+  uint32_t m = 1U << (addr % 32);
+  uint32_t old = __atomic_load_n (w, __ATOMIC_RELAXED);
+  uint32_t nw = accept ? old | m : old & ~m;
+  if (nw == old)
+    return false;
+  /* only the event loop writes */
+  __atomic_store_n (w, nw, __ATOMIC_RELAXED);
+  return true;
+}
+
+bool
+TPUARTthread::accepts (eibaddr_t addr, bool group)
+{
+  if (group ? ackallgroup : ackallindividual)
+    return true;
+  const uint32_t *w = &(group ? grp_ok : ind_ok)[addr / 32];
+  return __atomic_load_n (w, __ATOMIC_RELAXED) & (1U << (addr % 32));
+}
+
+void
+TPUARTthread::notify_cb (ev::async &, int)
+{
+  on_recv ();
+}
+
+/* Everything below runs in the thread. Don't trace here. */
+
+void *
+TPUARTthread::run_ (void *arg)
+{
+  static_cast<TPUARTthread *> (arg)->run ();
+  return nullptr;
+}
+
+void
+TPUARTthread::emit (EventType type, const uint8_t *data, size_t len,
+                    uint64_t rxt, bool echo)
+{
+  Event *e = rx.back ();
+  if (!e)
+    {
+      __atomic_add_fetch (&lost, 1, __ATOMIC_RELAXED);
+      notify.send ();
+      return;
+    }
+  e->type = type;
+  e->echo = echo;
+  e->len = len;
+  e->rx = rxt ? rxt : rx_clock ();
+  if (data)
+    memcpy (e->data, data, len);
+  rx.push ();
+  notify.send ();
+}
+
+bool
+TPUARTthread::write_all (const uint8_t *data, size_t len)
+{
+  while (len)
+    {
+      ssize_t n = write (fd, data, len);
+      if (n < 0)
+        {
+          if (errno == EINTR || errno == EAGAIN)
+            continue;
+          return false;
+        }
+      data += n;
+      len -= n;
+    }
+  return true;
+}
+
+void
+TPUARTthread::on_header (uint64_t rxt)
+{
+  const uint8_t *d = in.data ();
+  bool ext = in.extended ();
+  if (!__atomic_load_n (&acking, __ATOMIC_ACQUIRE))
+    return;
+
+  bool group = d[ext ? 1 : 5] & 0x80;
+  uint8_t c = 0x10;
+  if (accepts ((d[3 + ext] << 8) | d[4 + ext], group))
+    c |= 0x01;
+  if (!write_all (&c, 1))
+    {
+      int err = errno;
+      emit (E_ERROR, nullptr, err);
+      return;
+    }
+  uint64_t dt = rx_clock () - rxt;
+  latency.sample (dt, dt > AckLatency::deadline (d, ext));
+}
+
+void
+TPUARTthread::run ()
+{
+  uint8_t buf[256];
+  bool echo = false;
+  /* when the last part of an incomplete frame arrived */
+  uint64_t partial = 0;
+
+  while (!__atomic_load_n (&quit, __ATOMIC_ACQUIRE))
+    {
+      struct pollfd p[2];
+      p[0].fd = fd;
+      p[0].events = POLLIN;
+      p[1].fd = wake[0];
+      p[1].events = POLLIN;
+
+      int timeout = -1;
+      if (in.busy ())
+        {
+          /* the rest of a frame must follow within a second of the
+           * last part */
+          int64_t left = (int64_t) (partial + 1000000000 - rx_clock ()) / 1000000;
+          timeout = left > 0 ? left : 0;
+        }
+      int r = poll (p, 2, timeout);
+      if (r < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          emit (E_ERROR, nullptr, errno);
+          return;
+        }
+      if (r == 0 && in.busy ())
+        {
+          emit (E_INCOMPLETE, in.data (), in.size ());
+          in.reset ();
+          continue;
+        }
+
+      if (p[1].revents)
+        while (read (wake[0], buf, sizeof (buf)) > 0)
+          ;
+      CArray **c;
+      while ((c = tx.front ()))
+        {
+          bool ok = write_all ((*c)->data (), (*c)->size ());
+          delete *c;
+          tx.pop ();
+          if (!ok)
+            {
+              emit (E_ERROR, nullptr, errno);
+              return;
+            }
+        }
+
+      if (!p[0].revents)
+        continue;
+      ssize_t n = read (fd, buf, sizeof (buf));
+      if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        continue;
+      if (n <= 0)
+        {
+          emit (E_ERROR, nullptr, n < 0 ? errno : EPIPE);
+          return;
+        }
+      uint64_t rxt = rx_clock ();
+
+      in.feed (buf, n);
+      bool more = true;
+      while (more)
+        switch (in.next ())
+          {
+          case TPUARTparser::NEED_MORE:
+            if (in.busy ())
+              {
+                partial = rxt;
+                emit (E_PARTIAL, nullptr, 0, rxt);
+              }
+            more = false;
+            break;
+          case TPUARTparser::CONTROL:
+            emit (E_CONTROL, &in.control, 1, rxt);
+            /* NCN5120wrap::RecvLPDU, which gets these, skips an octet */
+            if (frame_end && (in.control == 0xCC || in.control == 0xC0 || in.control == 0x0C))
+              in.skip_next = true;
+            break;
+          case TPUARTparser::HEADER:
+            {
+              uint64_t k = __atomic_load_n (&echo_key, __ATOMIC_ACQUIRE);
+              echo = k && k == key (in.data (), in.extended ());
+              if (!echo)
+                on_header (rxt);
+            }
+            break;
+          case TPUARTparser::FRAME:
+            emit (E_FRAME, in.data (), in.size (), rxt, echo);
+            if (frame_end && !echo)
+              in.skip_next = true;
+            break;
+          }
+    }
+}
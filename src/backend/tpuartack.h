@@ -0,0 +1,211 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TPUARTACK_H
+#define TPUARTACK_H
+
+#include <string>
+#include "config.h"
+#include "callbacks.h"
+#include "lowlevel.h"
+#include "tpuartparse.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/**
+ * Histogram of the time between reading a frame's header from the TPUART
+ * and telling it whether to ACK the frame, in power-of-two microsecond
+ * buckets. sample() may be called from another thread.
+ */
+class AckLatency
+{
+public:
+  /** @param late the rest of the frame has passed on the bus by now */
+  void sample (uint64_t ns, bool late);
+  std::string info () const;
+
+  /** how long the rest of a frame takes on the bus, roughly */
+  static uint64_t deadline (const uint8_t *hdr, bool ext);
+
+private:
+  /** bucket i: less than 2^(i+1) usec */
+  static const unsigned BUCKETS = 21;
+  unsigned long hist[BUCKETS] = {};
+  unsigned long late = 0;
+  uint64_t max = 0;
+};
+
+/**
+ * Ring buffer between exactly one producing and one consuming thread.
+ * N must be a power of two.
+ */
+template<class T, unsigned N>
+class SpscRing
+{
+  static_assert ((N & (N - 1)) == 0, "ring size must be a power of two");
+
+public:
+  /** the slot to fill, or nullptr if the ring is full */
+  T *back ()
+  {
+    unsigned h = __atomic_load_n (&head, __ATOMIC_RELAXED);
+    if (h - __atomic_load_n (&tail, __ATOMIC_ACQUIRE) == N)
+      return nullptr;
+    return &q[h % N];
+  }
+  /** the slot returned by back() is filled */
+  void push ()
+  {
+    __atomic_store_n (&head, head + 1, __ATOMIC_RELEASE);
+  }
+  /** the oldest slot, or nullptr if the ring is empty */
+  T *front ()
+  {
+    unsigned t = __atomic_load_n (&tail, __ATOMIC_RELAXED);
+    if (t == __atomic_load_n (&head, __ATOMIC_ACQUIRE))
+      return nullptr;
+    return &q[t % N];
+  }
+  /** the slot returned by front() may be re-used */
+  void pop ()
+  {
+    __atomic_store_n (&tail, tail + 1, __ATOMIC_RELEASE);
+  }
+
+private:
+  T q[N];
+  unsigned head = 0;
+  unsigned tail = 0;
+};
+
+/**
+ * Serial reader thread for TPUART and NCN5120 devices.
+ *
+ * A TPUART must be told whether to ACK a frame before the frame has
+ * passed on the bus. When the event loop is busy routing, that may take
+ * too long; this thread reads the device, decides about the ACK as soon as
+ * a frame's header has arrived, and hands everything else to the event
+ * loop.
+ *
+ * The decision is made against a bitmap of the addresses the router
+ * accepts, which the event loop maintains: it's built at start, refreshed
+ * piecewise, and corrected whenever a frame shows it to be out of date.
+ * The thread also does all writes, so that an ACK can't end up in the
+ * middle of a frame being sent.
+ */
+class TPUARTthread : public FDthread
+{
+public:
+  TPUARTthread (TracePtr tr);
+  virtual ~TPUARTthread ();
+
+  /** SCHED_FIFO priority, 0: don't change the scheduling */
+  int priority = 0;
+  /** the device sends an extra octet after each frame (NCN5120) */
+  bool frame_end = false;
+  bool ackallgroup = false;
+  bool ackallindividual = false;
+
+  bool start (int fd);
+  void stop ();
+  void send (CArray *c);
+
+  /** whether we're online, and need to ACK */
+  void set_acking (bool on);
+  /** the frame we're sending, so that its echo isn't ACKed; empty: none */
+  void set_echo (const CArray &out);
+  /** @return whether this changed the bitmap */
+  bool set_address (eibaddr_t addr, bool group, bool accept);
+
+  enum EventType
+  {
+    /** a service octet */
+    E_CONTROL,
+    /** the read ended within a frame */
+    E_PARTIAL,
+    /** a complete frame */
+    E_FRAME,
+    /** the rest of a frame didn't arrive in time; data is what did */
+    E_INCOMPLETE,
+    /** reading or writing failed; len is errno */
+    E_ERROR,
+  };
+  struct Event
+  {
+    EventType type;
+    /** E_FRAME: it's the echo of our own */
+    bool echo;
+    uint16_t len;
+    /** rx_clock() after the read */
+    uint64_t rx;
+    uint8_t data[TPUARTparser::MAX_FRAME];
+  };
+  /** called on the event loop when there are events */
+  InfoCallback on_recv;
+  /** the next event, or nullptr */
+  Event *next_event ()
+  {
+    return rx.front ();
+  }
+  void done_event ()
+  {
+    rx.pop ();
+  }
+
+  AckLatency latency;
+  /** events dropped because the event loop didn't keep up */
+  unsigned long lost = 0;
+
+private:
+  TracePtr t;
+  int fd = -1;
+  int wake[2] = { -1, -1 };
+  bool quit = false;
+#ifdef HAVE_PTHREAD
+  pthread_t thr;
+#endif
+  bool running = false;
+
+  SpscRing<Event, 64> rx;
+  SpscRing<CArray *, 64> tx;
+  ev::async notify;
+  void notify_cb (ev::async &w, int revents);
+
+  /** the echo's header, first octet without the repeat flag, and its
+   * length in the top octet; 0: not sending */
+  uint64_t echo_key = 0;
+  bool acking = false;
+  uint32_t ind_ok[65536 / 32];
+  uint32_t grp_ok[65536 / 32];
+
+  static void *run_ (void *arg);
+  void run ();
+  bool accepts (eibaddr_t addr, bool group);
+  static uint64_t key (const uint8_t *hdr, bool ext);
+  /** the thread's side of things */
+  TPUARTparser in;
+  void emit (EventType type, const uint8_t *data = nullptr, size_t len = 0,
+             uint64_t rxt = 0, bool echo = false);
+  bool write_all (const uint8_t *data, size_t len);
+  void on_header (uint64_t rxt);
+};
+
+#endif
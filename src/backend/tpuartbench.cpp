@@ -0,0 +1,274 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Fuzz test and benchmark for TPUARTparser.
+ *
+ * The input is a byte stream as read from a TPUART or NCN5120, e.g.
+ * recorded with "cat /dev/ttyKNX1 > file" while the bus is busy, or a
+ * random one. The stream is parsed one octet at a time for reference.
+ *
+ * Fuzzing splits the stream at random points, and also parses randomly
+ * damaged copies of it; the events must not depend on where the reads
+ * end. The benchmark compares parsing whole reads with the old way of
+ * appending every octet to a CArray and looking at the frame again.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "types.h"
+#include "tpuartparse.h"
+
+/** aborts program with a printf like message */
+void
+die (const char *msg, ...)
+{
+  va_list ap;
+  va_start (ap, msg);
+  vprintf (msg, ap);
+  printf ("\n");
+  va_end (ap);
+
+  exit (1);
+}
+
+/** what the parser said, flattened: event type, then its octets */
+static void
+parse (const CArray &s, size_t chunk, std::vector<uint8_t> *ev, unsigned *frames)
+{
+  TPUARTparser p;
+  size_t pos = 0;
+  unsigned n = 0;
+
+  while (pos < s.size ())
+    {
+      size_t len = chunk ? chunk : 1 + random () % 100;
+      if (len > s.size () - pos)
+        len = s.size () - pos;
+      p.feed (s.data () + pos, len);
+      pos += len;
+      while (true)
+        {
+          TPUARTparser::Event e = p.next ();
+          if (e == TPUARTparser::NEED_MORE)
+            break;
+          if (e == TPUARTparser::FRAME)
+            n++;
+          if (p.size () > TPUARTparser::MAX_FRAME)
+            die ("frame of %u octets", p.size ());
+          if (!ev)
+            continue;
+          ev->push_back (e);
+          if (e == TPUARTparser::CONTROL)
+            ev->push_back (p.control);
+          else
+            ev->insert (ev->end (), p.data (), p.data () + p.size ());
+        }
+    }
+  if (frames)
+    *frames = n;
+}
+
+/** the old TPUARTwrap::recv_Data, minus the driver */
+static unsigned
+parse_old (const CArray &s)
+{
+  CArray in;
+  unsigned n = 0;
+
+  for (uint8_t c : s)
+    {
+      if (in.size () > 0)
+        {
+          in.setpart (&c, in.size (), 1);
+          bool ext = !(in[0] & 0x80);
+          if (in.size () >= 6u + ext)
+            {
+              unsigned len = (ext ? in[6] : (in[5] & 0x0f)) + 6 + ext + 2;
+              if (in.size () >= len)
+                {
+                  n++;
+                  in.clear ();
+                }
+            }
+          continue;
+        }
+      if (TPUARTparser::starts_frame (c))
+        in.setpart (&c, in.size (), 1);
+    }
+  return n;
+}
+
+/** frames and service octets, like a busy line */
+static CArray
+make_stream (size_t len)
+{
+  static const uint8_t svc[] = { 0x8B, 0x0B, 0x07, 0xCC, 0xC0, 0x0C, 0xCB, 0x13 };
+  CArray s;
+
+  while (s.size () < len)
+    {
+      if (random () % 4 == 0)
+        {
+          s.push_back (svc[random () % sizeof (svc)]);
+          continue;
+        }
+      bool ext = random () % 8 == 0;
+      unsigned pl = ext ? random () % 64 : random () % 16;
+      s.push_back (ext ? 0x30 : 0xBC);
+      if (ext)
+        s.push_back (0xE0);
+      s.push_back (0x11);
+      s.push_back (random ());
+      s.push_back (0x0A);
+      s.push_back (random ());
+      if (ext)
+        s.push_back (pl);
+      else
+        s.push_back (0xE0 | pl);
+      for (unsigned i = 0; i < pl + 2; i++)
+        s.push_back (random ());
+    }
+  return s;
+}
+
+static CArray
+read_file (const char *name)
+{
+  FILE *f = fopen (name, "rb");
+  if (!f)
+    die ("%s: %s", name, strerror (errno));
+  CArray s;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread (buf, 1, sizeof (buf), f)) > 0)
+    s.insert (s.end (), buf, buf + n);
+  fclose (f);
+  return s;
+}
+
+static double
+now ()
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+fuzz (const CArray &s, unsigned runs)
+{
+  std::vector<uint8_t> ref, ev;
+  parse (s, 1, &ref, nullptr);
+  for (unsigned i = 0; i < runs; i++)
+    {
+      ev.clear ();
+      parse (s, 0, &ev, nullptr);
+      if (ev != ref)
+        die ("run %u: events depend on read boundaries", i);
+
+      /* damage a few octets */
+      CArray d = s;
+      for (unsigned j = random () % 8; j > 0 && d.size (); j--)
+        d[random () % d.size ()] = random ();
+      std::vector<uint8_t> dref;
+      parse (d, 1, &dref, nullptr);
+      ev.clear ();
+      parse (d, 0, &ev, nullptr);
+      if (ev != dref)
+        die ("run %u: damaged stream: events depend on read boundaries", i);
+    }
+  printf ("fuzz: %u runs OK\n", runs);
+}
+
+static void
+bench (const CArray &s, unsigned rounds, size_t chunk)
+{
+  unsigned frames = 0, n;
+  double t0 = now ();
+  for (unsigned i = 0; i < rounds; i++)
+    parse (s, chunk, nullptr, &frames);
+  double t1 = now ();
+  for (unsigned i = 0; i < rounds; i++)
+    n = parse_old (s);
+  double t2 = now ();
+  if (n != frames)
+    die ("old parser found %u frames, new one %u", n, frames);
+
+  double mb = (double) s.size () * rounds / 1e6;
+  printf ("reads of %zu: %.1f MB/s, %.0f frames/s\n", chunk,
+          mb / (t1 - t0), frames * rounds / (t1 - t0));
+  printf ("per octet:   %.1f MB/s, %.0f frames/s\n",
+          mb / (t2 - t1), n * rounds / (t2 - t1));
+}
+
+int
+main (int ac, char *ag[])
+{
+  unsigned runs = 1000, rounds = 100, chunk = 64, seed = time (nullptr);
+  size_t len = 100000;
+  int c;
+
+  while ((c = getopt (ac, ag, "f:n:c:l:s:")) != -1)
+    switch (c)
+      {
+      case 'f':
+        runs = atoi (optarg);
+        break;
+      case 'n':
+        rounds = atoi (optarg);
+        break;
+      case 'c':
+        chunk = atoi (optarg);
+        break;
+      case 'l':
+        len = atoi (optarg);
+        break;
+      case 's':
+        seed = atoi (optarg);
+        break;
+      default:
+        die ("usage: %s [-f fuzzruns] [-n rounds] [-c readsize] [-l len] [-s seed] [recording...]", ag[0]);
+      }
+  if (!chunk || !rounds)
+    die ("read size and rounds must be positive");
+  srandom (seed);
+  printf ("seed %u\n", seed);
+
+  std::vector<CArray> streams;
+  for (int i = optind; i < ac; i++)
+    streams.push_back (read_file (ag[i]));
+  if (streams.empty ())
+    streams.push_back (make_stream (len));
+
+  for (CArray &s : streams)
+    {
+      printf ("%zu octets\n", s.size ());
+      fuzz (s, runs);
+      bench (s, rounds, chunk);
+    }
+  return 0;
+}
@@ -0,0 +1,89 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <cstring>
+#include "tpuartparse.h"
+
+void
+TPUARTparser::reset ()
+{
+  chunk = nullptr;
+  have = 0;
+  need = 0;
+  done = false;
+}
+
+TPUARTparser::Event
+TPUARTparser::next ()
+{
+  if (done)
+    reset ();
+
+  while (p < end)
+    {
+      if (!have)
+        {
+          uint8_t c = *p++;
+          if (skip_next)
+            {
+              skip_next = false;
+              continue;
+            }
+          if (!starts_frame (c))
+            {
+              control = c;
+              return CONTROL;
+            }
+          chunk = p - 1;
+          have = 1;
+        }
+      else
+        {
+          /* the header (one more octet if extended) tells the length */
+          unsigned want = need ? need : 6 + extended ();
+          size_t n = want - have;
+          if (n > (size_t)(end - p))
+            n = end - p;
+          if (!chunk)
+            memcpy (buf + have, p, n);
+          p += n;
+          have += n;
+        }
+
+      if (!need && have >= 6u + extended ())
+        {
+          const uint8_t *d = data ();
+          need = (extended () ? d[6] : (d[5] & 0x0f)) + 6 + extended () + 2;
+          return HEADER;
+        }
+      if (need && have >= need)
+        {
+          done = true;
+          return FRAME;
+        }
+    }
+
+  /* the rest of the frame comes with the next read */
+  if (chunk)
+    {
+      memcpy (buf, chunk, have);
+      chunk = nullptr;
+    }
+  return NEED_MORE;
+}
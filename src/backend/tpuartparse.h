@@ -0,0 +1,107 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TPUARTPARSE_H
+#define TPUARTPARSE_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Splits what a TPUART or NCN5120 sends into single service octets and
+ * TP1 frames.
+ *
+ * Feed each chunk read from the device, then call next() until it says
+ * NEED_MORE. A frame which lies completely within one chunk is returned
+ * in place; only frames split across reads are collected in the
+ * parser's own buffer. The pointer returned by data() is valid until the
+ * next call to next() or feed().
+ */
+class TPUARTparser
+{
+public:
+  enum Event
+  {
+    /** the chunk is used up */
+    NEED_MORE,
+    /** a service octet, see control */
+    CONTROL,
+    /** a frame's header is complete: data() has at least 6 octets, 7
+     * for an extended frame. Sent once per frame, before FRAME. */
+    HEADER,
+    /** data() and size() are a complete frame */
+    FRAME,
+  };
+
+  /** longest possible frame: extended, 255 octets payload */
+  static const unsigned MAX_FRAME = 7 + 255 + 2;
+
+  void feed (const uint8_t *data, size_t len)
+  {
+    p = data;
+    end = data + len;
+  }
+  Event next ();
+
+  /** the octet if next() returned CONTROL */
+  uint8_t control = 0;
+  /** skip the next octet if it's not part of a frame (NCN5120) */
+  bool skip_next = false;
+
+  const uint8_t *data () const
+  {
+    return chunk ? chunk : buf;
+  }
+  unsigned size () const
+  {
+    return have;
+  }
+  bool extended () const
+  {
+    return have && !(data()[0] & 0x80);
+  }
+  /** a frame is incomplete */
+  bool busy () const
+  {
+    return have && !done;
+  }
+  /** drop an incomplete frame */
+  void reset ();
+
+  /** Does this octet, outside of a frame, start one? The service octets
+   * are checked first, as some of them look like control fields. */
+  static bool starts_frame (uint8_t c)
+  {
+    return (c & 0x50) == 0x10 && (c & 0x17) != 0x13 && (c & 0x07) != 0x07;
+  }
+
+private:
+  const uint8_t *p = nullptr;
+  const uint8_t *end = nullptr;
+  /** the frame so far, if it is still in the current chunk */
+  const uint8_t *chunk = nullptr;
+  unsigned have = 0;
+  /** total length, once the header is known */
+  unsigned need = 0;
+  /** FRAME has been returned */
+  bool done = false;
+  uint8_t buf[MAX_FRAME];
+};
+
+#endif
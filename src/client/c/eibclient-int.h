@@ -51,6 +51,8 @@ struct _EIBConnection
   int (*complete) (EIBConnection *);
   /** file descriptor */
   int fd;
+  /** fd is a SOCK_SEQPACKET socket: one message per packet, no length header */
+  int seqpacket;
   unsigned readlen;
   /** buffer */
   uint8_t *buf;
@@ -58,6 +60,8 @@ struct _EIBConnection
   unsigned buflen;
   /** used buffer */
   unsigned size;
+  /** messages knxd dropped for us (EIB_MESSAGES_LOST) */
+  uint32_t lost;
   struct
   {
     int sendlen;
@@ -81,9 +85,15 @@ struct _EIBConnection
 /** set EIB address */
 #define EIBSETADDR(buf,type) do{(buf)[0]=((type)>>8)&0xff;(buf)[1]=(type)&0xff;}while(0)
 
+/** suffix of the SOCK_SEQPACKET variant of a local socket */
+#define EIB_SEQPACKET_SUFFIX ".seq"
+/** largest message; the length header has 16 bits */
+#define EIB_MAX_MESSAGE 0xffff
+
 int _EIB_SendRequest (EIBConnection * con, unsigned int size, uint8_t * data);
 int _EIB_CheckRequest (EIBConnection * con, int block);
 int _EIB_GetRequest (EIBConnection * con);
+void _EIB_CheckLost (EIBConnection * con);
 
 #define EIBC_LICENSE(text)
 
@@ -47,6 +47,21 @@ _EIB_SendRequest (EIBConnection * con, unsigned int size, uint8_t * data)
       errno = EINVAL;
       return -1;
     }
+  if (con->seqpacket)
+    {
+lp0:
+      i = write (con->fd, data, size);
+      if (i == -1 && errno == EINTR)
+        goto lp0;
+      if (i == -1)
+        return -1;
+      if (i != (int) size)
+        {
+          errno = ECONNRESET;
+          return -1;
+        }
+      return 0;
+    }
   head[0] = (size >> 8) & 0xff;
   head[1] = (size) & 0xff;
 
@@ -99,6 +114,38 @@ _EIB_CheckRequest (EIBConnection * con, int block)
         return 0;
     }
 
+  if (con->seqpacket)
+    {
+      /* every packet is a complete message */
+      if (con->readlen)
+        return 0;
+      if (con->buflen < EIB_MAX_MESSAGE)
+        {
+          con->buf = (uint8_t *) realloc (con->buf, EIB_MAX_MESSAGE);
+          if (con->buf == 0)
+            {
+              con->buflen = 0;
+              errno = ENOMEM;
+              return -1;
+            }
+          con->buflen = EIB_MAX_MESSAGE;
+        }
+      i = read (con->fd, con->buf, con->buflen);
+      if (i == -1 && errno == EINTR)
+        return 0;
+      if (i == -1)
+        return -1;
+      if (i < 2)
+        {
+          errno = ECONNRESET;
+          return -1;
+        }
+      con->size = i;
+      con->readlen = i + 2;
+      _EIB_CheckLost (con);
+      return 0;
+    }
+
   if (con->readlen < 2)
     {
       uint8_t head[2];
@@ -150,10 +197,23 @@ _EIB_CheckRequest (EIBConnection * con, int block)
           return -1;
         }
       con->readlen += i;
+      if (con->readlen == con->size + 2)
+        _EIB_CheckLost (con);
     }
   return 0;
 }
 
+/** swallow a gap notice, remembering its count */
+void
+_EIB_CheckLost (EIBConnection * con)
+{
+  if (con->size < 6 || EIBTYPE (con) != EIB_MESSAGES_LOST)
+    return;
+  con->lost += (con->buf[2] << 24) | (con->buf[3] << 16) |
+    (con->buf[4] << 8) | (con->buf[5]);
+  con->readlen = 0;
+}
+
 /** receive packet from eibd */
 int
 _EIB_GetRequest (EIBConnection * con)
@@ -41,9 +41,28 @@ EIBSocketLocal (const char *path)
       return 0;
     }
   addr.sun_family = AF_LOCAL;
+
+  /* prefer the packet socket: no length headers, one syscall per message */
+  if (strlen (path) + strlen (EIB_SEQPACKET_SUFFIX) < sizeof (addr.sun_path))
+    {
+      strcpy (addr.sun_path, path);
+      strcat (addr.sun_path, EIB_SEQPACKET_SUFFIX);
+      con->fd = socket (AF_LOCAL, SOCK_SEQPACKET, 0);
+      if (con->fd != -1)
+        {
+          if (connect (con->fd, (struct sockaddr *) &addr, sizeof (addr)) == 0)
+            {
+              con->seqpacket = 1;
+              goto done;
+            }
+          close (con->fd);
+        }
+    }
+
   strncpy (addr.sun_path, path, sizeof (addr.sun_path));
   addr.sun_path[sizeof (addr.sun_path) - 1] = 0;
 
+  con->seqpacket = 0;
   con->fd = socket (AF_LOCAL, SOCK_STREAM, 0);
   if (con->fd == -1)
     {
@@ -59,7 +78,9 @@ EIBSocketLocal (const char *path)
       errno = saveerr;
       return 0;
     }
+done:
   con->complete = 0;
+  con->lost = 0;
   con->buflen = 0;
   con->buf = 0;
   con->readlen = 0;
@@ -0,0 +1,390 @@
+/*
+    EIBD client library
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    In addition to the permissions in the GNU General Public License,
+    you may link the compiled version of this file into combinations
+    with other programs, and distribute those combinations without any
+    restriction coming from the use of this file. (The General Public
+    License restrictions do apply in other respects; for example, they
+    cover modification of the file, and distribution when not linked into
+    a combine executable.)
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "eibclient-int.h"
+#include "shmring.h"
+
+/** shared-memory busmonitor ring, reader side */
+struct _EIBShmRing
+{
+  int memfd;
+  int efd;
+  int ctlfd;
+  size_t maplen;
+  /** the ring, mapped read-only */
+  const struct eib_shmring_hdr *hdr;
+  /** our control page */
+  struct eib_shmring_reader *ctl;
+  /** ring geometry, copied from the header once */
+  uint32_t slots;
+  uint32_t recsize;
+  uint32_t recoffset;
+  /** next record to read */
+  uint64_t tail;
+  /** records overwritten before we got to them */
+  uint64_t lost;
+};
+
+/** receive the reply to EIB_OPEN_VBUSMONITOR_SHM plus its descriptors */
+static int
+_EIB_GetRequestFDs (EIBConnection * con, int *fds, int maxfds)
+{
+  uint8_t head[2];
+  struct iovec iov;
+  struct msghdr mh;
+  union
+  {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE (sizeof (int) * 4)];
+  } cbuf;
+  struct cmsghdr *cm;
+  int i, n = 0;
+
+  if (con->seqpacket)
+    {
+      /* the whole reply is one packet */
+      if (con->buflen < EIB_MAX_MESSAGE)
+        {
+          con->buf = (uint8_t *) realloc (con->buf, EIB_MAX_MESSAGE);
+          if (con->buf == 0)
+            {
+              con->buflen = 0;
+              errno = ENOMEM;
+              return -1;
+            }
+          con->buflen = EIB_MAX_MESSAGE;
+        }
+      iov.iov_base = con->buf;
+      iov.iov_len = con->buflen;
+    }
+  else
+    {
+      iov.iov_base = head;
+      iov.iov_len = 2;
+    }
+  memset (&mh, 0, sizeof (mh));
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  mh.msg_control = cbuf.buf;
+  mh.msg_controllen = sizeof (cbuf.buf);
+
+lp1:
+  i = recvmsg (con->fd, &mh, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+  if (i == -1 && errno == EINTR)
+    goto lp1;
+  if (i == -1)
+    return -1;
+
+  for (cm = CMSG_FIRSTHDR (&mh); cm; cm = CMSG_NXTHDR (&mh, cm))
+    if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS)
+      {
+        int *cfd = (int *) CMSG_DATA (cm);
+        int j, cnt = (cm->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+        for (j = 0; j < cnt; j++)
+          if (n < maxfds)
+            fds[n++] = cfd[j];
+          else
+            close (cfd[j]);
+      }
+
+  if (con->seqpacket)
+    {
+      if (i < 2)
+        goto err;
+      con->size = i;
+      con->readlen = 0;
+      return n;
+    }
+  if (i != 2)
+    goto err;
+  con->size = (head[0] << 8) | (head[1]);
+  if (con->size < 2)
+    goto err;
+  if (con->size > con->buflen)
+    {
+      con->buf = (uint8_t *) realloc (con->buf, con->size);
+      if (con->buf == 0)
+        {
+          con->buflen = 0;
+          errno = ENOMEM;
+          goto err2;
+        }
+      con->buflen = con->size;
+    }
+  con->readlen = 2;
+  if (_EIB_GetRequest (con) == -1)
+    goto err2;
+  return n;
+
+err:
+  errno = ECONNRESET;
+err2:
+  while (n > 0)
+    close (fds[--n]);
+  return -1;
+}
+
+EIBShmRing *
+EIBOpenVBusmonitorShm (EIBConnection * con)
+{
+  uint8_t head[2];
+  int fds[3];
+  int n;
+  struct stat st;
+  EIBShmRing *ring;
+  const struct eib_shmring_hdr *hdr;
+  void *map;
+
+  if (!con)
+    {
+      errno = EINVAL;
+      return 0;
+    }
+  ring = (EIBShmRing *) malloc (sizeof (EIBShmRing));
+  if (!ring)
+    {
+      errno = ENOMEM;
+      return 0;
+    }
+
+  EIBSETTYPE (head, EIB_OPEN_VBUSMONITOR_SHM);
+  if (_EIB_SendRequest (con, 2, head) == -1)
+    goto ex;
+  n = _EIB_GetRequestFDs (con, fds, 3);
+  if (n == -1)
+    goto ex;
+  if (EIBTYPE (con) == EIB_CONNECTION_INUSE)
+    {
+      errno = EBUSY;
+      goto ex2;
+    }
+  if (EIBTYPE (con) != EIB_OPEN_VBUSMONITOR_SHM || n != 3)
+    {
+      errno = EIBTYPE (con) == EIB_INVALID_REQUEST ? ENOTSUP : ECONNRESET;
+      goto ex2;
+    }
+
+  ring->memfd = fds[0];
+  ring->efd = fds[1];
+  ring->ctlfd = fds[2];
+  if (fstat (ring->memfd, &st) == -1)
+    goto ex2;
+  ring->maplen = st.st_size;
+  if (ring->maplen < sizeof (struct eib_shmring_hdr))
+    {
+      errno = ECONNRESET;
+      goto ex2;
+    }
+  map = mmap (NULL, ring->maplen, PROT_READ, MAP_SHARED, ring->memfd, 0);
+  if (map == MAP_FAILED)
+    goto ex2;
+  hdr = (const struct eib_shmring_hdr *) map;
+  ring->hdr = hdr;
+  ring->slots = hdr->slots;
+  ring->recsize = hdr->recsize;
+  ring->recoffset = hdr->recoffset;
+  if (__atomic_load_n (&hdr->magic, __ATOMIC_ACQUIRE) != EIB_SHMRING_MAGIC
+      || hdr->version != EIB_SHMRING_VERSION
+      || !ring->slots || (ring->slots & (ring->slots - 1))
+      || ring->recsize < sizeof (struct eib_shmring_rec) || ring->recsize % 8
+      || ring->recoffset < sizeof (struct eib_shmring_hdr)
+      || ring->recoffset % 8
+      || ring->recoffset + (uint64_t) ring->slots * ring->recsize > ring->maplen)
+    {
+      munmap (map, ring->maplen);
+      errno = EPROTO;
+      goto ex2;
+    }
+  ring->ctl = (struct eib_shmring_reader *)
+    mmap (NULL, sizeof (struct eib_shmring_reader), PROT_READ | PROT_WRITE,
+          MAP_SHARED, ring->ctlfd, 0);
+  if (ring->ctl == MAP_FAILED)
+    {
+      munmap (map, ring->maplen);
+      goto ex2;
+    }
+
+  ring->tail = __atomic_load_n (&hdr->head, __ATOMIC_ACQUIRE);
+  ring->lost = 0;
+  return ring;
+
+ex2:
+  while (n > 0)
+    close (fds[--n]);
+ex:
+  free (ring);
+  return 0;
+}
+
+int
+EIBShmRingGetPacket (EIBShmRing * ring, int maxlen, uint8_t * buf,
+                     uint8_t * status, uint32_t * sec, uint32_t * nsec)
+{
+  const struct eib_shmring_hdr *hdr;
+  const struct eib_shmring_rec *rec;
+  uint64_t head, seq;
+  int len;
+
+  if (!ring || maxlen < 0 || (maxlen && !buf))
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  hdr = ring->hdr;
+
+  for (;;)
+    {
+      head = __atomic_load_n (&hdr->head, __ATOMIC_ACQUIRE);
+      if (ring->tail == head)
+        return 0;
+      if (head - ring->tail > ring->slots)
+        {
+          ring->lost += head - ring->slots - ring->tail;
+          ring->tail = head - ring->slots;
+        }
+
+      rec = (const struct eib_shmring_rec *)
+        ((const uint8_t *) hdr + ring->recoffset +
+         (ring->tail & (ring->slots - 1)) * ring->recsize);
+      seq = __atomic_load_n (&rec->seq, __ATOMIC_ACQUIRE);
+      if (seq != 2 * ring->tail + 2)
+        {
+          /* lapped while we looked: skip ahead */
+          ring->lost++;
+          ring->tail++;
+          continue;
+        }
+
+      /* the record may be rewritten while we copy it, so the length
+       * must be bounded before it is used; the seq check below throws
+       * away whatever a torn read produced */
+      len = __atomic_load_n (&rec->len, __ATOMIC_RELAXED);
+      if (len > (int) (ring->recsize - sizeof (struct eib_shmring_rec)))
+        len = ring->recsize - sizeof (struct eib_shmring_rec);
+      if (len > maxlen)
+        len = maxlen;
+      memcpy (buf, rec->data, len);
+      if (status)
+        *status = rec->status;
+      if (sec)
+        *sec = rec->ts_sec;
+      if (nsec)
+        *nsec = rec->ts_nsec;
+
+      __atomic_thread_fence (__ATOMIC_ACQUIRE);
+      if (__atomic_load_n (&rec->seq, __ATOMIC_RELAXED) != seq)
+        {
+          ring->lost++;
+          ring->tail++;
+          continue;
+        }
+      ring->tail++;
+      return len;
+    }
+}
+
+int
+EIBShmRingPrepareWait (EIBShmRing * ring)
+{
+  uint32_t *waiting;
+  uint64_t cnt;
+
+  if (!ring)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  waiting = &ring->ctl->waiting;
+
+  /* drain old wakeups */
+  while (read (ring->efd, &cnt, sizeof (cnt)) == sizeof (cnt))
+    ;
+
+  __atomic_store_n (waiting, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  if (__atomic_load_n (&ring->hdr->head, __ATOMIC_ACQUIRE) != ring->tail)
+    {
+      __atomic_store_n (waiting, 0, __ATOMIC_RELAXED);
+      return 1;
+    }
+  return 0;
+}
+
+int
+EIBShmRingWait (EIBShmRing * ring, int timeout)
+{
+  struct pollfd pfd;
+  int i;
+
+  i = EIBShmRingPrepareWait (ring);
+  if (i != 0)
+    return i;
+
+  pfd.fd = ring->efd;
+  pfd.events = POLLIN;
+  do
+    i = poll (&pfd, 1, timeout);
+  while (i == -1 && errno == EINTR);
+  if (i == -1)
+    return -1;
+  return __atomic_load_n (&ring->hdr->head, __ATOMIC_ACQUIRE) != ring->tail;
+}
+
+int
+EIBShmRing_FD (EIBShmRing * ring)
+{
+  if (!ring)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  return ring->efd;
+}
+
+uint64_t
+EIBShmRingLost (EIBShmRing * ring)
+{
+  return ring ? ring->lost : 0;
+}
+
+void
+EIBShmRingClose (EIBShmRing * ring)
+{
+  if (!ring)
+    return;
+  munmap ((void *) ring->hdr, ring->maplen);
+  munmap (ring->ctl, sizeof (struct eib_shmring_reader));
+  close (ring->memfd);
+  close (ring->efd);
+  close (ring->ctlfd);
+  free (ring);
+}
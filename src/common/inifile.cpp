@@ -105,7 +105,7 @@ IniSection::value(const std::string& name, double def)
   if (!v.size())
     return def;
   char *pos;
-  int res = std::strtod(v.c_str(), &pos);
+  double res = std::strtod(v.c_str(), &pos);
   if (!*pos)
     return res;
   std::cerr << "Parse error: Not a float: " << name << "=" << v << std::endl;
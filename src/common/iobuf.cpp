@@ -23,8 +23,71 @@
 #include <fcntl.h>
 #include "iobuf.h"
 
+bool
+parse_sb_policy(const std::string& name, SB_POLICY& policy)
+{
+  if (name == "drop-oldest")
+    policy = SB_DROP_OLDEST;
+  else if (name == "drop-newest")
+    policy = SB_DROP_NEWEST;
+  else if (name == "disconnect")
+    policy = SB_DISCONNECT;
+  else
+    return false;
+  return true;
+}
+
+bool
+SendBuf::make_room(const CArray *data)
+{
+  size_t len = data->size();
+  unsigned long n = 0;
+
+  if (!over(len))
+    return true;
+
+  switch (policy)
+    {
+    case SB_DROP_OLDEST:
+      // the partially-written head must stay, or the stream is corrupted
+      while (over(len) && !sendqueue.empty())
+        {
+          const CArray *old = sendqueue.get();
+          account(-(ssize_t)old->size());
+          delete old;
+          n++;
+        }
+      // a single message larger than the budget still gets through
+      break;
+
+    case SB_DROP_NEWEST:
+      delete data;
+      n = 1;
+      break;
+
+    case SB_DISCONNECT:
+      // report from the event loop, not from within our caller
+      delete data;
+      overrun = true;
+      ready = true;
+      io.start();
+      return false;
+    }
+
+  dropped += n;
+  dropped_total += n;
+  if (n)
+    on_overflow();
+  return policy != SB_DROP_NEWEST;
+}
+
 void SendBuf::write(const CArray *data)
 {
+  if (overrun)
+    {
+      delete data;
+      return;
+    }
   if (!ready)
     {
       ssize_t len = ::write(fd, data->data(), data->size());
@@ -35,9 +98,15 @@ void SendBuf::write(const CArray *data)
         }
       sendbuf = data;
       sendpos = (len>0) ? len : 0;
+      account(data->size() - sendpos);
     }
   else
-    sendqueue.push(data);
+    {
+      if (!make_room(data))
+        return;
+      sendqueue.push(data);
+      account(data->size());
+    }
   if (!ready)
     {
       ready = true;
@@ -48,6 +117,12 @@ void SendBuf::write(const CArray *data)
 void
 SendBuf::io_cb (ev::io &, int)
 {
+  if (overrun)
+    {
+      io.stop();
+      on_error();
+      return;
+    }
   while (sendbuf || !sendqueue.empty())
     {
       if (sendbuf)
@@ -56,6 +131,7 @@ SendBuf::io_cb (ev::io &, int)
           if (i > 0)
             {
               sendpos += i;
+              account(-i);
               if (sendpos < sendbuf->size())
                 return;
             }
@@ -87,7 +163,11 @@ SendBuf::io_cb (ev::io &, int)
 void
 RecvBuf::io_cb (ev::io &, int)
 {
+  bool live = true;
+  bool *outer = alive;
   bool some = false;
+
+  alive = &live;
   while(sizeof(recvbuf) > recvpos)
     {
       int i = ::read(fd, recvbuf+recvpos, quick ? 1 : (sizeof(recvbuf)-recvpos));
@@ -99,6 +179,8 @@ RecvBuf::io_cb (ev::io &, int)
             {
               io.stop();
               on_error();
+              if (!live)
+                goto dead;
             }
           break;
         }
@@ -108,21 +190,45 @@ RecvBuf::io_cb (ev::io &, int)
       some = true;
     }
   feed_out();
+  if (!live)
+    goto dead;
+  alive = outer;
+  return;
+dead:
+  if (outer)
+    *outer = false;
 }
 
 void RecvBuf::feed_out()
 {
+  bool live = true;
+  bool *outer = alive;
+
+  alive = &live;
   while (running && recvpos > 0)
     {
       size_t i = on_read(recvbuf,recvpos);
+      if (!live)
+        {
+          // the owner deleted us
+          if (outer)
+            *outer = false;
+          return;
+        }
       if (i == 0)
         {
           if (recvpos == sizeof(recvbuf))
             {
               io.stop();
               on_error();
+              if (!live)
+                {
+                  if (outer)
+                    *outer = false;
+                  return;
+                }
             }
-          return;
+          break;
         }
       if (i == recvpos)
         recvpos = 0;
@@ -132,7 +238,7 @@ void RecvBuf::feed_out()
           memmove(recvbuf,recvbuf+i,recvpos);
         }
     }
-
+  alive = outer;
 }
 
 void
@@ -164,11 +270,13 @@ SendBuf::start()
 void
 RecvBuf::stop(bool clear)
 {
-  if (!running)
-    running = false;
+  running = false;
   io.stop();
   if (clear)
-    fd = -1;
+    {
+      fd = -1;
+      recvpos = 0;
+    }
 }
 
 void
@@ -33,11 +33,32 @@
 
 void set_non_blocking(int fd);
 
+/** what to do when a SendBuf exceeds its budget */
+typedef enum
+{
+  SB_DROP_OLDEST, /**< discard queued messages, oldest first */
+  SB_DROP_NEWEST, /**< discard the message being written */
+  SB_DISCONNECT, /**< report an error */
+} SB_POLICY;
+
+/** parse a policy name; returns false if unknown */
+bool parse_sb_policy(const std::string& name, SB_POLICY& policy);
+
+/** byte budget shared by several SendBufs */
+struct SendBudget
+{
+  size_t used = 0;
+  /** 0: unlimited */
+  size_t limit = 0;
+};
+
 class SendBuf
 {
 public:
   InfoCallback on_error;
   InfoCallback on_next;
+  /** called after messages have been dropped */
+  InfoCallback on_overflow;
   void error_cb() {}
   void next_cb() {}
 
@@ -56,6 +77,7 @@ public:
     io.set<SendBuf, &SendBuf::io_cb>(this);
     on_error.set<SendBuf,&SendBuf::error_cb>(this);
     on_next.set<SendBuf,&SendBuf::next_cb>(this);
+    on_overflow.set<SendBuf,&SendBuf::next_cb>(this);
   };
 
   virtual ~SendBuf()
@@ -67,8 +89,24 @@ public:
       }
     if (sendbuf)
       delete sendbuf;
+    account(-(ssize_t)queued);
   };
 
+  /**
+   * Limit the amount of queued data.
+   * @param limit bytes this buffer may queue; 0: unlimited
+   * @param policy what to do when a limit is exceeded
+   * @param budget shared budget, also enforced; may be NULL
+   */
+  void set_limit(size_t limit, SB_POLICY policy, SendBudget *budget = nullptr)
+  {
+    account(-(ssize_t)queued);
+    this->limit = limit;
+    this->policy = policy;
+    this->budget = budget;
+    account(queued);
+  }
+
   void start();
   void stop(bool clear = false);
 
@@ -80,6 +118,35 @@ public:
 
   void write(const CArray *data);
 
+  /** nothing queued or partially sent */
+  bool idle() const
+  {
+    return sendbuf == nullptr && sendqueue.empty();
+  }
+
+  /** bytes waiting to be sent */
+  size_t pending() const
+  {
+    return queued;
+  }
+
+  /** messages dropped since the last call */
+  unsigned long take_dropped()
+  {
+    unsigned long d = dropped;
+    dropped = 0;
+    return d;
+  }
+
+  /** SB_DISCONNECT has been triggered */
+  bool overflowed() const
+  {
+    return overrun;
+  }
+
+  /** messages dropped over the lifetime of this buffer */
+  unsigned long dropped_total = 0;
+
 protected:
   /** client connection */
   int fd = -1;
@@ -90,6 +157,29 @@ protected:
   Queue <const CArray *> sendqueue;
   bool ready = false;
 
+  /** budget */
+  size_t queued = 0;
+  size_t limit = 0;
+  SB_POLICY policy = SB_DISCONNECT;
+  SendBudget *budget = nullptr;
+  unsigned long dropped = 0;
+  /** SB_DISCONNECT triggered */
+  bool overrun = false;
+
+  void account(ssize_t len)
+  {
+    queued += len;
+    if (budget)
+      budget->used += len;
+  }
+  bool over(size_t len) const
+  {
+    return (limit && queued + len > limit)
+           || (budget && budget->limit && budget->used + len > budget->limit);
+  }
+  /** apply the policy; returns false if @data must not be queued */
+  bool make_room(const CArray *data);
+
 private:
   ev::io io;
   void io_cb (ev::io &w, int revents);
@@ -127,7 +217,11 @@ public:
   {
     quick = true;
   }
-  virtual ~RecvBuf() = default;
+  virtual ~RecvBuf()
+  {
+    if (alive)
+      *alive = false;
+  }
 
   void start();
   void stop(bool clear = false);
@@ -147,6 +241,8 @@ private:
   ev::io io;
   void io_cb (ev::io &w, int revents);
   bool quick = false;
+  /** cleared when we're deleted from within a callback */
+  bool *alive = nullptr;
 };
 
 #endif
@@ -41,6 +41,14 @@ public:
   using std::queue<_T>::push;
   using std::queue<_T>::empty;
 
+  using std::queue<_T>::size;
+
+  /** element @i of the queue, 0 being the front */
+  inline const _T& peek (size_t i) const
+  {
+    return this->c[i];
+  }
+
   inline void clear()
   {
     while (!empty())
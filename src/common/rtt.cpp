@@ -0,0 +1,101 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "rtt.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+RttEstimator::RttEstimator (ev_tstamp min, ev_tstamp max)
+{
+  set_limits (min, max);
+}
+
+void
+RttEstimator::set_limits (ev_tstamp min, ev_tstamp max)
+{
+  lo = min;
+  hi = max;
+  cur = hi;
+  have = false;
+}
+
+void
+RttEstimator::sample (ev_tstamp rtt)
+{
+  if (!have)
+    {
+      srtt = rtt;
+      rttvar = rtt / 2;
+      have = true;
+    }
+  else
+    {
+      rttvar = 0.75 * rttvar + 0.25 * fabs (srtt - rtt);
+      srtt = 0.875 * srtt + 0.125 * rtt;
+    }
+  cur = srtt + 4 * rttvar;
+  if (cur < lo)
+    cur = lo;
+  if (cur > hi)
+    cur = hi;
+  recent[samples++ % (sizeof (recent) / sizeof (recent[0]))] = rtt * 1000;
+}
+
+void
+RttEstimator::backoff ()
+{
+  timeouts++;
+  cur *= 2;
+  if (cur > hi)
+    cur = hi;
+}
+
+std::string
+RttEstimator::info (bool rto) const
+{
+  char buf[200];
+  size_t n = samples;
+  if (n > sizeof (recent) / sizeof (recent[0]))
+    n = sizeof (recent) / sizeof (recent[0]);
+  if (!n)
+    {
+      if (rto)
+        snprintf (buf, sizeof (buf), "rto %.1f ms, no RTT samples, %lu timeouts",
+                  cur * 1000, timeouts);
+      else
+        snprintf (buf, sizeof (buf), "no RTT samples");
+      return buf;
+    }
+
+  std::vector<float> v (recent, recent + n);
+  std::sort (v.begin (), v.end ());
+  if (rto)
+    snprintf (buf, sizeof (buf),
+              "rto %.1f ms, rtt ms p50 %.2f p90 %.2f p99 %.2f max %.2f (last %zu of %lu), %lu timeouts",
+              cur * 1000, v[n / 2], v[n * 9 / 10], v[n * 99 / 100], v[n - 1],
+              n, samples, timeouts);
+  else
+    snprintf (buf, sizeof (buf),
+              "rtt ms p50 %.2f p90 %.2f p99 %.2f max %.2f (last %zu of %lu)",
+              v[n / 2], v[n * 9 / 10], v[n * 99 / 100], v[n - 1], n, samples);
+  return buf;
+}
@@ -0,0 +1,61 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef RTT_H
+#define RTT_H
+
+#include <string>
+#include <ev++.h>
+
+/**
+ * Retransmission timeout from measured ACK round trips (SRTT/RTTVAR as in
+ * RFC 6298), clamped to [min, max]. Until the first sample, and after
+ * each timeout, it errs towards max. The default maximum is KNXnet/IP's
+ * tunnelling request timeout.
+ */
+class RttEstimator
+{
+public:
+  RttEstimator (ev_tstamp min = 0.05, ev_tstamp max = 1);
+  void set_limits (ev_tstamp min, ev_tstamp max);
+
+  /** an ACK arrived @rtt seconds after the only transmission of its request */
+  void sample (ev_tstamp rtt);
+  /** an ACK didn't arrive in time */
+  void backoff ();
+  ev_tstamp rto () const
+  {
+    return cur;
+  }
+  /** RTT percentiles of recent samples, for diagnostics; with the
+   * timeout and the number of timeouts if @rto is set */
+  std::string info (bool rto = true) const;
+
+private:
+  ev_tstamp lo, hi;
+  ev_tstamp srtt = 0, rttvar = 0, cur;
+  bool have = false;
+
+  /** the most recent samples, in msec */
+  float recent[128];
+  unsigned long samples = 0;
+  unsigned long timeouts = 0;
+};
+
+#endif
@@ -0,0 +1,111 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    In addition to the permissions in the GNU General Public License,
+    you may link the compiled version of this file into combinations
+    with other programs, and distribute those combinations without any
+    restriction coming from the use of this file. (The General Public
+    License restrictions do apply in other respects; for example, they
+    cover modification of the file, and distribution when not linked into
+    a combine executable.)
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/**
+ * Layout of the shared-memory busmonitor ring.
+ *
+ * knxd is the only writer. Records have a fixed size; the ring simply
+ * overwrites the oldest record when it is full. Every record carries a
+ * sequence word which is odd while knxd is writing it and
+ * 2*(record number + 1) when it is complete, so a reader can detect both
+ * a torn read and being lapped by the writer without any locking.
+ *
+ * The ring is mapped read-only by the readers; knxd seals it so that
+ * it can't be written to or resized through any other mapping. knxd
+ * never reads the header back, so a reader can't make it write
+ * anywhere else.
+ *
+ * Each reader gets a control page of its own, which both sides map
+ * writable. A reader which runs out of data sets its "waiting" word there
+ * and sleeps on its eventfd. knxd only writes to eventfds of waiting
+ * readers, so busy readers cost no system calls at all.
+ *
+ * This file is shared between knxd and the C client library.
+ */
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stdint.h>
+
+#define EIB_SHMRING_MAGIC      0x4b4e5852 /* "KNXR" */
+#define EIB_SHMRING_VERSION    2
+#define EIB_SHMRING_MAXREADERS 32
+
+/** per-reader control page */
+struct eib_shmring_reader
+{
+  /** set by the reader before it sleeps; cleared by knxd when signalling */
+  uint32_t waiting;
+  uint32_t reserved;
+};
+
+/** ring header, at offset 0 of the shared memory */
+struct eib_shmring_hdr
+{
+  uint32_t magic;
+  uint32_t version;
+  /** number of record slots, a power of two */
+  uint32_t slots;
+  /** size of one record in bytes */
+  uint32_t recsize;
+  /** offset of the first record */
+  uint32_t recoffset;
+  uint32_t reserved;
+  /** number of records published so far */
+  uint64_t head;
+  uint8_t pad[32];
+};
+
+/** one record; the data area extends to recsize */
+struct eib_shmring_rec
+{
+  /** odd: being written; else 2*(record number + 1) */
+  uint64_t seq;
+  /** CLOCK_REALTIME at which the driver received the frame */
+  uint32_t ts_sec;
+  uint32_t ts_nsec;
+  /** L_Busmonitor status byte */
+  uint8_t status;
+  uint8_t flags;
+  /** length of the frame; may exceed the space in the record */
+  uint16_t len;
+  uint8_t pad[4];
+  uint8_t data[];
+};
+
+/* readers in other languages rely on this */
+#ifdef __cplusplus
+static_assert (sizeof (struct eib_shmring_rec) == 24, "ring record header must be 24 bytes");
+#else
+_Static_assert (sizeof (struct eib_shmring_rec) == 24, "ring record header must be 24 bytes");
+#endif
+
+/** the record holds only the first part of the frame */
+#define EIB_SHMRING_TRUNCATED 0x01
+
+#endif
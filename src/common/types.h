@@ -165,6 +165,39 @@ public:
   }
 };
 
+/** read-only, non-owning view of octets, e.g. of a CArray or a frame buffer */
+class CSpan
+{
+public:
+  CSpan (const uint8_t *p, size_t n) : p(p), n(n) { }
+  CSpan (const CArray &c) : p(c.data()), n(c.size()) { }
+
+  size_t size () const
+  {
+    return n;
+  }
+  const uint8_t *data () const
+  {
+    return p;
+  }
+  uint8_t operator[] (size_t i) const
+  {
+    return p[i];
+  }
+  const uint8_t *begin () const
+  {
+    return p;
+  }
+  const uint8_t *end () const
+  {
+    return p + n;
+  }
+
+private:
+  const uint8_t *p;
+  size_t n;
+};
+
 template <typename To, typename From>
 std::unique_ptr<To>
 dynamic_unique_cast(std::unique_ptr<From>&& p)
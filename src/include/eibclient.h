@@ -92,6 +92,14 @@ int EIB_Poll_Complete (EIBConnection * con);
  */
 int EIB_Poll_FD (EIBConnection * con);
 
+/** Returns the number of messages knxd discarded for this connection
+ * because it did not read fast enough, and resets the count.
+ * Only servers with output-overflow=drop-oldest report this.
+ * \param con eibd connection
+ * \return number of lost messages, or -1 if error
+ */
+int EIBGetLostMessages (EIBConnection * con);
+
 /** Switches the connection to pristine state
  * \param con eibd connection
  * \return 0 if successful, -1 if error
@@ -180,6 +188,162 @@ int EIBOpenVBusmonitorTS (EIBConnection * con, uint32_t * timebase);
  */
 int EIBOpenVBusmonitorTS_async (EIBConnection * con, uint32_t * timebase);
 
+/** Switches the connection to batched binary busmonitor mode.
+ * All frames received in one go are delivered as one batch, see
+ * EIBGetBusmonitorBatch.
+ * \param con eibd connection
+ * \return 0 if successful, -1 if error
+ */
+int EIBOpenBusmonitorBatch (EIBConnection * con);
+
+/** Switches the connection to batched binary busmonitor mode - asynchronous.
+ * \param con eibd connection
+ * \return 0 if started, -1 if error
+ */
+int EIBOpenBusmonitorBatch_async (EIBConnection * con);
+
+/** Switches the connection to batched binary vbusmonitor mode.
+ * \param con eibd connection
+ * \return 0 if successful, -1 if error
+ */
+int EIBOpenVBusmonitorBatch (EIBConnection * con);
+
+/** Switches the connection to batched binary vbusmonitor mode - asynchronous.
+ * \param con eibd connection
+ * \return 0 if started, -1 if error
+ */
+int EIBOpenVBusmonitorBatch_async (EIBConnection * con);
+
+/** Switches the connection to binary busmonitor mode, delivering only
+ * the frames which match a filter expression.
+ * \param con eibd connection
+ * \param len length of the expression
+ * \param filter expression, e.g. "group && dst in 1/2/0-1/2/255 && apci == write"
+ * \return 0 if successful, -1 if error (EINVAL: knxd rejected the expression)
+ */
+int EIBOpenBusmonitorFilter (EIBConnection * con, int len,
+                             const uint8_t * filter);
+
+/** Switches the connection to filtered binary busmonitor mode - asynchronous.
+ * \param con eibd connection
+ * \param len length of the expression
+ * \param filter expression
+ * \return 0 if started, -1 if error
+ */
+int EIBOpenBusmonitorFilter_async (EIBConnection * con, int len,
+                                   const uint8_t * filter);
+
+/** Switches the connection to text busmonitor mode, delivering only
+ * the frames which match a filter expression.
+ * \param con eibd connection
+ * \param len length of the expression
+ * \param filter expression
+ * \return 0 if successful, -1 if error (EINVAL: knxd rejected the expression)
+ */
+int EIBOpenBusmonitorTextFilter (EIBConnection * con, int len,
+                                 const uint8_t * filter);
+
+/** Switches the connection to filtered text busmonitor mode - asynchronous.
+ * \param con eibd connection
+ * \param len length of the expression
+ * \param filter expression
+ * \return 0 if started, -1 if error
+ */
+int EIBOpenBusmonitorTextFilter_async (EIBConnection * con, int len,
+                                       const uint8_t * filter);
+
+/** Switches the connection to binary vbusmonitor mode, delivering only
+ * the frames which match a filter expression.
+ * \param con eibd connection
+ * \param len length of the expression
+ * \param filter expression
+ * \return 0 if successful, -1 if error (EINVAL: knxd rejected the expression)
+ */
+int EIBOpenVBusmonitorFilter (EIBConnection * con, int len,
+                              const uint8_t * filter);
+
+/** Switches the connection to filtered binary vbusmonitor mode - asynchronous.
+ * \param con eibd connection
+ * \param len length of the expression
+ * \param filter expression
+ * \return 0 if started, -1 if error
+ */
+int EIBOpenVBusmonitorFilter_async (EIBConnection * con, int len,
+                                    const uint8_t * filter);
+
+/** Switches the connection to text vbusmonitor mode, delivering only
+ * the frames which match a filter expression.
+ * \param con eibd connection
+ * \param len length of the expression
+ * \param filter expression
+ * \return 0 if successful, -1 if error (EINVAL: knxd rejected the expression)
+ */
+int EIBOpenVBusmonitorTextFilter (EIBConnection * con, int len,
+                                  const uint8_t * filter);
+
+/** Switches the connection to filtered text vbusmonitor mode - asynchronous.
+ * \param con eibd connection
+ * \param len length of the expression
+ * \param filter expression
+ * \return 0 if started, -1 if error
+ */
+int EIBOpenVBusmonitorTextFilter_async (EIBConnection * con, int len,
+                                        const uint8_t * filter);
+
+/** type represents the shared-memory vbusmonitor ring of a local connection */
+typedef struct _EIBShmRing EIBShmRing;
+
+/** Maps the shared-memory vbusmonitor ring of a local (Unix socket) connection.
+ * Frames are then read from the ring without any system call. The connection
+ * must stay open while the ring is in use.
+ * \param con eibd connection
+ * \return ring handle or NULL
+ */
+EIBShmRing *EIBOpenVBusmonitorShm (EIBConnection * con);
+
+/** Reads the next frame from the ring (non-blocking).
+ * Frames which are longer than a ring record are truncated.
+ * \param ring ring handle
+ * \param maxlen buffer size
+ * \param buf buffer
+ * \param status if not null, the L_Busmonitor status is stored here
+ * \param sec if not null, the receive time (seconds) is stored here
+ * \param nsec if not null, the receive time (nanoseconds) is stored here
+ * \return length of the frame, 0 if none is available, -1 if error
+ */
+int EIBShmRingGetPacket (EIBShmRing * ring, int maxlen, uint8_t * buf,
+                         uint8_t * status, uint32_t * sec, uint32_t * nsec);
+
+/** Arms the wakeup of the ring before polling on EIBShmRing_FD.
+ * \param ring ring handle
+ * \return 1 if data is available (do not sleep), 0 if armed, -1 if error
+ */
+int EIBShmRingPrepareWait (EIBShmRing * ring);
+
+/** Waits for the next frame.
+ * \param ring ring handle
+ * \param timeout in milliseconds, -1 for infinite
+ * \return 1 if data is available, 0 on timeout, -1 if error
+ */
+int EIBShmRingWait (EIBShmRing * ring, int timeout);
+
+/** Returns the FD which becomes readable once the ring has new data
+ * after EIBShmRingPrepareWait returned 0.
+ * \param ring ring handle
+ * \return -1 if any error, else file descriptor
+ */
+int EIBShmRing_FD (EIBShmRing * ring);
+
+/** Returns the number of frames which were overwritten before they could be read.
+ * \param ring ring handle
+ */
+uint64_t EIBShmRingLost (EIBShmRing * ring);
+
+/** Unmaps the ring.
+ * \param ring ring handle
+ */
+void EIBShmRingClose (EIBShmRing * ring);
+
 /** Receives a packet on a busmonitor connection.
  * \param con eibd connection
  * \param maxlen size of the buffer
@@ -200,6 +364,26 @@ int EIBGetBusmonitorPacketTS (EIBConnection * con, uint8_t * status,
                               uint32_t * timestamp, int maxlen,
                               uint8_t * buf);
 
+/** Receives a batch of packets on a batched busmonitor connection.
+ * The batch is a sequence of records, each consisting of a 2-byte length
+ * of the rest of the record, the busmonitor status byte, the reception
+ * time in ns since the epoch (8 bytes) and the packet; all values are
+ * big endian.
+ * \param con eibd connection
+ * \param maxlen size of the buffer
+ * \param buf buffer
+ * \return -1 if error, else length of the batch
+ */
+int EIBGetBusmonitorBatch (EIBConnection * con, int maxlen, uint8_t * buf);
+
+/** Receives a batch of packets on a batched busmonitor connection - asynchronous.
+ * \param con eibd connection
+ * \param maxlen size of the buffer
+ * \param buf buffer
+ * \return 0 if started, -1 if error
+ */
+int EIBGetBusmonitorBatch_async (EIBConnection * con, int maxlen, uint8_t * buf);
+
 /** Opens a connection of type T_Connection.
  * \param con eibd connection
  * \param dest destination address
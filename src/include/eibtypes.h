@@ -32,6 +32,7 @@
 #define EIB_PROCESSING_ERROR            0x0002
 #define EIB_CLOSED                      0x0003
 #define EIB_RESET_CONNECTION            0x0004
+#define EIB_MESSAGES_LOST               0x0005
 
 #define EIB_OPEN_BUSMONITOR             0x0010
 #define EIB_OPEN_BUSMONITOR_TEXT        0x0011
@@ -41,6 +42,10 @@
 #define EIB_BUSMONITOR_PACKET_TS        0x0015
 #define EIB_OPEN_BUSMONITOR_TS          0x0016
 #define EIB_OPEN_VBUSMONITOR_TS         0x0017
+#define EIB_OPEN_VBUSMONITOR_SHM        0x0018
+#define EIB_OPEN_BUSMONITOR_BATCH       0x0019
+#define EIB_OPEN_VBUSMONITOR_BATCH      0x001a
+#define EIB_BUSMONITOR_BATCH            0x001b
 
 #define EIB_OPEN_T_CONNECTION           0x0020
 #define EIB_OPEN_T_INDIVIDUAL           0x0021
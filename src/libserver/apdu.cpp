@@ -21,9 +21,140 @@
 
 #include <cstdio>
 #include <cstring>
+#include <new>
 
-APDUPtr
-APDU::fromPacket (const CArray & c, TracePtr tr)
+/*
+ * APCI dispatch: the list below maps each APCI to an APDU class; some
+ * services use the low bits of the APCI for data and so cover a range.
+ * It is expanded at compile time into a table with an entry per APCI
+ * that indexes apdu_makers.
+ *
+ * @todo A_SystemNetworkParameter_{Read,Response,Write} lie within the
+ * A_ADC_Response range (channel 0x08..0x0a), and aren't decoded yet.
+ */
+#define APDU_KINDS \
+  K (A_GroupValue_Read, 0) \
+  K (A_GroupValue_Response, 0x03F) \
+  K (A_GroupValue_Write, 0x03F) \
+  K (A_IndividualAddress_Write, 0) \
+  K (A_IndividualAddress_Read, 0) \
+  K (A_IndividualAddress_Response, 0) \
+  K (A_ADC_Read, 0x03F) \
+  K (A_ADC_Response, 0x03F) \
+  K (A_Memory_Read, 0x00F) \
+  K (A_Memory_Response, 0x00F) \
+  K (A_Memory_Write, 0x00F) \
+  K (A_UserMemory_Read, 0) \
+  K (A_UserMemory_Response, 0) \
+  K (A_UserMemory_Write, 0) \
+  K (A_UserMemoryBit_Write, 0) \
+  K (A_UserManufacturerInfo_Read, 0) \
+  K (A_UserManufacturerInfo_Response, 0) \
+  K (A_FunctionPropertyCommand, 0) \
+  K (A_FunctionPropertyState_Read, 0) \
+  K (A_FunctionPropertyState_Response, 0) \
+  K (A_DeviceDescriptor_Read, 0x03F) \
+  K (A_DeviceDescriptor_Response, 0x03F) \
+  K (A_Restart, 0x01F) \
+  K (A_Restart_Response, 0x01F) \
+  K (A_Open_Routing_Table_Request, 0) \
+  K (A_Read_Routing_Table_Request, 0) \
+  K (A_Read_Routing_Table_Response, 0) \
+  K (A_Write_Routing_Table_Request, 0) \
+  K (A_Read_Router_Memory_Request, 0) \
+  K (A_Read_Router_Memory_Response, 0) \
+  K (A_Write_Router_Memory_Request, 0) \
+  K (A_Read_Router_Status_Request, 0) \
+  K (A_Read_Router_Status_Response, 0) \
+  K (A_Write_Router_Status_Request, 0) \
+  K (A_MemoryBit_Write, 0) \
+  K (A_Authorize_Request, 0) \
+  K (A_Authorize_Response, 0) \
+  K (A_Key_Write, 0) \
+  K (A_Key_Response, 0) \
+  K (A_PropertyValue_Read, 0) \
+  K (A_PropertyValue_Response, 0) \
+  K (A_PropertyValue_Write, 0) \
+  K (A_PropertyDescription_Read, 0) \
+  K (A_PropertyDescription_Response, 0) \
+  K (A_NetworkParameter_Read, 0) \
+  K (A_NetworkParameter_Response, 0) \
+  K (A_IndividualAddressSerialNumber_Read, 0) \
+  K (A_IndividualAddressSerialNumber_Response, 0) \
+  K (A_IndividualAddressSerialNumber_Write, 0) \
+  K (A_ServiceInformation_Indication_Write, 0) \
+  K (A_DomainAddress_Write, 0) \
+  K (A_DomainAddress_Read, 0) \
+  K (A_DomainAddress_Response, 0) \
+  K (A_DomainAddressSelective_Read, 0) \
+  K (A_NetworkParameter_Write, 0) \
+  K (A_Link_Read, 0) \
+  K (A_Link_Response, 0) \
+  K (A_Link_Write, 0) \
+  K (A_GroupPropValue_Read, 0) \
+  K (A_GroupPropValue_Response, 0) \
+  K (A_GroupPropValue_Write, 0) \
+  K (A_GroupPropValue_InfoReport, 0) \
+  K (A_DomainAddressSerialNumber_Read, 0) \
+  K (A_DomainAddressSerialNumber_Response, 0) \
+  K (A_DomainAddressSerialNumber_Write, 0) \
+  K (A_FileStream_InfoReport, 0) \
+
+enum APDU_kind : uint8_t
+{
+  K_Unknown,
+#define K(type, range) K_##type,
+  APDU_KINDS
+#undef K
+};
+
+static constexpr uint8_t
+apdu_kind (uint16_t apci)
+{
+#define K(type, range) (apci & ~range) == type ? K_##type :
+  return APDU_KINDS K_Unknown;
+#undef K
+}
+
+#define APCI_1(n) apdu_kind (n)
+#define APCI_4(n) APCI_1 (n), APCI_1 (n + 1), APCI_1 (n + 2), APCI_1 (n + 3)
+#define APCI_16(n) APCI_4 (n), APCI_4 (n + 4), APCI_4 (n + 8), APCI_4 (n + 12)
+#define APCI_64(n) APCI_16 (n), APCI_16 (n + 16), APCI_16 (n + 32), APCI_16 (n + 48)
+#define APCI_256(n) APCI_64 (n), APCI_64 (n + 64), APCI_64 (n + 128), APCI_64 (n + 192)
+
+static constexpr uint8_t apci_kinds[1024] =
+{
+  APCI_256 (0), APCI_256 (256), APCI_256 (512), APCI_256 (768)
+};
+
+#undef APCI_1
+#undef APCI_4
+#undef APCI_16
+#undef APCI_64
+#undef APCI_256
+
+/** construct a T in @where, or on the heap if that's nullptr */
+template<class T>
+static APDU *
+make_apdu (void *where)
+{
+  static_assert (sizeof (T) <= APDUBuf::SIZE, "APDUBuf is too small");
+  static_assert (alignof (T) <= alignof (std::max_align_t), "APDUBuf is misaligned");
+  if (where)
+    return new (where) T ();
+  return new T ();
+}
+
+static APDU *(* const apdu_makers[]) (void *) =
+{
+  make_apdu<A_Unknown_PDU>,
+#define K(type, range) make_apdu<type##_PDU>,
+  APDU_KINDS
+#undef K
+};
+
+static APDU *
+make_apdu (const CSpan & c, void *where, TracePtr tr)
 {
   /* @todo provide additional parameter or split function to differentiate:
    * - multicast
@@ -32,244 +163,81 @@ APDU::fromPacket (const CArray & c, TracePtr tr)
    * - p2p connectionless
    * - p2p connection-oriented
    */
-  APDUPtr a;
   if (c.size() >= 2)
     {
       uint16_t apci = ((c[0] & 0x03) << 8) | c[1];
-      switch (apci)
+      uint8_t kind = apci_kinds[apci];
+      if (kind != K_Unknown)
         {
-        case A_GroupValue_Read:
-          a = APDUPtr(new A_GroupValue_Read_PDU ());
-          break;
-        case A_GroupValue_Response ... A_GroupValue_Response | 0x03F:
-          a = APDUPtr(new A_GroupValue_Response_PDU ());
-          break;
-        case A_GroupValue_Write ... A_GroupValue_Write | 0x03F:
-          a = APDUPtr(new A_GroupValue_Write_PDU ());
-          break;
-        case A_IndividualAddress_Write:
-          a = APDUPtr(new A_IndividualAddress_Write_PDU ());
-          break;
-        case A_IndividualAddress_Read:
-          a = APDUPtr(new A_IndividualAddress_Read_PDU ());
-          break;
-        case A_IndividualAddress_Response:
-          a = APDUPtr(new A_IndividualAddress_Response_PDU ());
-          break;
-        case A_ADC_Read ... A_ADC_Read | 0x03F:
-          a = APDUPtr(new A_ADC_Read_PDU ());
-          break;
-        case A_ADC_Response ... A_ADC_Response | 0x03F:
-          a = APDUPtr(new A_ADC_Response_PDU ());
-          break;
-        /* @todo
-        case A_SystemNetworkParameter_Read: // same as A_ADC_Response with channel_nr=0x80
-          a = APDUPtr(new A_SystemNetworkParameter_Read_PDU ());
-          break;
-        case A_SystemNetworkParameter_Response: // same as A_ADC_Response with channel_nr=0x81
-          a = APDUPtr(new A_SystemNetworkParameter_Response_PDU ());
-          break;
-        case A_SystemNetworkParameter_Write: // same as A_ADC_Response with channel_nr=0x82
-          a = APDUPtr(new A_SystemNetworkParameter_Write_PDU ());
-          break;
-        */
-        case A_Memory_Read ... A_Memory_Read | 0x00F:
-          a = APDUPtr(new A_Memory_Read_PDU ());
-          break;
-        case A_Memory_Response ... A_Memory_Response | 0x00F:
-          a = APDUPtr(new A_Memory_Response_PDU ());
-          break;
-        case A_Memory_Write ... A_Memory_Write | 0x00F:
-          a = APDUPtr(new A_Memory_Write_PDU ());
-          break;
-        case A_UserMemory_Read:
-          a = APDUPtr(new A_UserMemory_Read_PDU ());
-          break;
-        case A_UserMemory_Response:
-          a = APDUPtr(new A_UserMemory_Response_PDU ());
-          break;
-        case A_UserMemory_Write:
-          a = APDUPtr(new A_UserMemory_Write_PDU ());
-          break;
-        case A_UserMemoryBit_Write:
-          a = APDUPtr(new A_UserMemoryBit_Write_PDU ());
-          break;
-        case A_UserManufacturerInfo_Read:
-          a = APDUPtr(new A_UserManufacturerInfo_Read_PDU ());
-          break;
-        case A_UserManufacturerInfo_Response:
-          a = APDUPtr(new A_UserManufacturerInfo_Response_PDU ());
-          break;
-        case A_FunctionPropertyCommand:
-          a = APDUPtr(new A_FunctionPropertyCommand_PDU ());
-          break;
-        case A_FunctionPropertyState_Read:
-          a = APDUPtr(new A_FunctionPropertyState_Read_PDU ());
-          break;
-        case A_FunctionPropertyState_Response:
-          a = APDUPtr(new A_FunctionPropertyState_Response_PDU ());
-          break;
-        case A_DeviceDescriptor_Read ... A_DeviceDescriptor_Read | 0x03F:
-          a = APDUPtr(new A_DeviceDescriptor_Read_PDU ());
-          break;
-        case A_DeviceDescriptor_Response ... A_DeviceDescriptor_Response | 0x03F:
-          a = APDUPtr(new A_DeviceDescriptor_Response_PDU ());
-          break;
-        case A_Restart ... A_Restart | 0x01F:
-          a = APDUPtr(new A_Restart_PDU ());
-          break;
-        case A_Restart_Response ... A_Restart_Response | 0x01F:
-          a = APDUPtr(new A_Restart_Response_PDU ());
-          break;
-        case A_Open_Routing_Table_Request:
-          a = APDUPtr(new A_Open_Routing_Table_Request_PDU ());
-          break;
-        case A_Read_Routing_Table_Request:
-          a = APDUPtr(new A_Read_Routing_Table_Request_PDU ());
-          break;
-        case A_Read_Routing_Table_Response:
-          a = APDUPtr(new A_Read_Routing_Table_Response_PDU ());
-          break;
-        case A_Write_Routing_Table_Request:
-          a = APDUPtr(new A_Write_Routing_Table_Request_PDU ());
-          break;
-        case A_Read_Router_Memory_Request:
-          a = APDUPtr(new A_Read_Router_Memory_Request_PDU ());
-          break;
-        case A_Read_Router_Memory_Response:
-          a = APDUPtr(new A_Read_Router_Memory_Response_PDU ());
-          break;
-        case A_Write_Router_Memory_Request:
-          a = APDUPtr(new A_Write_Router_Memory_Request_PDU ());
-          break;
-        case A_Read_Router_Status_Request:
-          a = APDUPtr(new A_Read_Router_Status_Request_PDU ());
-          break;
-        case A_Read_Router_Status_Response:
-          a = APDUPtr(new A_Read_Router_Status_Response_PDU ());
-          break;
-        case A_Write_Router_Status_Request:
-          a = APDUPtr(new A_Write_Router_Status_Request_PDU ());
-          break;
-        case A_MemoryBit_Write:
-          a = APDUPtr(new A_MemoryBit_Write_PDU ());
-          break;
-        case A_Authorize_Request:
-          a = APDUPtr(new A_Authorize_Request_PDU ());
-          break;
-        case A_Authorize_Response:
-          a = APDUPtr(new A_Authorize_Response_PDU ());
-          break;
-        case A_Key_Write:
-          a = APDUPtr(new A_Key_Write_PDU ());
-          break;
-        case A_Key_Response:
-          a = APDUPtr(new A_Key_Response_PDU ());
-          break;
-        case A_PropertyValue_Read:
-          a = APDUPtr(new A_PropertyValue_Read_PDU ());
-          break;
-        case A_PropertyValue_Response:
-          a = APDUPtr(new A_PropertyValue_Response_PDU ());
-          break;
-        case A_PropertyValue_Write:
-          a = APDUPtr(new A_PropertyValue_Write_PDU ());
-          break;
-        case A_PropertyDescription_Read:
-          a = APDUPtr(new A_PropertyDescription_Read_PDU ());
-          break;
-        case A_PropertyDescription_Response:
-          a = APDUPtr(new A_PropertyDescription_Response_PDU ());
-          break;
-        case A_NetworkParameter_Read:
-          a = APDUPtr(new A_NetworkParameter_Read_PDU ());
-          break;
-        case A_NetworkParameter_Response:
-          a = APDUPtr(new A_NetworkParameter_Response_PDU ());
-          break;
-        case A_IndividualAddressSerialNumber_Read:
-          a = APDUPtr(new A_IndividualAddressSerialNumber_Read_PDU ());
-          break;
-        case A_IndividualAddressSerialNumber_Response:
-          a = APDUPtr(new A_IndividualAddressSerialNumber_Response_PDU ());
-          break;
-        case A_IndividualAddressSerialNumber_Write:
-          a = APDUPtr(new A_IndividualAddressSerialNumber_Write_PDU ());
-          break;
-        case A_ServiceInformation_Indication_Write:
-          a = APDUPtr(new A_ServiceInformation_Indication_Write_PDU ());
-          break;
-        case A_DomainAddress_Write:
-          a = APDUPtr(new A_DomainAddress_Write_PDU ());
-          break;
-        case A_DomainAddress_Read:
-          a = APDUPtr(new A_DomainAddress_Read_PDU ());
-          break;
-        case A_DomainAddress_Response:
-          a = APDUPtr(new A_DomainAddress_Response_PDU ());
-          break;
-        case A_DomainAddressSelective_Read:
-          a = APDUPtr(new A_DomainAddressSelective_Read_PDU ());
-          break;
-        case A_NetworkParameter_Write:
-          a = APDUPtr(new A_NetworkParameter_Write_PDU ());
-          break;
-        case A_Link_Read:
-          a = APDUPtr(new A_Link_Read_PDU ());
-          break;
-        case A_Link_Response:
-          a = APDUPtr(new A_Link_Response_PDU ());
-          break;
-        case A_Link_Write:
-          a = APDUPtr(new A_Link_Write_PDU ());
-          break;
-        case A_GroupPropValue_Read:
-          a = APDUPtr(new A_GroupPropValue_Read_PDU ());
-          break;
-        case A_GroupPropValue_Response:
-          a = APDUPtr(new A_GroupPropValue_Response_PDU ());
-          break;
-        case A_GroupPropValue_Write:
-          a = APDUPtr(new A_GroupPropValue_Write_PDU ());
-          break;
-        case A_GroupPropValue_InfoReport:
-          a = APDUPtr(new A_GroupPropValue_InfoReport_PDU ());
-          break;
-        case A_DomainAddressSerialNumber_Read:
-          a = APDUPtr(new A_DomainAddressSerialNumber_Read_PDU ());
-          break;
-        case A_DomainAddressSerialNumber_Response:
-          a = APDUPtr(new A_DomainAddressSerialNumber_Response_PDU ());
-          break;
-        case A_DomainAddressSerialNumber_Write:
-          a = APDUPtr(new A_DomainAddressSerialNumber_Write_PDU ());
-          break;
-        case A_FileStream_InfoReport:
-          a = APDUPtr(new A_FileStream_InfoReport_PDU ());
-          break;
-        default:
-          break;
+          APDU *a = apdu_makers[kind] (where);
+          if (a->init (c, tr))
+            return a;
+          if (where)
+            a->~APDU ();
+          else
+            delete a;
         }
     }
-  if (a && a->init (c, tr))
-    return a;
-  a = APDUPtr(new A_Unknown_PDU);
+  APDU *a = make_apdu<A_Unknown_PDU> (where);
   a->init (c, tr);
   return a;
 }
 
+APDUPtr
+APDU::fromPacket (const CSpan & c, TracePtr tr)
+{
+  return APDUPtr (make_apdu (c, nullptr, tr));
+}
+
+APDU *
+APDU::decode (const CSpan & c, APDUBuf & buf, TracePtr tr)
+{
+  buf.reset ();
+  buf.apdu = make_apdu (c, buf.mem, tr);
+  return buf.apdu;
+}
+
+CArray
+APDU::ToPacket () const
+{
+  CArray pdu;
+  ToPacket (pdu);
+  return pdu;
+}
+
+void
+APDU::ToPacket (CArray & pdu, uint8_t tpci) const
+{
+  PDUWriter w (pdu);
+  encode (w);
+  if (pdu.size())
+    pdu[0] |= tpci;
+}
+
+size_t
+APDU::ToPacket (uint8_t *buf, size_t max, uint8_t tpci) const
+{
+  PDUWriter w (buf, max);
+  encode (w);
+  if (!w.fits () || !w.size ())
+    return 0;
+  buf[0] |= tpci;
+  return w.size ();
+}
+
 /* A_Unknown_PDU */
 
 bool
-A_Unknown_PDU::init (const CArray & c, TracePtr)
+A_Unknown_PDU::init (const CSpan & c, TracePtr)
 {
-  pdu = c;
+  pdu.set (c.data(), c.size());
   return true;
 }
 
-CArray A_Unknown_PDU::ToPacket () const
+void
+A_Unknown_PDU::encode (PDUWriter & w) const
 {
-  return pdu;
+  w.setpart (pdu.data(), 0, pdu.size());
 }
 
 std::string A_Unknown_PDU::Decode (TracePtr) const
@@ -292,20 +260,19 @@ bool A_Unknown_PDU::isResponse (const APDU *) const
 /* A_GroupValue_Read */
 
 bool
-A_GroupValue_Read_PDU::init (const CArray & c, TracePtr)
+A_GroupValue_Read_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 2)
     return false;
   return true;
 }
 
-CArray A_GroupValue_Read_PDU::ToPacket () const
+void
+A_GroupValue_Read_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(2);
   pdu[0] = A_GroupValue_Read >> 8;
   pdu[1] = A_GroupValue_Read & 0xff;
-  return pdu;
 }
 
 std::string A_GroupValue_Read_PDU::Decode (TracePtr) const
@@ -321,7 +288,7 @@ bool A_GroupValue_Read_PDU::isResponse (const APDU *) const
 /* A_GroupValue_Response */
 
 bool
-A_GroupValue_Response_PDU::init (const CArray & c, TracePtr)
+A_GroupValue_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 2)
     return false;
@@ -339,11 +306,11 @@ A_GroupValue_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray A_GroupValue_Response_PDU::ToPacket () const
+void
+A_GroupValue_Response_PDU::encode (PDUWriter & pdu) const
 {
   assert (!issmall || (data.size() == 1 && (data[0] & 0xC0) == 0));
 
-  CArray pdu;
   pdu.resize (2);
   pdu[0] = A_GroupValue_Response >> 8;
   pdu[1] = A_GroupValue_Response & 0xc0;
@@ -356,7 +323,6 @@ CArray A_GroupValue_Response_PDU::ToPacket () const
       pdu.resize (2 + data.size());
       pdu.setpart (data.data(), 2, data.size());
     }
-  return pdu;
 }
 
 std::string A_GroupValue_Response_PDU::Decode (TracePtr) const
@@ -381,7 +347,7 @@ bool A_GroupValue_Response_PDU::isResponse (const APDU * req) const
 /* A_GroupValue_Write */
 
 bool
-A_GroupValue_Write_PDU::init (const CArray & c, TracePtr)
+A_GroupValue_Write_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 2)
     return false;
@@ -399,14 +365,14 @@ A_GroupValue_Write_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray A_GroupValue_Write_PDU::ToPacket () const
+void
+A_GroupValue_Write_PDU::encode (PDUWriter & pdu) const
 {
   assert (!issmall || (data.size() == 1 && (data[0] & 0xC0) == 0));
 
-  CArray pdu;
   pdu.resize (2);
-  pdu[0] = A_GroupValue_Response >> 8;
-  pdu[1] = A_GroupValue_Response & 0xc0;
+  pdu[0] = A_GroupValue_Write >> 8;
+  pdu[1] = A_GroupValue_Write & 0xc0;
   if (issmall)
     {
       pdu[1] |= data[0] & 0x3F;
@@ -416,7 +382,6 @@ CArray A_GroupValue_Write_PDU::ToPacket () const
       pdu.resize (2 + data.size());
       pdu.setpart (data.data(), 2, data.size());
     }
-  return pdu;
 }
 
 std::string A_GroupValue_Write_PDU::Decode (TracePtr) const
@@ -439,7 +404,7 @@ bool A_GroupValue_Write_PDU::isResponse (const APDU *) const
 /* A_IndividualAddress_Write */
 
 bool
-A_IndividualAddress_Write_PDU::init (const CArray & c, TracePtr)
+A_IndividualAddress_Write_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 4)
     return false;
@@ -448,15 +413,14 @@ A_IndividualAddress_Write_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray A_IndividualAddress_Write_PDU::ToPacket () const
+void
+A_IndividualAddress_Write_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (4);
   pdu[0] = A_IndividualAddress_Write >> 8;
   pdu[1] = A_IndividualAddress_Write & 0xff;
   pdu[2] = newaddress >> 8;
   pdu[3] = newaddress & 0xff;
-  return pdu;
 }
 
 std::string A_IndividualAddress_Write_PDU::Decode (TracePtr) const
@@ -473,20 +437,19 @@ bool A_IndividualAddress_Write_PDU::isResponse (const APDU *) const
 /* A_IndividualAddress_Read */
 
 bool
-A_IndividualAddress_Read_PDU::init (const CArray & c, TracePtr)
+A_IndividualAddress_Read_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 2)
     return false;
   return true;
 }
 
-CArray A_IndividualAddress_Read_PDU::ToPacket () const
+void
+A_IndividualAddress_Read_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(2);
   pdu[0] = A_IndividualAddress_Read >> 8;
   pdu[1] = A_IndividualAddress_Read & 0xff;
-  return pdu;
 }
 
 std::string A_IndividualAddress_Read_PDU::Decode (TracePtr) const
@@ -501,7 +464,7 @@ bool A_IndividualAddress_Read_PDU::isResponse (const APDU *) const
 
 /* A_IndividualAddress_Response */
 
-bool A_IndividualAddress_Response_PDU::init (const CArray & c, TracePtr tr)
+bool A_IndividualAddress_Response_PDU::init (const CSpan & c, TracePtr tr)
 {
   if (c.size() != 2)
     {
@@ -511,13 +474,12 @@ bool A_IndividualAddress_Response_PDU::init (const CArray & c, TracePtr tr)
   return true;
 }
 
-CArray A_IndividualAddress_Response_PDU::ToPacket () const
+void
+A_IndividualAddress_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(2);
   pdu[0] = A_IndividualAddress_Response >> 8;
   pdu[1] = A_IndividualAddress_Response & 0xff;
-  return pdu;
 }
 
 std::string A_IndividualAddress_Response_PDU::Decode (TracePtr) const
@@ -535,7 +497,7 @@ bool A_IndividualAddress_Response_PDU::isResponse (const APDU * req) const
 /* A_ADC_Read */
 
 bool
-A_ADC_Read_PDU::init (const CArray & c, TracePtr)
+A_ADC_Read_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 3)
     return false;
@@ -545,17 +507,15 @@ A_ADC_Read_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_ADC_Read_PDU::ToPacket () const
+void
+A_ADC_Read_PDU::encode (PDUWriter & pdu) const
 {
   assert ((channel_nr & 0xC0) == 0);
 
-  CArray pdu;
   pdu.resize (3);
   pdu[0] = A_ADC_Read >> 8;
   pdu[1] = (A_ADC_Read & 0xc0) | (channel_nr & 0x3F);
   pdu[2] = read_count;
-  return pdu;
 }
 
 std::string
@@ -578,7 +538,7 @@ bool A_ADC_Read_PDU::isResponse (const APDU *) const
 /* A_ADC_Response */
 
 bool
-A_ADC_Response_PDU::init (const CArray & c, TracePtr)
+A_ADC_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 5)
     return false;
@@ -589,19 +549,17 @@ A_ADC_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_ADC_Response_PDU::ToPacket () const
+void
+A_ADC_Response_PDU::encode (PDUWriter & pdu) const
 {
   assert ((channel_nr & 0xC0) == 0);
 
-  CArray pdu;
   pdu.resize (5);
-  pdu[0] = A_ADC_Read >> 8;
-  pdu[1] = (A_ADC_Read & 0xc0) | (channel_nr & 0x3F);
+  pdu[0] = A_ADC_Response >> 8;
+  pdu[1] = (A_ADC_Response & 0xc0) | (channel_nr & 0x3F);
   pdu[2] = read_count;
   pdu[3] = sum >> 8;
   pdu[4] = sum & 0xff;
-  return pdu;
 }
 
 std::string
@@ -633,7 +591,7 @@ bool A_ADC_Response_PDU::isResponse (const APDU * req) const
 /* A_SystemNetworkParameter_Read */
 
 bool
-A_SystemNetworkParameter_Read_PDU::init (const CArray & c, TracePtr)
+A_SystemNetworkParameter_Read_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 5)
     return false;
@@ -641,15 +599,13 @@ A_SystemNetworkParameter_Read_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_SystemNetworkParameter_Read_PDU::ToPacket () const
+void
+A_SystemNetworkParameter_Read_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(2);
   pdu[0] = A_SystemNetworkParameter_Read >> 8;
   pdu[1] = A_SystemNetworkParameter_Read & 0xff;
   // @todo
-  return pdu;
 }
 
 std::string
@@ -668,7 +624,7 @@ bool A_SystemNetworkParameter_Read_PDU::isResponse (const APDU *) const
 /* A_SystemNetworkParameter_Response */
 
 bool
-A_SystemNetworkParameter_Response_PDU::init (const CArray & c, TracePtr)
+A_SystemNetworkParameter_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 5)
     return false;
@@ -676,15 +632,13 @@ A_SystemNetworkParameter_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_SystemNetworkParameter_Response_PDU::ToPacket () const
+void
+A_SystemNetworkParameter_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(2);
   pdu[0] = A_SystemNetworkParameter_Response >> 8;
   pdu[1] = A_SystemNetworkParameter_Response & 0xff;
   // @todo
-  return pdu;
 }
 
 std::string
@@ -705,7 +659,7 @@ bool A_SystemNetworkParameter_Response_PDU::isResponse (const APDU * req) const
 /* A_SystemNetworkParameter_Write */
 
 bool
-A_SystemNetworkParameter_Write_PDU::init (const CArray & c, TracePtr)
+A_SystemNetworkParameter_Write_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 6)
     return false;
@@ -713,15 +667,13 @@ A_SystemNetworkParameter_Write_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_SystemNetworkParameter_Write_PDU::ToPacket () const
+void
+A_SystemNetworkParameter_Write_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(2);
   pdu[0] = A_SystemNetworkParameter_Write >> 8;
   pdu[1] = A_SystemNetworkParameter_Write & 0xff;
   // @todo
-  return pdu;
 }
 
 std::string
@@ -740,7 +692,7 @@ bool A_SystemNetworkParameter_Write_PDU::isResponse (const APDU *) const
 /* A_Memory_Read */
 
 bool
-A_Memory_Read_PDU::init (const CArray & c, TracePtr)
+A_Memory_Read_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 4)
     return false;
@@ -750,18 +702,16 @@ A_Memory_Read_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Memory_Read_PDU::ToPacket () const
+void
+A_Memory_Read_PDU::encode (PDUWriter & pdu) const
 {
   assert ((number & 0xf0) == 0);
 
-  CArray pdu;
   pdu.resize (4);
   pdu[0] = A_Memory_Read >> 8;
   pdu[1] = (A_Memory_Read & 0xf0) | (number & 0x0f);
   pdu[2] = address >> 8;
   pdu[3] = address & 0xff;
-  return pdu;
 }
 
 std::string
@@ -784,7 +734,7 @@ bool A_Memory_Read_PDU::isResponse (const APDU *) const
 /* A_Memory_Response */
 
 bool
-A_Memory_Response_PDU::init (const CArray & c, TracePtr)
+A_Memory_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 4)
     return false;
@@ -797,20 +747,18 @@ A_Memory_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Memory_Response_PDU::ToPacket () const
+void
+A_Memory_Response_PDU::encode (PDUWriter & pdu) const
 {
   assert ((number & 0xf0) == 0);
   assert (data.size() == number);
 
-  CArray pdu;
   pdu.resize (4 + data.size());
   pdu[0] = A_Memory_Response >> 8;
   pdu[1] = (A_Memory_Response & 0xf0) | (number & 0x0f);
   pdu[2] = address >> 8;
   pdu[3] = address & 0xff;
   pdu.setpart (data.data(), 4, data.size());
-  return pdu;
 }
 
 std::string
@@ -845,7 +793,7 @@ bool A_Memory_Response_PDU::isResponse (const APDU * req) const
 /* A_Memory_Write */
 
 bool
-A_Memory_Write_PDU::init (const CArray & c, TracePtr)
+A_Memory_Write_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 4)
     return false;
@@ -858,20 +806,18 @@ A_Memory_Write_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Memory_Write_PDU::ToPacket () const
+void
+A_Memory_Write_PDU::encode (PDUWriter & pdu) const
 {
   assert ((number & 0xf0) == 0);
   assert (data.size() == number);
 
-  CArray pdu;
   pdu.resize (4 + data.size());
   pdu[0] = A_Memory_Write >> 8;
   pdu[1] = (A_Memory_Write & 0xf0) | (number & 0x0f);
   pdu[2] = address >> 8;
   pdu[3] = address & 0xff;
   pdu.setpart (data.data(), 4, data.size());
-  return pdu;
 }
 
 std::string
@@ -898,7 +844,7 @@ bool A_Memory_Write_PDU::isResponse (const APDU *) const
 /* A_UserMemory_Read */
 
 bool
-A_UserMemory_Read_PDU::init (const CArray & c, TracePtr)
+A_UserMemory_Read_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 5)
     return false;
@@ -909,20 +855,18 @@ A_UserMemory_Read_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_UserMemory_Read_PDU::ToPacket () const
+void
+A_UserMemory_Read_PDU::encode (PDUWriter & pdu) const
 {
   assert ((address_extension & 0xf0) == 0);
   assert ((number & 0xf0) == 0);
 
-  CArray pdu;
   pdu.resize (5);
   pdu[0] = A_UserMemory_Read >> 8;
   pdu[1] = A_UserMemory_Read & 0xff;
   pdu[2] = (address_extension & 0x0f) << 4 | (number & 0x0f);
   pdu[3] = address >> 8;
   pdu[4] = address & 0xff;
-  return pdu;
 }
 
 std::string
@@ -948,7 +892,7 @@ bool A_UserMemory_Read_PDU::isResponse (const APDU *) const
 /* A_UserMemory_Response */
 
 bool
-A_UserMemory_Response_PDU::init (const CArray & c, TracePtr)
+A_UserMemory_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 5)
     return false;
@@ -962,14 +906,13 @@ A_UserMemory_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_UserMemory_Response_PDU::ToPacket () const
+void
+A_UserMemory_Response_PDU::encode (PDUWriter & pdu) const
 {
   assert ((address_extension & 0xf0) == 0);
   assert ((number & 0xf0) == 0);
   assert (data.size() == number);
 
-  CArray pdu;
   pdu.resize (5 + data.size());
   pdu[0] = A_UserMemory_Response >> 8;
   pdu[1] = A_UserMemory_Response & 0xff;
@@ -977,7 +920,6 @@ A_UserMemory_Response_PDU::ToPacket () const
   pdu[3] = address >> 8;
   pdu[4] = address & 0xff;
   pdu.setpart (data.data(), 5, data.size());
-  return pdu;
 }
 
 std::string
@@ -1017,7 +959,7 @@ bool A_UserMemory_Response_PDU::isResponse (const APDU * req) const
 /* A_UserMemory_Write */
 
 bool
-A_UserMemory_Write_PDU::init (const CArray & c, TracePtr)
+A_UserMemory_Write_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 5)
     return false;
@@ -1031,14 +973,13 @@ A_UserMemory_Write_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_UserMemory_Write_PDU::ToPacket () const
+void
+A_UserMemory_Write_PDU::encode (PDUWriter & pdu) const
 {
   assert ((address_extension & 0xf0) == 0);
   assert ((number & 0xf0) == 0);
   assert (data.size() == number);
 
-  CArray pdu;
   pdu.resize (5 + data.size());
   pdu[0] = A_UserMemory_Write >> 8;
   pdu[1] = A_UserMemory_Write & 0xff;
@@ -1046,7 +987,6 @@ A_UserMemory_Write_PDU::ToPacket () const
   pdu[3] = address >> 8;
   pdu[4] = address & 0xff;
   pdu.setpart (data.data(), 5, data.size());
-  return pdu;
 }
 
 std::string
@@ -1076,7 +1016,7 @@ bool A_UserMemory_Write_PDU::isResponse (const APDU *) const
 /* A_UserMemoryBit_Write */
 
 bool
-A_UserMemoryBit_Write_PDU::init (const CArray & c, TracePtr)
+A_UserMemoryBit_Write_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 5)
     return false;
@@ -1090,13 +1030,12 @@ A_UserMemoryBit_Write_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_UserMemoryBit_Write_PDU::ToPacket () const
+void
+A_UserMemoryBit_Write_PDU::encode (PDUWriter & pdu) const
 {
   assert (and_data.size() == number);
   assert (xor_data.size() == number);
 
-  CArray pdu;
   pdu.resize (5 + 2 * number);
   pdu[0] = A_UserMemoryBit_Write >> 8;
   pdu[1] = A_UserMemoryBit_Write & 0xff;
@@ -1105,7 +1044,6 @@ A_UserMemoryBit_Write_PDU::ToPacket () const
   pdu[4] = address & 0xff;
   pdu.setpart (and_data.data(), 5, number);
   pdu.setpart (xor_data.data(), 5 + number, number);
-  return pdu;
 }
 
 std::string
@@ -1134,21 +1072,19 @@ bool A_UserMemoryBit_Write_PDU::isResponse (const APDU *) const
 
 /* A_UserManufacturerInfo_Read */
 
-bool A_UserManufacturerInfo_Read_PDU::init (const CArray & c, TracePtr)
+bool A_UserManufacturerInfo_Read_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 2)
     return false;
   return true;
 }
 
-CArray
-A_UserManufacturerInfo_Read_PDU::ToPacket () const
+void
+A_UserManufacturerInfo_Read_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (2);
   pdu[0] = A_UserManufacturerInfo_Read >> 8;
   pdu[1] = A_UserManufacturerInfo_Read & 0xff;
-  return pdu;
 }
 
 std::string
@@ -1166,7 +1102,7 @@ bool A_UserManufacturerInfo_Read_PDU::isResponse (const APDU *) const
 /* A_UserManufacturerInfo_Response */
 
 bool
-A_UserManufacturerInfo_Response_PDU::init (const CArray & c, TracePtr)
+A_UserManufacturerInfo_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 5)
     return false;
@@ -1176,17 +1112,15 @@ A_UserManufacturerInfo_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_UserManufacturerInfo_Response_PDU::ToPacket () const
+void
+A_UserManufacturerInfo_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (5);
   pdu[0] = A_UserManufacturerInfo_Response >> 8;
   pdu[1] = A_UserManufacturerInfo_Response & 0xff;
   pdu[2] = manufacturer_id;
   pdu[3] = manufacturer_data >> 8;
   pdu[4] = manufacturer_data & 0xff;
-  return pdu;
 }
 
 std::string
@@ -1209,7 +1143,7 @@ bool A_UserManufacturerInfo_Response_PDU::isResponse (const APDU * req) const
 /* A_FunctionPropertyCommand */
 
 bool
-A_FunctionPropertyCommand_PDU::init (const CArray & c, TracePtr)
+A_FunctionPropertyCommand_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 4)
     return false;
@@ -1220,17 +1154,15 @@ A_FunctionPropertyCommand_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_FunctionPropertyCommand_PDU::ToPacket () const
+void
+A_FunctionPropertyCommand_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(4 + data.size());
   pdu[0] = A_FunctionPropertyCommand >> 8;
   pdu[1] = A_FunctionPropertyCommand & 0xff;
   pdu[2] = object_index;
   pdu[3] = property_id;
   pdu.setpart (data.data(), 4, data.size());
-  return pdu;
 }
 
 std::string
@@ -1249,7 +1181,7 @@ bool A_FunctionPropertyCommand_PDU::isResponse (const APDU *) const
 /* A_FunctionPropertyState_Read */
 
 bool
-A_FunctionPropertyState_Read_PDU::init (const CArray & c, TracePtr)
+A_FunctionPropertyState_Read_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 4)
     return false;
@@ -1260,17 +1192,15 @@ A_FunctionPropertyState_Read_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_FunctionPropertyState_Read_PDU::ToPacket () const
+void
+A_FunctionPropertyState_Read_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(4 + data.size());
   pdu[0] = A_FunctionPropertyState_Read >> 8;
   pdu[1] = A_FunctionPropertyState_Read & 0xff;
   pdu[2] = object_index;
   pdu[3] = property_id;
   pdu.setpart (data.data(), 4, data.size());
-  return pdu;
 }
 
 std::string
@@ -1289,7 +1219,7 @@ bool A_FunctionPropertyState_Read_PDU::isResponse (const APDU *) const
 /* A_FunctionPropertyState_Response */
 
 bool
-A_FunctionPropertyState_Response_PDU::init (const CArray & c, TracePtr)
+A_FunctionPropertyState_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 5)
     return false;
@@ -1301,10 +1231,9 @@ A_FunctionPropertyState_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_FunctionPropertyState_Response_PDU::ToPacket () const
+void
+A_FunctionPropertyState_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(5 + data.size());
   pdu[0] = A_FunctionPropertyState_Response >> 8;
   pdu[1] = A_FunctionPropertyState_Response & 0xff;
@@ -1312,7 +1241,6 @@ A_FunctionPropertyState_Response_PDU::ToPacket () const
   pdu[3] = property_id;
   pdu[4] = return_code;
   pdu.setpart (data.data(), 5, data.size());
-  return pdu;
 }
 
 std::string
@@ -1339,7 +1267,7 @@ bool A_FunctionPropertyState_Response_PDU::isResponse (const APDU * req) const
 /* A_DeviceDescriptor_Read */
 
 bool
-A_DeviceDescriptor_Read_PDU::init (const CArray & c, TracePtr)
+A_DeviceDescriptor_Read_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 2)
     return false;
@@ -1348,16 +1276,14 @@ A_DeviceDescriptor_Read_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_DeviceDescriptor_Read_PDU::ToPacket () const
+void
+A_DeviceDescriptor_Read_PDU::encode (PDUWriter & pdu) const
 {
   assert ((descriptor_type & 0xC0) == 0);
 
-  CArray pdu;
   pdu.resize (2);
   pdu[0] = A_DeviceDescriptor_Read >> 8;
   pdu[1] = (A_DeviceDescriptor_Read & 0xc0) | (descriptor_type & 0x3f);
-  return pdu;
 }
 
 std::string
@@ -1377,7 +1303,7 @@ bool A_DeviceDescriptor_Read_PDU::isResponse (const APDU *) const
 
 /* A_DeviceDescriptor_Response */
 
-bool A_DeviceDescriptor_Response_PDU::init (const CArray & c, TracePtr tr)
+bool A_DeviceDescriptor_Response_PDU::init (const CSpan & c, TracePtr tr)
 {
   if (c.size() != 4)
     {
@@ -1390,18 +1316,16 @@ bool A_DeviceDescriptor_Response_PDU::init (const CArray & c, TracePtr tr)
   return true;
 }
 
-CArray
-A_DeviceDescriptor_Response_PDU::ToPacket () const
+void
+A_DeviceDescriptor_Response_PDU::encode (PDUWriter & pdu) const
 {
   assert ((descriptor_type & 0xC0) == 0);
 
-  CArray pdu;
   pdu.resize (4);
   pdu[0] = A_DeviceDescriptor_Response >> 8;
   pdu[1] = (A_DeviceDescriptor_Response & 0xc0) | (descriptor_type & 0x3f);
   pdu[2] = device_descriptor >> 8;
   pdu[3] = device_descriptor & 0xff;
-  return pdu;
 }
 
 std::string
@@ -1430,24 +1354,25 @@ bool A_DeviceDescriptor_Response_PDU::isResponse (const APDU * req) const
 /* A_Restart */
 
 bool
-A_Restart_PDU::init (const CArray & c, TracePtr)
+A_Restart_PDU::init (const CSpan & c, TracePtr)
 {
-  if ((c.size() != 2) || (c.size() != 4))
+  if ((c.size() != 2) && (c.size() != 4))
     return false;
 
   restart_type = c[1] & 0x01;
   if (restart_type == 1)
     {
+      if (c.size() != 4)
+        return false;
       erase_code = c[2];
       channel_number = c[3];
     }
   return true;
 }
 
-CArray
-A_Restart_PDU::ToPacket () const
+void
+A_Restart_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (2);
   pdu[0] = A_Restart >> 8;
   pdu[1] = (A_Restart & 0xc0) | restart_type;
@@ -1457,7 +1382,6 @@ A_Restart_PDU::ToPacket () const
       pdu[2] = erase_code;
       pdu[3] = channel_number;
     }
-  return pdu;
 }
 
 std::string
@@ -1475,7 +1399,7 @@ bool A_Restart_PDU::isResponse (const APDU *) const
 /* A_Restart_Response */
 
 bool
-A_Restart_Response_PDU::init (const CArray & c, TracePtr)
+A_Restart_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 5)
     return false;
@@ -1486,17 +1410,15 @@ A_Restart_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Restart_Response_PDU::ToPacket () const
+void
+A_Restart_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
-  pdu.resize (2);
+  pdu.resize (5);
   pdu[0] = A_Restart_Response >> 8;
-  pdu[1] = (A_Restart_Response & 0xc0) | restart_type;
+  pdu[1] = (A_Restart_Response & 0xe0) | restart_type;
   pdu[2] = error_code;
   pdu[3] = process_time >> 8;
   pdu[4] = process_time & 0xff;
-  return pdu;
 }
 
 std::string
@@ -1516,7 +1438,7 @@ bool A_Restart_Response_PDU::isResponse (const APDU * req) const
 /* A_Open_Routing_Table_Request */
 
 bool
-A_Open_Routing_Table_Request_PDU::init (const CArray & c, TracePtr)
+A_Open_Routing_Table_Request_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 2)
     return false;
@@ -1525,15 +1447,13 @@ A_Open_Routing_Table_Request_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Open_Routing_Table_Request_PDU::ToPacket () const
+void
+A_Open_Routing_Table_Request_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (2 + data.size());
   pdu[0] = A_Open_Routing_Table_Request >> 8;
   pdu[1] = A_Open_Routing_Table_Request & 0xff;
   pdu.setpart (data.data(), 2, data.size());
-  return pdu;
 }
 
 std::string
@@ -1553,7 +1473,7 @@ bool A_Open_Routing_Table_Request_PDU::isResponse (const APDU *) const
 /* A_Read_Routing_Table_Request */
 
 bool
-A_Read_Routing_Table_Request_PDU::init (const CArray & c, TracePtr)
+A_Read_Routing_Table_Request_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 2)
     return false;
@@ -1562,15 +1482,13 @@ A_Read_Routing_Table_Request_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Read_Routing_Table_Request_PDU::ToPacket () const
+void
+A_Read_Routing_Table_Request_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (2 + data.size());
   pdu[0] = A_Read_Routing_Table_Request >> 8;
   pdu[1] = A_Read_Routing_Table_Request & 0xff;
   pdu.setpart (data.data(), 2, data.size());
-  return pdu;
 }
 
 std::string
@@ -1590,7 +1508,7 @@ bool A_Read_Routing_Table_Request_PDU::isResponse (const APDU *) const
 /* A_Read_Routing_Table_Response */
 
 bool
-A_Read_Routing_Table_Response_PDU::init (const CArray & c, TracePtr)
+A_Read_Routing_Table_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 2)
     return false;
@@ -1599,15 +1517,13 @@ A_Read_Routing_Table_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Read_Routing_Table_Response_PDU::ToPacket () const
+void
+A_Read_Routing_Table_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (2 + data.size());
   pdu[0] = A_Read_Routing_Table_Response >> 8;
   pdu[1] = A_Read_Routing_Table_Response & 0xff;
   pdu.setpart (data.data(), 2, data.size());
-  return pdu;
 }
 
 std::string
@@ -1629,7 +1545,7 @@ bool A_Read_Routing_Table_Response_PDU::isResponse (const APDU * req) const
 /* A_Write_Routing_Table_Request */
 
 bool
-A_Write_Routing_Table_Request_PDU::init (const CArray & c, TracePtr)
+A_Write_Routing_Table_Request_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 2)
     return false;
@@ -1638,15 +1554,13 @@ A_Write_Routing_Table_Request_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Write_Routing_Table_Request_PDU::ToPacket () const
+void
+A_Write_Routing_Table_Request_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (2 + data.size());
   pdu[0] = A_Write_Routing_Table_Request >> 8;
   pdu[1] = A_Write_Routing_Table_Request & 0xff;
   pdu.setpart (data.data(), 2, data.size());
-  return pdu;
 }
 
 std::string
@@ -1666,7 +1580,7 @@ bool A_Write_Routing_Table_Request_PDU::isResponse (const APDU *) const
 /* A_Read_Router_Memory_Request */
 
 bool
-A_Read_Router_Memory_Request_PDU::init (const CArray & c, TracePtr)
+A_Read_Router_Memory_Request_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 2)
     return false;
@@ -1675,15 +1589,13 @@ A_Read_Router_Memory_Request_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Read_Router_Memory_Request_PDU::ToPacket () const
+void
+A_Read_Router_Memory_Request_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (2 + data.size());
   pdu[0] = A_Read_Router_Memory_Request >> 8;
   pdu[1] = A_Read_Router_Memory_Request & 0xff;
   pdu.setpart (data.data(), 2, data.size());
-  return pdu;
 }
 
 std::string
@@ -1703,7 +1615,7 @@ bool A_Read_Router_Memory_Request_PDU::isResponse (const APDU *) const
 /* A_Read_Router_Memory_Response */
 
 bool
-A_Read_Router_Memory_Response_PDU::init (const CArray & c, TracePtr)
+A_Read_Router_Memory_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 2)
     return false;
@@ -1712,15 +1624,13 @@ A_Read_Router_Memory_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Read_Router_Memory_Response_PDU::ToPacket () const
+void
+A_Read_Router_Memory_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (2 + data.size());
   pdu[0] = A_Read_Router_Memory_Response >> 8;
   pdu[1] = A_Read_Router_Memory_Response & 0xff;
   pdu.setpart (data.data(), 2, data.size());
-  return pdu;
 }
 
 std::string
@@ -1742,7 +1652,7 @@ bool A_Read_Router_Memory_Response_PDU::isResponse (const APDU * req) const
 /* A_Write_Router_Memory_Request */
 
 bool
-A_Write_Router_Memory_Request_PDU::init (const CArray & c, TracePtr)
+A_Write_Router_Memory_Request_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 2)
     return false;
@@ -1751,15 +1661,13 @@ A_Write_Router_Memory_Request_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Write_Router_Memory_Request_PDU::ToPacket () const
+void
+A_Write_Router_Memory_Request_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (2 + data.size());
   pdu[0] = A_Write_Router_Memory_Request >> 8;
   pdu[1] = A_Write_Router_Memory_Request & 0xff;
   pdu.setpart (data.data(), 2, data.size());
-  return pdu;
 }
 
 std::string
@@ -1779,7 +1687,7 @@ bool A_Write_Router_Memory_Request_PDU::isResponse (const APDU *) const
 /* A_Read_Router_Status_Request */
 
 bool
-A_Read_Router_Status_Request_PDU::init (const CArray & c, TracePtr)
+A_Read_Router_Status_Request_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 2)
     return false;
@@ -1788,15 +1696,13 @@ A_Read_Router_Status_Request_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Read_Router_Status_Request_PDU::ToPacket () const
+void
+A_Read_Router_Status_Request_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (2 + data.size());
   pdu[0] = A_Read_Router_Status_Request >> 8;
   pdu[1] = A_Read_Router_Status_Request & 0xff;
   pdu.setpart (data.data(), 2, data.size());
-  return pdu;
 }
 
 std::string
@@ -1816,7 +1722,7 @@ bool A_Read_Router_Status_Request_PDU::isResponse (const APDU *) const
 /* A_Read_Router_Status_Response */
 
 bool
-A_Read_Router_Status_Response_PDU::init (const CArray & c, TracePtr)
+A_Read_Router_Status_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 2)
     return false;
@@ -1825,15 +1731,13 @@ A_Read_Router_Status_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Read_Router_Status_Response_PDU::ToPacket () const
+void
+A_Read_Router_Status_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (2 + data.size());
   pdu[0] = A_Read_Router_Status_Response >> 8;
   pdu[1] = A_Read_Router_Status_Response & 0xff;
   pdu.setpart (data.data(), 2, data.size());
-  return pdu;
 }
 
 std::string
@@ -1855,7 +1759,7 @@ bool A_Read_Router_Status_Response_PDU::isResponse (const APDU * req) const
 /* A_Write_Router_Status_Request */
 
 bool
-A_Write_Router_Status_Request_PDU::init (const CArray & c, TracePtr)
+A_Write_Router_Status_Request_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 2)
     return false;
@@ -1864,15 +1768,13 @@ A_Write_Router_Status_Request_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Write_Router_Status_Request_PDU::ToPacket () const
+void
+A_Write_Router_Status_Request_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (2 + data.size());
-  pdu[0] = A_Read_Router_Status_Request >> 8;
-  pdu[1] = A_Read_Router_Status_Request & 0xff;
+  pdu[0] = A_Write_Router_Status_Request >> 8;
+  pdu[1] = A_Write_Router_Status_Request & 0xff;
   pdu.setpart (data.data(), 2, data.size());
-  return pdu;
 }
 
 std::string
@@ -1892,7 +1794,7 @@ bool A_Write_Router_Status_Request_PDU::isResponse (const APDU *) const
 /* A_MemoryBit_Write */
 
 bool
-A_MemoryBit_Write_PDU::init (const CArray & c, TracePtr)
+A_MemoryBit_Write_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 5)
     return false;
@@ -1906,13 +1808,12 @@ A_MemoryBit_Write_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_MemoryBit_Write_PDU::ToPacket () const
+void
+A_MemoryBit_Write_PDU::encode (PDUWriter & pdu) const
 {
   assert (and_data.size() == number);
   assert (xor_data.size() == number);
 
-  CArray pdu;
   pdu.resize (number * 2 + 5);
   pdu[0] = A_MemoryBit_Write >> 8;
   pdu[1] = A_MemoryBit_Write & 0xff;
@@ -1921,7 +1822,6 @@ A_MemoryBit_Write_PDU::ToPacket () const
   pdu[4] = address & 0xff;
   pdu.setpart (and_data.data(), 5, number);
   pdu.setpart (xor_data.data(), 5 + number, number);
-  return pdu;
 }
 
 std::string
@@ -1951,7 +1851,7 @@ bool A_MemoryBit_Write_PDU::isResponse (const APDU *) const
 /* A_Authorize_Request */
 
 bool
-A_Authorize_Request_PDU::init (const CArray & c, TracePtr)
+A_Authorize_Request_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 7)
     return false;
@@ -1960,10 +1860,9 @@ A_Authorize_Request_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Authorize_Request_PDU::ToPacket () const
+void
+A_Authorize_Request_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (7);
   pdu[0] = A_Authorize_Request >> 8;
   pdu[1] = A_Authorize_Request & 0xff;
@@ -1972,7 +1871,6 @@ A_Authorize_Request_PDU::ToPacket () const
   pdu[4] = (key >> 16) & 0xff;
   pdu[5] = (key >> 8) & 0xff;
   pdu[6] = key & 0xff;
-  return pdu;
 }
 
 std::string
@@ -1990,7 +1888,7 @@ bool A_Authorize_Request_PDU::isResponse (const APDU *) const
 /* A_Authorize_Response */
 
 bool
-A_Authorize_Response_PDU::init (const CArray & c, TracePtr)
+A_Authorize_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 3)
     return false;
@@ -1999,15 +1897,13 @@ A_Authorize_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Authorize_Response_PDU::ToPacket () const
+void
+A_Authorize_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (3);
   pdu[0] = A_Authorize_Response >> 8;
   pdu[1] = A_Authorize_Response & 0xff;
   pdu[2] = level;
-  return pdu;
 }
 
 std::string
@@ -2028,7 +1924,7 @@ bool A_Authorize_Response_PDU::isResponse (const APDU * req) const
 /* A_Key_Write */
 
 bool
-A_Key_Write_PDU::init (const CArray & c, TracePtr)
+A_Key_Write_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 7)
     return false;
@@ -2038,10 +1934,9 @@ A_Key_Write_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Key_Write_PDU::ToPacket () const
+void
+A_Key_Write_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (7);
   pdu[0] = A_Key_Write >> 8;
   pdu[1] = A_Key_Write & 0xff;
@@ -2050,7 +1945,6 @@ A_Key_Write_PDU::ToPacket () const
   pdu[4] = (key >> 16) & 0xff;
   pdu[5] = (key >> 8) & 0xff;
   pdu[6] = key & 0xff;
-  return pdu;
 }
 
 std::string
@@ -2070,7 +1964,7 @@ bool A_Key_Write_PDU::isResponse (const APDU *) const
 /* A_Key_Response */
 
 bool
-A_Key_Response_PDU::init (const CArray & c, TracePtr)
+A_Key_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 3)
     return false;
@@ -2079,15 +1973,13 @@ A_Key_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Key_Response_PDU::ToPacket () const
+void
+A_Key_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (3);
   pdu[0] = A_Key_Response >> 8;
   pdu[1] = A_Key_Response & 0xff;
   pdu[2] = level;
-  return pdu;
 }
 
 std::string
@@ -2110,7 +2002,7 @@ bool A_Key_Response_PDU::isResponse (const APDU * req) const
 /* A_PropertyValue_Read */
 
 bool
-A_PropertyValue_Read_PDU::init (const CArray & c, TracePtr)
+A_PropertyValue_Read_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 6)
     return false;
@@ -2122,13 +2014,12 @@ A_PropertyValue_Read_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_PropertyValue_Read_PDU::ToPacket () const
+void
+A_PropertyValue_Read_PDU::encode (PDUWriter & pdu) const
 {
   assert ((nr_of_elem & 0xf0) == 0);
   assert ((start_index & 0xf000) == 0);
 
-  CArray pdu;
   pdu.resize (6);
   pdu[0] = A_PropertyValue_Read >> 8;
   pdu[1] = A_PropertyValue_Read & 0xff;
@@ -2136,7 +2027,6 @@ A_PropertyValue_Read_PDU::ToPacket () const
   pdu[3] = property_id;
   pdu[4] = (nr_of_elem << 4) | (start_index >> 8);
   pdu[5] = start_index & 0xff;
-  return pdu;
 }
 
 std::string
@@ -2164,7 +2054,7 @@ bool A_PropertyValue_Read_PDU::isResponse (const APDU *) const
 /* A_PropertyValue_Response */
 
 bool
-A_PropertyValue_Response_PDU::init (const CArray & c, TracePtr)
+A_PropertyValue_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 6)
     return false;
@@ -2177,13 +2067,12 @@ A_PropertyValue_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_PropertyValue_Response_PDU::ToPacket () const
+void
+A_PropertyValue_Response_PDU::encode (PDUWriter & pdu) const
 {
   assert ((nr_of_elem & 0xf0) == 0);
   assert ((start_index & 0xf000) == 0);
 
-  CArray pdu;
   pdu.resize (6 + data.size());
   pdu[0] = A_PropertyValue_Response >> 8;
   pdu[1] = A_PropertyValue_Response & 0xff;
@@ -2192,7 +2081,6 @@ A_PropertyValue_Response_PDU::ToPacket () const
   pdu[4] = (nr_of_elem << 4) | (start_index >> 8);
   pdu[5] = start_index & 0xff;
   pdu.setpart (data.data(), 6, data.size());
-  return pdu;
 }
 
 std::string
@@ -2251,7 +2139,7 @@ bool A_PropertyValue_Response_PDU::isResponse (const APDU * req) const
 /* A_PropertyValue_Write */
 
 bool
-A_PropertyValue_Write_PDU::init (const CArray & c, TracePtr)
+A_PropertyValue_Write_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 6)
     return false;
@@ -2264,13 +2152,12 @@ A_PropertyValue_Write_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_PropertyValue_Write_PDU::ToPacket () const
+void
+A_PropertyValue_Write_PDU::encode (PDUWriter & pdu) const
 {
   assert ((nr_of_elem & 0xf0) == 0);
   assert ((start_index & 0xf000) == 0);
 
-  CArray pdu;
   pdu.resize (6 + data.size());
   pdu[0] = A_PropertyValue_Write >> 8;
   pdu[1] = A_PropertyValue_Write & 0xff;
@@ -2279,7 +2166,6 @@ A_PropertyValue_Write_PDU::ToPacket () const
   pdu[4] = (nr_of_elem << 4) | (start_index >> 8);
   pdu[5] = start_index & 0xff;
   pdu.setpart (data.data(), 6, data.size());
-  return pdu;
 }
 
 std::string
@@ -2310,7 +2196,7 @@ bool A_PropertyValue_Write_PDU::isResponse (const APDU *) const
 /* A_PropertyDescription_Read */
 
 bool
-A_PropertyDescription_Read_PDU::init (const CArray & c, TracePtr)
+A_PropertyDescription_Read_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 5)
     return false;
@@ -2321,17 +2207,15 @@ A_PropertyDescription_Read_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_PropertyDescription_Read_PDU::ToPacket () const
+void
+A_PropertyDescription_Read_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (5);
   pdu[0] = A_PropertyDescription_Read >> 8;
   pdu[1] = A_PropertyDescription_Read & 0xff;
   pdu[2] = object_index;
   pdu[3] = property_id;
   pdu[4] = property_index;
-  return pdu;
 }
 
 std::string
@@ -2354,7 +2238,7 @@ bool A_PropertyDescription_Read_PDU::isResponse (const APDU *) const
 /* A_PropertyDescription_Response */
 
 bool
-A_PropertyDescription_Response_PDU::init (const CArray & c, TracePtr)
+A_PropertyDescription_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 9)
     return false;
@@ -2369,10 +2253,9 @@ A_PropertyDescription_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_PropertyDescription_Response_PDU::ToPacket () const
+void
+A_PropertyDescription_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (9);
   pdu[0] = A_PropertyDescription_Response >> 8;
   pdu[1] = A_PropertyDescription_Response & 0xff;
@@ -2383,7 +2266,6 @@ A_PropertyDescription_Response_PDU::ToPacket () const
   pdu[6] = max_nr_of_elem >> 8;
   pdu[7] = max_nr_of_elem & 0xff;
   pdu[8] = access;
-  return pdu;
 }
 
 std::string
@@ -2419,7 +2301,7 @@ bool A_PropertyDescription_Response_PDU::isResponse (const APDU * req) const
 /* A_NetworkParameter_Read */
 
 bool
-A_NetworkParameter_Read_PDU::init (const CArray & c, TracePtr)
+A_NetworkParameter_Read_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 5)
     return false;
@@ -2429,16 +2311,14 @@ A_NetworkParameter_Read_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_NetworkParameter_Read_PDU::ToPacket () const
+void
+A_NetworkParameter_Read_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (5 + test_info.size());
   pdu[0] = A_NetworkParameter_Read >> 8;
   pdu[1] = A_NetworkParameter_Read & 0xff;
-  pdu.setpart (parameter_type.data(), 3, 3);
+  pdu.setpart (parameter_type.data(), 2, 3);
   pdu.setpart (test_info.data(), 5, test_info.size());
-  return pdu;
 }
 
 std::string
@@ -2457,7 +2337,7 @@ bool A_NetworkParameter_Read_PDU::isResponse (const APDU *) const
 /* A_NetworkParameter_Response */
 
 bool
-A_NetworkParameter_Response_PDU::init (const CArray & c, TracePtr)
+A_NetworkParameter_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 16)
     return false;
@@ -2467,16 +2347,14 @@ A_NetworkParameter_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_NetworkParameter_Response_PDU::ToPacket () const
+void
+A_NetworkParameter_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (5 + test_info_result.size());
   pdu[0] = A_NetworkParameter_Response >> 8;
   pdu[1] = A_NetworkParameter_Response & 0xff;
-  pdu.setpart (parameter_type.data(), 3, 3);
+  pdu.setpart (parameter_type.data(), 2, 3);
   pdu.setpart (test_info_result.data(), 5, test_info_result.size());
-  return pdu;
 }
 
 std::string
@@ -2508,7 +2386,7 @@ A_IndividualAddressSerialNumber_Read_PDU ()
 }
 
 bool
-A_IndividualAddressSerialNumber_Read_PDU::init (const CArray & c, TracePtr)
+A_IndividualAddressSerialNumber_Read_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 8)
     return false;
@@ -2517,14 +2395,13 @@ A_IndividualAddressSerialNumber_Read_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray A_IndividualAddressSerialNumber_Read_PDU::ToPacket () const
+void
+A_IndividualAddressSerialNumber_Read_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (8);
   pdu[0] = A_IndividualAddressSerialNumber_Read >> 8;
   pdu[1] = A_IndividualAddressSerialNumber_Read & 0xff;
   pdu.setpart (serial_number.data(), 2, 6);
-  return pdu;
 }
 
 std::string A_IndividualAddressSerialNumber_Read_PDU::Decode (TracePtr) const
@@ -2556,7 +2433,7 @@ A_IndividualAddressSerialNumber_Response_PDU ()
 }
 
 bool
-A_IndividualAddressSerialNumber_Response_PDU::init (const CArray & c, TracePtr)
+A_IndividualAddressSerialNumber_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 12)
     return false;
@@ -2567,9 +2444,9 @@ A_IndividualAddressSerialNumber_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray A_IndividualAddressSerialNumber_Response_PDU::ToPacket () const
+void
+A_IndividualAddressSerialNumber_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (12);
   pdu[0] = A_IndividualAddressSerialNumber_Response >> 8;
   pdu[1] = A_IndividualAddressSerialNumber_Response & 0xff;
@@ -2578,7 +2455,6 @@ CArray A_IndividualAddressSerialNumber_Response_PDU::ToPacket () const
   pdu[9] = domain_address & 0xff;
   pdu[10] = reserved[0];
   pdu[11] = reserved[1];
-  return pdu;
 }
 
 std::string A_IndividualAddressSerialNumber_Response_PDU::Decode (TracePtr) const
@@ -2616,7 +2492,7 @@ A_IndividualAddressSerialNumber_Write_PDU ()
   serial_number.fill(0);
 }
 
-bool A_IndividualAddressSerialNumber_Write_PDU::init (const CArray & c, TracePtr)
+bool A_IndividualAddressSerialNumber_Write_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 14)
     return false;
@@ -2627,9 +2503,9 @@ bool A_IndividualAddressSerialNumber_Write_PDU::init (const CArray & c, TracePtr
   return true;
 }
 
-CArray A_IndividualAddressSerialNumber_Write_PDU::ToPacket () const
+void
+A_IndividualAddressSerialNumber_Write_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (14);
   pdu[0] = A_IndividualAddressSerialNumber_Write >> 8;
   pdu[1] = A_IndividualAddressSerialNumber_Write & 0xff;
@@ -2640,7 +2516,6 @@ CArray A_IndividualAddressSerialNumber_Write_PDU::ToPacket () const
   pdu[11] = reserved[1];
   pdu[12] = reserved[2];
   pdu[13] = reserved[3];
-  return pdu;
 }
 
 std::string A_IndividualAddressSerialNumber_Write_PDU::Decode (TracePtr) const
@@ -2668,28 +2543,26 @@ const
 /* A_ServiceInformation_Indication_Write_PDU */
 
 bool
-A_ServiceInformation_Indication_Write_PDU::init (const CArray & c, TracePtr)
+A_ServiceInformation_Indication_Write_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 5)
     return false;
 
   verify_mode = (c[2] & 0x04) ? true : false;
-  duplicate_address = (c[3] & 0x02) ? true : false;
+  duplicate_address = (c[2] & 0x02) ? true : false;
   appl_stopped = (c[2] & 0x01) ? true : false;
   return true;
 }
 
-CArray
-A_ServiceInformation_Indication_Write_PDU::ToPacket () const
+void
+A_ServiceInformation_Indication_Write_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (5);
   pdu[0] = A_ServiceInformation_Indication_Write >> 8;
   pdu[1] = A_ServiceInformation_Indication_Write & 0xff;
   pdu[2] = (verify_mode << 2) | (duplicate_address << 1) | appl_stopped;
   pdu[3] = 0x00;
   pdu[4] = 0x00;
-  return pdu;
 }
 
 std::string
@@ -2716,7 +2589,7 @@ const
 /* A_DomainAddress_Write */
 
 bool
-A_DomainAddress_Write_PDU::init (const CArray & c, TracePtr)
+A_DomainAddress_Write_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 4)
     return false;
@@ -2725,15 +2598,14 @@ A_DomainAddress_Write_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray A_DomainAddress_Write_PDU::ToPacket () const
+void
+A_DomainAddress_Write_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (4);
   pdu[0] = A_DomainAddress_Write >> 8;
   pdu[1] = A_DomainAddress_Write & 0xff;
   pdu[2] = domain_address >> 8;
   pdu[3] = domain_address & 0xff;
-  return pdu;
 }
 
 std::string A_DomainAddress_Write_PDU::Decode (TracePtr) const
@@ -2751,20 +2623,19 @@ bool A_DomainAddress_Write_PDU::isResponse (const APDU *) const
 /* A_DomainAddress_Read */
 
 bool
-A_DomainAddress_Read_PDU::init (const CArray & c, TracePtr)
+A_DomainAddress_Read_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 2)
     return false;
   return true;
 }
 
-CArray A_DomainAddress_Read_PDU::ToPacket () const
+void
+A_DomainAddress_Read_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(2);
   pdu[0] = A_DomainAddress_Read >> 8;
   pdu[1] = A_DomainAddress_Read & 0xff;
-  return pdu;
 }
 
 std::string A_DomainAddress_Read_PDU::Decode (TracePtr) const
@@ -2780,7 +2651,7 @@ bool A_DomainAddress_Read_PDU::isResponse (const APDU *) const
 /* A_DomainAddress_Response */
 
 bool
-A_DomainAddress_Response_PDU::init (const CArray & c, TracePtr)
+A_DomainAddress_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 4)
     return false;
@@ -2789,15 +2660,14 @@ A_DomainAddress_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray A_DomainAddress_Response_PDU::ToPacket () const
+void
+A_DomainAddress_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (4);
   pdu[0] = A_DomainAddress_Response >> 8;
   pdu[1] = A_DomainAddress_Response & 0xff;
   pdu[2] = domain_address >> 8;
   pdu[3] = domain_address & 0xff;
-  return pdu;
 }
 
 std::string A_DomainAddress_Response_PDU::Decode (TracePtr) const
@@ -2817,7 +2687,7 @@ bool A_DomainAddress_Response_PDU::isResponse (const APDU * req) const
 /* A_DomainAddressSelective_Read */
 
 bool
-A_DomainAddressSelective_Read_PDU::init (const CArray & c, TracePtr)
+A_DomainAddressSelective_Read_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 7)
     return false;
@@ -2828,18 +2698,17 @@ A_DomainAddressSelective_Read_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray A_DomainAddressSelective_Read_PDU::ToPacket () const
+void
+A_DomainAddressSelective_Read_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (7);
   pdu[0] = A_DomainAddressSelective_Read >> 8;
   pdu[1] = A_DomainAddressSelective_Read & 0xff;
   pdu[2] = domain_address >> 8;
   pdu[3] = domain_address & 0xff;
-  pdu[2] = start_address >> 8;
-  pdu[3] = start_address & 0xff;
+  pdu[4] = start_address >> 8;
+  pdu[5] = start_address & 0xff;
   pdu[6] = range;
-  return pdu;
 }
 
 std::string
@@ -2862,7 +2731,7 @@ bool A_DomainAddressSelective_Read_PDU::isResponse (const APDU *) const
 /* A_NetworkParameter_Write */
 
 bool
-A_NetworkParameter_Write_PDU::init (const CArray & c, TracePtr)
+A_NetworkParameter_Write_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 5)
     return false;
@@ -2872,16 +2741,14 @@ A_NetworkParameter_Write_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_NetworkParameter_Write_PDU::ToPacket () const
+void
+A_NetworkParameter_Write_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize (5 + value.size());
   pdu[0] = A_NetworkParameter_Write >> 8;
   pdu[1] = A_NetworkParameter_Write & 0xff;
-  pdu.setpart (parameter_type.data(), 3, 3);
+  pdu.setpart (parameter_type.data(), 2, 3);
   pdu.setpart (value.data(), 5, value.size());
-  return pdu;
 }
 
 std::string
@@ -2900,7 +2767,7 @@ bool A_NetworkParameter_Write_PDU::isResponse (const APDU *) const
 /* A_Link_Read */
 
 bool
-A_Link_Read_PDU::init (const CArray & c, TracePtr)
+A_Link_Read_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 4)
     return false;
@@ -2910,16 +2777,14 @@ A_Link_Read_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Link_Read_PDU::ToPacket () const
+void
+A_Link_Read_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(4);
   pdu[0] = A_Link_Read >> 8;
   pdu[1] = A_Link_Read & 0xff;
   pdu[2] = group_object_number;
   pdu[3] = start_index & 0x0f;
-  return pdu;
 }
 
 std::string
@@ -2938,7 +2803,7 @@ bool A_Link_Read_PDU::isResponse (const APDU *) const
 /* A_Link_Response */
 
 bool
-A_Link_Response_PDU::init (const CArray & c, TracePtr)
+A_Link_Response_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 4)
     return false;
@@ -2950,17 +2815,15 @@ A_Link_Response_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Link_Response_PDU::ToPacket () const
+void
+A_Link_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(4 + group_address_list.size());
   pdu[0] = A_Link_Response >> 8;
   pdu[1] = A_Link_Response & 0xff;
   pdu[2] = group_object_number;
   pdu[3] = (sending_address << 4) | start_index;
   pdu.setpart (group_address_list.data(), 4, group_address_list.size());
-  return pdu;
 }
 
 std::string
@@ -2987,7 +2850,7 @@ bool A_Link_Response_PDU::isResponse (const APDU * req) const
 /* A_Link_Write */
 
 bool
-A_Link_Write_PDU::init (const CArray & c, TracePtr)
+A_Link_Write_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 6)
     return false;
@@ -2998,10 +2861,9 @@ A_Link_Write_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_Link_Write_PDU::ToPacket () const
+void
+A_Link_Write_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(6);
   pdu[0] = A_Link_Write >> 8;
   pdu[1] = A_Link_Write & 0xff;
@@ -3009,7 +2871,6 @@ A_Link_Write_PDU::ToPacket () const
   pdu[3] = flags;
   pdu[4] = group_address >> 8;
   pdu[5] = group_address & 0xff;
-  return pdu;
 }
 
 std::string
@@ -3028,21 +2889,19 @@ bool A_Link_Write_PDU::isResponse (const APDU *) const
 /* A_GroupPropValue_Read */
 
 bool
-A_GroupPropValue_Read_PDU::init (const CArray &, TracePtr)
+A_GroupPropValue_Read_PDU::init (const CSpan &, TracePtr)
 {
   // @todo
   return true;
 }
 
-CArray
-A_GroupPropValue_Read_PDU::ToPacket () const
+void
+A_GroupPropValue_Read_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(2);
   pdu[0] = A_GroupPropValue_Read >> 8;
   pdu[1] = A_GroupPropValue_Read & 0xff;
   // @todo
-  return pdu;
 }
 
 std::string
@@ -3061,21 +2920,19 @@ bool A_GroupPropValue_Read_PDU::isResponse (const APDU *) const
 /* A_GroupPropValue_Response */
 
 bool
-A_GroupPropValue_Response_PDU::init (const CArray &, TracePtr)
+A_GroupPropValue_Response_PDU::init (const CSpan &, TracePtr)
 {
   // @todo
   return true;
 }
 
-CArray
-A_GroupPropValue_Response_PDU::ToPacket () const
+void
+A_GroupPropValue_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(2);
   pdu[0] = A_GroupPropValue_Response >> 8;
   pdu[1] = A_GroupPropValue_Response & 0xff;
   // @todo
-  return pdu;
 }
 
 std::string
@@ -3097,21 +2954,19 @@ bool A_GroupPropValue_Response_PDU::isResponse (const APDU * req) const
 /* A_GroupPropValue_Write */
 
 bool
-A_GroupPropValue_Write_PDU::init (const CArray &, TracePtr)
+A_GroupPropValue_Write_PDU::init (const CSpan &, TracePtr)
 {
   // @todo
   return true;
 }
 
-CArray
-A_GroupPropValue_Write_PDU::ToPacket () const
+void
+A_GroupPropValue_Write_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(2);
   pdu[0] = A_GroupPropValue_Write >> 8;
   pdu[1] = A_GroupPropValue_Write & 0xff;
   // @todo
-  return pdu;
 }
 
 std::string
@@ -3130,21 +2985,19 @@ bool A_GroupPropValue_Write_PDU::isResponse (const APDU *) const
 /* A_GroupPropValue_InfoReport */
 
 bool
-A_GroupPropValue_InfoReport_PDU::init (const CArray &, TracePtr)
+A_GroupPropValue_InfoReport_PDU::init (const CSpan &, TracePtr)
 {
   // @todo
   return true;
 }
 
-CArray
-A_GroupPropValue_InfoReport_PDU::ToPacket () const
+void
+A_GroupPropValue_InfoReport_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(2);
   pdu[0] = A_GroupPropValue_InfoReport >> 8;
   pdu[1] = A_GroupPropValue_InfoReport & 0xff;
   // @todo
-  return pdu;
 }
 
 std::string
@@ -3164,21 +3017,19 @@ bool A_GroupPropValue_InfoReport_PDU::isResponse (const APDU *) const
 /* A_DomainAddressSerialNumber_Read */
 
 bool
-A_DomainAddressSerialNumber_Read_PDU::init (const CArray &, TracePtr)
+A_DomainAddressSerialNumber_Read_PDU::init (const CSpan &, TracePtr)
 {
   // @todo
   return true;
 }
 
-CArray
-A_DomainAddressSerialNumber_Read_PDU::ToPacket () const
+void
+A_DomainAddressSerialNumber_Read_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(2);
   pdu[0] = A_DomainAddressSerialNumber_Read >> 8;
   pdu[1] = A_DomainAddressSerialNumber_Read & 0xff;
   // @todo
-  return pdu;
 }
 
 std::string
@@ -3197,21 +3048,19 @@ bool A_DomainAddressSerialNumber_Read_PDU::isResponse (const APDU *) const
 /* A_DomainAddressSerialNumber_Response */
 
 bool
-A_DomainAddressSerialNumber_Response_PDU::init (const CArray &, TracePtr)
+A_DomainAddressSerialNumber_Response_PDU::init (const CSpan &, TracePtr)
 {
   // @todo
   return true;
 }
 
-CArray
-A_DomainAddressSerialNumber_Response_PDU::ToPacket () const
+void
+A_DomainAddressSerialNumber_Response_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(2);
   pdu[0] = A_DomainAddressSerialNumber_Response >> 8;
   pdu[1] = A_DomainAddressSerialNumber_Response & 0xff;
   // @todo
-  return pdu;
 }
 
 std::string
@@ -3233,21 +3082,19 @@ bool A_DomainAddressSerialNumber_Response_PDU::isResponse (const APDU * req) con
 /* A_DomainAddressSerialNumber_Write */
 
 bool
-A_DomainAddressSerialNumber_Write_PDU::init (const CArray &, TracePtr)
+A_DomainAddressSerialNumber_Write_PDU::init (const CSpan &, TracePtr)
 {
   // @todo
   return true;
 }
 
-CArray
-A_DomainAddressSerialNumber_Write_PDU::ToPacket () const
+void
+A_DomainAddressSerialNumber_Write_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(2);
   pdu[0] = A_DomainAddressSerialNumber_Write >> 8;
   pdu[1] = A_DomainAddressSerialNumber_Write & 0xff;
   // @todo
-  return pdu;
 }
 
 std::string
@@ -3266,7 +3113,7 @@ bool A_DomainAddressSerialNumber_Write_PDU::isResponse (const APDU *) const
 /* A_FileStream_InfoReport */
 
 bool
-A_FileStream_InfoReport_PDU::init (const CArray & c, TracePtr)
+A_FileStream_InfoReport_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 3)
     return false;
@@ -3277,16 +3124,14 @@ A_FileStream_InfoReport_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray
-A_FileStream_InfoReport_PDU::ToPacket () const
+void
+A_FileStream_InfoReport_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(3 + file_block.size());
   pdu[0] = A_FileStream_InfoReport >> 8;
   pdu[1] = A_FileStream_InfoReport & 0xff;
   pdu[2] = (file_handle << 4) | file_block_sequence_number;
   pdu.setpart (file_block.data(), 3, file_block.size());
-  return pdu;
 }
 
 std::string
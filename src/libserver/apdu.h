@@ -28,6 +28,7 @@
 #define APDU_H
 
 #include <array>
+#include <cstddef>
 
 #include "common.h"
 
@@ -114,6 +115,65 @@ enum APDU_type : uint16_t
 
 class APDU;
 using APDUPtr = std::unique_ptr<APDU>;
+class APDUBuf;
+
+/**
+ * Where an APDU or TPDU is encoded to: either a fixed buffer, or a
+ * CArray whose storage is re-used and which grows as needed.
+ *
+ * It has the part of CArray's interface the encoders use. Octets beyond
+ * the end of a fixed buffer are dropped; fits() tells.
+ */
+class PDUWriter
+{
+public:
+  PDUWriter (uint8_t *buf, size_t max) : buf(buf), max(max) {}
+  PDUWriter (CArray & c) : arr(&c)
+  {
+    c.clear ();
+  }
+
+  void resize (size_t n)
+  {
+    if (arr)
+      {
+        arr->resize (n);
+        buf = arr->data();
+        max = n;
+      }
+    else if (n > len && len < max)
+      memset (buf + len, 0, (n < max ? n : max) - len);
+    len = n;
+  }
+  uint8_t & operator[] (size_t i)
+  {
+    return i < max ? buf[i] : scratch;
+  }
+  void setpart (const uint8_t *elem, size_t start, size_t cnt)
+  {
+    if (start + cnt > len)
+      resize (start + cnt);
+    for (size_t i = 0; i < cnt; i++)
+      (*this)[start + i] = elem[i];
+  }
+
+  size_t size () const
+  {
+    return len;
+  }
+  /** everything has been written */
+  bool fits () const
+  {
+    return len <= max;
+  }
+
+private:
+  uint8_t *buf = nullptr;
+  size_t max = 0;
+  size_t len = 0;
+  CArray *arr = nullptr;
+  uint8_t scratch;
+};
 
 /** represents an APDU */
 class APDU
@@ -121,28 +181,82 @@ class APDU
 public:
   virtual ~APDU () = default;
 
-  virtual bool init (const CArray &, TracePtr tr) = 0;
+  virtual bool init (const CSpan &, TracePtr tr) = 0;
+  /** encode into @pdu */
+  virtual void encode (PDUWriter & pdu) const = 0;
   /** convert to character array */
-  virtual CArray ToPacket () const = 0;
+  CArray ToPacket () const;
+  /**
+   * Encode into @pdu, re-using its storage, and merge @tpci into the
+   * first octet. This is how a T_Data PDU is built around the APDU.
+   */
+  void ToPacket (CArray & pdu, uint8_t tpci = 0) const;
+  /**
+   * Encode into @buf, like ToPacket (CArray &, uint8_t).
+   * @return the APDU's length; 0 if it doesn't fit into @max octets
+   */
+  size_t ToPacket (uint8_t *buf, size_t max, uint8_t tpci = 0) const;
   /** decode content as string */
   virtual std::string Decode (TracePtr tr) const = 0;
 
   /** converts character array to a APDU */
-  static APDUPtr fromPacket (const CArray &, TracePtr tr);
+  static APDUPtr fromPacket (const CSpan &, TracePtr tr);
+  /**
+   * Like fromPacket, but the APDU is constructed in @buf instead of being
+   * allocated. It lives until @buf is re-used or goes out of scope.
+   */
+  static APDU *decode (const CSpan &, APDUBuf &buf, TracePtr tr);
   /** gets APDU type */
   virtual APDU_type getType () const = 0;
   /** returns true, if this is can be an answer of req */
   virtual bool isResponse (const APDU * req) const = 0;
 };
 
+/**
+ * Room for any APDU, so that one can be decoded on the stack.
+ *
+ * Only the APDU object lives here: payloads are still copied into its
+ * CArray members, so decoding an APDU which carries data still allocates.
+ */
+class APDUBuf
+{
+public:
+  APDUBuf () = default;
+  APDUBuf (const APDUBuf &) = delete;
+  APDUBuf &operator= (const APDUBuf &) = delete;
+  ~APDUBuf ()
+  {
+    reset ();
+  }
+
+  APDU *get () const
+  {
+    return apdu;
+  }
+  void reset ()
+  {
+    if (apdu)
+      apdu->~APDU ();
+    apdu = nullptr;
+  }
+
+  /** large enough for every APDU class; checked in apdu.cpp */
+  static const size_t SIZE = 96;
+
+private:
+  friend class APDU;
+  alignas (alignof (std::max_align_t)) unsigned char mem[SIZE];
+  APDU *apdu = nullptr;
+};
+
 class A_Unknown_PDU:public APDU
 {
 public:
   CArray pdu;
 
   A_Unknown_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -155,8 +269,8 @@ class A_GroupValue_Read_PDU:public APDU
 {
 public:
   A_GroupValue_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -171,8 +285,8 @@ public:
   CArray data;
 
   A_GroupValue_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -190,8 +304,8 @@ public:
   CArray data;
 
   A_GroupValue_Write_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -209,8 +323,8 @@ public:
   eibaddr_t newaddress = 0;
 
   A_IndividualAddress_Write_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -224,8 +338,8 @@ class A_IndividualAddress_Read_PDU:public APDU
 public:
 
   A_IndividualAddress_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -239,8 +353,8 @@ class A_IndividualAddress_Response_PDU:public APDU
 public:
 
   A_IndividualAddress_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -256,8 +370,8 @@ public:
   uint8_t read_count = 0;
 
   A_ADC_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -274,8 +388,8 @@ public:
   int16_t sum = 0;
 
   A_ADC_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -290,8 +404,8 @@ public:
   // @todo
 
   A_SystemNetworkParameter_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -306,8 +420,8 @@ public:
   // @todo
 
   A_SystemNetworkParameter_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -322,8 +436,8 @@ public:
   // @todo
 
   A_SystemNetworkParameter_Write_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -342,8 +456,8 @@ public:
   memaddr_t address = 0;
 
   A_Memory_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -360,8 +474,8 @@ public:
   CArray data;
 
   A_Memory_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -378,8 +492,8 @@ public:
   CArray data;
 
   A_Memory_Write_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -396,8 +510,8 @@ public:
   memaddr_t address = 0;
 
   A_UserMemory_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -415,8 +529,8 @@ public:
   CArray data;
 
   A_UserMemory_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -434,8 +548,8 @@ public:
   CArray data;
 
   A_UserMemory_Write_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -453,8 +567,8 @@ public:
   CArray xor_data;
 
   A_UserMemoryBit_Write_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -468,8 +582,8 @@ class A_UserManufacturerInfo_Read_PDU:public APDU
 public:
 
   A_UserManufacturerInfo_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -485,8 +599,8 @@ public:
   uint16_t manufacturer_data = 0;
 
   A_UserManufacturerInfo_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -503,8 +617,8 @@ public:
   CArray data;
 
   A_FunctionPropertyCommand_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -521,8 +635,8 @@ public:
   CArray data;
 
   A_FunctionPropertyState_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -540,8 +654,8 @@ public:
   CArray data;
 
   A_FunctionPropertyState_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -556,8 +670,8 @@ public:
   uint8_t descriptor_type = 0;
 
   A_DeviceDescriptor_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -573,8 +687,8 @@ public:
   uint16_t device_descriptor = 0;
 
   A_DeviceDescriptor_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -593,8 +707,8 @@ public:
   uint8_t channel_number = 0;
 
   A_Restart_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -611,12 +725,12 @@ public:
   uint16_t process_time = 0;
 
   A_Restart_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
-    return A_Restart;
+    return A_Restart_Response;
   }
   virtual bool isResponse (const APDU * req) const override;
 };
@@ -627,8 +741,8 @@ public:
   CArray data;
 
   A_Open_Routing_Table_Request_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -643,8 +757,8 @@ public:
   CArray data;
 
   A_Read_Routing_Table_Request_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -659,8 +773,8 @@ public:
   CArray data;
 
   A_Read_Routing_Table_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -675,8 +789,8 @@ public:
   CArray data;
 
   A_Write_Routing_Table_Request_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -691,8 +805,8 @@ public:
   CArray data;
 
   A_Read_Router_Memory_Request_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -707,8 +821,8 @@ public:
   CArray data;
 
   A_Read_Router_Memory_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -723,8 +837,8 @@ public:
   CArray data;
 
   A_Write_Router_Memory_Request_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -739,8 +853,8 @@ public:
   CArray data;
 
   A_Read_Router_Status_Request_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -755,8 +869,8 @@ public:
   CArray data;
 
   A_Read_Router_Status_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -771,8 +885,8 @@ public:
   CArray data;
 
   A_Write_Router_Status_Request_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -790,8 +904,8 @@ public:
   CArray xor_data;
 
   A_MemoryBit_Write_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -806,8 +920,8 @@ public:
   eibkey_type key = 0;
 
   A_Authorize_Request_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -822,8 +936,8 @@ public:
   uint8_t level = 0;
 
   A_Authorize_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -839,8 +953,8 @@ public:
   eibkey_type key = 0;
 
   A_Key_Write_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -855,8 +969,8 @@ public:
   uint8_t level = 0;
 
   A_Key_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -880,8 +994,8 @@ public:
   uint16_t start_index = 0;
 
   A_PropertyValue_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -900,8 +1014,8 @@ public:
   CArray data;
 
   A_PropertyValue_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -920,8 +1034,8 @@ public:
   CArray data;
 
   A_PropertyValue_Write_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -938,8 +1052,8 @@ public:
   uint8_t property_index = 0;
 
   A_PropertyDescription_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -960,8 +1074,8 @@ public:
   uint8_t access = 0;
 
   A_PropertyDescription_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -977,8 +1091,8 @@ public:
   CArray test_info;
 
   A_NetworkParameter_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -994,8 +1108,8 @@ public:
   CArray test_info_result; // @todo unclear where test_info ends and test_result begins
 
   A_NetworkParameter_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1015,8 +1129,8 @@ public:
   serialnumber_t serial_number;
 
   A_IndividualAddressSerialNumber_Read_PDU ();
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1033,8 +1147,8 @@ public:
   CArray reserved;
 
   A_IndividualAddressSerialNumber_Response_PDU ();
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1051,8 +1165,8 @@ public:
   CArray reserved;
 
   A_IndividualAddressSerialNumber_Write_PDU ();
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1069,8 +1183,8 @@ public:
   bool appl_stopped = false;
 
   A_ServiceInformation_Indication_Write_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1085,8 +1199,8 @@ public:
   domainaddr_t domain_address = 0;
 
   A_DomainAddress_Write_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1100,8 +1214,8 @@ class A_DomainAddress_Read_PDU:public APDU
 public:
 
   A_DomainAddress_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1116,8 +1230,8 @@ public:
   domainaddr_t domain_address = 0;
 
   A_DomainAddress_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1134,8 +1248,8 @@ public:
   uint8_t range = 0;
 
   A_DomainAddressSelective_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1151,8 +1265,8 @@ public:
   CArray value;
 
   A_NetworkParameter_Write_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1168,8 +1282,8 @@ public:
   uint8_t start_index = 0;
 
   A_Link_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1187,8 +1301,8 @@ public:
   CArray group_address_list;
 
   A_Link_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1205,8 +1319,8 @@ public:
   eibaddr_t group_address = 0;
 
   A_Link_Write_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1221,8 +1335,8 @@ public:
   // @todo
 
   A_GroupPropValue_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1237,8 +1351,8 @@ public:
   // @todo
 
   A_GroupPropValue_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1253,8 +1367,8 @@ public:
   // @todo
 
   A_GroupPropValue_Write_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1269,8 +1383,8 @@ public:
   // @todo
 
   A_GroupPropValue_InfoReport_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1285,8 +1399,8 @@ public:
   serialnumber_t serial_number;
 
   A_DomainAddressSerialNumber_Read_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1302,8 +1416,8 @@ public:
   domainaddr_t domain_address = 0;
 
   A_DomainAddressSerialNumber_Response_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1319,8 +1433,8 @@ public:
   domainaddr_t domain_address = 0;
 
   A_DomainAddressSerialNumber_Write_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -1337,8 +1451,8 @@ public:
   CArray file_block;
 
   A_FileStream_InfoReport_PDU () = default;
-  virtual bool init (const CArray & p, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & p, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual APDU_type getType () const override
   {
@@ -0,0 +1,523 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "busmonfilter.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
+#include "apdu.h"
+#include "ldataview.h"
+
+enum
+{
+  OP_TEST, // acc = lo <= (field & mask) <= hi
+  OP_TESTN,// acc = !(lo <= (field & mask) <= hi), false if no field
+  OP_NOT,  // acc = !acc
+  OP_JF,   // if (!acc) goto arg
+  OP_JT,   // if (acc) goto arg
+};
+
+enum
+{
+  F_SRC,
+  F_DST,
+  F_GROUP,
+  F_PRIO,
+  F_REPEATED,
+  F_HOPS,
+  F_LEN,
+  F_APCI,
+  F_DATA,
+};
+
+/** limits, so that a client cannot make us recurse or allocate much */
+#define MAX_PROG 1024
+#define MAX_DEPTH 32
+
+static const struct
+{
+  const char *name;
+  uint8_t field;
+} fields[] =
+{
+  { "src", F_SRC },
+  { "dst", F_DST },
+  { "group", F_GROUP },
+  { "prio", F_PRIO },
+  { "repeated", F_REPEATED },
+  { "hops", F_HOPS },
+  { "len", F_LEN },
+  { "apci", F_APCI },
+  { "data", F_DATA },
+};
+
+static const struct
+{
+  const char *name;
+  uint16_t apci;
+} apci_names[] =
+{
+  { "read", A_GroupValue_Read },
+  { "response", A_GroupValue_Response },
+  { "write", A_GroupValue_Write },
+  { "individual_write", A_IndividualAddress_Write },
+  { "individual_read", A_IndividualAddress_Read },
+  { "individual_response", A_IndividualAddress_Response },
+  { "adc_read", A_ADC_Read },
+  { "adc_response", A_ADC_Response },
+  { "memory_read", A_Memory_Read },
+  { "memory_response", A_Memory_Response },
+  { "memory_write", A_Memory_Write },
+  { "descriptor_read", A_DeviceDescriptor_Read },
+  { "descriptor_response", A_DeviceDescriptor_Response },
+  { "restart", A_Restart },
+  { "restart_response", A_Restart_Response },
+  { "authorize_request", A_Authorize_Request },
+  { "property_read", A_PropertyValue_Read },
+  { "property_response", A_PropertyValue_Response },
+  { "property_write", A_PropertyValue_Write },
+};
+
+static const char *prio_names[] = { "system", "urgent", "normal", "low" };
+
+/** APCI with any data bits in the short forms masked off */
+static uint16_t
+apci_class (uint8_t t0, uint8_t t1)
+{
+  uint16_t a = ((t0 & 0x03) << 8) | t1;
+  switch (a >> 6)
+    {
+    case 0x0: case 0x1: case 0x2: case 0x6:
+    case 0x8: case 0x9: case 0xa: case 0xc: case 0xd:
+      return a & 0x3c0;
+    case 0x7:
+      if (a >= A_SystemNetworkParameter_Read && a <= 0x1cb)
+        return a;
+      return A_ADC_Response;
+    case 0xe:
+      return a & 0x3e0;
+    default:
+      return a;
+    }
+}
+
+bool
+BusmonFilter::match (const uint8_t *c, size_t len) const
+{
+  if (prog.empty())
+    return true;
+
+  /* L_Data frames only; ACKs and polls fail every test */
+  LDataView f (c, len, LDataView::TP1);
+  bool ok = f.valid ();
+  const uint8_t *lsdu = f.lsdu ();
+  unsigned tlen = f.lsdu_len ();
+
+  bool acc = true;
+  for (size_t pc = 0; pc < prog.size(); pc++)
+    {
+      const Insn& i = prog[pc];
+      switch (i.op)
+        {
+        case OP_TEST:
+        case OP_TESTN:
+          {
+            uint16_t v;
+            acc = ok;
+            if (!ok)
+              break;
+            switch (i.field)
+              {
+              case F_SRC:
+                v = f.source ();
+                break;
+              case F_DST:
+                v = f.destination ();
+                break;
+              case F_GROUP:
+                v = f.address_type () == GroupAddress;
+                break;
+              case F_PRIO:
+                v = f.priority ();
+                break;
+              case F_REPEATED:
+                v = f.repeated ();
+                break;
+              case F_HOPS:
+                v = f.hop_count ();
+                break;
+              case F_LEN:
+                v = tlen;
+                break;
+              case F_APCI:
+                acc = tlen >= 2;
+                v = acc ? apci_class (lsdu[0], lsdu[1]) : 0;
+                break;
+              case F_DATA:
+                acc = i.arg < tlen;
+                v = acc ? lsdu[i.arg] : 0;
+                break;
+              default:
+                acc = false;
+                v = 0;
+                break;
+              }
+            v &= i.mask;
+            acc = acc && ((v >= i.lo && v <= i.hi) != (i.op == OP_TESTN));
+          }
+          break;
+        case OP_NOT:
+          acc = !acc;
+          break;
+        case OP_JF:
+          if (!acc)
+            pc = i.arg - 1;
+          break;
+        case OP_JT:
+          if (acc)
+            pc = i.arg - 1;
+          break;
+        }
+    }
+  return acc;
+}
+
+bool
+BusmonFilter::compile (const std::string& expr, std::string& err)
+{
+  prog.clear();
+  src = expr;
+  pos = 0;
+  depth = 0;
+  error.clear();
+
+  next();
+  if (tok.empty())
+    return true;
+  if (parse_or ())
+    {
+      if (tok.empty())
+        {
+          src.clear();
+          return true;
+        }
+      error = "unexpected '" + tok + "'";
+    }
+  prog.clear();
+  src.clear();
+  err = error;
+  return false;
+}
+
+void
+BusmonFilter::next ()
+{
+  tok.clear();
+  while (pos < src.size() && isspace ((unsigned char) src[pos]))
+    pos++;
+  if (pos >= src.size())
+    return;
+
+  unsigned char c = src[pos];
+  if (isalnum (c) || c == '_' || c == '.' || c == '/')
+    {
+      while (pos < src.size() && (isalnum ((unsigned char) src[pos])
+                                  || src[pos] == '_' || src[pos] == '.' || src[pos] == '/'))
+        tok += src[pos++];
+      return;
+    }
+  if (pos + 1 < src.size())
+    {
+      std::string two = src.substr (pos, 2);
+      if (two == "||" || two == "&&" || two == "==" || two == "!=" || two == "<=" || two == ">=")
+        {
+          tok = two;
+          pos += 2;
+          return;
+        }
+    }
+  tok = c;
+  pos++;
+}
+
+bool
+BusmonFilter::emit (uint8_t op, uint8_t field, uint16_t arg,
+                    uint16_t mask, uint16_t lo, uint16_t hi)
+{
+  if (prog.size() >= MAX_PROG)
+    {
+      error = "expression too long";
+      return false;
+    }
+  prog.push_back ({ op, field, arg, mask, lo, hi });
+  return true;
+}
+
+bool
+BusmonFilter::parse_or ()
+{
+  std::vector<size_t> jumps;
+
+  if (!parse_and ())
+    return false;
+  while (tok == "||" || tok == "or")
+    {
+      jumps.push_back (prog.size());
+      if (!emit (OP_JT))
+        return false;
+      next();
+      if (!parse_and ())
+        return false;
+    }
+  for (size_t j : jumps)
+    prog[j].arg = prog.size();
+  return true;
+}
+
+bool
+BusmonFilter::parse_and ()
+{
+  std::vector<size_t> jumps;
+
+  if (!parse_factor ())
+    return false;
+  while (tok == "&&" || tok == "and")
+    {
+      jumps.push_back (prog.size());
+      if (!emit (OP_JF))
+        return false;
+      next();
+      if (!parse_factor ())
+        return false;
+    }
+  for (size_t j : jumps)
+    prog[j].arg = prog.size();
+  return true;
+}
+
+bool
+BusmonFilter::parse_factor ()
+{
+  bool res;
+
+  if (++depth > MAX_DEPTH)
+    {
+      error = "expression nested too deeply";
+      return false;
+    }
+  if (tok == "!" || tok == "not")
+    {
+      next();
+      res = parse_factor () && emit (OP_NOT);
+    }
+  else if (tok == "(")
+    {
+      next();
+      res = parse_or ();
+      if (res && tok != ")")
+        {
+          error = "missing ')'";
+          res = false;
+        }
+      if (res)
+        next();
+    }
+  else
+    res = parse_test ();
+  depth--;
+  return res;
+}
+
+bool
+BusmonFilter::parse_test ()
+{
+  uint8_t field = 0xff;
+  uint16_t arg = 0, mask = 0xffff, lo, hi, v;
+  bool neg = false;
+
+  for (auto& f : fields)
+    if (tok == f.name)
+      field = f.field;
+  if (field == 0xff)
+    {
+      error = tok.empty() ? "unexpected end" : "unknown field '" + tok + "'";
+      return false;
+    }
+  next();
+
+  if (field == F_DATA)
+    {
+      if (tok != "[")
+        {
+          error = "data needs an index";
+          return false;
+        }
+      next();
+      char *end;
+      unsigned long n = strtoul (tok.c_str(), &end, 0);
+      if (tok.empty() || *end || n > 0xff)
+        {
+          error = "bad data index '" + tok + "'";
+          return false;
+        }
+      arg = n;
+      next();
+      if (tok != "]")
+        {
+          error = "missing ']'";
+          return false;
+        }
+      next();
+    }
+
+  if (tok == "&")
+    {
+      next();
+      if (!parse_value (F_LEN, mask))
+        return false;
+      next();
+    }
+
+  if (tok == "in")
+    {
+      next();
+      if (!parse_value (field, lo))
+        return false;
+      next();
+      if (tok != "-")
+        {
+          error = "range needs a '-'";
+          return false;
+        }
+      next();
+      if (!parse_value (field, hi))
+        return false;
+      next();
+    }
+  else if (tok == "==" || tok == "!=" || tok == "<" || tok == "<=" || tok == ">" || tok == ">=")
+    {
+      std::string op = tok;
+      next();
+      if (!parse_value (field, v))
+        return false;
+      next();
+      lo = 0;
+      hi = 0xffff;
+      if (op == "==" || op == "!=")
+        {
+          lo = hi = v;
+          neg = (op == "!=");
+        }
+      else if (op == "<")
+        {
+          if (v)
+            hi = v - 1;
+          else
+            {
+              lo = 1;
+              hi = 0;
+            }
+        }
+      else if (op == "<=")
+        hi = v;
+      else if (op == ">")
+        {
+          if (v < 0xffff)
+            lo = v + 1;
+          else
+            {
+              lo = 1;
+              hi = 0;
+            }
+        }
+      else
+        lo = v;
+    }
+  else
+    {
+      lo = 1;
+      hi = 0xffff;
+    }
+
+  return emit (neg ? OP_TESTN : OP_TEST, field, arg, mask, lo, hi);
+}
+
+bool
+BusmonFilter::parse_value (uint8_t field, uint16_t& val)
+{
+  unsigned a, b, c;
+  char x;
+
+  if (tok.empty())
+    {
+      error = "missing value";
+      return false;
+    }
+  if (field == F_PRIO)
+    for (unsigned i = 0; i < 4; i++)
+      if (tok == prio_names[i])
+        {
+          val = i;
+          return true;
+        }
+  if (field == F_APCI)
+    for (auto& n : apci_names)
+      if (tok == n.name)
+        {
+          val = n.apci;
+          return true;
+        }
+
+  if (sscanf (tok.c_str(), "%u.%u.%u%c", &a, &b, &c, &x) == 3)
+    {
+      if (a > 0x0f || b > 0x0f || c > 0xff)
+        goto bad;
+      val = (a << 12) | (b << 8) | c;
+      return true;
+    }
+  if (sscanf (tok.c_str(), "%u/%u/%u%c", &a, &b, &c, &x) == 3)
+    {
+      if (a > 0x1f || b > 0x07 || c > 0xff)
+        goto bad;
+      val = (a << 11) | (b << 8) | c;
+      return true;
+    }
+  if (sscanf (tok.c_str(), "%u/%u%c", &a, &b, &x) == 2)
+    {
+      if (a > 0x1f || b > 0x7ff)
+        goto bad;
+      val = (a << 11) | b;
+      return true;
+    }
+
+  {
+    char *end;
+    unsigned long n = strtoul (tok.c_str(), &end, 0);
+    if (!*end && n <= 0xffff)
+      {
+        val = n;
+        return true;
+      }
+  }
+bad:
+  error = "bad value '" + tok + "'";
+  return false;
+}
@@ -0,0 +1,96 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/**
+ * @file
+ * @addtogroup Server
+ * @{
+ */
+
+#ifndef BUSMONFILTER_H
+#define BUSMONFILTER_H
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+/**
+ * Busmonitor filter expression.
+ *
+ * The expression is compiled once into a short program which is run
+ * against each raw TP1 frame, before the frame is copied or decoded.
+ *
+ *   expr   := term { ("||" | "or") term }
+ *   term   := factor { ("&&" | "and") factor }
+ *   factor := ("!" | "not") factor | "(" expr ")" | test
+ *   test   := field [ "&" mask ] [ op value | "in" value "-" value ]
+ *
+ * Fields: src dst group prio repeated hops len apci data[N]
+ * (data[0] is the TPCI octet). A field without comparison tests for
+ * non-zero. Values are numbers, X.Y.Z / A/B/C / A/B addresses,
+ * priority names (system urgent normal low) or APCI names.
+ * A test on a field the frame does not have (e.g. apci of an ACK) is false,
+ * "!=" included; "!" negates the test's result, so "!(apci == write)" is
+ * true for an ACK.
+ */
+class BusmonFilter
+{
+public:
+  /** compile @expr; an empty expression matches everything */
+  bool compile (const std::string& expr, std::string& err);
+  /** does the frame match? */
+  bool match (const uint8_t *frame, size_t len) const;
+  bool empty () const
+  {
+    return prog.empty();
+  }
+
+private:
+  struct Insn
+  {
+    uint8_t op;
+    uint8_t field;
+    uint16_t arg;
+    uint16_t mask;
+    uint16_t lo;
+    uint16_t hi;
+  };
+  std::vector<Insn> prog;
+
+  /* compiler state */
+  std::string src;
+  size_t pos;
+  int depth;
+  std::string tok;
+  std::string error;
+
+  void next ();
+  bool parse_or ();
+  bool parse_and ();
+  bool parse_factor ();
+  bool parse_test ();
+  bool parse_value (uint8_t field, uint16_t& val);
+  bool emit (uint8_t op, uint8_t field = 0, uint16_t arg = 0,
+             uint16_t mask = 0xffff, uint16_t lo = 0, uint16_t hi = 0);
+};
+
+#endif
+
+/** @} */
@@ -21,6 +21,11 @@
 
 #include "server.h"
 
+#ifdef HAVE_SHMRING
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
 A_Busmonitor::~A_Busmonitor ()
 {
   TRACEPRINTF (t, 7, "Close A_Busmonitor");
@@ -69,11 +74,25 @@ A_Busmonitor::setup (uint8_t *buf, size_t len)
 {
   CArray resp;
 
-  if (len != 2)
+  if (len < 2)
     {
       con->sendreject ();
       return false;
     }
+  if (len > 2)
+    {
+      /* the rest of the request is a filter expression */
+      std::string expr ((const char *)buf + 2, len - 2);
+      std::string err;
+      if (expr.back() == '\0')
+        expr.pop_back();
+      if (!filter.compile (expr, err))
+        {
+          TRACEPRINTF (t, 7, "bad filter '%s': %s", expr, err);
+          return false;
+        }
+      TRACEPRINTF (t, 7, "filter '%s'", expr);
+    }
 
   resp.setpart (buf, 0, 2);
   if (ts)
@@ -129,3 +148,115 @@ A_Text_Busmonitor::send_L_Busmonitor (LBusmonPtr p)
   con->sendmessage (buf.size(), buf.data());
 }
 
+
+A_Batch_Busmonitor::A_Batch_Busmonitor (ClientConnPtr c, bool virt)
+  : A_Busmonitor (c, virt, false)
+{
+  t->setAuxName("BBusMon");
+  flush.set<A_Batch_Busmonitor,&A_Batch_Busmonitor::flush_cb>(this);
+}
+
+A_Batch_Busmonitor::~A_Batch_Busmonitor ()
+{
+  stop();
+}
+
+void
+A_Batch_Busmonitor::stop()
+{
+  flush.stop();
+  A_Busmonitor::stop();
+}
+
+void
+A_Batch_Busmonitor::send_L_Busmonitor (LBusmonPtr p)
+{
+  size_t len = p->lpdu.size();
+
+  // a message may not exceed 64k
+  if (batch.size() + 11 + len > 0xffff)
+    flush_cb (flush, 0);
+  if (!batch.size())
+    {
+      batch.resize (2);
+      EIBSETTYPE (batch, EIB_BUSMONITOR_BATCH);
+      flush.start();
+    }
+
+  size_t pos = batch.size();
+  batch.resize (pos + 11 + len);
+  batch[pos] = ((len + 9) >> 8) & 0xff;
+  batch[pos+1] = (len + 9) & 0xff;
+  batch[pos+2] = p->l_status;
+  for (int i = 0; i < 8; i++)
+    batch[pos+3+i] = (p->rx_time >> (56 - 8*i)) & 0xff;
+  batch.setpart (p->lpdu.data(), pos + 11, len);
+}
+
+void
+A_Batch_Busmonitor::flush_cb (ev::prepare &, int)
+{
+  flush.stop();
+  if (!batch.size())
+    return;
+  con->sendmessage (batch.size(), batch.data());
+  batch.resize (0);
+}
+
+#ifdef HAVE_SHMRING
+A_Shm_Busmonitor::A_Shm_Busmonitor (ClientConnPtr c)
+  : A__Base(c)
+{
+  t->setAuxName("ShmBusMon");
+  TRACEPRINTF (t, 7, "Open A_Shm_Busmonitor");
+}
+
+A_Shm_Busmonitor::~A_Shm_Busmonitor ()
+{
+  TRACEPRINTF (t, 7, "Close A_Shm_Busmonitor");
+  stop();
+}
+
+bool
+A_Shm_Busmonitor::setup (uint8_t *buf, size_t len)
+{
+  if (len != 2)
+    return false;
+
+  ring = con->server->busmonitor_ring();
+  if (!ring)
+    {
+      TRACEPRINTF (t, 7, "no shared-memory ring on this server");
+      return false;
+    }
+
+  efd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (efd == -1)
+    {
+      ERRORPRINTF (t, E_ERROR | 136, "eventfd: %s", strerror(errno));
+      return false;
+    }
+  reader = ring->attach (efd);
+  if (reader < 0)
+    return false;
+
+  uint8_t resp[2];
+  int fds[3] = { ring->memfd(), efd, ring->ctlfd (reader) };
+  EIBSETTYPE (resp, EIB_OPEN_VBUSMONITOR_SHM);
+  return con->sendmessage_fds (sizeof(resp), resp, fds, 3);
+}
+
+void
+A_Shm_Busmonitor::stop()
+{
+  if (ring && reader >= 0)
+    ring->detach (reader);
+  reader = -1;
+  ring = nullptr;
+  if (efd >= 0)
+    {
+      close (efd);
+      efd = -1;
+    }
+}
+#endif
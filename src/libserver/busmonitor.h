@@ -27,6 +27,7 @@
 #ifndef BUSMONITOR_H
 #define BUSMONITOR_H
 
+#include "busmonfilter.h"
 #include "client.h"
 #include "connection.h"
 #include "link.h"
@@ -52,6 +53,10 @@ public:
   virtual void stop() override;
 
   void send_L_Busmonitor (LBusmonPtr l);
+  bool want_L_Busmonitor (const CArray& frame)
+  {
+    return filter.match (frame.data(), frame.size());
+  }
   // dummy method
   virtual void recv_Data(uint8_t *, size_t) override {}
 
@@ -60,6 +65,8 @@ protected:
   Router& router;
   /** debug output */
   TracePtr t;
+  /** frames the client asked for */
+  BusmonFilter filter;
 
 private:
   /** is virtual busmonitor */
@@ -89,6 +96,52 @@ public:
   void send_L_Busmonitor (LBusmonPtr l);
 };
 
+/**
+ * implements batched binary busmonitor functions for a client:
+ * all frames seen during one event loop iteration are sent as one
+ * EIB_BUSMONITOR_BATCH message of records
+ * (length:2, status:1, reception time in ns:8, frame)
+ */
+class A_Batch_Busmonitor:public A_Busmonitor
+{
+public:
+  A_Batch_Busmonitor (ClientConnPtr c, bool virt);
+  virtual ~A_Batch_Busmonitor ();
+  virtual void stop() override;
+
+  void send_L_Busmonitor (LBusmonPtr l);
+
+private:
+  /** pending batch, starting with the message type */
+  CArray batch;
+  ev::prepare flush;
+  void flush_cb (ev::prepare &w, int revents);
+};
+
+#ifdef HAVE_SHMRING
+#include "busmonring.h"
+
+/** hands the client the shared-memory vbusmonitor ring of its server */
+class A_Shm_Busmonitor:public A__Base
+{
+public:
+  A_Shm_Busmonitor (ClientConnPtr c);
+  virtual ~A_Shm_Busmonitor ();
+  virtual bool setup(uint8_t *buf,size_t len) override;
+  virtual void stop() override;
+
+  // dummy method
+  virtual void recv_Data(uint8_t *, size_t) override {}
+
+private:
+  BusmonRingPtr ring;
+  /** reader slot in the ring */
+  int reader = -1;
+  /** wakeup eventfd */
+  int efd = -1;
+};
+#endif
+
 #endif
 
 /** @} */
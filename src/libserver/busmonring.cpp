@@ -0,0 +1,236 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "busmonring.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+BusmonRing::BusmonRing (Router& r, TracePtr tr, unsigned s, unsigned rs)
+  : L_Busmonitor_CallBack(ring_name), router(r), ring_name("shmring")
+{
+  t = TracePtr(new Trace(*tr));
+  t->setAuxName("ShmRing");
+
+  slots = 1;
+  while (slots < s)
+    slots <<= 1;
+  recsize = (rs + 7) & ~7U;
+  if (recsize < sizeof(struct eib_shmring_rec) + 24)
+    recsize = sizeof(struct eib_shmring_rec) + 24;
+}
+
+BusmonRing::~BusmonRing ()
+{
+  for (unsigned i = 0; i < EIB_SHMRING_MAXREADERS; i++)
+    if (readers[i].efd >= 0)
+      detach (i);
+  unmap();
+}
+
+bool
+BusmonRing::map()
+{
+  if (hdr)
+    return true;
+
+  recoffset = (sizeof(struct eib_shmring_hdr) + 63) & ~size_t(63);
+  maplen = recoffset + size_t(slots) * recsize;
+  head = 0;
+
+  fd = memfd_create ("knxd-busmonitor", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd == -1)
+    {
+      ERRORPRINTF (t, E_ERROR | 132, "memfd_create: %s", strerror(errno));
+      return false;
+    }
+  if (ftruncate (fd, maplen) == -1)
+    {
+      ERRORPRINTF (t, E_ERROR | 133, "ftruncate %d: %s", maplen, strerror(errno));
+      goto ex;
+    }
+  hdr = (struct eib_shmring_hdr *) mmap (NULL, maplen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (hdr == MAP_FAILED)
+    {
+      hdr = nullptr;
+      ERRORPRINTF (t, E_ERROR | 134, "mmap %d: %s", maplen, strerror(errno));
+      goto ex;
+    }
+  /* Our own mapping stays writable; every later one must be read-only,
+   * and nobody may resize the memfd under us. */
+  if (fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) == -1)
+    {
+      ERRORPRINTF (t, E_ERROR | 179, "seal ring: %s", strerror(errno));
+      munmap (hdr, maplen);
+      hdr = nullptr;
+      goto ex;
+    }
+
+  /* the memfd is zero-filled, so every record starts out "never written" */
+  hdr->version = EIB_SHMRING_VERSION;
+  hdr->slots = slots;
+  hdr->recsize = recsize;
+  hdr->recoffset = recoffset;
+  hdr->head = head;
+  __atomic_store_n (&hdr->magic, EIB_SHMRING_MAGIC, __ATOMIC_RELEASE);
+
+  TRACEPRINTF (t, 7, "ring: %d slots of %d bytes", slots, recsize);
+  return true;
+
+ex:
+  close (fd);
+  fd = -1;
+  return false;
+}
+
+void
+BusmonRing::unmap()
+{
+  if (hdr)
+    {
+      munmap (hdr, maplen);
+      hdr = nullptr;
+    }
+  if (fd >= 0)
+    {
+      close (fd);
+      fd = -1;
+    }
+}
+
+int
+BusmonRing::attach (int efd)
+{
+  if (!map())
+    return -1;
+
+  for (unsigned i = 0; i < EIB_SHMRING_MAXREADERS; i++)
+    {
+      Reader &r = readers[i];
+      if (r.efd >= 0)
+        continue;
+
+      r.ctlfd = memfd_create ("knxd-busmonitor-reader", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+      if (r.ctlfd == -1)
+        {
+          ERRORPRINTF (t, E_ERROR | 180, "memfd_create: %s", strerror(errno));
+          return -1;
+        }
+      if (ftruncate (r.ctlfd, sizeof(struct eib_shmring_reader)) == -1
+          || fcntl (r.ctlfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1)
+        {
+          ERRORPRINTF (t, E_ERROR | 181, "control page: %s", strerror(errno));
+          goto ex;
+        }
+      r.ctl = (struct eib_shmring_reader *)
+              mmap (NULL, sizeof(struct eib_shmring_reader), PROT_READ | PROT_WRITE, MAP_SHARED, r.ctlfd, 0);
+      if (r.ctl == MAP_FAILED)
+        {
+          r.ctl = nullptr;
+          ERRORPRINTF (t, E_ERROR | 182, "mmap control page: %s", strerror(errno));
+          goto ex;
+        }
+      if (!n_readers && !router.registerVBusmonitor (this))
+        goto ex;
+      r.efd = efd;
+      n_readers++;
+      TRACEPRINTF (t, 7, "reader %d attached", i);
+      return i;
+
+ex:
+      if (r.ctl)
+        munmap (r.ctl, sizeof(struct eib_shmring_reader));
+      r.ctl = nullptr;
+      close (r.ctlfd);
+      r.ctlfd = -1;
+      return -1;
+    }
+  ERRORPRINTF (t, E_WARNING | 135, "too many ring readers");
+  return -1;
+}
+
+void
+BusmonRing::detach (int reader)
+{
+  if (reader < 0 || reader >= EIB_SHMRING_MAXREADERS || readers[reader].efd < 0)
+    return;
+  Reader &r = readers[reader];
+  munmap (r.ctl, sizeof(struct eib_shmring_reader));
+  r.ctl = nullptr;
+  close (r.ctlfd);
+  r.ctlfd = -1;
+  r.efd = -1;
+  TRACEPRINTF (t, 7, "reader %d detached", reader);
+  if (!--n_readers)
+    router.deregisterVBusmonitor (this);
+}
+
+void
+BusmonRing::send_L_Busmonitor (LBusmonPtr l)
+{
+  if (!hdr)
+    return;
+
+  uint64_t n = head++;
+  struct eib_shmring_rec *rec = (struct eib_shmring_rec *)
+                                ((uint8_t *)hdr + recoffset + (n & (slots - 1)) * recsize);
+  size_t room = recsize - sizeof(struct eib_shmring_rec);
+  size_t len = l->lpdu.size();
+
+  __atomic_store_n (&rec->seq, 2*n+1, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+
+  rec->ts_sec = l->rx_time / 1000000000;
+  rec->ts_nsec = l->rx_time % 1000000000;
+  rec->status = l->l_status;
+  rec->flags = 0;
+  rec->len = len;
+  if (len > room)
+    {
+      rec->flags |= EIB_SHMRING_TRUNCATED;
+      len = room;
+    }
+  memcpy (rec->data, l->lpdu.data(), len);
+
+  __atomic_store_n (&rec->seq, 2*n+2, __ATOMIC_RELEASE);
+  __atomic_store_n (&hdr->head, head, __ATOMIC_RELEASE);
+
+  /* pairs with the reader's fence between setting "waiting" and
+   * re-checking the head */
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  for (unsigned i = 0; i < EIB_SHMRING_MAXREADERS; i++)
+    {
+      Reader &r = readers[i];
+      if (r.efd < 0)
+        continue;
+      if (!__atomic_load_n (&r.ctl->waiting, __ATOMIC_RELAXED))
+        continue;
+      if (!__atomic_exchange_n (&r.ctl->waiting, 0, __ATOMIC_ACQ_REL))
+        continue;
+      uint64_t one = 1;
+      if (write (r.efd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+        TRACEPRINTF (t, 7, "reader %d: wakeup: %s", i, strerror(errno));
+    }
+}
@@ -0,0 +1,103 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/**
+ * @file
+ * @addtogroup Server
+ * @{
+ */
+
+#ifndef BUSMONRING_H
+#define BUSMONRING_H
+
+#include "link.h"
+#include "router.h"
+#include "shmring.h"
+
+/**
+ * Shared-memory vbusmonitor ring.
+ *
+ * One ring is shared by all local clients which asked for it; the ring
+ * is registered as a vbusmonitor only while at least one reader is
+ * attached. See shmring.h for the layout.
+ */
+class BusmonRing : public L_Busmonitor_CallBack
+{
+public:
+  /**
+   * @param r router to monitor
+   * @param tr debug output
+   * @param slots number of records, rounded up to a power of two
+   * @param recsize size of one record, including its header
+   */
+  BusmonRing (Router& r, TracePtr tr, unsigned slots, unsigned recsize);
+  virtual ~BusmonRing ();
+
+  /** attach a reader which sleeps on @efd; returns the reader slot or -1 */
+  int attach (int efd);
+  /** detach a reader */
+  void detach (int reader);
+  /** the memfd backing the ring; it can only be mapped read-only */
+  int memfd() const
+  {
+    return fd;
+  }
+  /** the memfd backing the control page of @reader */
+  int ctlfd(int reader) const
+  {
+    return readers[reader].ctlfd;
+  }
+
+  void send_L_Busmonitor (LBusmonPtr l);
+
+private:
+  Router& router;
+  TracePtr t;
+  std::string ring_name;
+
+  /* Ring geometry and position. These are only ever stored into the
+   * mapping, never read back. */
+  unsigned slots;
+  unsigned recsize;
+  size_t recoffset = 0;
+  uint64_t head = 0;
+
+  int fd = -1;
+  struct eib_shmring_hdr *hdr = nullptr;
+  size_t maplen = 0;
+
+  struct Reader
+  {
+    /** eventfd, -1 if unused */
+    int efd = -1;
+    int ctlfd = -1;
+    struct eib_shmring_reader *ctl = nullptr;
+  };
+  Reader readers[EIB_SHMRING_MAXREADERS];
+  unsigned n_readers = 0;
+
+  bool map();
+  void unmap();
+};
+
+using BusmonRingPtr = std::shared_ptr<BusmonRing>;
+
+#endif
+
+/** @} */
@@ -21,6 +21,7 @@
 #include "config.h"
 
 #include <cerrno>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #ifdef HAVE_BUSMONITOR
@@ -35,7 +36,7 @@
 #endif
 #include "server.h"
 
-ClientConnection::ClientConnection (NetServerPtr s, int fd) : router(static_cast<Router&>(s->router)), sendbuf(fd),recvbuf(fd)
+ClientConnection::ClientConnection (NetServerPtr s, int fd, bool packet) : router(static_cast<Router&>(s->router)), sendbuf(fd),recvbuf(fd)
 {
   t = TracePtr(new Trace(*(s->t)));
   t->setAuxName("CConn");
@@ -46,10 +47,14 @@ ClientConnection::ClientConnection (NetServerPtr s, int fd) : router(static_cast
   this->addr = router.get_client_addr(this->t);
 
   this->fd = fd;
+  this->packet = packet;
 
   recvbuf.on_read.set<ClientConnection,&ClientConnection::read_cb>(this);
   recvbuf.on_error.set<ClientConnection,&ClientConnection::error_cb>(this);
   sendbuf.on_error.set<ClientConnection,&ClientConnection::error_cb>(this);
+  sendbuf.on_overflow.set<ClientConnection,&ClientConnection::overflow_cb>(this);
+  sendbuf.on_next.set<ClientConnection,&ClientConnection::drained_cb>(this);
+  sendbuf.set_limit(s->max_output, s->output_policy, &s->output_budget);
 }
 
 ClientConnection::~ClientConnection ()
@@ -62,9 +67,23 @@ ClientConnection::~ClientConnection ()
 void
 ClientConnection::error_cb ()
 {
+  if (sendbuf.overflowed())
+    ERRORPRINTF (t, E_WARNING | 139, "%s: output budget exceeded (%d bytes queued), disconnecting", FormatEIBAddr (addr), sendbuf.pending());
   stop();
 }
 
+void
+ClientConnection::overflow_cb ()
+{
+  if (!overflow_reported)
+    {
+      ERRORPRINTF (t, E_WARNING | 140, "%s: output budget exceeded (%d bytes queued), dropping messages", FormatEIBAddr (addr), sendbuf.pending());
+      overflow_reported = true;
+    }
+  else
+    TRACEPRINTF (t, 8, "dropped messages: %d", sendbuf.dropped_total);
+}
+
 bool
 ClientConnection::setup()
 {
@@ -79,7 +98,13 @@ ClientConnection::start()
   if (fd == -1)
     return;
   sendbuf.start();
-  recvbuf.start();
+  if (packet)
+    {
+      packet_io.set<ClientConnection,&ClientConnection::packet_cb>(this);
+      packet_io.start(fd, ev::READ);
+    }
+  else
+    recvbuf.start();
 
   if (!addr)
     {
@@ -93,6 +118,8 @@ ClientConnection::start()
 void
 ClientConnection::stop()
 {
+  if (sendbuf.dropped_total)
+    ERRORPRINTF (t, E_NOTICE | 141, "%s: %d messages were dropped", FormatEIBAddr (addr), sendbuf.dropped_total);
   if (addr)
     {
       TRACEPRINTF (t, 8, "ClientConnection %s closing", FormatEIBAddr (addr));
@@ -107,6 +134,7 @@ ClientConnection::stop()
     return;
   sendbuf.stop();
   recvbuf.stop();
+  packet_io.stop();
   close (fd);
   fd = -1;
   running = false;
@@ -138,7 +166,37 @@ ClientConnection::read_cb (uint8_t *buf, size_t len)
   unsigned int xlen = (buf[0] << 8) | (buf[1]);
   if (len < xlen+2)
     return 0;
-  buf += 2;
+  handle_message (buf+2, xlen);
+  return xlen+2;
+}
+
+void
+ClientConnection::packet_cb (ev::io &, int)
+{
+  /* messages are at most 64k; the event loop is single-threaded */
+  static uint8_t buf[0x10000];
+
+  ssize_t len = recv (fd, buf, sizeof(buf), 0);
+  if (len == -1)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+          TRACEPRINTF (t, 8, "recv: %s", strerror(errno));
+          stop();
+        }
+      return;
+    }
+  if (len < 2)
+    {
+      stop();
+      return;
+    }
+  handle_message (buf, len);
+}
+
+void
+ClientConnection::handle_message (uint8_t *buf, size_t xlen)
+{
   t->TracePacket (0, "ReadMessage", xlen, buf);
 
   int msg = EIBTYPE (buf);
@@ -151,7 +209,7 @@ ClientConnection::read_cb (uint8_t *buf, size_t len)
         }
       else
         a_conn->recv_Data(buf,xlen);
-      return xlen+2;
+      return;
     }
 
   switch (msg)
@@ -180,6 +238,20 @@ ClientConnection::read_cb (uint8_t *buf, size_t len)
     case EIB_OPEN_VBUSMONITOR_TS:
       a_conn = new A_Busmonitor (SFT, true, true);
       goto new_a_conn;
+
+    case EIB_OPEN_BUSMONITOR_BATCH:
+      a_conn = new A_Batch_Busmonitor (SFT, false);
+      goto new_a_conn;
+
+    case EIB_OPEN_VBUSMONITOR_BATCH:
+      a_conn = new A_Batch_Busmonitor (SFT, true);
+      goto new_a_conn;
+
+#ifdef HAVE_SHMRING
+    case EIB_OPEN_VBUSMONITOR_SHM:
+      a_conn = new A_Shm_Busmonitor (SFT);
+      goto new_a_conn;
+#endif
 #endif
     case EIB_OPEN_T_BROADCAST:
       a_conn = new A_Broadcast (SFT);
@@ -276,8 +348,6 @@ new_a_conn:
         }
       break;
     }
-
-  return xlen+2;
 }
 
 void
@@ -296,15 +366,100 @@ ClientConnection::sendreject (int type)
   sendmessage (2, buf);
 }
 
+void
+ClientConnection::drained_cb ()
+{
+  /* Report the gap only once the queue is empty: a notice queued
+   * earlier could itself be dropped, losing its count. */
+  if (server->output_policy != SB_DROP_OLDEST)
+    return;
+  unsigned long lost = sendbuf.take_dropped();
+  if (!lost)
+    return;
+
+  uint8_t gap[6];
+  EIBSETTYPE (gap, EIB_MESSAGES_LOST);
+  gap[2] = (lost >> 24) & 0xff;
+  gap[3] = (lost >> 16) & 0xff;
+  gap[4] = (lost >> 8) & 0xff;
+  gap[5] = (lost) & 0xff;
+  sendmessage (sizeof(gap), gap);
+}
+
 void
 ClientConnection::sendmessage (int size, const uint8_t * msg)
+{
+  assert (size >= 2);
+  t->TracePacket (0, "Send", size, msg);
+  if (packet)
+    {
+      sendbuf.write(msg,size);
+      return;
+    }
+
+  /* one buffer, so that the header does not cost a syscall of its own */
+  CArray *data = new CArray();
+  data->resize(size+2);
+  (*data)[0] = (size >> 8) & 0xff;
+  (*data)[1] = (size) & 0xff;
+  data->setpart(msg, 2, size);
+  sendbuf.write(data);
+}
+
+bool
+ClientConnection::sendmessage_fds (int size, const uint8_t * msg, const int *fds, int nfds)
 {
   uint8_t head[2];
+  struct iovec iov[2];
+  struct msghdr mh;
+  union
+  {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int) * 4)];
+  } cbuf;
+  struct cmsghdr *cm;
+
   assert (size >= 2);
+  assert (nfds > 0 && nfds <= 4);
+
+  /* the descriptors must travel with the first byte of the message */
+  if (!sendbuf.idle())
+    {
+      TRACEPRINTF (t, 7, "cannot pass descriptors: output pending");
+      return false;
+    }
+
   head[0] = (size >> 8) & 0xff;
   head[1] = (size) & 0xff;
-
-  t->TracePacket (0, "Send", size, msg);
-  sendbuf.write(head,2);
-  sendbuf.write(msg,size);
+  iov[0].iov_base = head;
+  iov[0].iov_len = 2;
+  iov[1].iov_base = (void *)msg;
+  iov[1].iov_len = size;
+
+  memset (&mh, 0, sizeof(mh));
+  mh.msg_iov = packet ? iov+1 : iov;
+  mh.msg_iovlen = packet ? 1 : 2;
+  mh.msg_control = cbuf.buf;
+  mh.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+  cm = CMSG_FIRSTHDR(&mh);
+  cm->cmsg_level = SOL_SOCKET;
+  cm->cmsg_type = SCM_RIGHTS;
+  cm->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+  memcpy (CMSG_DATA(cm), fds, sizeof(int) * nfds);
+
+  t->TracePacket (0, "SendFD", size, msg);
+  ssize_t i = sendmsg (fd, &mh, MSG_NOSIGNAL);
+  if (i == -1)
+    {
+      TRACEPRINTF (t, 7, "sendmsg: %s", strerror(errno));
+      return false;
+    }
+  /* the kernel took the descriptors; queue whatever did not fit */
+  if (packet)
+    return true;
+  if (i < 2)
+    sendbuf.write(head+i,2-i);
+  if (i < size+2)
+    sendbuf.write(msg+(i > 2 ? i-2 : 0),size-(i > 2 ? i-2 : 0));
+  return true;
 }
@@ -54,7 +54,7 @@ public:
   /** server creating this connection */
   NetServerPtr server;
 
-  ClientConnection (NetServerPtr s, int fd);
+  ClientConnection (NetServerPtr s, int fd, bool packet = false);
   virtual ~ClientConnection ();
   bool setup();
   void start();
@@ -62,6 +62,10 @@ public:
 
   size_t read_cb(uint8_t *buf, size_t len);
   void error_cb();
+  void overflow_cb();
+  void drained_cb();
+  /** process one complete message */
+  void handle_message(uint8_t *buf, size_t len);
 
   /** send a message */
   void sendmessage (int size, const uint8_t * msg);
@@ -69,6 +73,8 @@ public:
   void sendreject ();
   /** sends a reject with code @code */
   void sendreject (int code);
+  /** send a message which carries file descriptors (Unix sockets only) */
+  bool sendmessage_fds (int size, const uint8_t * msg, const int *fds, int nfds);
 
 protected:
   /** sending */
@@ -77,10 +83,17 @@ protected:
   A__Base *a_conn = nullptr;
 
   void exit_conn();
+  /** the first drop has been logged */
+  bool overflow_reported = false;
 
 private:
   /** client connection */
   int fd;
+
+  /** SOCK_SEQPACKET: one message per packet, without length header */
+  bool packet;
+  ev::io packet_io;
+  void packet_cb (ev::io &w, int revents);
 };
 
 using ClientConnPtr = std::shared_ptr<ClientConnection>;
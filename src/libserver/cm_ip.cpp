@@ -26,13 +26,13 @@
 #include <unistd.h>
 
 CArray
-IPtoEIBNetIP (const struct sockaddr_in * a, bool nat)
+IPtoEIBNetIP (const struct sockaddr_in * a, bool nat, bool tcp)
 {
   CArray buf;
   buf.resize (8);
   buf[0] = 0x08;
-  buf[1] = 0x01;
-  if (nat)
+  buf[1] = tcp ? 0x02 : 0x01;
+  if (nat || tcp)
     {
       buf[2] = 0;
       buf[3] = 0;
@@ -59,7 +59,7 @@ EIBnettoIP (const CArray & buf, struct sockaddr_in *a,
 {
   int ip, port;
   memset (a, 0, sizeof (*a));
-  if (buf[0] != 0x8 || buf[1] != 0x1)
+  if (buf[0] != 0x8 || (buf[1] != 0x1 && buf[1] != 0x2))
     return true;
   ip = (buf[2] << 24) | (buf[3] << 16) | (buf[4] << 8) | (buf[5]);
   port = (buf[6] << 8) | (buf[7]);
@@ -67,11 +67,11 @@ EIBnettoIP (const CArray & buf, struct sockaddr_in *a,
   a->sin_len = sizeof (*a);
 #endif
   a->sin_family = AF_INET;
-  if (port == 0)
+  if (port == 0 || buf[1] == 0x2)
     a->sin_port = src->sin_port;
   else
     a->sin_port = htons (port);
-  if (ip == 0)
+  if (ip == 0 || buf[1] == 0x2)
     {
       nat = true;
       a->sin_addr.s_addr = src->sin_addr.s_addr;
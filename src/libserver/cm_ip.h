@@ -29,10 +29,10 @@
 
 #include "common.h"
 
-/** convert a to EIBnet/IP format */
-CArray IPtoEIBNetIP (const struct sockaddr_in *a, bool nat);
+/** convert a to EIBnet/IP format; a TCP HPAI carries no address */
+CArray IPtoEIBNetIP (const struct sockaddr_in *a, bool nat, bool tcp = false);
 
-/** convert EIBnet/IP IP Address to a */
+/** convert EIBnet/IP IP Address to a; for a TCP HPAI, this is src */
 bool EIBnettoIP (const CArray & buf, struct sockaddr_in *a,
                  const struct sockaddr_in *src, bool & nat);
 
@@ -19,111 +19,143 @@
 
 #include "cm_tp1.h"
 
+#include <cstring>
+
 /* L_Data */
 
-LDataPtr CM_TP1_to_L_Data (const CArray & c, TracePtr)
+bool
+CM_TP1_to_L_Data (const uint8_t *c, size_t len, L_Data_PDU & l)
 {
-  LDataPtr l = LDataPtr(new L_Data_PDU ());
-  if (c.size() < 6)
-    return nullptr;
+  l.clear ();
+  if (len < 6)
+    return false;
   if ((c[0] & 0x53) != 0x10)
-    return nullptr;
-  l->frame_format = (c[0] & 0x80) ? 1 : 0;
-  l->repeated = (c[0] & 0x20) ? 0 : 1;
-  l->priority = static_cast<EIB_Priority>((c[0] >> 2) & 0x3);
-  l->valid_length = 1;
-  if (l->frame_format)
+    return false;
+  l.frame_format = (c[0] & 0x80) ? 1 : 0;
+  l.repeated = (c[0] & 0x20) ? 0 : 1;
+  l.priority = static_cast<EIB_Priority>((c[0] >> 2) & 0x3);
+  l.valid_length = 1;
+  if (l.frame_format)
     {
       /* Standard frame */
-      l->source_address = (c[1] << 8) | (c[2]);
-      l->destination_address = (c[3] << 8) | (c[4]);
-      l->address_type = (c[5] & 0x80) ? GroupAddress : IndividualAddress;
-      l->hop_count = (c[5] >> 4) & 0x07; // @todo this is NPDU
-      uint8_t len = (c[5] & 0x0f) + 1;
-      if (len + 7 != c.size())
-        return nullptr;
-      l->lsdu.set (c.data() + 6, len);
+      l.source_address = (c[1] << 8) | (c[2]);
+      l.destination_address = (c[3] << 8) | (c[4]);
+      l.address_type = (c[5] & 0x80) ? GroupAddress : IndividualAddress;
+      l.hop_count = (c[5] >> 4) & 0x07; // @todo this is NPDU
+      uint8_t dlen = (c[5] & 0x0f) + 1;
+      if (dlen + 7u != len)
+        return false;
+      l.lsdu.set (c + 6, dlen);
     }
   else
     {
       /* extended frame */
       if ((c[1] & 0x0f) != 0)
-        return nullptr;
-      if (c.size() < 7)
-        return nullptr;
-      l->address_type = (c[1] & 0x80) ? GroupAddress : IndividualAddress;
-      l->hop_count = (c[1] >> 4) & 0x07; // @todo this is NPDU
-      l->source_address = (c[2] << 8) | (c[3]);
-      l->destination_address = (c[4] << 8) | (c[5]);
-      uint8_t len = c[6] + 1;
-      if (len + 8 != c.size())
+        return false;
+      if (len < 7)
+        return false;
+      l.address_type = (c[1] & 0x80) ? GroupAddress : IndividualAddress;
+      l.hop_count = (c[1] >> 4) & 0x07; // @todo this is NPDU
+      l.source_address = (c[2] << 8) | (c[3]);
+      l.destination_address = (c[4] << 8) | (c[5]);
+      unsigned dlen = c[6] + 1;
+      if (dlen + 8 != len)
         {
-          if (c.size() == 23)
+          if (len == 23)
             {
-              l->valid_length = 0;
-              l->lsdu.set (c.data() + 7, 8);
+              l.valid_length = 0;
+              l.lsdu.set (c + 7, 8);
             }
           else
-            return nullptr;
+            return false;
         }
       else
-        l->lsdu.set (c.data() + 7, len);
+        l.lsdu.set (c + 7, dlen);
     }
 
   /* checksum */
   uint8_t checksum = 0;
-  for (unsigned i = 0; i < c.size () - 1; i++)
+  for (unsigned i = 0; i < len - 1; i++)
     checksum ^= c[i];
   checksum = ~checksum;
-  l->valid_checksum = (c[c.size () - 1] == checksum);
+  l.valid_checksum = (c[len - 1] == checksum);
 
+  return true;
+}
+
+LDataPtr CM_TP1_to_L_Data (const CArray & c, TracePtr)
+{
+  LDataPtr l = LDataPtr(new L_Data_PDU ());
+  if (!CM_TP1_to_L_Data (c.data(), c.size(), *l))
+    return nullptr;
   return l;
 }
 
-CArray L_Data_to_CM_TP1 (const LDataPtr & p)
+size_t
+CM_TP1_encode (bool repeated, EIB_Priority prio, EIB_AddrType type,
+               uint8_t hops, eibaddr_t src, eibaddr_t dst,
+               const uint8_t *lsdu, size_t lsdu_len,
+               uint8_t *pdu, size_t max)
 {
-  assert (p->lsdu.size() >= 1);
-  assert (p->lsdu.size() <= 0xff);
-  assert ((p->hop_count & 0xf8) == 0);
+  size_t size = lsdu_len + (lsdu_len <= 0x10 ? 7 : 8);
+  if (size > max)
+    return 0;
 
-  CArray pdu;
-  uint8_t len = p->lsdu.size() - 1;
+  uint8_t len = lsdu_len - 1;
   if (len <= 0x0f)
     {
       /* L_Data_Standard Frame */
-      pdu.resize (7 + p->lsdu.size());
-      pdu[0] = 0x90 | (p->repeated ? 0x00 : 0x20) | (p->priority << 2);
-      pdu[1] = p->source_address >> 8;
-      pdu[2] = p->source_address & 0xff;
-      pdu[3] = p->destination_address >> 8;
-      pdu[4] = p->destination_address & 0xff;
+      pdu[0] = 0x90 | (repeated ? 0x00 : 0x20) | (prio << 2);
+      pdu[1] = src >> 8;
+      pdu[2] = src & 0xff;
+      pdu[3] = dst >> 8;
+      pdu[4] = dst & 0xff;
       pdu[5] =
-        (p->address_type == GroupAddress ? 0x80 : 0x00) |
-        ((p->hop_count & 0x07) << 4) |
+        (type == GroupAddress ? 0x80 : 0x00) |
+        ((hops & 0x07) << 4) |
         (len & 0x0f);
-      pdu.setpart (p->lsdu.data(), 6, 1 + (len & 0x0f));
+      memcpy (pdu + 6, lsdu, lsdu_len);
     }
   else
     {
       /* L_Data_Extended Frame */
-      pdu.resize (8 + p->lsdu.size());
-      pdu[0] = 0x10 | (p->repeated ? 0x00 : 0x20) | (p->priority << 2);
+      pdu[0] = 0x10 | (repeated ? 0x00 : 0x20) | (prio << 2);
       pdu[1] =
-        (p->address_type == GroupAddress ? 0x80 : 0x00) |
-        ((p->hop_count & 0x07) << 4);
-      pdu[2] = p->source_address >> 8;
-      pdu[3] = p->source_address & 0xff;
-      pdu[4] = p->destination_address >> 8;
-      pdu[5] = p->destination_address & 0xff;
-      pdu[6] = (p->lsdu.size() - 1) & 0xff;
-      pdu.setpart (p->lsdu.data(), 7, 1 + (len & 0xff));
+        (type == GroupAddress ? 0x80 : 0x00) |
+        ((hops & 0x07) << 4);
+      pdu[2] = src >> 8;
+      pdu[3] = src & 0xff;
+      pdu[4] = dst >> 8;
+      pdu[5] = dst & 0xff;
+      pdu[6] = len;
+      memcpy (pdu + 7, lsdu, lsdu_len);
     }
 
   /* checksum */
   uint8_t checksum = 0;
-  for (unsigned i = 0; i < pdu.size() - 1; i++)
+  for (unsigned i = 0; i < size - 1; i++)
     checksum ^= pdu[i];
-  pdu[pdu.size() - 1] = ~checksum;
+  pdu[size - 1] = ~checksum;
+
+  return size;
+}
+
+size_t
+L_Data_to_CM_TP1 (const L_Data_PDU & p, uint8_t *pdu, size_t max)
+{
+  assert (p.lsdu.size() >= 1);
+  assert (p.lsdu.size() <= 0xff);
+  assert ((p.hop_count & 0xf8) == 0);
 
+  return CM_TP1_encode (p.repeated, p.priority, p.address_type, p.hop_count,
+                        p.source_address, p.destination_address,
+                        p.lsdu.data(), p.lsdu.size(), pdu, max);
+}
+
+CArray L_Data_to_CM_TP1 (const LDataPtr & p)
+{
+  CArray pdu;
+  pdu.resize (L_Data_CM_TP1_size (*p));
+  L_Data_to_CM_TP1 (*p, pdu.data(), pdu.size());
   return pdu;
 }
@@ -29,6 +29,37 @@
 
 #include "lpdu.h"
 
+/** the longest TP1 L_Data frame: extended header, 255 octets LSDU, checksum */
+#define CM_TP1_MAX_FRAME (7 + 255 + 1)
+
+/** length of the TP1 frame for @p */
+inline size_t L_Data_CM_TP1_size (const L_Data_PDU & p)
+{
+  return p.lsdu.size() + (p.lsdu.size() <= 0x10 ? 7 : 8);
+}
+
+/**
+ * Encode a TP1 L_Data frame with these fields into @buf.
+ * @return the frame's length, 0 if it doesn't fit into @max octets
+ */
+size_t CM_TP1_encode (bool repeated, EIB_Priority prio, EIB_AddrType type,
+                      uint8_t hops, eibaddr_t src, eibaddr_t dst,
+                      const uint8_t *lsdu, size_t lsdu_len,
+                      uint8_t *buf, size_t max);
+
+/**
+ * Encode L_Data_PDU as TP1 frame into @buf.
+ * @return the frame's length, 0 if it doesn't fit into @max octets
+ */
+size_t L_Data_to_CM_TP1 (const L_Data_PDU & p, uint8_t *buf, size_t max);
+
+/**
+ * Decode a TP1 frame into @l, overwriting all of its fields except the
+ * reception time.
+ * @return false if it's not a valid L_Data frame
+ */
+bool CM_TP1_to_L_Data (const uint8_t *c, size_t len, L_Data_PDU & l);
+
 /** convert L_Data_PDU to TP1 frame */
 CArray L_Data_to_CM_TP1 (const LDataPtr & p);
 
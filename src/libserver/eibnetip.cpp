@@ -20,12 +20,92 @@
 #include "eibnetip.h"
 #include "config.h"
 
+#include <algorithm>
+#include <arpa/inet.h>
 #include <cerrno>
+#include <cmath>
 #include <cstring>
 #include <net/if.h>
 #include <netdb.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <vector>
+
+/** keep at most this many unused buffers */
+#define BUF_POOL_MAX 256
+
+EIBNetIPBuf::Buf *EIBNetIPBuf::pool = nullptr;
+unsigned EIBNetIPBuf::pooled = 0;
+
+EIBNetIPBuf::Buf *
+EIBNetIPBuf::get (size_t len)
+{
+  Buf *n = pool;
+  if (n)
+    {
+      pool = n->next;
+      pooled--;
+    }
+  else
+    n = new Buf;
+  n->refs = 1;
+  n->data.resize (len);
+  return n;
+}
+
+void
+EIBNetIPBuf::reset ()
+{
+  if (!b)
+    return;
+  if (!--b->refs)
+    {
+      if (pooled < BUF_POOL_MAX)
+        {
+          b->next = pool;
+          pool = b;
+          pooled++;
+        }
+      else
+        delete b;
+    }
+  b = nullptr;
+}
+
+EIBNetIPBuf
+EIBNetIPBuf::alloc (uint16_t service, size_t len)
+{
+  EIBNetIPBuf r;
+  r.b = get (6 + len);
+  uint8_t *c = r.b->data.data();
+  c[0] = 0x06;
+  c[1] = 0x10;
+  c[2] = (service >> 8) & 0xff;
+  c[3] = (service) & 0xff;
+  c[4] = ((len + 6) >> 8) & 0xff;
+  c[5] = ((len + 6)) & 0xff;
+  return r;
+}
+
+EIBNetIPBuf
+EIBNetIPBuf::alloc (uint16_t service, const CArray &body)
+{
+  EIBNetIPBuf r = alloc (service, body.size());
+  if (body.size())
+    memcpy (r.body (), body.data(), body.size());
+  return r;
+}
+
+EIBNetIPBuf
+EIBNetIPBuf::copy (const CArray &frame)
+{
+  EIBNetIPBuf r;
+  r.b = get (frame.size());
+  if (frame.size())
+    memcpy (r.b->data.data(), frame.data(), frame.size());
+  return r;
+}
 
 EIBNetIPPacket::EIBNetIPPacket ()
 {
@@ -67,8 +147,107 @@ const
   return c;
 }
 
+EIBNetIPBuf
+EIBNetIPPacket::Encode ()
+const
+{
+  return EIBNetIPBuf::alloc (service, data);
+}
+
+#ifdef HAVE_RECVMMSG
+typedef struct mmsghdr mmsg_t;
+#else
+struct mmsg_t
+{
+  struct msghdr msg_hdr;
+  unsigned int msg_len;
+};
+#endif
+
+/** receive up to @n datagrams; returns the number received or -1 */
+static int
+recv_mmsg (int fd, mmsg_t *m, unsigned n)
+{
+#ifdef HAVE_RECVMMSG
+  return recvmmsg (fd, m, n, MSG_DONTWAIT, nullptr);
+#else
+  unsigned k;
+  for (k = 0; k < n; k++)
+    {
+      int i = recvmsg (fd, &m[k].msg_hdr, MSG_DONTWAIT);
+      if (i < 0)
+        return k ? k : -1;
+      m[k].msg_len = i;
+    }
+  return k;
+#endif
+}
+
+/** send up to @n datagrams; returns the number sent or -1 */
+static int
+send_mmsg (int fd, mmsg_t *m, unsigned n)
+{
+#ifdef HAVE_SENDMMSG
+  return sendmmsg (fd, m, n, MSG_DONTWAIT);
+#else
+  unsigned k;
+  for (k = 0; k < n; k++)
+    {
+      int i = sendmsg (fd, &m[k].msg_hdr, MSG_DONTWAIT);
+      if (i <= 0)
+        return k ? k : i;
+      m[k].msg_len = i;
+    }
+  return k;
+#endif
+}
+
+struct EIBNetIPSocket::Batch
+{
+  struct Slot
+  {
+    uint8_t buf[255];
+    struct sockaddr_in addr;
+    struct iovec iov;
+    union
+    {
+      struct cmsghdr align;
+      char buf[CMSG_SPACE(sizeof(struct timespec))];
+    } cbuf;
+  };
+  std::vector<Slot> rslots;
+  std::vector<mmsg_t> rmsgs;
+  std::vector<struct iovec> siov;
+  std::vector<mmsg_t> smsgs;
+};
+
+void
+EIBNetIPSocket::set_batch (unsigned recv, unsigned send)
+{
+  recv = recv < 1 ? 1 : recv > 256 ? 256 : recv;
+  send = send < 1 ? 1 : send > 256 ? 256 : send;
+
+  batch->rslots.resize (recv);
+  batch->rmsgs.resize (recv);
+  for (unsigned k = 0; k < recv; k++)
+    {
+      Batch::Slot &s = batch->rslots[k];
+      struct msghdr &mh = batch->rmsgs[k].msg_hdr;
+      s.iov.iov_base = s.buf;
+      s.iov.iov_len = sizeof (s.buf);
+      memset (&mh, 0, sizeof (mh));
+      mh.msg_name = &s.addr;
+      mh.msg_iov = &s.iov;
+      mh.msg_iovlen = 1;
+      mh.msg_control = s.cbuf.buf;
+    }
+  batch->siov.resize (send);
+  batch->smsgs.resize (send);
+}
+
 EIBNetIPSocket::EIBNetIPSocket (struct sockaddr_in bindaddr, bool reuseaddr,
                                 TracePtr tr, SockMode mode)
+  : batch(new Batch)
 {
   int i;
   t = tr;
@@ -79,6 +258,7 @@ EIBNetIPSocket::EIBNetIPSocket (struct sockaddr_in bindaddr, bool reuseaddr,
   memset (&recvaddr, 0, sizeof (recvaddr));
   memset (&recvaddr2, 0, sizeof (recvaddr2));
   recvall = 0;
+  set_batch (16, 16);
 
   io_send.set<EIBNetIPSocket, &EIBNetIPSocket::io_send_cb>(this);
   io_recv.set<EIBNetIPSocket, &EIBNetIPSocket::io_recv_cb>(this);
@@ -124,6 +304,12 @@ EIBNetIPSocket::EIBNetIPSocket (struct sockaddr_in bindaddr, bool reuseaddr,
       }
   }
 
+#ifdef HAVE_SO_TIMESTAMPNS
+  // kernel receive timestamps; without them we stamp at recvmsg time
+  i = 1;
+  setsockopt (fd, SOL_SOCKET, SO_TIMESTAMPNS, &i, sizeof (i));
+#endif
+
   // don't really care if this fails
   if (mode == S_RD)
     shutdown (fd, SHUT_WR);
@@ -138,6 +324,8 @@ EIBNetIPSocket::EIBNetIPSocket (struct sockaddr_in bindaddr, bool reuseaddr,
 EIBNetIPSocket::~EIBNetIPSocket ()
 {
   TRACEPRINTF (t, 0, "Close");
+  if (in_recv)
+    *in_recv = false;
   stop();
 }
 
@@ -207,16 +395,22 @@ EIBNetIPSocket::SetMulticast (struct ip_mreq multicastaddr)
   if (setsockopt (fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &maddr, sizeof (maddr))
       == -1)
     return false;
+#ifdef IP_MULTICAST_ALL
+  /* only deliver groups this socket joined, on the interface it joined
+   * them on; several sockets may share a port, one per backbone */
+  int zero = 0;
+  setsockopt (fd, IPPROTO_IP, IP_MULTICAST_ALL, &zero, sizeof (zero));
+#endif
   multicast = true;
   return true;
 }
 
 void
-EIBNetIPSocket::Send (EIBNetIPPacket p, struct sockaddr_in addr)
+EIBNetIPSocket::Send (const EIBNetIPBuf& b, struct sockaddr_in addr)
 {
   struct _EIBNetIP_Send s;
-  t->TracePacket (1, "Send", p.data);
-  s.data = p;
+  t->TracePacket (1, "Send", b.size() - 6, b.data() + 6);
+  s.buf = b;
   s.addr = addr;
 
   if (send_q.empty())
@@ -233,14 +427,29 @@ EIBNetIPSocket::io_send_cb (ev::io &, int)
       on_next();
       return;
     }
-  const struct _EIBNetIP_Send s = send_q.front ();
-  CArray p = s.data.ToPacket ();
-  t->TracePacket (0, "Send", p);
-  int i = sendto (fd, p.data(), p.size(), 0,
-                  (const struct sockaddr *) &s.addr, sizeof (s.addr));
+
+  unsigned n = send_q.size();
+  if (n > batch->smsgs.size())
+    n = batch->smsgs.size();
+  for (unsigned k = 0; k < n; k++)
+    {
+      const struct _EIBNetIP_Send &s = send_q.peek (k);
+      struct msghdr &mh = batch->smsgs[k].msg_hdr;
+      t->TracePacket (0, "Send", s.buf.size(), s.buf.data());
+      batch->siov[k].iov_base = (void *) s.buf.data();
+      batch->siov[k].iov_len = s.buf.size();
+      memset (&mh, 0, sizeof (mh));
+      mh.msg_name = (void *) &s.addr;
+      mh.msg_namelen = sizeof (s.addr);
+      mh.msg_iov = &batch->siov[k];
+      mh.msg_iovlen = 1;
+    }
+
+  int i = send_mmsg (fd, batch->smsgs.data(), n);
   if (i > 0)
     {
-      send_q.get ();
+      while (i--)
+        send_q.get ();
       send_error = 0;
     }
   else
@@ -250,7 +459,7 @@ EIBNetIPSocket::io_send_cb (ev::io &, int)
           TRACEPRINTF (t, 0, "Send: %s", strerror(errno));
           if (send_error++ > 5)
             {
-              t->TracePacket (0, "EIBnetSocket:drop", p);
+              t->TracePacket (0, "EIBnetSocket:drop", send_q.front ().buf.size(), send_q.front ().buf.data());
               send_q.get ();
               send_error = 0;
               on_error();
@@ -262,32 +471,199 @@ EIBNetIPSocket::io_send_cb (ev::io &, int)
 void
 EIBNetIPSocket::io_recv_cb (ev::io &, int)
 {
-  uint8_t buf[255];
-  socklen_t rl;
-  sockaddr_in r;
-  rl = sizeof (r);
-  memset (&r, 0, sizeof (r));
+  unsigned n = batch->rslots.size();
+  for (unsigned k = 0; k < n; k++)
+    {
+      struct msghdr &mh = batch->rmsgs[k].msg_hdr;
+      memset (&batch->rslots[k].addr, 0, sizeof (struct sockaddr_in));
+      mh.msg_namelen = sizeof (struct sockaddr_in);
+      mh.msg_controllen = sizeof (batch->rslots[k].cbuf.buf);
+      mh.msg_flags = 0;
+    }
 
-  int i = recvfrom (fd, buf, sizeof (buf), 0, (struct sockaddr *) &r, &rl);
-  if (i < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
-    on_error();
-  else if (i >= 0 && rl == sizeof (r))
+  int cnt = recv_mmsg (fd, batch->rmsgs.data(), n);
+  if (cnt < 0)
     {
-      if (recvall == 1 || !memcmp (&r, &recvaddr, sizeof (r)) ||
-          (recvall == 2 && memcmp (&r, &localaddr, sizeof (r))) ||
-          (recvall == 3 && !memcmp (&r, &recvaddr2, sizeof (r))))
-        {
-          t->TracePacket (0, "Recv", i, buf);
-          EIBNetIPPacket *p =
-            EIBNetIPPacket::fromPacket (CArray (buf, i), r);
-          if (p)
-            on_recv(p);
-          else
-            t->TracePacket (0, "Parse?", i, buf);
-        }
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        on_error();
+      return;
+    }
+
+  bool alive = true;
+  in_recv = &alive;
+  for (int k = 0; k < cnt; k++)
+    {
+      recv_one (batch->rslots[k].buf, batch->rmsgs[k].msg_len, batch->rmsgs[k].msg_hdr);
+      if (!alive)
+        return; // we've been deleted
+      if (fd == -1)
+        break;
+    }
+  in_recv = nullptr;
+}
+
+void
+EIBNetIPSocket::recv_one (uint8_t *buf, int i, struct msghdr& mh)
+{
+  const sockaddr_in &r = *(const sockaddr_in *) mh.msg_name;
+  uint64_t rx = 0;
+
+#ifdef HAVE_SO_TIMESTAMPNS
+  for (struct cmsghdr *cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm))
+    if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPNS)
+      {
+        struct timespec ts;
+        memcpy (&ts, CMSG_DATA(cm), sizeof (ts));
+        rx = uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+      }
+#endif
+  if (mh.msg_namelen != sizeof (r))
+    return;
+
+  // frames built from this packet carry the kernel's receive time
+  RxTime rt(rx ? rx : rx_clock());
+  if (recvall == 1 || !memcmp (&r, &recvaddr, sizeof (r)) ||
+      (recvall == 2 && memcmp (&r, &localaddr, sizeof (r))) ||
+      (recvall == 3 && !memcmp (&r, &recvaddr2, sizeof (r))))
+    {
+      t->TracePacket (0, "Recv", i, buf);
+      EIBNetIPPacket *p =
+        EIBNetIPPacket::fromPacket (CArray (buf, i), r);
+      if (p)
+        on_recv(p);
       else
-        t->TracePacket (0, "Dropped", i, buf);
+        t->TracePacket (0, "Parse?", i, buf);
+    }
+  else
+    t->TracePacket (0, "Dropped", i, buf);
+}
+
+EIBNetIPStream::EIBNetIPStream (int fd, const struct sockaddr_in& peer, TracePtr tr)
+  : sendbuf(fd), recvbuf(fd)
+{
+  int one = 1;
+
+  t = tr;
+  this->fd = fd;
+  this->peer = peer;
+  // a tunnel sends small frames and wants them out now
+  setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+  on_recv.set<EIBNetIPStream,&EIBNetIPStream::recv_cb>(this);
+  on_error.set<EIBNetIPStream,&EIBNetIPStream::error_cb>(this);
+  on_next.set<EIBNetIPStream,&EIBNetIPStream::next_cb>(this);
+  sendbuf.on_next.set<EIBNetIPStream,&EIBNetIPStream::drained_cb>(this);
+  recvbuf.on_read.set<EIBNetIPStream,&EIBNetIPStream::read_cb>(this);
+  recvbuf.on_error.set<EIBNetIPStream,&EIBNetIPStream::io_error_cb>(this);
+  sendbuf.on_error.set<EIBNetIPStream,&EIBNetIPStream::io_error_cb>(this);
+  TRACEPRINTF (t, 0, "Stream %s:%d", inet_ntoa (peer.sin_addr), ntohs (peer.sin_port));
+}
+
+EIBNetIPStream::~EIBNetIPStream ()
+{
+  TRACEPRINTF (t, 0, "Close stream");
+  stop ();
+}
+
+EIBNetIPStream *
+EIBNetIPStream::connect (const struct sockaddr_in& addr, TracePtr tr)
+{
+  int fd = socket (AF_INET, SOCK_STREAM, 0);
+  if (fd == -1)
+    {
+      ERRORPRINTF (tr, E_ERROR | 144, "TCP socket: %s", strerror(errno));
+      return nullptr;
+    }
+  set_non_blocking (fd);
+  if (::connect (fd, (const struct sockaddr *) &addr, sizeof (addr)) == -1
+      && errno != EINPROGRESS)
+    {
+      ERRORPRINTF (tr, E_ERROR | 145, "TCP connect to %s:%d: %s",
+                   inet_ntoa (addr.sin_addr), ntohs (addr.sin_port), strerror(errno));
+      close (fd);
+      return nullptr;
+    }
+  /* Writes are queued until the connection is up; if it can't be
+   * established, the first write reports the error. */
+  return new EIBNetIPStream (fd, addr, tr);
+}
+
+void
+EIBNetIPStream::start ()
+{
+  if (fd == -1)
+    return;
+  sendbuf.start();
+  recvbuf.start();
+}
+
+void
+EIBNetIPStream::stop ()
+{
+  if (fd == -1)
+    return;
+  sendbuf.stop(true);
+  recvbuf.stop(true);
+  close (fd);
+  fd = -1;
+}
+
+void
+EIBNetIPStream::Send (const EIBNetIPPacket& p)
+{
+  if (fd == -1)
+    return;
+  t->TracePacket (1, "Send", p.data);
+  sendbuf.write (new CArray (p.ToPacket ()));
+}
+
+void
+EIBNetIPStream::Send (const EIBNetIPBuf& b)
+{
+  if (fd == -1)
+    return;
+  t->TracePacket (1, "Send", b.size() - 6, b.data() + 6);
+  sendbuf.write (b.data(), b.size());
+}
+
+void
+EIBNetIPStream::Send (const CArray& c)
+{
+  if (fd == -1)
+    return;
+  t->TracePacket (1, "Send", c);
+  sendbuf.write (new CArray (c));
+}
+
+size_t
+EIBNetIPStream::read_cb (uint8_t *buf, size_t len)
+{
+  if (len < 6)
+    return 0;
+  unsigned flen = (buf[4] << 8) | buf[5];
+  if (buf[0] != 0x06 || buf[1] != 0x10 || flen < 6 || flen > 1024)
+    {
+      t->TracePacket (0, "Framing?", len, buf);
+      io_error_cb ();
+      return 0;
     }
+  if (len < flen)
+    return 0;
+
+  t->TracePacket (0, "Recv", flen, buf);
+  EIBNetIPPacket *p = EIBNetIPPacket::fromPacket (CArray (buf, flen), peer);
+  if (p)
+    on_recv(p); // may delete us
+  else
+    t->TracePacket (0, "Parse?", flen, buf);
+  return flen;
+}
+
+void
+EIBNetIPStream::io_error_cb ()
+{
+  TRACEPRINTF (t, 0, "Stream closed");
+  stop ();
+  on_error (); // may delete us
 }
 
 bool
@@ -302,6 +678,9 @@ EIBNetIPSocket::SetInterface(std::string& iface)
   if (iface.size() == 0)
     return true;
   addr.imr_ifindex = if_nametoindex(iface.c_str());
+  /* send from the interface's own address, not the routed one */
+  if (GetInterfaceAddress (nullptr, iface, &sa))
+    addr.imr_address = sa.sin_addr;
   return
     setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &addr, sizeof(addr)) >= 0;
 }
@@ -526,8 +905,8 @@ EIBNetIPPacket EIBnet_ConnectRequest::ToPacket ()const
 {
   EIBNetIPPacket p;
   CArray ca, da;
-  ca = IPtoEIBNetIP (&caddr, nat);
-  da = IPtoEIBNetIP (&daddr, nat);
+  ca = IPtoEIBNetIP (&caddr, nat, tcp);
+  da = IPtoEIBNetIP (&daddr, nat, tcp);
   p.service = CONNECTION_REQUEST;
   p.data.resize (ca.size() + da.size() + 1 + CRI.size());
   p.data.setpart (ca, 0);
@@ -563,7 +942,7 @@ EIBnet_ConnectResponse::EIBnet_ConnectResponse ()
 EIBNetIPPacket EIBnet_ConnectResponse::ToPacket ()const
 {
   EIBNetIPPacket p;
-  CArray da = IPtoEIBNetIP (&daddr, nat);
+  CArray da = IPtoEIBNetIP (&daddr, nat, tcp);
   p.service = CONNECTION_RESPONSE;
   if (status != 0)
     p.data.resize (2);
@@ -616,7 +995,7 @@ EIBnet_ConnectionStateRequest::EIBnet_ConnectionStateRequest ()
 EIBNetIPPacket EIBnet_ConnectionStateRequest::ToPacket ()const
 {
   EIBNetIPPacket p;
-  CArray ca = IPtoEIBNetIP (&caddr, nat);
+  CArray ca = IPtoEIBNetIP (&caddr, nat, tcp);
   p.service = CONNECTIONSTATE_REQUEST;
   p.data.resize (ca.size() + 2);
   p.data[0] = channel;
@@ -670,7 +1049,7 @@ EIBnet_DisconnectRequest::EIBnet_DisconnectRequest ()
 EIBNetIPPacket EIBnet_DisconnectRequest::ToPacket ()const
 {
   EIBNetIPPacket p;
-  CArray ca = IPtoEIBNetIP (&caddr, nat);
+  CArray ca = IPtoEIBNetIP (&caddr, nat, tcp);
   p.service = DISCONNECT_REQUEST;
   p.data.resize (ca.size() + 2);
   p.data[0] = channel;
@@ -729,6 +1108,19 @@ EIBNetIPPacket EIBnet_ConfigRequest::ToPacket ()const
   return p;
 }
 
+EIBNetIPBuf
+EIBnet_ConfigRequest::Encode (uint8_t channel, uint8_t seqno, const CArray &cemi)
+{
+  EIBNetIPBuf b = EIBNetIPBuf::alloc (DEVICE_CONFIGURATION_REQUEST, cemi.size() + 4);
+  uint8_t *d = b.body ();
+  d[0] = 4;
+  d[1] = channel;
+  d[2] = seqno;
+  d[3] = 0;
+  memcpy (d + 4, cemi.data(), cemi.size());
+  return b;
+}
+
 int
 parseEIBnet_ConfigRequest (const EIBNetIPPacket & p, EIBnet_ConfigRequest & r)
 {
@@ -756,6 +1148,18 @@ EIBNetIPPacket EIBnet_ConfigACK::ToPacket ()const
   return p;
 }
 
+EIBNetIPBuf
+EIBnet_ConfigACK::Encode ()const
+{
+  EIBNetIPBuf b = EIBNetIPBuf::alloc (DEVICE_CONFIGURATION_ACK, 4);
+  uint8_t *d = b.body ();
+  d[0] = 4;
+  d[1] = channel;
+  d[2] = seqno;
+  d[3] = status;
+  return b;
+}
+
 int
 parseEIBnet_ConfigACK (const EIBNetIPPacket & p, EIBnet_ConfigACK & r)
 {
@@ -784,6 +1188,19 @@ EIBNetIPPacket EIBnet_TunnelRequest::ToPacket ()const
   return p;
 }
 
+EIBNetIPBuf
+EIBnet_TunnelRequest::Encode (uint8_t channel, uint8_t seqno, const CArray &cemi)
+{
+  EIBNetIPBuf b = EIBNetIPBuf::alloc (TUNNEL_REQUEST, cemi.size() + 4);
+  uint8_t *d = b.body ();
+  d[0] = 4;
+  d[1] = channel;
+  d[2] = seqno;
+  d[3] = 0;
+  memcpy (d + 4, cemi.data(), cemi.size());
+  return b;
+}
+
 int
 parseEIBnet_TunnelRequest (const EIBNetIPPacket & p, EIBnet_TunnelRequest & r)
 {
@@ -811,6 +1228,18 @@ EIBNetIPPacket EIBnet_TunnelACK::ToPacket ()const
   return p;
 }
 
+EIBNetIPBuf
+EIBnet_TunnelACK::Encode ()const
+{
+  EIBNetIPBuf b = EIBNetIPBuf::alloc (TUNNEL_RESPONSE, 4);
+  uint8_t *d = b.body ();
+  d[0] = 4;
+  d[1] = channel;
+  d[2] = seqno;
+  d[3] = status;
+  return b;
+}
+
 int
 parseEIBnet_TunnelACK (const EIBNetIPPacket & p, EIBnet_TunnelACK & r)
 {
@@ -840,12 +1269,51 @@ parseEIBnet_RoutingIndication (const EIBNetIPPacket & p, EIBnet_RoutingIndicatio
 
 EIBNetIPPacket EIBnet_RoutingLostMessage::ToPacket () const
 {
-  // @todo
-  abort();
+  EIBNetIPPacket p;
+  p.service = ROUTING_LOST_MESSAGE;
+  p.data.resize (4);
+  p.data[0] = 4;
+  p.data[1] = devicestatus;
+  p.data[2] = (lost >> 8) & 0xff;
+  p.data[3] = lost & 0xff;
+  return p;
 }
 
 int
 parseEIBnet_RoutingLostMessage (const EIBNetIPPacket & p, EIBnet_RoutingLostMessage & r)
 {
+  if (p.service != ROUTING_LOST_MESSAGE)
+    return 1;
+  if (p.data.size() != 4 || p.data[0] != 4)
+    return 1;
+  r.devicestatus = p.data[1];
+  r.lost = (p.data[2] << 8) | p.data[3];
+  return 0;
+}
+
+EIBNetIPPacket EIBnet_RoutingBusy::ToPacket () const
+{
+  EIBNetIPPacket p;
+  p.service = ROUTING_BUSY;
+  p.data.resize (6);
+  p.data[0] = 6;
+  p.data[1] = devicestatus;
+  p.data[2] = (waittime >> 8) & 0xff;
+  p.data[3] = waittime & 0xff;
+  p.data[4] = (control >> 8) & 0xff;
+  p.data[5] = control & 0xff;
+  return p;
+}
+
+int
+parseEIBnet_RoutingBusy (const EIBNetIPPacket & p, EIBnet_RoutingBusy & r)
+{
+  if (p.service != ROUTING_BUSY)
+    return 1;
+  if (p.data.size() != 6 || p.data[0] != 6)
+    return 1;
+  r.devicestatus = p.data[1];
+  r.waittime = (p.data[2] << 8) | p.data[3];
+  r.control = (p.data[4] << 8) | p.data[5];
   return 0;
 }
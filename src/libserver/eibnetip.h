@@ -27,6 +27,8 @@
 #ifndef EIBNETIP_H
 #define EIBNETIP_H
 
+#include <memory>
+
 #include <ev++.h>
 #include <netinet/in.h>
 
@@ -36,6 +38,7 @@
 #include "iobuf.h" // for nonblocking
 #include "ipsupport.h"
 #include "lpdu.h"
+#include "rtt.h"
 
 // all values are from 03_08_01 5.* unless otherwise specified
 
@@ -148,6 +151,77 @@ struct DIB_service_Entry
   uint8_t version;
 };
 
+/**
+ * A serialized KNXnet/IP frame, header included, ready to be sent.
+ *
+ * Buffers come from a free list and are reference counted, so a frame can
+ * be queued for several destinations, or repeated, without being copied
+ * or encoded again. Don't modify a frame after it has been queued.
+ */
+class EIBNetIPBuf
+{
+public:
+  EIBNetIPBuf () = default;
+  EIBNetIPBuf (const EIBNetIPBuf &o) : b(o.b)
+  {
+    if (b)
+      b->refs++;
+  }
+  EIBNetIPBuf (EIBNetIPBuf &&o) : b(o.b)
+  {
+    o.b = nullptr;
+  }
+  EIBNetIPBuf &operator= (EIBNetIPBuf o)
+  {
+    std::swap (b, o.b);
+    return *this;
+  }
+  ~EIBNetIPBuf ()
+  {
+    reset ();
+  }
+
+  /** a frame for @service with a @len byte body, which the caller fills in */
+  static EIBNetIPBuf alloc (uint16_t service, size_t len);
+  /** a frame for @service with a copy of @body */
+  static EIBNetIPBuf alloc (uint16_t service, const CArray &body);
+  /** a copy of an already serialized frame */
+  static EIBNetIPBuf copy (const CArray &frame);
+
+  explicit operator bool () const
+  {
+    return b != nullptr;
+  }
+  const uint8_t *data () const
+  {
+    return b->data.data();
+  }
+  size_t size () const
+  {
+    return b->data.size();
+  }
+  /** the part after the header */
+  uint8_t *body ()
+  {
+    return b->data.data() + 6;
+  }
+  void reset ();
+
+private:
+  struct Buf
+  {
+    CArray data;
+    unsigned refs;
+    Buf *next;
+  };
+  Buf *b = nullptr;
+
+  static Buf *get (size_t len);
+  /** unused buffers, which keep their allocation */
+  static Buf *pool;
+  static unsigned pooled;
+};
+
 /** represents a EIBnet/IP packet */
 class EIBNetIPPacket
 {
@@ -167,6 +241,8 @@ public:
                                      const struct sockaddr_in src);
   /** convert to character array */
   CArray ToPacket () const;
+  /** serialize into a pooled buffer */
+  EIBNetIPBuf Encode () const;
 };
 
 class EIBnet_SearchRequest
@@ -242,6 +318,8 @@ public:
   struct sockaddr_in daddr;
   CArray CRI;
   bool nat = false;
+  /** send TCP HPAIs */
+  bool tcp = false;
   EIBNetIPPacket ToPacket () const;
 };
 
@@ -256,6 +334,8 @@ public:
   uint8_t status = 0;
   struct sockaddr_in daddr;
   bool nat = false;
+  /** send TCP HPAIs */
+  bool tcp = false;
   CArray CRD;
   EIBNetIPPacket ToPacket () const;
 };
@@ -271,6 +351,8 @@ public:
   uint8_t status = 0;
   struct sockaddr_in caddr;
   bool nat = false;
+  /** send TCP HPAIs */
+  bool tcp = false;
   EIBNetIPPacket ToPacket () const;
 };
 
@@ -296,6 +378,8 @@ public:
   struct sockaddr_in caddr;
   uint8_t channel = 0;
   bool nat = false;
+  /** send TCP HPAIs */
+  bool tcp = false;
   EIBNetIPPacket ToPacket () const;
 };
 
@@ -322,6 +406,12 @@ public:
   uint8_t seqno = 0;
   CArray CEMI;
   EIBNetIPPacket ToPacket () const;
+  EIBNetIPBuf Encode () const
+  {
+    return Encode (channel, seqno, CEMI);
+  }
+  /** serialize a request for @cemi, without copying it into a ConfigRequest first */
+  static EIBNetIPBuf Encode (uint8_t channel, uint8_t seqno, const CArray &cemi);
 };
 
 int parseEIBnet_ConfigRequest (const EIBNetIPPacket & p,
@@ -335,6 +425,7 @@ public:
   uint8_t seqno = 0;
   uint8_t status = 0;
   EIBNetIPPacket ToPacket () const;
+  EIBNetIPBuf Encode () const;
 };
 
 int parseEIBnet_ConfigACK (const EIBNetIPPacket & p, EIBnet_ConfigACK & r); // @todo rename to parseEIBnet_DeviceConfigurationAck
@@ -347,6 +438,12 @@ public:
   uint8_t seqno = 0;
   CArray CEMI;
   EIBNetIPPacket ToPacket () const;
+  EIBNetIPBuf Encode () const
+  {
+    return Encode (channel, seqno, CEMI);
+  }
+  /** serialize a request for @cemi, without copying it into a TunnelRequest first */
+  static EIBNetIPBuf Encode (uint8_t channel, uint8_t seqno, const CArray &cemi);
 };
 
 int parseEIBnet_TunnelRequest (const EIBNetIPPacket & p,
@@ -360,6 +457,7 @@ public:
   uint8_t seqno = 0;
   uint8_t status = 0;
   EIBNetIPPacket ToPacket () const;
+  EIBNetIPBuf Encode () const;
 };
 
 int parseEIBnet_TunnelACK (const EIBNetIPPacket & p, EIBnet_TunnelACK & r);
@@ -373,11 +471,27 @@ int parseEIBnet_RoutingIndication (const EIBNetIPPacket & p, EIBnet_RoutingIndic
 
 class EIBnet_RoutingLostMessage
 {
+public:
+  uint8_t devicestatus = 0;
+  uint16_t lost = 0;
   EIBNetIPPacket ToPacket () const;
 };
 
 int parseEIBnet_RoutingLostMessage (const EIBNetIPPacket & p, EIBnet_RoutingLostMessage & r);
 
+class EIBnet_RoutingBusy
+{
+public:
+  uint8_t devicestatus = 0;
+  /** milliseconds */
+  uint16_t waittime = 0;
+  /** zero: everybody must pause */
+  uint16_t control = 0;
+  EIBNetIPPacket ToPacket () const;
+};
+
+int parseEIBnet_RoutingBusy (const EIBNetIPPacket & p, EIBnet_RoutingBusy & r);
+
 typedef void (*eibpacket_cb_t)(void *data, EIBNetIPPacket *p);
 
 class EIBPacketCallback
@@ -428,8 +542,8 @@ private:
 /** represents a EIBnet/IP packet to send */
 struct _EIBNetIP_Send
 {
-  /** packet */
-  EIBNetIPPacket data;
+  /** serialized packet */
+  EIBNetIPBuf buf;
   /** destination address */
   struct sockaddr_in addr;
 };
@@ -451,10 +565,23 @@ public:
   /** enables multicast */
   bool SetMulticast (struct ip_mreq multicastaddr);
   /** sends a packet */
-  void Send (EIBNetIPPacket p, struct sockaddr_in addr);
-  void Send (EIBNetIPPacket p)
+  void Send (const EIBNetIPPacket& p, struct sockaddr_in addr)
+  {
+    Send (p.Encode (), addr);
+  }
+  void Send (const EIBNetIPPacket& p)
+  {
+    Send (p.Encode (), sendaddr);
+  }
+  /** sends an already serialized packet */
+  void Send (const EIBNetIPBuf& b, struct sockaddr_in addr);
+  void Send (const EIBNetIPBuf& b)
+  {
+    Send (b, sendaddr);
+  }
+  void Send (const CArray& c, struct sockaddr_in addr)
   {
-    Send (p, sendaddr);
+    Send (EIBNetIPBuf::copy (c), addr);
   }
 
   /** get the port this socket is bound to (network byte order) */
@@ -462,6 +589,9 @@ public:
 
   bool SetInterface(std::string& iface);
 
+  /** read up to @recv datagrams per wakeup, send up to @send per call */
+  void set_batch (unsigned recv, unsigned send);
+
   /** default send address */
   struct sockaddr_in sendaddr;
 
@@ -490,6 +620,13 @@ private:
   void io_send_cb (ev::io &w, int revents);
   unsigned int send_error;
 
+  /** buffers for recvmmsg/sendmmsg */
+  struct Batch;
+  std::unique_ptr<Batch> batch;
+  /** cleared when we're deleted from within on_recv */
+  bool *in_recv = nullptr;
+  void recv_one (uint8_t *buf, int len, struct msghdr& mh);
+
   void recv_cb(EIBNetIPPacket *p)
   {
     t->TracePacket (0, "Drop", p->data);
@@ -514,6 +651,64 @@ private:
   bool multicast;
 };
 
+/** Don't ask for more while this many bytes wait for the TCP peer. */
+constexpr size_t STREAM_BACKLOG = 4096;
+
+/**
+ * KNXnet/IP over TCP. Frames are delimited by the header's total length;
+ * tunnelling requests are not acknowledged on this transport.
+ */
+class EIBNetIPStream
+{
+public:
+  EIBPacketCallback on_recv;
+  InfoCallback on_error;
+  /** everything queued has been sent */
+  InfoCallback on_next;
+
+  /** takes over @fd, which may still be connecting */
+  EIBNetIPStream (int fd, const struct sockaddr_in& peer, TracePtr tr);
+  virtual ~EIBNetIPStream ();
+  /** starts connecting to @addr; failure is reported by on_error later */
+  static EIBNetIPStream *connect (const struct sockaddr_in& addr, TracePtr tr);
+
+  void start ();
+  void stop ();
+  /** sends a packet */
+  void Send (const EIBNetIPPacket& p);
+  /** sends an already serialized packet */
+  void Send (const EIBNetIPBuf& b);
+  void Send (const CArray& c);
+  /** bytes the kernel did not take yet */
+  size_t pending () const
+  {
+    return sendbuf.pending();
+  }
+
+  /** the other side, also the source of received packets */
+  struct sockaddr_in peer;
+
+private:
+  TracePtr t;
+  int fd;
+  SendBuf sendbuf;
+  RecvBuf recvbuf;
+  size_t read_cb (uint8_t *buf, size_t len);
+  void io_error_cb ();
+  void drained_cb ()
+  {
+    on_next();
+  }
+
+  void recv_cb(EIBNetIPPacket *p)
+  {
+    t->TracePacket (0, "Drop", p->data);
+    delete p;
+  }
+  void error_cb() { }
+  void next_cb() { }
+};
+
 #endif
 
 /** @} */
@@ -20,6 +20,8 @@
 #include "eibnetserver.h"
 #include "config.h"
 
+#include <arpa/inet.h>
+#include <cerrno>
 #include <cstdlib>
 #include <cstring>
 #include <memory>
@@ -28,6 +30,10 @@
 #include <netinet/in.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
+#ifdef HAVE_LINUX_NETLINK
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
 #ifndef SIOCGIFHWADDR
 #include <sys/sysctl.h>
 #include <net/if_dl.h>
@@ -50,16 +56,22 @@ EIBnetServer::EIBnetServer (BaseRouter& r, IniSectionPtr& s)
   t->setAuxName("server");
   drop_trigger.set<EIBnetServer,&EIBnetServer::drop_trigger_cb>(this);
   drop_trigger.start();
+  nl_watch.set<EIBnetServer,&EIBnetServer::nl_cb>(this);
+  tcp_watch.set<EIBnetServer,&EIBnetServer::tcp_cb>(this);
 }
 
 EIBnetDriver::EIBnetDriver (LinkConnectClientPtr c,
-                            std::string& multicastaddr, int port, std::string& intf)
-  : SubDriver(c)
+                            std::string& multicastaddr, int port, std::string& intf,
+                            bool backbone)
+  : SubDriver(c), backbone(backbone)
 {
   struct sockaddr_in baddr;
+  struct sockaddr_in iaddr;
   struct ip_mreq mcfg;
+  bool have_iaddr;
   sock = 0;
   t->setAuxName("driver");
+  flow_timer.set<EIBnetDriver,&EIBnetDriver::flow_timer_cb>(this);
 
   TRACEPRINTF (t, 8, "OpenD");
 
@@ -68,6 +80,11 @@ EIBnetDriver::EIBnetDriver (LinkConnectClientPtr c,
       ERRORPRINTF (t, E_ERROR | 11, "Addr '%s' not resolvable", multicastaddr);
       goto err_out;
     }
+  /* a backbone must know its interface's address; the main group falls
+   * back to the default interface */
+  have_iaddr = intf.size() && GetInterfaceAddress (backbone ? t : nullptr, intf, &iaddr);
+  if (backbone && !have_iaddr)
+    goto err_out;
 
   if (port)
     {
@@ -83,6 +100,10 @@ EIBnetDriver::EIBnetDriver (LinkConnectClientPtr c,
       sock = new EIBNetIPSocket (baddr, 1, t);
       if (!sock->SetInterface(intf))
         goto err_out;
+      {
+        EIBnetServer &parent = *std::static_pointer_cast<EIBnetServer>(server);
+        sock->set_batch (parent.recv_batch, parent.send_batch);
+      }
       if (!sock->init ())
         goto err_out;
       sock->on_recv.set<EIBnetDriver,&EIBnetDriver::recv_cb>(this);
@@ -96,14 +117,16 @@ EIBnetDriver::EIBnetDriver (LinkConnectClientPtr c,
     }
 
   mcfg.imr_multiaddr = maddr.sin_addr;
-  mcfg.imr_interface.s_addr = htonl (INADDR_ANY);
+  mcfg.imr_interface.s_addr = have_iaddr ? iaddr.sin_addr.s_addr : htonl (INADDR_ANY);
   if (!sock->SetMulticast (mcfg))
     goto err_out;
 
   /** This causes us to ignore multicast packets sent by ourselves */
-  if (!GetSourceAddress (t, &maddr, &sock->localaddr))
+  if (have_iaddr)
+    sock->localaddr = iaddr;
+  else if (!GetSourceAddress (t, &maddr, &sock->localaddr))
     goto err_out;
-  sock->localaddr.sin_port = std::static_pointer_cast<EIBnetServer>(server)->Port;
+  sock->localaddr.sin_port = backbone ? sock->port () : std::static_pointer_cast<EIBnetServer>(server)->Port;
   sock->recvall = 2;
 
   TRACEPRINTF (t, 8, "OpenedD");
@@ -119,6 +142,20 @@ err_out:
 bool
 EIBnetDriver::setup()
 {
+  EIBnetServer &parent = *std::static_pointer_cast<EIBnetServer>(server);
+  rate_limit = parent.rate_limit;
+  rate_burst = parent.rate_burst;
+  busy_wait = parent.busy_wait;
+  routing_queue = parent.routing_queue;
+  if (backbone)
+    {
+      /* checked by EIBnetServer::setup */
+      rate_limit = cfg->value("rate-limit",rate_limit);
+      rate_burst = cfg->value("rate-burst",(int)rate_burst);
+      busy_wait = cfg->value("busy-wait",(int)busy_wait);
+      routing_queue = cfg->value("routing-queue",(int)routing_queue);
+    }
+
   if (!assureFilter("pace"))
     return false;
   if (!SubDriver::setup())
@@ -138,6 +175,8 @@ EIBnetServer::~EIBnetServer ()
 EIBnetDriver::~EIBnetDriver ()
 {
   TRACEPRINTF (t, 8, "CloseD");
+  TRACEPRINTF (t, 5, "%s", info(0));
+  flow_timer.stop();
   EIBnetServer &parent = *std::static_pointer_cast<EIBnetServer>(server);
   EIBNetIPSocket *ps = parent.sock;
   if (sock && ps && ps != sock)
@@ -156,9 +195,37 @@ EIBnetServer::setup()
   tunnel = tunnel_cfg->name.size() > 0;
   discover = cfg->value("discover",false);
   single_port = !cfg->value("multi-port",false);
+  tcp = cfg->value("tcp",false);
   multicastaddr = cfg->value("multicast-address","224.0.23.12");
   port = cfg->value("port",3671);
   interface = cfg->value("interface","");
+  recv_batch = cfg->value("recv-batch",16);
+  send_batch = cfg->value("send-batch",16);
+  rate_limit = cfg->value("rate-limit",0.);
+  {
+    int burst = cfg->value("rate-burst",10);
+    int wait = cfg->value("busy-wait",100);
+    int queue = cfg->value("routing-queue",100);
+    if (rate_limit < 0 || burst < 1 || wait < 20 || wait > 100 || queue < 0)
+      {
+        ERRORPRINTF (t, E_ERROR | 143, "rate-limit must be >=0, rate-burst >0, busy-wait 20..100, routing-queue >=0");
+        return false;
+      }
+    rate_burst = burst;
+    busy_wait = wait;
+    routing_queue = queue;
+  }
+  {
+    int lo = cfg->value("ack-timeout-min",50);
+    int hi = cfg->value("ack-timeout-max",1000);
+    if (lo < 1 || hi < lo)
+      {
+        ERRORPRINTF (t, E_ERROR | 149, "need 0 < ack-timeout-min <= ack-timeout-max");
+        return false;
+      }
+    ack_min = lo / 1000.;
+    ack_max = hi / 1000.;
+  }
   servername = cfg->value("name", dynamic_cast<Router *>(&router)->servername);
 
   if (tunnel)
@@ -177,6 +244,43 @@ EIBnetServer::setup()
         return false;
     }
 
+  {
+    std::string x = cfg->value("backbones","");
+    size_t pos = 0;
+    size_t comma = 0;
+    while(true)
+      {
+        comma = x.find(',',pos);
+        std::string name = x.substr(pos,comma-pos);
+        if (name.size())
+          {
+            IniSectionPtr bs = router.ini[name];
+            if (bs->value("interface","").size() == 0)
+              {
+                ERRORPRINTF (t, E_ERROR | 153, "backbone '%s' needs an interface", name);
+                return false;
+              }
+            bs->value("multicast-address",multicastaddr);
+            bs->value("port",(int)port);
+            double limit = bs->value("rate-limit",rate_limit);
+            int burst = bs->value("rate-burst",(int)rate_burst);
+            int wait = bs->value("busy-wait",(int)busy_wait);
+            int queue = bs->value("routing-queue",(int)routing_queue);
+            if (limit < 0 || burst < 1 || wait < 20 || wait > 100 || queue < 0)
+              {
+                ERRORPRINTF (t, E_ERROR | 154, "%s: rate-limit must be >=0, rate-burst >0, busy-wait 20..100, routing-queue >=0", name);
+                return false;
+              }
+            if (!static_cast<Router &>(router).checkStack(bs))
+              return false;
+            backbone_cfg.push_back(bs);
+          }
+        if (comma == std::string::npos)
+          break;
+        pos = comma+1;
+      }
+  }
+
   return true;
 }
 
@@ -194,6 +298,26 @@ EIBnetServer::start()
       ERRORPRINTF (t, E_ERROR | 27, "Lookup socket creation failed");
       goto err_out0;
     }
+#ifdef HAVE_LINUX_NETLINK
+  if (discover)
+    {
+      /* tells us when to look at the interfaces again */
+      struct sockaddr_nl nl;
+      memset (&nl, 0, sizeof (nl));
+      nl.nl_family = AF_NETLINK;
+      nl.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV4_ROUTE;
+      nl_fd = socket (PF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+      if (nl_fd >= 0 && bind (nl_fd, (struct sockaddr *) &nl, sizeof (nl)) == -1)
+        {
+          close (nl_fd);
+          nl_fd = -1;
+        }
+      if (nl_fd < 0)
+        TRACEPRINTF (t, 2, "netlink: %s; polling interfaces instead", strerror(errno));
+      else
+        nl_watch.start (nl_fd, ev::READ);
+    }
+#endif
   memset (&baddr, 0, sizeof (baddr));
 #ifdef HAVE_SOCKADDR_IN_LEN
   baddr.sin_len = sizeof (baddr);
@@ -209,6 +333,7 @@ EIBnetServer::start()
       goto err_out1;
     }
   sock->SetInterface(interface);
+  sock->set_batch (recv_batch, send_batch);
 
   if (!sock->init ())
     goto err_out2;
@@ -219,6 +344,23 @@ EIBnetServer::start()
   sock->recvall = 1;
   Port = sock->port ();
 
+  if (tcp)
+    {
+      int one = 1;
+      baddr.sin_port = htons (port);
+      tcp_fd = socket (AF_INET, SOCK_STREAM, 0);
+      if (tcp_fd == -1
+          || setsockopt (tcp_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one)) == -1
+          || bind (tcp_fd, (struct sockaddr *) &baddr, sizeof (baddr)) == -1
+          || listen (tcp_fd, 16) == -1)
+        {
+          ERRORPRINTF (t, E_ERROR | 146, "TCP port %d: %s", port, strerror(errno));
+          goto err_out2;
+        }
+      set_non_blocking (tcp_fd);
+      tcp_watch.start (tcp_fd, ev::READ);
+    }
+
   mcast_conn = LinkConnectClientPtr(new LinkConnectClient(std::dynamic_pointer_cast<EIBnetServer>(shared_from_this()), router_cfg, t));
   mcast = EIBnetDriverPtr(new EIBnetDriver (mcast_conn, multicastaddr, single_port ? 0 : port, interface));
   if (!mcast)
@@ -232,43 +374,234 @@ EIBnetServer::start()
   if (route && !static_cast<Router &>(router).registerLink(mcast_conn))
     goto err_out3;
 
+  for (IniSectionPtr &bs : backbone_cfg)
+    {
+      std::string bmaddr = bs->value("multicast-address",multicastaddr);
+      std::string bintf = bs->value("interface","");
+      int bport = bs->value("port",(int)port);
+      LinkConnectClientPtr bconn = LinkConnectClientPtr(new LinkConnectClient(std::dynamic_pointer_cast<EIBnetServer>(shared_from_this()), bs, t));
+      EIBnetDriverPtr b = EIBnetDriverPtr(new EIBnetDriver (bconn, bmaddr, bport, bintf, true));
+      bconn->set_driver(b);
+      if (!bconn->setup ())
+        goto err_out4;
+      if (!static_cast<Router &>(router).registerLink(bconn))
+        goto err_out4;
+      backbones.push_back(b);
+      TRACEPRINTF (t, 8, "Backbone %s: %s on %s", bs->name, bmaddr, bintf);
+    }
+
   TRACEPRINTF (t, 8, "Opened");
 
   Server::start();
   return;
 
+err_out4:
+  for (EIBnetDriverPtr &b : backbones)
+    stop_link (b, true);
+  backbones.clear();
+  stop_link (mcast, route);
 err_out3:
   mcast.reset();
 err_out2:
+  tcp_watch.stop();
+  if (tcp_fd >= 0)
+    {
+      close (tcp_fd);
+      tcp_fd = -1;
+    }
   delete sock;
   sock = NULL;
 err_out1:
   close (sock_mac);
   sock_mac = -1;
+  nl_watch.stop();
+  if (nl_fd >= 0)
+    {
+      close (nl_fd);
+      nl_fd = -1;
+    }
 err_out0:
   Server::stop();
 }
 
-void EIBnetDriver::Send (EIBNetIPPacket p, struct sockaddr_in addr)
+void EIBnetDriver::Send (const EIBNetIPBuf& b, struct sockaddr_in addr)
 {
   if (sock)
-    sock->Send (p, addr);
+    sock->Send (b, addr);
+}
+
+void
+EIBnetDriver::Route (const EIBNetIPBuf& b)
+{
+  EIBnetServer &parent = *std::static_pointer_cast<EIBnetServer>(server);
+  if (backbone)
+    Send (b, maddr);
+  else
+    parent.Send (b);
 }
 
 void
 EIBnetDriver::send_L_Data (LDataPtr l)
 {
   EIBnetServer &parent = *std::static_pointer_cast<EIBnetServer>(server);
-  if (parent.route)
+  if (backbone || parent.route)
     {
-      EIBNetIPPacket p;
-      p.service = ROUTING_INDICATION;
-      p.data = L_Data_ToCEMI (0x29, l);
-      parent.Send (p);
+      size_t len = L_Data_CEMI_size (*l);
+      EIBNetIPBuf p = EIBNetIPBuf::alloc (ROUTING_INDICATION, len);
+      L_Data_ToCEMI (0x29, *l, p.body (), len);
+
+      ev_tstamp now = ev_now (EV_DEFAULT);
+      if (pending.empty() && may_send (now))
+        {
+          stats.sent++;
+          Route (p);
+        }
+      else if (pending.size() >= routing_queue)
+        {
+          stats.dropped++;
+          TRACEPRINTF (t, 3, "backbone busy, dropped %s", l->Decode (t));
+        }
+      else
+        {
+          stats.delayed++;
+          pending.put (std::move(p));
+          schedule (now);
+        }
     }
   send_Next();
 }
 
+/** Consume a token if we're allowed to send now. */
+bool
+EIBnetDriver::may_send (ev_tstamp now)
+{
+  if (now < pause_until)
+    return false;
+  if (rate_limit <= 0)
+    return true;
+
+  tokens += (now - token_time) * rate_limit;
+  if (tokens > rate_burst)
+    tokens = rate_burst;
+  token_time = now;
+  if (tokens < 1)
+    return false;
+  tokens -= 1;
+  return true;
+}
+
+void
+EIBnetDriver::schedule (ev_tstamp now)
+{
+  if (flow_timer.is_active())
+    return;
+  ev_tstamp when = pause_until;
+  if (rate_limit > 0 && tokens < 1)
+    {
+      ev_tstamp tw = token_time + (1 - tokens) / rate_limit;
+      if (tw > when)
+        when = tw;
+    }
+  flow_timer.start (when > now ? when - now : 0, 0);
+}
+
+void
+EIBnetDriver::flow_timer_cb (ev::timer &, int)
+{
+  ev_tstamp now = ev_now (EV_DEFAULT);
+  while (!pending.empty() && may_send (now))
+    {
+      stats.sent++;
+      Route (pending.get());
+    }
+  if (!pending.empty())
+    schedule (now);
+}
+
+/**
+ * Pause for the announced time plus a random slice which grows with the
+ * number of recent BUSY bursts N. BUSYs from several routers within
+ * 10 msec count once; N decays by one every 5 msec, starting N*100 msec
+ * after the pause ends.
+ */
+void
+EIBnetDriver::routing_busy (const EIBnet_RoutingBusy &r)
+{
+  stats.busy_rx++;
+  if (r.control)
+    return;
+
+  ev_tstamp now = ev_now (EV_DEFAULT);
+  if (busy_n && now > busy_decay)
+    {
+      unsigned d = (now - busy_decay) / 0.005;
+      busy_n = d >= busy_n ? 0 : busy_n - d;
+      busy_decay += d * 0.005;
+    }
+  if (now - busy_last >= 0.010)
+    busy_n++;
+  busy_last = now;
+
+  ev_tstamp until = now + r.waittime / 1000. + busy_n * 0.050 * random() / RAND_MAX;
+  if (until > pause_until)
+    pause_until = until;
+  busy_decay = pause_until + busy_n * 0.100;
+  TRACEPRINTF (t, 5, "ROUTING_BUSY %d ms: pause %.3f s, N=%d", r.waittime, pause_until - now, busy_n);
+
+  if (!pending.empty())
+    {
+      flow_timer.stop();
+      schedule (now);
+    }
+}
+
+void
+EIBnetDriver::routing_lost (const EIBnet_RoutingLostMessage &r)
+{
+  stats.lost_rx += r.lost;
+  TRACEPRINTF (t, 3, "ROUTING_LOST_MESSAGE: %d lost", r.lost);
+}
+
+void
+EIBnetDriver::check_congestion ()
+{
+  EIBnetServer &parent = *std::static_pointer_cast<EIBnetServer>(server);
+  Router &rt = static_cast<Router &>(parent.router);
+
+  if (rt.lost != lost_seen)
+    {
+      EIBnet_RoutingLostMessage r;
+      unsigned long n = rt.lost - lost_seen;
+      r.lost = n > 0xffff ? 0xffff : n;
+      lost_seen = rt.lost;
+      stats.lost_tx++;
+      Route (r.ToPacket ());
+    }
+
+  ev_tstamp now = ev_now (EV_DEFAULT);
+  if (rt.congested() && now - busy_sent >= 0.010)
+    {
+      EIBnet_RoutingBusy r;
+      r.waittime = busy_wait;
+      busy_sent = now;
+      stats.busy_tx++;
+      TRACEPRINTF (t, 5, "congested: sending ROUTING_BUSY");
+      Route (r.ToPacket ());
+    }
+}
+
+std::string
+EIBnetDriver::info(int verbose)
+{
+  std::string res = SubDriver::info(verbose);
+  char buf[200];
+  snprintf (buf, sizeof (buf),
+            " sent:%lu delayed:%lu dropped:%lu busy-rx:%lu busy-tx:%lu lost-rx:%lu lost-tx:%lu",
+            stats.sent, stats.delayed, stats.dropped,
+            stats.busy_rx, stats.busy_tx, stats.lost_rx, stats.lost_tx);
+  return res + buf;
+}
+
 bool ConnState::setup()
 {
   // Force queuing so that a bad or unreachable client can't disable the whole system
@@ -306,18 +639,21 @@ void ConnState::send_L_Data (LDataPtr l)
     }
 }
 
+/** lowest free channel id, or 0x100 if all are taken */
+int
+EIBnetServer::alloc_channel ()
+{
+  for (unsigned w = 0; w < 4; w++)
+    if (~chan_used[w])
+      return w * 64 + __builtin_ctzll (~chan_used[w]);
+  return 0x100;
+}
+
 int
 EIBnetServer::addClient (ConnType type, const EIBnet_ConnectRequest & r1,
-                         eibaddr_t addr)
+                         eibaddr_t addr, EIBnetStreamConn *sc)
 {
-  int id = 1;
-rt:
-  ITER(i, connections)
-  if ((*i)->channel == id)
-    {
-      id++;
-      goto rt;
-    }
+  int id = alloc_channel ();
   if (id <= 0xff)
     {
       LinkConnectClientPtr conn = LinkConnectClientPtr(new LinkConnectClient(std::dynamic_pointer_cast<EIBnetServer>(shared_from_this()), tunnel_cfg, t));
@@ -332,11 +668,16 @@ rt:
       s->no = 1;
       s->type = type;
       s->nat = r1.nat;
+      s->tcp = sc;
+      s->rtt.set_limits (ack_min, ack_max);
       if(!conn->setup())
         return -1;
       if(!static_cast<Router &>(router).registerLink(conn, true))
         return -1;
-      connections.push_back(s);
+      channels[id] = s;
+      chan_used[id >> 6] |= 1ULL << (id & 63);
+      if (sc)
+        sc->tunnel = s;
     }
   return id;
 }
@@ -354,42 +695,66 @@ ConnState::ConnState (LinkConnectClientPtr c, eibaddr_t addr)
   TRACEPRINTF (t, 9, "has %s", FormatEIBAddr (addr));
 }
 
+/** Send a request at most this often. Repeats follow the measured RTT;
+ * the last copy waits the full timeout. */
+#define ACK_MAX_SENDS 2
+
 void ConnState::sendtimeout_cb(ev::timer &, int)
 {
-  if (++retries <= 2)
+  rtt.backoff ();
+  if (retries < ACK_MAX_SENDS)
     {
+      TRACEPRINTF (t, 8, "Retry %d, timeout %.3f", retries, rtt.rto ());
       send_trigger.send();
       return;
     }
   CArray p = out.get ();
+  sending.reset ();
   t->TracePacket (2, "dropped no-ACK", p.size(), p.data());
   stop();
 }
 
+EIBNetIPBuf ConnState::request (const CArray &cemi)
+{
+  if (type == CT_CONFIG)
+    return EIBnet_ConfigRequest::Encode (channel, sno, cemi);
+  else
+    return EIBnet_TunnelRequest::Encode (channel, sno, cemi);
+}
+
 void ConnState::send_trigger_cb(ev::async &, int)
 {
+  if (tcp)
+    {
+      stream_out ();
+      return;
+    }
   if (out.empty ())
     return;
-  EIBNetIPPacket p;
-  if (type == CT_CONFIG)
+  if (!retries)
     {
-      EIBnet_ConfigRequest r;
-      r.channel = channel;
-      r.seqno = sno;
-      r.CEMI = out.front ();
-      p = r.ToPacket ();
+      sent_at = ev_time ();
+      sending = request (out.front ());
     }
-  else
+  retries ++;
+  sendtimeout.start(retries < ACK_MAX_SENDS ? rtt.rto () : TUNNELING_REQUEST_TIMEOUT,0);
+  std::static_pointer_cast<EIBnetServer>(server)->mcast->Send (sending, daddr);
+}
+
+/** TCP has no ACKs: hand everything to the stream, and ask for more
+ * unless the connection is backed up. */
+void ConnState::stream_out ()
+{
+  while (!out.empty ())
     {
-      EIBnet_TunnelRequest r;
-      r.channel = channel;
-      r.seqno = sno;
-      r.CEMI = out.front ();
-      p = r.ToPacket ();
+      tcp->Send (request (out.get ()));
+      sno++;
+    }
+  if (do_send_next && tcp->pending () < STREAM_BACKLOG)
+    {
+      do_send_next = false;
+      send_Next();
     }
-  retries ++;
-  sendtimeout.start(TUNNELING_REQUEST_TIMEOUT,0);
-  std::static_pointer_cast<EIBnetServer>(server)->mcast->Send (p, daddr);
 }
 
 void ConnState::timeout_cb(ev::timer &, int)
@@ -398,7 +763,12 @@ void ConnState::timeout_cb(ev::timer &, int)
     {
       EIBnet_DisconnectRequest r;
       r.channel = channel;
-      if (GetSourceAddress (t, &caddr, &r.caddr))
+      if (tcp)
+        {
+          r.tcp = true;
+          tcp->Send (r.ToPacket ());
+        }
+      else if (GetSourceAddress (t, &caddr, &r.caddr))
         {
           r.caddr.sin_port = std::static_pointer_cast<EIBnetServer>(server)->Port;
           r.nat = nat;
@@ -417,7 +787,14 @@ void ConnState::stop()
   sendtimeout.stop();
   send_trigger.stop();
   retries = 0;
+  last_ack.reset ();
   std::static_pointer_cast<EIBnetServer>(server)->drop_connection (std::static_pointer_cast<ConnState>(shared_from_this()));
+  if (tcp)
+    {
+      EIBnetStreamConn *sc = tcp;
+      tcp = nullptr;
+      sc->tunnel_stopped ();
+    }
   if (addr)
     {
       dynamic_cast<Router *>(&server->router)->release_client_addr(addr);
@@ -432,26 +809,50 @@ void EIBnetServer::drop_connection (ConnStatePtr s)
   drop_trigger.send();
 }
 
+void EIBnetServer::drop_stream (EIBnetStreamConn *sc)
+{
+  stream_drop_q.put(std::move(sc));
+  drop_trigger.send();
+}
+
 void EIBnetServer::drop_trigger_cb(ev::async &, int)
 {
-  while (!drop_q.empty())
+  while (!stream_drop_q.empty())
     {
-      ConnStatePtr s = drop_q.get();
-      ITER(i,connections)
-      if (*i == s)
+      EIBnetStreamConn *sc = stream_drop_q.get();
+      ITER(i, streams)
+      if (i->get() == sc)
         {
-          connections.erase (i);
-          auto c = std::dynamic_pointer_cast<LinkConnect>(s->conn.lock());
-          if (c != nullptr)
-            static_cast<Router &>(router).unregisterLink(c);
+          streams.erase (i);
           break;
         }
     }
+  while (!drop_q.empty())
+    {
+      ConnStatePtr s = drop_q.get();
+      if (channels[s->channel] != s)
+        continue;
+      channels[s->channel].reset();
+      chan_used[s->channel >> 6] &= ~(1ULL << (s->channel & 63));
+      auto c = std::dynamic_pointer_cast<LinkConnect>(s->conn.lock());
+      if (c != nullptr)
+        static_cast<Router &>(router).unregisterLink(c);
+    }
 }
 
 ConnState::~ConnState()
 {
-  TRACEPRINTF (t, 8, "CloseS");
+  TRACEPRINTF (t, 8, "CloseS: %s rx:%lu dup:%lu oow:%lu", rtt.info(),
+               rx_stats.requests, rx_stats.duplicates, rx_stats.out_of_window);
+}
+
+std::string
+ConnState::info(int verbose)
+{
+  char buf[100];
+  snprintf (buf, sizeof (buf), " rx:%lu dup:%lu oow:%lu",
+            rx_stats.requests, rx_stats.duplicates, rx_stats.out_of_window);
+  return SubDriver::info(verbose) + " " + rtt.info() + buf;
 }
 
 void ConnState::reset_timer()
@@ -459,137 +860,261 @@ void ConnState::reset_timer()
   timeout.set(120,0);
 }
 
+/** don't look at the interfaces more often than this */
+#define DIB_MIN_AGE 1.
+/** without netlink, look again after this long */
+#define DIB_MAX_AGE 30.
+
 void
-EIBnetServer::handle_packet (EIBNetIPPacket *p1, EIBNetIPSocket *isock)
+EIBnetServer::get_mac (uint8_t *mac)
 {
-  /* Get MAC Address */
-  /* TODO: cache all of this, and ask at most once per seoncd */
-
   struct ifreq ifr;
   struct ifconf ifc;
   char buf[1024];
-  unsigned char mac_address[IFHWADDRLEN]= {0,0,0,0,0,0};
 
-  if (sock_mac != -1 && discover &&
-      (p1->service == DESCRIPTION_REQUEST || p1->service == SEARCH_REQUEST))
-    {
-      ifc.ifc_len = sizeof(buf);
-      ifc.ifc_buf = buf;
-      if (ioctl(sock_mac, SIOCGIFCONF, &ifc) != -1)
-        {
-          struct ifreq* it = ifc.ifc_req;
-          const struct ifreq* const end = it + (ifc.ifc_len / sizeof(struct ifreq));
+  memset (mac, 0, IFHWADDRLEN);
+  if (sock_mac == -1)
+    return;
 
-          for (; it != end; ++it)
-            {
-              strcpy(ifr.ifr_name, it->ifr_name);
-              if (ioctl(sock_mac, SIOCGIFFLAGS, &ifr))
-                continue;
-              if (ifr.ifr_flags & IFF_LOOPBACK) // don't count loopback
-                continue;
+  ifc.ifc_len = sizeof(buf);
+  ifc.ifc_buf = buf;
+  if (ioctl(sock_mac, SIOCGIFCONF, &ifc) == -1)
+    return;
+
+  struct ifreq* it = ifc.ifc_req;
+  const struct ifreq* const end = it + (ifc.ifc_len / sizeof(struct ifreq));
+
+  for (; it != end; ++it)
+    {
+      strcpy(ifr.ifr_name, it->ifr_name);
+      if (ioctl(sock_mac, SIOCGIFFLAGS, &ifr))
+        continue;
+      if (ifr.ifr_flags & IFF_LOOPBACK) // don't count loopback
+        continue;
 #ifdef SIOCGIFHWADDR
-              if (ioctl(sock_mac, SIOCGIFHWADDR, &ifr))
-                continue;
-              if (ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER)
-                continue;
-              memcpy(mac_address, ifr.ifr_hwaddr.sa_data, sizeof(mac_address));
+      if (ioctl(sock_mac, SIOCGIFHWADDR, &ifr))
+        continue;
+      if (ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER)
+        continue;
+      memcpy(mac, ifr.ifr_hwaddr.sa_data, IFHWADDRLEN);
 #else
-              /* for FreeBSD, doesn't have ioctl SIOCGIFHWADDR */
-              int mib[6];
-              size_t len;
-              char *buf;
-              unsigned char *ptr;
-              struct if_msghdr        *ifm;
-              struct sockaddr_dl        *sdl;
-
-              mib[0] = CTL_NET;
-              mib[1] = AF_ROUTE;
-              mib[2] = 0;
-              mib[3] = AF_LINK;
-              mib[4] = NET_RT_IFLIST;
-
-              if ((mib[5] = if_nametoindex(ifr.ifr_name)) == 0)
-                {
-                  TRACEPRINTF(t, 2, "get_mac_address if_nametoindex error");
-                  goto out;
-                }
-              if (sysctl(mib, 6, NULL, &len, NULL, 0) < 0)
-                {
-                  TRACEPRINTF(t, 2, "get_mac_address sysctl 1 error");
-                  goto out;
-                }
+      /* for FreeBSD, doesn't have ioctl SIOCGIFHWADDR */
+      int mib[6];
+      size_t len;
+      struct if_msghdr        *ifm;
+      struct sockaddr_dl        *sdl;
+
+      mib[0] = CTL_NET;
+      mib[1] = AF_ROUTE;
+      mib[2] = 0;
+      mib[3] = AF_LINK;
+      mib[4] = NET_RT_IFLIST;
+
+      if ((mib[5] = if_nametoindex(ifr.ifr_name)) == 0)
+        {
+          TRACEPRINTF(t, 2, "get_mac_address if_nametoindex error");
+          return;
+        }
+      if (sysctl(mib, 6, NULL, &len, NULL, 0) < 0)
+        {
+          TRACEPRINTF(t, 2, "get_mac_address sysctl 1 error");
+          return;
+        }
 
-              buf = new char[len];
+      std::unique_ptr<char[]> lbuf(new char[len]);
 
-              if (sysctl(mib, 6, buf, &len, NULL, 0) < 0)
-                {
-                  TRACEPRINTF(t, 2, "get_mac_address sysctl 2 error");
-                  goto out;
-                }
+      if (sysctl(mib, 6, lbuf.get(), &len, NULL, 0) < 0)
+        {
+          TRACEPRINTF(t, 2, "get_mac_address sysctl 2 error");
+          return;
+        }
 
-              ifm = (struct if_msghdr *)buf;
-              sdl = (struct sockaddr_dl *)(ifm + 1);
-              ptr = (unsigned char *)LLADDR(sdl);
-              memcpy(mac_address, ptr, sizeof(mac_address));
+      ifm = (struct if_msghdr *)lbuf.get();
+      sdl = (struct sockaddr_dl *)(ifm + 1);
+      memcpy(mac, LLADDR(sdl), IFHWADDRLEN);
 #endif
-              break;
-            }
+      break;
+    }
+}
+
+/** Rebuild the discovery responses if the interfaces may have changed,
+ * but at most once per DIB_MIN_AGE. */
+void
+EIBnetServer::refresh_dib ()
+{
+  ev_tstamp now = ev_now (EV_DEFAULT);
+  if (!search_resp.empty())
+    {
+      if (!dib_stale && (nl_fd >= 0 || now - dib_time < DIB_MAX_AGE))
+        return;
+      if (now - dib_time < DIB_MIN_AGE)
+        return;
+    }
+  dib_stale = false;
+  dib_time = now;
+  src_cache.clear();
+
+  uint8_t mac_address[IFHWADDRLEN];
+  get_mac (mac_address);
+  TRACEPRINTF (t, 8, "DIB refresh, MAC %02x:%02x:%02x:%02x:%02x:%02x",
+               mac_address[0], mac_address[1], mac_address[2],
+               mac_address[3], mac_address[4], mac_address[5]);
+
+  {
+    EIBnet_SearchResponse r2;
+    DIB_service_Entry d;
+
+    r2.KNXmedium = 2;
+    r2.devicestatus = 0;
+    r2.individual_addr = dynamic_cast<Router *>(&router)->addr;
+    r2.installid = 0;
+    r2.multicastaddr = mcast->maddr.sin_addr;
+    r2.serial[0]=1;
+    r2.serial[1]=2;
+    r2.serial[2]=3;
+    r2.serial[3]=4;
+    r2.serial[4]=5;
+    r2.serial[5]=6;
+    //FIXME: Hostname, MAC-addr
+    memcpy(r2.MAC, mac_address, sizeof(r2.MAC));
+    //FIXME: Hostname, indiv. address
+    strncpy ((char *) r2.name, servername.c_str(), sizeof(r2.name) - 1);
+    d.version = 1;
+    d.family = 2; // core
+    r2.services.push_back (d);
+    //d.family = 3; // device management
+    //r2.services.add (d);
+    d.family = 4;
+    if (tunnel)
+      r2.services.push_back (d);
+    d.family = 5;
+    if (route)
+      r2.services.push_back (d);
+    search_resp = r2.ToPacket ().ToPacket ();
+  }
+  {
+    EIBnet_DescriptionResponse r2;
+    DIB_service_Entry d;
+
+    r2.KNXmedium = 2;
+    r2.devicestatus = 0;
+    r2.individual_addr = dynamic_cast<Router *>(&router)->addr;
+    r2.installid = 0;
+    r2.multicastaddr = mcast->maddr.sin_addr;
+    memcpy(r2.MAC, mac_address, sizeof(r2.MAC));
+    //FIXME: Hostname, indiv. address
+    strncpy ((char *) r2.name, servername.c_str(), sizeof(r2.name) - 1);
+    d.version = 1;
+    d.family = 2;
+    r2.services.push_back (d);
+    d.family = 3;
+    r2.services.push_back (d);
+    d.family = 4;
+    if (tunnel)
+      r2.services.push_back (d);
+    d.family = 5;
+    if (route)
+      r2.services.push_back (d);
+    descr_resp = r2.ToPacket ().ToPacket ();
+  }
+}
+
+/** The local address a requester can reach us at. Cached until the next
+ * DIB refresh; a handful of ETS instances asks over and over. */
+bool
+EIBnetServer::source_for (const struct sockaddr_in& dest, struct sockaddr_in& src)
+{
+  auto i = src_cache.find (dest.sin_addr.s_addr);
+  if (i != src_cache.end())
+    {
+      src = i->second;
+      return true;
+    }
+  if (!GetSourceAddress (t, &dest, &src))
+    return false;
+  src.sin_port = Port;
+  if (src_cache.size() >= 64)
+    src_cache.clear();
+  src_cache[dest.sin_addr.s_addr] = src;
+  return true;
+}
+
+void
+EIBnetServer::nl_cb (ev::io &, int)
+{
+  char buf[4096];
+
+  /* Every message in the groups we joined may change what we announce,
+   * so don't bother parsing them. ENOBUFS means we missed some. */
+  while (true)
+    {
+      ssize_t n = recv (nl_fd, buf, sizeof (buf), 0);
+      if (n > 0 || (n == -1 && errno == ENOBUFS))
+        {
+          dib_stale = true;
+          continue;
         }
+      if (n == -1 && errno == EINTR)
+        continue;
+      break;
     }
-  /* End MAC Address */
+}
+
+ConnStatePtr
+EIBnetServer::find_channel (uint8_t channel, EIBnetStreamConn *sc)
+{
+  ConnStatePtr s = channels[channel];
+  if (s && s->tcp != sc)
+    {
+      TRACEPRINTF (t, 8, "channel %d belongs to another connection", channel);
+      return nullptr;
+    }
+  return s;
+}
+
+void
+EIBnetServer::reply (EIBNetIPSocket *isock, EIBnetStreamConn *sc,
+                     EIBNetIPPacket p, struct sockaddr_in addr)
+{
+  if (sc)
+    sc->Send (p);
+  else
+    isock->Send (p, addr);
+}
+
+void
+EIBnetServer::handle_packet (EIBNetIPPacket *p1, EIBNetIPSocket *isock,
+                             EIBnetStreamConn *sc, EIBnetDriver *drv)
+{
+  /* routing packets belong to the link whose socket got them */
+  if (!drv && route && !sc)
+    drv = mcast.get();
 
   if (p1->service == SEARCH_REQUEST)
     {
       EIBnet_SearchRequest r1;
-      EIBnet_SearchResponse r2;
-      DIB_service_Entry d;
+      struct sockaddr_in caddr;
       if (parseEIBnet_SearchRequest (*p1, r1))
         {
           t->TracePacket (2, "unparseable SEARCH_REQUEST", p1->data);
           goto out;
         }
       TRACEPRINTF (t, 8, "SEARCH_REQ");
-      if (!discover)
+      if (!discover || sc)
         goto out;
 
-      r2.KNXmedium = 2;
-      r2.devicestatus = 0;
-      r2.individual_addr = dynamic_cast<Router *>(&router)->addr;
-      r2.installid = 0;
-      r2.multicastaddr = mcast->maddr.sin_addr;
-      r2.serial[0]=1;
-      r2.serial[1]=2;
-      r2.serial[2]=3;
-      r2.serial[3]=4;
-      r2.serial[4]=5;
-      r2.serial[5]=6;
-      //FIXME: Hostname, MAC-addr
-      memcpy(r2.MAC, mac_address, sizeof(r2.MAC));
-      //FIXME: Hostname, indiv. address
-      strncpy ((char *) r2.name, servername.c_str(), sizeof(r2.name) - 1);
-      d.version = 1;
-      d.family = 2; // core
-      r2.services.push_back (d);
-      //d.family = 3; // device management
-      //r2.services.add (d);
-      d.family = 4;
-      if (tunnel)
-        r2.services.push_back (d);
-      d.family = 5;
-      if (route)
-        r2.services.push_back (d);
-      if (!GetSourceAddress (t, &r1.caddr, &r2.caddr))
+      refresh_dib ();
+      if (!source_for (r1.caddr, caddr))
         goto out;
-      r2.caddr.sin_port = Port;
-      isock->Send (r2.ToPacket (), r1.caddr);
+      /* the HPAI follows the 6-byte header */
+      search_resp.setpart (IPtoEIBNetIP (&caddr, false), 6);
+      isock->Send (search_resp, r1.caddr);
       goto out;
     }
 
   if (p1->service == DESCRIPTION_REQUEST)
     {
       EIBnet_DescriptionRequest r1;
-      EIBnet_DescriptionResponse r2;
-      DIB_service_Entry d;
       if (parseEIBnet_DescriptionRequest (*p1, r1))
         {
           t->TracePacket (2, "unparseable DESCRIPTION_REQUEST", p1->data);
@@ -598,27 +1123,11 @@ EIBnetServer::handle_packet (EIBNetIPPacket *p1, EIBNetIPSocket *isock)
       if (!discover)
         goto out;
       TRACEPRINTF (t, 8, "DESCRIBE");
-      r2.KNXmedium = 2;
-      r2.devicestatus = 0;
-      r2.individual_addr = dynamic_cast<Router *>(&router)->addr;
-      r2.installid = 0;
-      r2.multicastaddr = mcast->maddr.sin_addr;
-      memcpy(r2.MAC, mac_address, sizeof(r2.MAC));
-      //FIXME: Hostname, indiv. address
-      strncpy ((char *) r2.name, servername.c_str(), sizeof(r2.name) - 1);
-      d.version = 1;
-      d.family = 2;
-      if (discover)
-        r2.services.push_back (d);
-      d.family = 3;
-      r2.services.push_back (d);
-      d.family = 4;
-      if (tunnel)
-        r2.services.push_back (d);
-      d.family = 5;
-      if (route)
-        r2.services.push_back (d);
-      isock->Send (r2.ToPacket (), r1.caddr);
+      refresh_dib ();
+      if (sc)
+        sc->stream->Send (descr_resp);
+      else
+        isock->Send (descr_resp, r1.caddr);
       goto out;
     }
   if (p1->service == ROUTING_INDICATION)
@@ -631,8 +1140,35 @@ EIBnetServer::handle_packet (EIBNetIPPacket *p1, EIBNetIPSocket *isock)
       LDataPtr c = CEMI_to_L_Data (p1->data, t);
       if (!c)
         t->TracePacket (2, "unCEMIable ROUTING_INDICATION", p1->data);
-      else if (route)
-        mcast->recv_L_Data (std::move(c));
+      else if (drv)
+        {
+          drv->recv_L_Data (std::move(c));
+          drv->check_congestion ();
+        }
+      goto out;
+    }
+  if (p1->service == ROUTING_BUSY)
+    {
+      EIBnet_RoutingBusy r1;
+      if (parseEIBnet_RoutingBusy (*p1, r1))
+        {
+          t->TracePacket (2, "unparseable ROUTING_BUSY", p1->data);
+          goto out;
+        }
+      if (drv)
+        drv->routing_busy (r1);
+      goto out;
+    }
+  if (p1->service == ROUTING_LOST_MESSAGE)
+    {
+      EIBnet_RoutingLostMessage r1;
+      if (parseEIBnet_RoutingLostMessage (*p1, r1))
+        {
+          t->TracePacket (2, "unparseable ROUTING_LOST_MESSAGE", p1->data);
+          goto out;
+        }
+      if (drv)
+        drv->routing_lost (r1);
       goto out;
     }
   if (p1->service == CONNECTIONSTATE_REQUEST)
@@ -646,18 +1182,17 @@ EIBnetServer::handle_packet (EIBNetIPPacket *p1, EIBNetIPSocket *isock)
         }
       r2.channel = r1.channel;
       r2.status = E_CONNECTION_ID;
-      ITER(i, connections)
-      if ((*i)->channel == r1.channel)
+      ConnStatePtr cs = find_channel (r1.channel, sc);
+      if (cs)
         {
-          TRACEPRINTF ((*i)->t, 8, "CONNECTIONSTATE_REQUEST on %d", r1.channel);
+          TRACEPRINTF (cs->t, 8, "CONNECTIONSTATE_REQUEST on %d", r1.channel);
           r2.status = 0;
-          (*i)->reset_timer();
-          break;
+          cs->reset_timer();
         }
       if (r2.status)
         TRACEPRINTF (t, 2, "Unknown connection %d", r2.channel);
 
-      isock->Send (r2.ToPacket (), r1.caddr);
+      reply (isock, sc, r2.ToPacket (), r1.caddr);
       goto out;
     }
   if (p1->service == DISCONNECT_REQUEST)
@@ -671,17 +1206,16 @@ EIBnetServer::handle_packet (EIBNetIPPacket *p1, EIBNetIPSocket *isock)
         }
       r2.status = E_CONNECTION_ID;
       r2.channel = r1.channel;
-      ITER(i,connections)
-      if ((*i)->channel == r1.channel)
+      ConnStatePtr cs = find_channel (r1.channel, sc);
+      if (cs)
         {
           r2.status = 0;
-          TRACEPRINTF ((*i)->t, 8, "DISCONNECT_REQUEST");
-          (*i)->stop();
-          break;
+          TRACEPRINTF (cs->t, 8, "DISCONNECT_REQUEST");
+          cs->stop();
         }
       if (r2.status)
         TRACEPRINTF (t, 8, "DISCONNECT_REQUEST on %d", r1.channel);
-      isock->Send (r2.ToPacket (), r1.caddr);
+      reply (isock, sc, r2.ToPacket (), r1.caddr);
       goto out;
     }
   if (p1->service == CONNECTION_REQUEST)
@@ -694,7 +1228,12 @@ EIBnetServer::handle_packet (EIBNetIPPacket *p1, EIBNetIPSocket *isock)
           goto out;
         }
       r2.status = E_CONNECTION_TYPE;
-      if (r1.CRI.size() == 3 && r1.CRI[0] == 4)
+      if (sc && sc->tunnel)
+        {
+          TRACEPRINTF (t, 8, "CONNECTION_REQ: TCP connection already has a tunnel");
+          r2.status = E_NO_MORE_CONNECTIONS;
+        }
+      else if (r1.CRI.size() == 3 && r1.CRI[0] == 4)
         {
           eibaddr_t a = tunnel ? static_cast<Router &>(router).get_client_addr (t) : 0;
           r2.CRD.resize (3);
@@ -712,7 +1251,7 @@ EIBnetServer::handle_packet (EIBNetIPPacket *p1, EIBNetIPSocket *isock)
             }
           else if (r1.CRI[1] == 0x02 || r1.CRI[1] == 0x80)
             {
-              int id = addClient ((r1.CRI[1] == 0x80) ? CT_BUSMONITOR : CT_STANDARD, r1, a);
+              int id = addClient ((r1.CRI[1] == 0x80) ? CT_BUSMONITOR : CT_STANDARD, r1, a, sc);
               if (id <= 0xff)
                 {
                   r2.channel = id;
@@ -730,7 +1269,7 @@ EIBnetServer::handle_packet (EIBNetIPPacket *p1, EIBNetIPSocket *isock)
           r2.CRD.resize (1);
           r2.CRD[0] = 0x03;
           TRACEPRINTF (t, 8, "Tunnel CONNECTION_REQ, no addr (mgmt)");
-          int id = addClient (CT_CONFIG, r1, 0);
+          int id = addClient (CT_CONFIG, r1, 0, sc);
           if (id <= 0xff)
             {
               r2.channel = id;
@@ -753,9 +1292,22 @@ EIBnetServer::handle_packet (EIBNetIPPacket *p1, EIBNetIPSocket *isock)
         }
       r2.daddr.sin_port = Port;
       r2.nat = r1.nat;
-      isock->Send (r2.ToPacket (), r1.caddr);
+      r2.tcp = sc != nullptr;
+      reply (isock, sc, r2.ToPacket (), r1.caddr);
       goto out;
     }
+  if (p1->service == TUNNEL_REQUEST || p1->service == DEVICE_CONFIGURATION_REQUEST)
+    {
+      /* A repeat of the last request: its ACK got lost. Resend that
+       * without looking at the rest. */
+      if (p1->data.size() >= 6 && p1->data[0] == 4
+          && (tunnel || p1->service == DEVICE_CONFIGURATION_REQUEST))
+        {
+          ConnStatePtr cs = find_channel (p1->data[1], sc);
+          if (cs && cs->repeated (p1->service, p1->data[2], isock))
+            goto out;
+        }
+    }
   if (p1->service == TUNNEL_REQUEST)
     {
       EIBnet_TunnelRequest r1;
@@ -765,13 +1317,12 @@ EIBnetServer::handle_packet (EIBNetIPPacket *p1, EIBNetIPSocket *isock)
           t->TracePacket (2, "unparseable TUNNEL_REQUEST", p1->data);
           goto out;
         }
-      if (tunnel)
-        ITER(i,connections)
-        if ((*i)->channel == r1.channel)
-          {
-            (*i)->tunnel_request(r1, isock);
-            goto out;
-          }
+      ConnStatePtr cs = find_channel (r1.channel, sc);
+      if (tunnel && cs)
+        {
+          cs->tunnel_request(r1, isock);
+          goto out;
+        }
       TRACEPRINTF (t, 8, "TUNNEL_REQ on unknown %d", r1.channel);
       goto out;
     }
@@ -783,13 +1334,12 @@ EIBnetServer::handle_packet (EIBNetIPPacket *p1, EIBNetIPSocket *isock)
           t->TracePacket (2, "unparseable TUNNEL_RESPONSE", p1->data);
           goto out;
         }
-      if (tunnel)
-        ITER(i, connections)
-        if ((*i)->channel == r1.channel)
-          {
-            (*i)->tunnel_response (r1);
-            goto out;
-          }
+      ConnStatePtr cs = find_channel (r1.channel, sc);
+      if (tunnel && cs)
+        {
+          cs->tunnel_response (r1);
+          goto out;
+        }
       TRACEPRINTF (t, 8, "TUNNEL_ACK on unknown %d",r1.channel);
       goto out;
     }
@@ -803,12 +1353,9 @@ EIBnetServer::handle_packet (EIBNetIPPacket *p1, EIBNetIPSocket *isock)
           goto out;
         }
       TRACEPRINTF (t, 8, "CONFIG_REQ on %d",r1.channel);
-      ITER(i, connections)
-      if ((*i)->channel == r1.channel)
-        {
-          (*i)->config_request (r1, isock);
-          break;
-        }
+      ConnStatePtr cs = find_channel (r1.channel, sc);
+      if (cs)
+        cs->config_request (r1, isock);
       goto out;
     }
   if (p1->service == DEVICE_CONFIGURATION_ACK)
@@ -819,10 +1366,10 @@ EIBnetServer::handle_packet (EIBNetIPPacket *p1, EIBNetIPSocket *isock)
           t->TracePacket (2, "unparseable DEVICE_CONFIGURATION_ACK", p1->data);
           goto out;
         }
-      ITER(i, connections)
-      if ((*i)->channel == r1.channel)
+      ConnStatePtr cs = find_channel (r1.channel, sc);
+      if (cs)
         {
-          (*i)->config_response (r1);
+          cs->config_response (r1);
           goto out;
         }
       TRACEPRINTF (t, 8, "CONFIG_ACK on unknown channel %d",r1.channel);
@@ -839,6 +1386,101 @@ EIBnetServer::recv_cb (EIBNetIPPacket *p)
   handle_packet (p, this->sock);
 }
 
+void
+EIBnetServer::tcp_cb (ev::io &, int)
+{
+  struct sockaddr_in peer;
+  socklen_t len = sizeof (peer);
+
+  int fd = accept (tcp_fd, (struct sockaddr *) &peer, &len);
+  if (fd == -1)
+    {
+      if (errno != EWOULDBLOCK && errno != EAGAIN && errno != EINTR)
+        ERRORPRINTF (t, E_ERROR | 147, "Accept TCP: %s", strerror(errno));
+      return;
+    }
+  TRACEPRINTF (t, 8, "TCP connection from %s:%d", inet_ntoa (peer.sin_addr), ntohs (peer.sin_port));
+  streams.push_back (EIBnetStreamConnPtr (new EIBnetStreamConn (this, fd, peer)));
+}
+
+/** a client gets this long to open a tunnel, or to hang up after closing one */
+#define STREAM_IDLE_TIME 10
+
+EIBnetStreamConn::EIBnetStreamConn (EIBnetServer *parent, int fd,
+                                    const struct sockaddr_in& peer)
+{
+  this->parent = parent;
+  stream = new EIBNetIPStream (fd, peer, parent->t);
+  stream->on_recv.set<EIBnetStreamConn,&EIBnetStreamConn::recv_cb>(this);
+  stream->on_error.set<EIBnetStreamConn,&EIBnetStreamConn::error_cb>(this);
+  stream->on_next.set<EIBnetStreamConn,&EIBnetStreamConn::next_cb>(this);
+  stream->start();
+  idle.set<EIBnetStreamConn,&EIBnetStreamConn::idle_cb>(this);
+  idle.start(STREAM_IDLE_TIME, 0);
+}
+
+EIBnetStreamConn::~EIBnetStreamConn ()
+{
+  idle.stop();
+  delete stream;
+}
+
+void
+EIBnetStreamConn::recv_cb (EIBNetIPPacket *p)
+{
+  if (closed)
+    {
+      delete p;
+      return;
+    }
+  parent->handle_packet (p, nullptr, this);
+  if (tunnel)
+    idle.stop();
+}
+
+void
+EIBnetStreamConn::error_cb ()
+{
+  TRACEPRINTF (parent->t, 8, "TCP connection from %s closed", inet_ntoa (stream->peer.sin_addr));
+  close ();
+}
+
+void
+EIBnetStreamConn::next_cb ()
+{
+  if (tunnel)
+    tunnel->send_trigger.send();
+}
+
+void
+EIBnetStreamConn::idle_cb (ev::timer &, int)
+{
+  TRACEPRINTF (parent->t, 8, "TCP connection from %s: no tunnel", inet_ntoa (stream->peer.sin_addr));
+  close ();
+}
+
+void
+EIBnetStreamConn::tunnel_stopped ()
+{
+  tunnel.reset();
+  if (!closed)
+    idle.start(STREAM_IDLE_TIME, 0);
+}
+
+/** Safe to call from our own callbacks; we're deleted later. */
+void
+EIBnetStreamConn::close ()
+{
+  if (closed)
+    return;
+  closed = true;
+  idle.stop();
+  if (tunnel)
+    tunnel->stop(); // calls tunnel_stopped
+  stream->stop();
+  parent->drop_stream (this);
+}
+
 void
 EIBnetServer::error_cb ()
 {
@@ -865,19 +1507,28 @@ EIBnetServer::stop_()
 {
   drop_trigger.stop();
 
-  R_ITER(i,connections)
-  (*i)->stop();
+  for (int i = 255; i > 0; i--)
+    if (channels[i])
+      channels[i]->stop();
+
+  ITER(i, streams)
+  (*i)->close();
+  streams.clear();
+  while (!stream_drop_q.empty())
+    stream_drop_q.get();
+  tcp_watch.stop();
+  if (tcp_fd >= 0)
+    {
+      close (tcp_fd);
+      tcp_fd = -1;
+    }
 
+  for (EIBnetDriverPtr &b : backbones)
+    stop_link (b, true);
+  backbones.clear();
   if (mcast)
     {
-      auto c = std::dynamic_pointer_cast<LinkConnect>(mcast->conn.lock());
-
-      if (c)
-        {
-          c->stop();
-          if(route)
-            static_cast<Router &>(router).unregisterLink(c);
-        }
+      stop_link (mcast, route);
       mcast.reset();
     }
   if (sock)
@@ -890,13 +1541,35 @@ EIBnetServer::stop_()
       close (sock_mac);
       sock_mac = -1;
     }
+  nl_watch.stop();
+  if (nl_fd >= 0)
+    {
+      close (nl_fd);
+      nl_fd = -1;
+    }
+  search_resp.clear();
+  descr_resp.clear();
+  src_cache.clear();
+}
+
+void
+EIBnetServer::stop_link (EIBnetDriverPtr &d, bool registered)
+{
+  auto c = std::dynamic_pointer_cast<LinkConnect>(d->conn.lock());
+
+  if (c)
+    {
+      c->stop();
+      if (registered)
+        static_cast<Router &>(router).unregisterLink(c);
+    }
 }
 
 void
 EIBnetDriver::recv_cb (EIBNetIPPacket *p)
 {
   EIBnetServer &parent = *std::static_pointer_cast<EIBnetServer>(server);
-  parent.handle_packet (p, this->sock);
+  parent.handle_packet (p, this->sock, nullptr, backbone ? this : nullptr);
 }
 
 void
@@ -907,24 +1580,47 @@ EIBnetDriver::error_cb ()
   parent.stop();
 }
 
+bool ConnState::repeated (int service, uint8_t seqno, EIBNetIPSocket *isock)
+{
+  if (seqno != ((rno - 1) & 0xff))
+    return false;
+  TRACEPRINTF (t, 8, "Lost ACK for %d", seqno);
+  rx_stats.duplicates++;
+  if (tcp)
+    return true;
+  if (last_ack && service == last_service)
+    isock->Send (last_ack, daddr);
+  else if (service == TUNNEL_REQUEST)
+    {
+      EIBnet_TunnelACK r2;
+      r2.channel = channel;
+      r2.seqno = seqno;
+      isock->Send (r2.Encode (), daddr);
+    }
+  else
+    {
+      EIBnet_ConfigACK r2;
+      r2.channel = channel;
+      r2.seqno = seqno;
+      isock->Send (r2.Encode (), daddr);
+    }
+  return true;
+}
+
 void ConnState::tunnel_request(EIBnet_TunnelRequest &r1, EIBNetIPSocket *isock)
 {
   EIBnet_TunnelACK r2;
   r2.channel = r1.channel;
   r2.seqno = r1.seqno;
 
-  if (rno == ((r1.seqno + 1) & 0xff))
-    {
-      TRACEPRINTF (t, 8, "Lost ACK for %d", rno);
-      isock->Send (r2.ToPacket (), daddr);
-      return;
-    }
   if (rno != r1.seqno)
     {
       TRACEPRINTF (t, 8, "Wrong sequence %d<->%d",
                    r1.seqno, rno);
+      rx_stats.out_of_window++;
       return;
     }
+  rx_stats.requests++;
   if (type == CT_STANDARD)
     {
       TRACEPRINTF (t, 8, "TUNNEL_REQ");
@@ -954,7 +1650,12 @@ void ConnState::tunnel_request(EIBnet_TunnelRequest &r1, EIBNetIPSocket *isock)
       r2.status = 0x29;
     }
   rno++;
-  isock->Send (r2.ToPacket (), daddr);
+  if (!tcp)
+    {
+      last_ack = r2.Encode ();
+      last_service = TUNNEL_REQUEST;
+      isock->Send (last_ack, daddr);
+    }
 
   reset_timer(); // presumably the client is alive if it can send
 }
@@ -983,9 +1684,12 @@ void ConnState::tunnel_response (EIBnet_TunnelACK &r1)
       TRACEPRINTF (t, 8, "Unexpected Connection Type");
       return;
     }
+  if (retries == 1) // Karn: a repeated request's ACK is ambiguous
+    rtt.sample (ev_time () - sent_at);
   sno++;
 
   out.get ();
+  sending.reset ();
   sendtimeout.stop();
   reset_timer(); // presumably the client is alive if it can ack
   retries = 0;
@@ -1001,19 +1705,14 @@ void ConnState::tunnel_response (EIBnet_TunnelACK &r1)
 void ConnState::config_request(EIBnet_ConfigRequest &r1, EIBNetIPSocket *isock)
 {
   EIBnet_ConfigACK r2;
-  if (rno == ((r1.seqno + 1) & 0xff))
-    {
-      r2.channel = r1.channel;
-      r2.seqno = r1.seqno;
-      isock->Send (r2.ToPacket (), daddr);
-      return;
-    }
   if (rno != r1.seqno)
     {
       TRACEPRINTF (t, 8, "Wrong sequence %d<->%d",
                    r1.seqno, rno);
+      rx_stats.out_of_window++;
       return;
     }
+  rx_stats.requests++;
   r2.channel = r1.channel;
   r2.seqno = r1.seqno;
   if (type == CT_CONFIG && r1.CEMI.size() > 1)
@@ -1068,7 +1767,12 @@ void ConnState::config_request(EIBnet_ConfigRequest &r1, EIBNetIPSocket *isock)
   else
     r2.status = E_TUNNELING_LAYER;
   rno++;
-  isock->Send (r2.ToPacket (), daddr);
+  if (!tcp)
+    {
+      last_ack = r2.Encode ();
+      last_service = DEVICE_CONFIGURATION_REQUEST;
+      isock->Send (last_ack, daddr);
+    }
 }
 
 void ConnState::config_response (EIBnet_ConfigACK &r1)
@@ -1095,10 +1799,13 @@ void ConnState::config_response (EIBnet_ConfigACK &r1)
       TRACEPRINTF (t, 8, "Unexpected Connection Type");
       return;
     }
+  if (retries == 1)
+    rtt.sample (ev_time () - sent_at);
   sno++;
   sendtimeout.stop();
 
   out.get ();
+  sending.reset ();
   retries = 0;
   if (!out.empty())
     send_trigger.send();
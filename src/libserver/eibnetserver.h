@@ -28,6 +28,8 @@
 #define EIBNET_SERVER_H
 
 #include <ev++.h>
+#include <unordered_map>
+#include <vector>
 
 #include "callbacks.h"
 #include "eibnetip.h"
@@ -41,6 +43,7 @@
 
 class EIBnetServer;
 using EIBnetServerPtr = std::shared_ptr<EIBnetServer>;
+class EIBnetStreamConn;
 
 enum ConnType
 {
@@ -70,20 +73,41 @@ public:
   ConnType type = CT_NONE;
   int no;
   bool nat;
+  /** set if the tunnel runs over TCP */
+  EIBnetStreamConn *tcp = nullptr;
 
   ev::timer timeout;
   void timeout_cb(ev::timer &w, int revents);
   ev::timer sendtimeout;
   void sendtimeout_cb(ev::timer &w, int revents);
+  RttEstimator rtt;
+  /** when the head of "out" was first sent */
+  ev_tstamp sent_at = 0;
   ev::async send_trigger;
   void send_trigger_cb(ev::async &w, int revents);
   bool do_send_next = false;
   Queue < CArray > out;
+  /** the head of "out", encoded once and repeated until it is ACKed */
+  EIBNetIPBuf sending;
   void reset_timer();
+  EIBNetIPBuf request (const CArray &cemi);
+  void stream_out ();
 
   struct sockaddr_in daddr;
   struct sockaddr_in caddr;
 
+  /** the ACK for request rno-1, sent again if the client repeats it */
+  EIBNetIPBuf last_ack;
+  /** the service of that request */
+  int last_service = 0;
+  struct
+  {
+    unsigned long requests, duplicates, out_of_window;
+  } rx_stats = {};
+  /** Resend the ACK if @seqno is a repeated request of type @service.
+   * This runs before the request is parsed. */
+  bool repeated (int service, uint8_t seqno, EIBNetIPSocket *isock);
+
   // handle various packets from the connection
   void tunnel_request(EIBnet_TunnelRequest &r1, EIBNetIPSocket *isock);
   void tunnel_response(EIBnet_TunnelACK &r1);
@@ -92,15 +116,60 @@ public:
 
   void send_L_Data (LDataPtr l);
   void send_L_Busmonitor (LBusmonPtr l);
+  std::string info(int verbose);
 };
 
 using ConnStatePtr = std::shared_ptr<ConnState>;
 
-/** Driver for routing */
+/** A KNXnet/IP client connected over TCP; it may open one tunnel */
+class EIBnetStreamConn
+{
+public:
+  EIBnetStreamConn (EIBnetServer *parent, int fd, const struct sockaddr_in& peer);
+  ~EIBnetStreamConn ();
+
+  EIBnetServer *parent;
+  EIBNetIPStream *stream;
+  ConnStatePtr tunnel;
+
+  void Send (const EIBNetIPPacket& p)
+  {
+    stream->Send (p);
+  }
+  void Send (const EIBNetIPBuf& b)
+  {
+    stream->Send (b);
+  }
+  size_t pending () const
+  {
+    return stream->pending();
+  }
+  /** the tunnel is gone; the client should hang up soon */
+  void tunnel_stopped ();
+  void close ();
+
+private:
+  bool closed = false;
+  /** closes connections without a tunnel */
+  ev::timer idle;
+  void idle_cb (ev::timer &w, int revents);
+  void recv_cb (EIBNetIPPacket *p);
+  void error_cb ();
+  void next_cb ();
+};
+
+using EIBnetStreamConnPtr = std::shared_ptr<EIBnetStreamConn>;
+
+/**
+ * Driver for routing. The server's main multicast group is one of these;
+ * each additional backbone is another, with its own socket on its own
+ * interface.
+ */
 class EIBnetDriver : public SubDriver
 {
 public:
-  EIBnetDriver (LinkConnectClientPtr c, std::string& multicastaddr, int port, std::string& intf);
+  EIBnetDriver (LinkConnectClientPtr c, std::string& multicastaddr, int port,
+                std::string& intf, bool backbone = false);
   virtual ~EIBnetDriver ();
   struct sockaddr_in maddr;
 
@@ -108,12 +177,65 @@ public:
   // void start();
   // void stop();
 
-  void Send (EIBNetIPPacket p, struct sockaddr_in addr);
+  void Send (const EIBNetIPBuf& b, struct sockaddr_in addr);
+  void Send (const EIBNetIPPacket& p, struct sockaddr_in addr)
+  {
+    Send (p.Encode (), addr);
+  }
 
   void send_L_Data (LDataPtr l);
 
+  /** routing flow control (03.08.05) */
+  void routing_busy (const EIBnet_RoutingBusy &r);
+  void routing_lost (const EIBnet_RoutingLostMessage &r);
+  /** tell the backbone when we can't keep up */
+  void check_congestion ();
+
+  std::string info(int verbose);
+
 private:
-  EIBNetIPSocket *sock; // receive only
+  /** receive only, unless this is a backbone */
+  EIBNetIPSocket *sock;
+  bool backbone;
+  /** send to our multicast group */
+  void Route (const EIBNetIPBuf& b);
+  void Route (const EIBNetIPPacket& p)
+  {
+    Route (p.Encode ());
+  }
+
+  /** flow control config; a backbone may override the server's */
+  double rate_limit;
+  unsigned rate_burst;
+  unsigned busy_wait;
+  unsigned routing_queue;
+
+  /** indications held back by ROUTING_BUSY or the rate limit */
+  Queue < EIBNetIPBuf > pending;
+  ev::timer flow_timer;
+  void flow_timer_cb (ev::timer &w, int revents);
+  bool may_send (ev_tstamp now);
+  void schedule (ev_tstamp now);
+
+  /** don't send before this */
+  ev_tstamp pause_until = 0;
+  /** the spec's N: number of recent ROUTING_BUSY bursts */
+  unsigned busy_n = 0;
+  ev_tstamp busy_last = 0;
+  /** N is decremented every 5 msec after this */
+  ev_tstamp busy_decay = 0;
+  ev_tstamp busy_sent = 0;
+  /** Router::lost, as last reported */
+  unsigned long lost_seen = 0;
+  /** token bucket */
+  double tokens = 0;
+  ev_tstamp token_time = 0;
+
+  struct
+  {
+    unsigned long sent, delayed, dropped;
+    unsigned long busy_rx, busy_tx, lost_rx, lost_tx;
+  } stats = {};
 
   void recv_cb(EIBNetIPPacket *p);
   EIBPacketCallback on_recv;
@@ -126,6 +248,7 @@ SERVER(EIBnetServer,ets_router)
 {
   friend class ConnState;
   friend class EIBnetDriver;
+  friend class EIBnetStreamConn;
 
 public:
   EIBnetServer (BaseRouter& r, IniSectionPtr& s);
@@ -134,20 +257,33 @@ public:
   void start();
   void stop();
 
-  void handle_packet (EIBNetIPPacket *p1, EIBNetIPSocket *isock);
+  /** @sc is set for packets which arrived over TCP, @drv for packets
+   * which arrived on a backbone's socket */
+  void handle_packet (EIBNetIPPacket *p1, EIBNetIPSocket *isock,
+                      EIBnetStreamConn *sc = nullptr,
+                      EIBnetDriver *drv = nullptr);
 
   void drop_connection (ConnStatePtr s);
   ev::async drop_trigger;
   void drop_trigger_cb(ev::async &w, int revents);
+  void drop_stream (EIBnetStreamConn *sc);
 
-  inline void Send (EIBNetIPPacket p)
+  inline void Send (const EIBNetIPPacket& p)
+  {
+    Send (p.Encode (), mcast->maddr);
+  }
+  inline void Send (const EIBNetIPPacket& p, struct sockaddr_in addr)
+  {
+    Send (p.Encode (), addr);
+  }
+  inline void Send (const EIBNetIPBuf& b)
   {
-    Send (p, mcast->maddr);
+    Send (b, mcast->maddr);
   }
-  inline void Send (EIBNetIPPacket p, struct sockaddr_in addr)
+  inline void Send (const EIBNetIPBuf& b, struct sockaddr_in addr)
   {
     if (sock)
-      sock->Send (p, addr);
+      sock->Send (b, addr);
   }
 
   bool checkAddress(eibaddr_t)
@@ -161,33 +297,79 @@ public:
 
 private:
   EIBnetDriverPtr mcast;   // used for multicast receiving
+  /** additional routing links, one per (interface, group) */
+  std::vector<EIBnetDriverPtr> backbones;
   EIBNetIPSocket *sock;  // used for normal dialog
 
   int sock_mac;          // used to query the list of interfaces
   int Port;              // copy of sock->port()
 
+  /** SEARCH_RESPONSE and DESCRIPTION_RESPONSE, serialized. The search
+   * response's HPAI is filled in per request. */
+  CArray search_resp;
+  CArray descr_resp;
+  ev_tstamp dib_time = 0;
+  /** set when netlink reports an interface, address or route change */
+  bool dib_stale = false;
+  /** source address to announce, by requester address */
+  std::unordered_map<in_addr_t, struct sockaddr_in> src_cache;
+  int nl_fd = -1;
+  ev::io nl_watch;
+  void nl_cb (ev::io &w, int revents);
+  void refresh_dib ();
+  void get_mac (uint8_t *mac);
+  bool source_for (const struct sockaddr_in& dest, struct sockaddr_in& src);
+
   /** config */
   bool tunnel;
   bool route;
   bool discover;
   bool single_port;
+  bool tcp;
   std::string multicastaddr;
   uint16_t port;
   std::string interface;
   std::string servername;
+  unsigned recv_batch;
+  unsigned send_batch;
+  /** routing flow control */
+  double rate_limit;
+  unsigned rate_burst;
+  unsigned busy_wait;
+  unsigned routing_queue;
+  /** tunnel ACK timeout, seconds */
+  ev_tstamp ack_min;
+  ev_tstamp ack_max;
   IniSectionPtr router_cfg;
+  std::vector<IniSectionPtr> backbone_cfg;
   IniSectionPtr tunnel_cfg;
 
-  std::vector < ConnStatePtr > connections;
+  /** tunnels by channel id, and which ids are taken (0 always is).
+   * A stopped tunnel keeps its id until drop_trigger_cb runs. */
+  ConnStatePtr channels[256];
+  uint64_t chan_used[4] = { 1, 0, 0, 0 };
+  int alloc_channel ();
   Queue < ConnStatePtr > drop_q;
+  /** the tunnel @sc (or UDP, if NULL) may talk to on @channel */
+  ConnStatePtr find_channel (uint8_t channel, EIBnetStreamConn *sc);
+
+  /** TCP */
+  int tcp_fd = -1;
+  ev::io tcp_watch;
+  void tcp_cb (ev::io &w, int revents);
+  std::vector<EIBnetStreamConnPtr> streams;
+  Queue < EIBnetStreamConn * > stream_drop_q;
+  void reply (EIBNetIPSocket *isock, EIBnetStreamConn *sc,
+              EIBNetIPPacket p, struct sockaddr_in addr);
 
   int addClient (ConnType type, const EIBnet_ConnectRequest & r1,
-                 eibaddr_t addr = 0);
+                 eibaddr_t addr = 0, EIBnetStreamConn *sc = nullptr);
   void addNAT (const LDataPtr &&l);
 
   void recv_cb(EIBNetIPPacket *p);
   void error_cb();
 
+  void stop_link (EIBnetDriverPtr &d, bool registered);
   void stop_();
 };
 
@@ -19,70 +19,91 @@
 
 #include "emi.h"
 
-CArray
-L_Data_ToCEMI (uint8_t code, const LDataPtr & l1)
+#include <cstring>
+
+size_t
+L_Data_ToCEMI (uint8_t code, const L_Data_PDU & l1, uint8_t *pdu, size_t max)
 {
-  CArray pdu;
-  assert (l1->lsdu.size() >= 1);
-  assert (l1->lsdu.size() < 0xff);
-  assert ((l1->hop_count & 0xf8) == 0);
+  assert (l1.lsdu.size() >= 1);
+  assert (l1.lsdu.size() < 0xff);
+  assert ((l1.hop_count & 0xf8) == 0);
 
-  pdu.resize (l1->lsdu.size() + 9);
+  size_t size = L_Data_CEMI_size (l1);
+  if (size > max)
+    return 0;
   pdu[0] = code;
   pdu[1] = 0x00;
-  pdu[2] = 0x10 | (l1->priority << 2) | (l1->lsdu.size() - 1 <= 0x0f ? 0x80 : 0x00);
+  pdu[2] = 0x10 | (l1.priority << 2) | (l1.lsdu.size() - 1 <= 0x0f ? 0x80 : 0x00);
   if (code == 0x29)
-    pdu[2] |= (l1->repeated ? 0 : 0x20);
+    pdu[2] |= (l1.repeated ? 0 : 0x20);
   else
     pdu[2] |= 0x20;
   pdu[3] =
-    (l1->address_type == GroupAddress ? 0x80 : 0x00) |
-    ((l1->hop_count & 0x7) << 4) | 0x0;
-  pdu[4] = (l1->source_address >> 8) & 0xff;
-  pdu[5] = (l1->source_address) & 0xff;
-  pdu[6] = (l1->destination_address >> 8) & 0xff;
-  pdu[7] = (l1->destination_address) & 0xff;
-  pdu[8] = l1->lsdu.size() - 1;
-  pdu.setpart (l1->lsdu.data(), 9, l1->lsdu.size());
+    (l1.address_type == GroupAddress ? 0x80 : 0x00) |
+    ((l1.hop_count & 0x7) << 4) | 0x0;
+  pdu[4] = (l1.source_address >> 8) & 0xff;
+  pdu[5] = (l1.source_address) & 0xff;
+  pdu[6] = (l1.destination_address >> 8) & 0xff;
+  pdu[7] = (l1.destination_address) & 0xff;
+  pdu[8] = l1.lsdu.size() - 1;
+  memcpy (pdu + 9, l1.lsdu.data(), l1.lsdu.size());
+  return size;
+}
+
+CArray
+L_Data_ToCEMI (uint8_t code, const LDataPtr & l1)
+{
+  CArray pdu;
+  pdu.resize (L_Data_CEMI_size (*l1));
+  L_Data_ToCEMI (code, *l1, pdu.data(), pdu.size());
   return pdu;
 }
 
-LDataPtr
-CEMI_to_L_Data (const CArray & data, TracePtr tr)
+bool
+CEMI_to_L_Data (const uint8_t *data, size_t len, L_Data_PDU & c, TracePtr tr)
 {
-  if (data.size() < 2)
+  c.clear ();
+  if (len < 2)
     {
-      TRACEPRINTF (tr, 7, "packet too short (%d)", data.size());
-      return nullptr;
+      TRACEPRINTF (tr, 7, "packet too short (%d)", len);
+      return false;
     }
   unsigned start = data[1] + 2;
-  if (data.size() < 7 + start)
+  if (len < 7 + start)
     {
-      TRACEPRINTF (tr, 7, "start too large (%d/%d)", data.size(),start);
-      return nullptr;
+      TRACEPRINTF (tr, 7, "start too large (%d/%d)", len, start);
+      return false;
     }
-  if (data.size() < 7 + start + data[6 + start] + 1)
+  if (len < 7 + start + data[6 + start] + 1)
     {
-      TRACEPRINTF (tr, 7, "packet too short (%d/%d)", data.size(), 7 + start + data[6 + start] + 1);
-      return nullptr;
+      TRACEPRINTF (tr, 7, "packet too short (%d/%d)", len, 7 + start + data[6 + start] + 1);
+      return false;
     }
 
-  LDataPtr c = LDataPtr(new L_Data_PDU ());
-  c->source_address = (data[start + 2] << 8) | (data[start + 3]);
-  c->destination_address = (data[start + 4] << 8) | (data[start + 5]);
-  c->lsdu.set (data.data() + start + 7, data[6 + start] + 1);
+  c.source_address = (data[start + 2] << 8) | (data[start + 3]);
+  c.destination_address = (data[start + 4] << 8) | (data[start + 5]);
+  c.lsdu.set (data + start + 7, data[6 + start] + 1);
   if (data[0] == 0x29)
-    c->repeated = (data[start] & 0x20) ? 0 : 1;
+    c.repeated = (data[start] & 0x20) ? 0 : 1;
   else
-    c->repeated = 0;
-  c->priority = static_cast<EIB_Priority>((data[start] >> 2) & 0x3);
-  c->hop_count = (data[start + 1] >> 4) & 0x07;
-  c->address_type = (data[start + 1] & 0x80) ? GroupAddress : IndividualAddress;
+    c.repeated = 0;
+  c.priority = static_cast<EIB_Priority>((data[start] >> 2) & 0x3);
+  c.hop_count = (data[start + 1] >> 4) & 0x07;
+  c.address_type = (data[start + 1] & 0x80) ? GroupAddress : IndividualAddress;
   if (!(data[start] & 0x80) && (data[start + 1] & 0x0f))
     {
       TRACEPRINTF (tr, 7, "Length? invalid (%02x%02x)", data[start],data[start+1]);
-      return 0;
+      return false;
     }
+  return true;
+}
+
+LDataPtr
+CEMI_to_L_Data (const CArray & data, TracePtr tr)
+{
+  LDataPtr c = LDataPtr(new L_Data_PDU ());
+  if (!CEMI_to_L_Data (data.data(), data.size(), *c, tr))
+    return nullptr;
   return c;
 }
 
@@ -128,42 +149,59 @@ Busmonitor_to_CEMI (uint8_t code, const LBusmonPtr & p, int no)
   return pdu;
 }
 
-CArray
-L_Data_ToEMI (uint8_t code, const LDataPtr & l1)
+size_t
+L_Data_ToEMI (uint8_t code, const L_Data_PDU & l1, uint8_t *pdu, size_t max)
 {
-  CArray pdu;
-  pdu.resize (l1->lsdu.size() + 7);
+  size_t size = L_Data_EMI_size (l1);
+  if (size > max)
+    return 0;
   pdu[0] = code;
-  pdu[1] = l1->priority << 2;
+  pdu[1] = l1.priority << 2;
   pdu[2] = 0;
   pdu[3] = 0;
-  pdu[4] = (l1->destination_address >> 8) & 0xff;
-  pdu[5] = (l1->destination_address) & 0xff;
+  pdu[4] = (l1.destination_address >> 8) & 0xff;
+  pdu[5] = (l1.destination_address) & 0xff;
   pdu[6] =
-    (l1->hop_count & 0x07) << 4 |
-    ((l1->lsdu.size() - 1) & 0x0f) |
-    (l1->address_type == GroupAddress ? 0x80 : 0x00);
-  pdu.setpart (l1->lsdu.data(), 7, l1->lsdu.size());
+    (l1.hop_count & 0x07) << 4 |
+    ((l1.lsdu.size() - 1) & 0x0f) |
+    (l1.address_type == GroupAddress ? 0x80 : 0x00);
+  memcpy (pdu + 7, l1.lsdu.data(), l1.lsdu.size());
+  return size;
+}
+
+CArray
+L_Data_ToEMI (uint8_t code, const LDataPtr & l1)
+{
+  CArray pdu;
+  pdu.resize (L_Data_EMI_size (*l1));
+  L_Data_ToEMI (code, *l1, pdu.data(), pdu.size());
   return pdu;
 }
 
+bool
+EMI_to_L_Data (const uint8_t *data, size_t len, L_Data_PDU & c, TracePtr)
+{
+  c.clear ();
+  if (len < 8)
+    return false;
+
+  c.source_address = (data[2] << 8) | (data[3]);
+  c.destination_address = (data[4] << 8) | (data[5]);
+  c.priority = static_cast<EIB_Priority>((data[1] >> 2) & 0x3);
+  c.address_type = (data[6] & 0x80) ? GroupAddress : IndividualAddress;
+  unsigned dlen = (data[6] & 0x0f) + 1;
+  if (dlen > len - 7)
+    dlen = len - 7;
+  c.lsdu.set (data + 7, dlen);
+  c.hop_count = (data[6] >> 4) & 0x07;
+  return true;
+}
+
 LDataPtr
-EMI_to_L_Data (const CArray & data, TracePtr)
+EMI_to_L_Data (const CArray & data, TracePtr tr)
 {
   LDataPtr c = LDataPtr(new L_Data_PDU ());
-  unsigned len;
-
-  if (data.size() < 8)
-    return 0;
-
-  c->source_address = (data[2] << 8) | (data[3]);
-  c->destination_address = (data[4] << 8) | (data[5]);
-  c->priority = static_cast<EIB_Priority>((data[1] >> 2) & 0x3);
-  c->address_type = (data[6] & 0x80) ? GroupAddress : IndividualAddress;
-  len = (data[6] & 0x0f) + 1;
-  if (len > data.size() - 7)
-    len = data.size() - 7;
-  c->lsdu.set (data.data() + 7, len);
-  c->hop_count = (data[6] >> 4) & 0x07;
+  if (!EMI_to_L_Data (data.data(), data.size(), *c, tr))
+    return nullptr;
   return c;
 }
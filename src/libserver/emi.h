@@ -30,6 +30,25 @@
 #include "link.h"
 #include "lpdu.h"
 
+/** length of the CEMI frame for @l */
+inline size_t L_Data_CEMI_size (const L_Data_PDU & l)
+{
+  return l.lsdu.size() + 9;
+}
+
+/**
+ * Encode L_Data_PDU as CEMI frame into @buf.
+ * @return the frame's length, 0 if it doesn't fit into @max octets
+ */
+size_t L_Data_ToCEMI (uint8_t code, const L_Data_PDU & l, uint8_t *buf, size_t max);
+
+/**
+ * Decode a CEMI frame into @l, overwriting all of its fields except the
+ * reception time.
+ * @return false if it's not a valid L_Data frame
+ */
+bool CEMI_to_L_Data (const uint8_t *data, size_t len, L_Data_PDU & l, TracePtr tr);
+
 /** convert L_Data_PDU to CEMI frame */
 CArray L_Data_ToCEMI (uint8_t code, const LDataPtr & p);
 
@@ -40,6 +59,25 @@ LBusmonPtr CEMI_to_Busmonitor (const CArray & data, DriverPtr l2);
 
 CArray Busmonitor_to_CEMI (uint8_t code, const LBusmonPtr &p, int no);
 
+/** length of the EMI1/2 frame for @l */
+inline size_t L_Data_EMI_size (const L_Data_PDU & l)
+{
+  return l.lsdu.size() + 7;
+}
+
+/**
+ * Encode L_Data_PDU as EMI1/2 frame into @buf.
+ * @return the frame's length, 0 if it doesn't fit into @max octets
+ */
+size_t L_Data_ToEMI (uint8_t code, const L_Data_PDU & l, uint8_t *buf, size_t max);
+
+/**
+ * Decode an EMI1/2 frame into @l, overwriting all of its fields except the
+ * reception time.
+ * @return false if it's too short
+ */
+bool EMI_to_L_Data (const uint8_t *data, size_t len, L_Data_PDU & l, TracePtr tr);
+
 /** convert L_Data_PDU to EMI1/2 frame */
 CArray L_Data_ToEMI (uint8_t code, const LDataPtr & p);
 
@@ -88,6 +88,9 @@ void
 EMI_Common::stop ()
 {
   TRACEPRINTF (t, 2, "CloseL2");
+  /* a pending confirm must not report an error for the stopped link */
+  timeout.stop();
+  state = E_idle;
   if (monitor)
     cmdLeaveMonitor();
   else
@@ -0,0 +1,271 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Benchmark of the L_Data frame conversions: TP1, cEMI and EMI1/2, each
+ * encoded and decoded, with a standard and an extended frame.
+ *
+ * Every conversion is timed twice: returning a new CArray or L_Data_PDU
+ * per frame, and writing into a buffer or PDU the caller re-uses. Both
+ * must produce the same result.
+ *
+ * Also compared: reading a cEMI frame's source address, and converting
+ * cEMI to TP1, by decoding into a new L_Data_PDU vs. with an LDataView.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <ctime>
+#include <unistd.h>
+#include "inifile.h"
+#include "emi.h"
+#include "cm_tp1.h"
+#include "ldataview.h"
+
+/** aborts program with a printf like message */
+void
+die (const char *msg, ...)
+{
+  va_list ap;
+  va_start (ap, msg);
+  vprintf (msg, ap);
+  printf ("\n");
+  va_end (ap);
+
+  exit (1);
+}
+
+static unsigned count = 2000000;
+static volatile unsigned sink;
+static TracePtr t;
+
+static double
+now ()
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+report (const char *what, const char *frame, double t_new, double t_in)
+{
+  printf ("%-12s %-9s %7.1f ns  %7.1f ns  %5.2fx\n", what, frame,
+          t_new * 1e9 / count, t_in * 1e9 / count, t_new / t_in);
+}
+
+static bool
+same (const L_Data_PDU &a, const L_Data_PDU &b)
+{
+  return a.source_address == b.source_address
+         && a.destination_address == b.destination_address
+         && a.address_type == b.address_type && a.priority == b.priority
+         && a.hop_count == b.hop_count && a.repeated == b.repeated
+         && a.valid_checksum == b.valid_checksum && a.lsdu == b.lsdu;
+}
+
+typedef CArray (*enc_new) (const LDataPtr &);
+typedef size_t (*enc_in) (const L_Data_PDU &, uint8_t *, size_t);
+typedef LDataPtr (*dec_new) (const CArray &);
+typedef bool (*dec_in) (const uint8_t *, size_t, L_Data_PDU &);
+
+static void
+bench (const char *what, const char *frame, const LDataPtr &l,
+       enc_new e1, enc_in e2, dec_new d1, dec_in d2)
+{
+  uint8_t buf[CM_TP1_MAX_FRAME + 9];
+  CArray ref = e1 (l);
+  size_t len = e2 (*l, buf, sizeof (buf));
+  if (len != ref.size() || memcmp (buf, ref.data(), len))
+    die ("%s %s: encoders differ", what, frame);
+  if (e2 (*l, buf, len - 1))
+    die ("%s %s: encoded into a short buffer", what, frame);
+
+  double t0 = now ();
+  for (unsigned i = 0; i < count; i++)
+    sink += e1 (l)[len - 1];
+  double t1 = now ();
+  for (unsigned i = 0; i < count; i++)
+    {
+      e2 (*l, buf, sizeof (buf));
+      sink += buf[len - 1];
+    }
+  double t2 = now ();
+  report (what, frame, t1 - t0, t2 - t1);
+
+  L_Data_PDU p;
+  LDataPtr q = d1 (ref);
+  if (!q || !d2 (ref.data(), ref.size(), p) || !same (*q, p))
+    die ("%s %s: decoders differ", what, frame);
+
+  t0 = now ();
+  for (unsigned i = 0; i < count; i++)
+    sink += d1 (ref)->destination_address;
+  t1 = now ();
+  for (unsigned i = 0; i < count; i++)
+    {
+      d2 (ref.data(), ref.size(), p);
+      sink += p.destination_address;
+    }
+  t2 = now ();
+  std::string dw = std::string (what);
+  dw.replace (dw.size() - 3, 3, "dec");
+  report (dw.c_str(), frame, t1 - t0, t2 - t1);
+}
+
+static void
+bench_view (const char *frame, const LDataPtr &l)
+{
+  uint8_t buf[CM_TP1_MAX_FRAME];
+  CArray ref = L_Data_ToCEMI (0x29, l);
+  LDataView v (ref, LDataView::CEMI);
+  CArray tp1 = L_Data_to_CM_TP1 (CEMI_to_L_Data (ref, t));
+  if (!v.complete () || v.source () != l->source_address
+      || v.to_CM_TP1 (buf, sizeof (buf)) != tp1.size()
+      || memcmp (buf, tp1.data(), tp1.size()))
+    die ("cEMI view %s: differs from decoding", frame);
+
+  double t0 = now ();
+  for (unsigned i = 0; i < count; i++)
+    sink += CEMI_to_L_Data (ref, t)->source_address;
+  double t1 = now ();
+  for (unsigned i = 0; i < count; i++)
+    sink += LDataView (ref, LDataView::CEMI).source ();
+  double t2 = now ();
+  report ("cEMI src", frame, t1 - t0, t2 - t1);
+
+  t0 = now ();
+  for (unsigned i = 0; i < count; i++)
+    sink += L_Data_to_CM_TP1 (CEMI_to_L_Data (ref, t))[0];
+  t1 = now ();
+  for (unsigned i = 0; i < count; i++)
+    {
+      LDataView (ref, LDataView::CEMI).to_CM_TP1 (buf, sizeof (buf));
+      sink += buf[0];
+    }
+  t2 = now ();
+  report ("cEMI->TP1", frame, t1 - t0, t2 - t1);
+}
+
+/* the conversions, with the code and trace arguments fixed */
+
+static CArray
+tp1_enc (const LDataPtr &l)
+{
+  return L_Data_to_CM_TP1 (l);
+}
+static LDataPtr
+tp1_dec (const CArray &c)
+{
+  return CM_TP1_to_L_Data (c, t);
+}
+
+static CArray
+cemi_enc (const LDataPtr &l)
+{
+  return L_Data_ToCEMI (0x29, l);
+}
+static size_t
+cemi_enc_in (const L_Data_PDU &l, uint8_t *buf, size_t max)
+{
+  return L_Data_ToCEMI (0x29, l, buf, max);
+}
+static LDataPtr
+cemi_dec (const CArray &c)
+{
+  return CEMI_to_L_Data (c, t);
+}
+static bool
+cemi_dec_in (const uint8_t *c, size_t len, L_Data_PDU &l)
+{
+  return CEMI_to_L_Data (c, len, l, t);
+}
+
+static CArray
+emi_enc (const LDataPtr &l)
+{
+  return L_Data_ToEMI (0x29, l);
+}
+static size_t
+emi_enc_in (const L_Data_PDU &l, uint8_t *buf, size_t max)
+{
+  return L_Data_ToEMI (0x29, l, buf, max);
+}
+static LDataPtr
+emi_dec (const CArray &c)
+{
+  return EMI_to_L_Data (c, t);
+}
+static bool
+emi_dec_in (const uint8_t *c, size_t len, L_Data_PDU &l)
+{
+  return EMI_to_L_Data (c, len, l, t);
+}
+
+int
+main (int ac, char *ag[])
+{
+  int opt;
+  while ((opt = getopt (ac, ag, "n:")) != -1)
+    switch (opt)
+      {
+      case 'n':
+        count = atoi (optarg);
+        break;
+      default:
+        die ("usage: %s [-n count]", ag[0]);
+      }
+  if (count < 1)
+    die ("count must be positive");
+
+  IniData ini;
+  t = TracePtr(new Trace(ini["main"], "framebench"));
+
+  /* 1.1.1 -> 1/2/3, GroupValue_Write 1 */
+  LDataPtr std_frame = LDataPtr (new L_Data_PDU ());
+  std_frame->source_address = 0x1101;
+  std_frame->destination_address = 0x0a03;
+  std_frame->address_type = GroupAddress;
+  static const uint8_t apdu[] = { 0x00, 0x81 };
+  std_frame->lsdu.set (apdu, sizeof (apdu));
+
+  /* the same with 15 octets of data, which needs an extended TP1 frame */
+  LDataPtr ext_frame = LDataPtr (new L_Data_PDU (*std_frame));
+  ext_frame->lsdu.resize (17);
+  ext_frame->lsdu[1] = 0x80;
+
+  printf ("%u conversions each; new object per frame, re-used buffer or view\n", count);
+  const char *names[] = { "standard", "extended" };
+  const LDataPtr *frames[] = { &std_frame, &ext_frame };
+  for (int i = 0; i < 2; i++)
+    {
+      bench ("TP1 enc", names[i], *frames[i], tp1_enc, L_Data_to_CM_TP1,
+             tp1_dec, CM_TP1_to_L_Data);
+      bench ("cEMI enc", names[i], *frames[i], cemi_enc, cemi_enc_in,
+             cemi_dec, cemi_dec_in);
+      /* EMI1/2 frames can't carry more than 16 octets */
+      if (i == 0)
+        bench ("EMI enc", names[i], *frames[i], emi_enc, emi_enc_in,
+               emi_dec, emi_dec_in);
+      bench_view (names[i], *frames[i]);
+    }
+  return 0;
+}
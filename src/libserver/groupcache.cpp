@@ -20,6 +20,7 @@
 #include "groupcache.h"
 
 #include "apdu.h"
+#include "ldataview.h"
 #include "tpdu.h"
 
 GroupCache::GroupCache (const LinkConnectPtr& c, IniSectionPtr& s)
@@ -74,37 +75,37 @@ GroupCache::send_L_Data (LDataPtr lpdu)
 {
   if (enable)
     {
-      TPDUPtr tpdu = TPDU::fromPacket (lpdu->address_type, lpdu->destination_address, lpdu->lsdu, t);
-      if (tpdu->getType () == T_Data_Group)
+      LDataView v (*lpdu);
+      int apci = v.apci ();
+      // T_Data_Group with A_GroupValue_Response or _Write
+      if (v.address_type () == GroupAddress && v.destination () != 0 &&
+          (v.tpci () & 0xFC) == 0x00 &&
+          ((apci & 0x3C0) == 0x040 || (apci & 0x3C0) == 0x080))
         {
-          T_Data_Group_PDU *tpdu1 = (T_Data_Group_PDU *) &*tpdu;
-          if (tpdu1->tsdu.size() >= 2 && !(tpdu1->tsdu[0] & 0x3) &&
-              ((tpdu1->tsdu[1] & 0xC0) == 0x40 || (tpdu1->tsdu[1] & 0xC0) == 0x80)) // response or write
+          eibaddr_t dest = v.destination ();
+          CacheMap::iterator ci = cache.find (dest);
+          CacheMap::value_type *c;
+          if (ci == cache.end())
             {
-              CacheMap::iterator ci = cache.find (lpdu->destination_address);
-              CacheMap::value_type *c;
-              if (ci == cache.end())
+              while (cache_seq.size() >= maxsize)
                 {
-                  while (cache_seq.size() >= maxsize)
-                    {
-                      SeqMap::iterator si = cache_seq.begin();
-                      cache.erase(si->second);
-                      cache_seq.erase(si);
-                    }
-                  c = &(*cache.emplace(lpdu->destination_address, GroupCacheEntry(lpdu->destination_address)).first);
+                  SeqMap::iterator si = cache_seq.begin();
+                  cache.erase(si->second);
+                  cache_seq.erase(si);
                 }
-              else
-                {
-                  c = &(*ci);
-                  cache_seq.erase(c->second.seq);
-                }
-              c->second.src = lpdu->source_address;
-              c->second.data = tpdu1->tsdu;
-              c->second.recvtime = time (0);
-              c->second.seq = seq++;
-              cache_seq.emplace(c->second.seq,c->first);
-              updated(c->second);
+              c = &(*cache.emplace(dest, GroupCacheEntry(dest)).first);
+            }
+          else
+            {
+              c = &(*ci);
+              cache_seq.erase(c->second.seq);
             }
+          c->second.src = v.source ();
+          c->second.data.set (v.lsdu (), v.lsdu_len ());
+          c->second.recvtime = time (0);
+          c->second.seq = seq++;
+          cache_seq.emplace(c->second.seq,c->first);
+          updated(c->second);
         }
     }
   send_Next();
@@ -292,9 +293,8 @@ GroupCache::Read (eibaddr_t addr, unsigned Timeout, uint16_t age,
 
   new GCReader(this,addr,Timeout,age, cb,cc);
 
-  tpdu.tsdu = apdu.ToPacket ();
   lpdu = LDataPtr(new L_Data_PDU ());
-  lpdu->lsdu = tpdu.ToPacket ();
+  tpdu.ToPacket (apdu, lpdu->lsdu);
   lpdu->source_address = 0;
   lpdu->destination_address = addr;
   lpdu->address_type = GroupAddress;
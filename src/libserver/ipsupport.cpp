@@ -22,6 +22,7 @@
 
 #include <cerrno>
 #include <cstring>
+#include <ifaddrs.h>
 #include <netdb.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -227,6 +228,32 @@ err_out:
 }
 #endif
 
+bool
+GetInterfaceAddress (TracePtr tr, const std::string& iface, struct sockaddr_in *addr)
+{
+  struct ifaddrs *ifa, *i;
+  bool found = false;
+
+  memset (addr, 0, sizeof (*addr));
+  if (getifaddrs (&ifa) == -1)
+    {
+      if (tr)
+        ERRORPRINTF (tr, E_ERROR | 151, "getifaddrs: %s", strerror(errno));
+      return false;
+    }
+  for (i = ifa; i; i = i->ifa_next)
+    if (i->ifa_addr && i->ifa_addr->sa_family == AF_INET && iface == i->ifa_name)
+      {
+        memcpy (addr, i->ifa_addr, sizeof (*addr));
+        found = true;
+        break;
+      }
+  freeifaddrs (ifa);
+  if (!found && tr)
+    ERRORPRINTF (tr, E_ERROR | 152, "Interface '%s' has no IPv4 address", iface);
+  return found;
+}
+
 bool
 compareIPAddress (const struct sockaddr_in & a, const struct sockaddr_in & b)
 {
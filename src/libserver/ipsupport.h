@@ -39,6 +39,10 @@ bool GetSourceAddress (TracePtr tr,
                        const struct sockaddr_in *dest,
                        struct sockaddr_in *src);
 
+/** gets the (first) IPv4 address of a network interface */
+bool GetInterfaceAddress (TracePtr tr, const std::string& iface,
+                          struct sockaddr_in *addr);
+
 bool compareIPAddress (const struct sockaddr_in &a,
                        const struct sockaddr_in &b);
 
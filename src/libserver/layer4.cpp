@@ -36,7 +36,8 @@ void
 T_Group::send_L_Data (LDataPtr lpdu)
 {
   GroupComm c;
-  TPDUPtr tpdu = TPDU::fromPacket (lpdu->address_type, lpdu->destination_address, lpdu->lsdu, t);
+  TPDUBuf tbuf;
+  TPDU *tpdu = TPDU::decode (lpdu->address_type, lpdu->destination_address, lpdu->lsdu, tbuf, t);
   if (tpdu->getType () == T_Data_Group)
     {
       T_Data_Group_PDU *tpdu1 = (T_Data_Group_PDU *) &*tpdu;
@@ -58,7 +59,7 @@ T_Group::recv_Data (const CArray & c)
   lpdu->source_address = 0;
   lpdu->destination_address = groupaddr;
   lpdu->address_type = GroupAddress;
-  lpdu->lsdu = tpdu.ToPacket ();
+  tpdu.ToPacket (lpdu->lsdu);
   auto r = recv.lock();
   if (r != nullptr)
     r->recv_L_Data (std::move(lpdu));
@@ -87,7 +88,8 @@ void
 T_Broadcast::send_L_Data (LDataPtr lpdu)
 {
   BroadcastComm c;
-  TPDUPtr tpdu = TPDU::fromPacket (lpdu->address_type, lpdu->destination_address, lpdu->lsdu, t);
+  TPDUBuf tbuf;
+  TPDU *tpdu = TPDU::decode (lpdu->address_type, lpdu->destination_address, lpdu->lsdu, tbuf, t);
   if (tpdu->getType () == T_Data_Broadcast)
     {
       T_Data_Broadcast_PDU *tpdu1 = (T_Data_Broadcast_PDU *) &*tpdu;
@@ -109,7 +111,7 @@ T_Broadcast::recv_Data (const CArray & c)
   lpdu->source_address = 0;
   lpdu->destination_address = 0;
   lpdu->address_type = GroupAddress;
-  lpdu->lsdu = tpdu.ToPacket ();
+  tpdu.ToPacket (lpdu->lsdu);
   lpdu->hop_count = 0x07;
   auto r = recv.lock();
   if (r != nullptr)
@@ -168,7 +170,8 @@ void
 T_Individual::send_L_Data (LDataPtr lpdu)
 {
   CArray c;
-  TPDUPtr tpdu = TPDU::fromPacket (lpdu->address_type, lpdu->destination_address, lpdu->lsdu, t);
+  TPDUBuf tbuf;
+  TPDU *tpdu = TPDU::decode (lpdu->address_type, lpdu->destination_address, lpdu->lsdu, tbuf, t);
   switch (tpdu->getType ())
     {
     case T_Data_Broadcast:
@@ -203,7 +206,7 @@ T_Individual::recv_Data (const CArray & c)
   lpdu->source_address = 0;
   lpdu->destination_address = dest;
   lpdu->address_type = IndividualAddress;
-  lpdu->lsdu = tpdu.ToPacket ();
+  tpdu.ToPacket (lpdu->lsdu);
   auto r = recv.lock();
   if (r != nullptr)
     r->recv_L_Data (std::move(lpdu));
@@ -235,7 +238,8 @@ T_Connection::~T_Connection ()
 void
 T_Connection::send_L_Data (LDataPtr lpdu)
 {
-  TPDUPtr tpdu = TPDU::fromPacket (lpdu->address_type, lpdu->destination_address, lpdu->lsdu, t);
+  TPDUBuf tbuf;
+  TPDU *tpdu = TPDU::decode (lpdu->address_type, lpdu->destination_address, lpdu->lsdu, tbuf, t);
   switch (tpdu->getType ())
     {
     case T_Data_Connected:
@@ -328,7 +332,7 @@ T_Connection::SendConnect ()
   lpdu->source_address = 0;
   lpdu->destination_address = dest;
   lpdu->address_type = IndividualAddress;
-  lpdu->lsdu = tpdu.ToPacket ();
+  tpdu.ToPacket (lpdu->lsdu);
   lpdu->priority = PRIO_SYSTEM;
 
   mode = 1;
@@ -349,7 +353,7 @@ T_Connection::SendDisconnect ()
   lpdu->source_address = 0;
   lpdu->destination_address = dest;
   lpdu->address_type = IndividualAddress;
-  lpdu->lsdu = tpdu.ToPacket ();
+  tpdu.ToPacket (lpdu->lsdu);
   lpdu->priority = PRIO_SYSTEM;
   auto r = recv.lock();
   if (r != nullptr)
@@ -366,7 +370,7 @@ T_Connection::SendAck (int sequence_number)
   lpdu->source_address = 0;
   lpdu->destination_address = dest;
   lpdu->address_type = IndividualAddress;
-  lpdu->lsdu = tpdu.ToPacket ();
+  tpdu.ToPacket (lpdu->lsdu);
   auto r = recv.lock();
   if (r != nullptr)
     r->recv_L_Data (std::move(lpdu));
@@ -383,7 +387,7 @@ T_Connection::SendData (int sequence_number, const CArray & c)
   lpdu->source_address = 0;
   lpdu->destination_address = dest;
   lpdu->address_type = IndividualAddress;
-  lpdu->lsdu = tpdu.ToPacket ();
+  tpdu.ToPacket (lpdu->lsdu);
   auto r = recv.lock();
   if (r != nullptr)
     r->recv_L_Data (std::move(lpdu));
@@ -437,7 +441,8 @@ void
 GroupSocket::send_L_Data (LDataPtr lpdu)
 {
   GroupAPDU c;
-  TPDUPtr tpdu = TPDU::fromPacket (lpdu->address_type, lpdu->destination_address, lpdu->lsdu, t);
+  TPDUBuf tbuf;
+  TPDU *tpdu = TPDU::decode (lpdu->address_type, lpdu->destination_address, lpdu->lsdu, tbuf, t);
   if (tpdu->getType () == T_Data_Group)
     {
       T_Data_Group_PDU *tpdu1 = (T_Data_Group_PDU *) &*tpdu;
@@ -460,7 +465,7 @@ GroupSocket::recv_Data (const GroupAPDU & c)
   lpdu->source_address = 0;
   lpdu->destination_address = c.dst;
   lpdu->address_type = GroupAddress;
-  lpdu->lsdu = tpdu.ToPacket ();
+  tpdu.ToPacket (lpdu->lsdu);
   auto r = recv.lock();
   if (r != nullptr)
     r->recv_L_Data (std::move(lpdu));
@@ -0,0 +1,151 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "ldataview.h"
+
+#include "cm_tp1.h"
+
+#include <cstring>
+
+LDataView::LDataView (const uint8_t *d, size_t l, Format f)
+  : data(d), len(l), format(f)
+{
+  size_t off, want;
+
+  if (f == TP1)
+    {
+      /* L_Data frames only; ACKs and polls aren't */
+      if (len < 8 || (d[0] & 0x53) != 0x10)
+        return;
+      if (d[0] & 0x80)
+        {
+          /* standard frame */
+          addr = d + 1;
+          npci = d + 5;
+          off = 6;
+          want = (d[5] & 0x0f) + 1;
+          full = (off + want + 1 == len);
+        }
+      else
+        {
+          /* extended frame */
+          npci = d + 1;
+          addr = d + 2;
+          off = 7;
+          want = d[6] + 1;
+          full = (off + want + 1 == len) && !(d[1] & 0x0f);
+        }
+      lsdu_ = d + off;
+      lsdu_len_ = (off + want > len - 1) ? len - 1 - off : want;
+      ctrl = d;
+    }
+  else
+    {
+      if (len < 2)
+        return;
+      size_t start = d[1] + 2;
+      if (len < start + 7)
+        return;
+      addr = d + start + 2;
+      npci = d + start + 1;
+      off = start + 7;
+      want = d[start + 6] + 1;
+      lsdu_ = d + off;
+      lsdu_len_ = (off + want > len) ? len - off : want;
+      ctrl = d + start;
+      /* a standard frame's length is in the length octet only */
+      full = (off + want <= len) && ((*ctrl & 0x80) || !(*npci & 0x0f));
+      has_repeat = (d[0] == 0x29);
+    }
+}
+
+LDataView::LDataView (const L_Data_PDU &l)
+  : data(l.lsdu.data()), len(l.lsdu.size()), format(PDU)
+{
+  hdr[0] = 0x90 | (l.repeated ? 0x00 : 0x20) | ((l.priority & 0x3) << 2);
+  hdr[1] = (l.source_address >> 8) & 0xff;
+  hdr[2] = l.source_address & 0xff;
+  hdr[3] = (l.destination_address >> 8) & 0xff;
+  hdr[4] = l.destination_address & 0xff;
+  hdr[5] = (l.address_type == GroupAddress ? 0x80 : 0x00) | ((l.hop_count & 0x07) << 4);
+  ctrl = hdr;
+  addr = hdr + 1;
+  npci = hdr + 5;
+  lsdu_ = data;
+  lsdu_len_ = len;
+  full = (len >= 1);
+}
+
+LDataView::LDataView (const LDataView &v)
+{
+  *this = v;
+}
+
+LDataView &
+LDataView::operator= (const LDataView &v)
+{
+  data = v.data;
+  len = v.len;
+  format = v.format;
+  ctrl = v.ctrl;
+  npci = v.npci;
+  addr = v.addr;
+  lsdu_ = v.lsdu_;
+  lsdu_len_ = v.lsdu_len_;
+  full = v.full;
+  has_repeat = v.has_repeat;
+  memcpy (hdr, v.hdr, sizeof (hdr));
+  /* don't point into the other view's header */
+  if (format == PDU)
+    {
+      ctrl = hdr;
+      addr = hdr + 1;
+      npci = hdr + 5;
+    }
+  return *this;
+}
+
+size_t
+LDataView::to_CM_TP1 (uint8_t *buf, size_t max) const
+{
+  if (!complete () || lsdu_len_ > 0xff)
+    return 0;
+  return CM_TP1_encode (repeated (), priority (), address_type (),
+                        hop_count (), source (), destination (),
+                        lsdu_, lsdu_len_, buf, max);
+}
+
+bool
+LDataView::to_L_Data (L_Data_PDU &l) const
+{
+  if (format == TP1 && complete ())
+    return CM_TP1_to_L_Data (data, len, l);
+
+  l.clear ();
+  if (!complete ())
+    return false;
+  l.source_address = source ();
+  l.destination_address = destination ();
+  l.lsdu.set (lsdu_, lsdu_len_);
+  l.repeated = repeated ();
+  l.priority = priority ();
+  l.hop_count = hop_count ();
+  l.address_type = address_type ();
+  return true;
+}
@@ -0,0 +1,151 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/**
+ * @file
+ * @ingroup KNX_03_03_02
+ * Non-owning view of an encoded L_Data frame
+ * @{
+ */
+
+#ifndef LDATAVIEW_H
+#define LDATAVIEW_H
+
+#include "lpdu.h"
+
+/**
+ * Header fields of a TP1 or cEMI L_Data frame, read directly from its
+ * octets.
+ *
+ * Constructing a view only locates the header and the LSDU; the fields
+ * are read when asked for. Nothing is copied, so the view must not
+ * outlive the data. Use to_L_Data() when you need a PDU of your own.
+ */
+class LDataView
+{
+public:
+  enum Format
+  {
+    /** as on the bus, with checksum */
+    TP1,
+    /** cEMI message, starting with the message code */
+    CEMI,
+    /** a decoded L_Data_PDU; the header is kept in the view */
+    PDU,
+  };
+
+  LDataView (const uint8_t *data, size_t len, Format f);
+  LDataView (const CArray &c, Format f) : LDataView (c.data(), c.size(), f) {}
+  /** view of a decoded frame, so that filters can check both alike */
+  explicit LDataView (const L_Data_PDU &l);
+  LDataView (const LDataView &v);
+  LDataView &operator= (const LDataView &v);
+
+  /** it's an L_Data frame and has a complete header */
+  bool valid () const
+  {
+    return ctrl != nullptr;
+  }
+  /** the LSDU is there, as long as the header says; the decoders accept it */
+  bool complete () const
+  {
+    return ctrl != nullptr && full;
+  }
+
+  eibaddr_t source () const
+  {
+    return (addr[0] << 8) | addr[1];
+  }
+  eibaddr_t destination () const
+  {
+    return (addr[2] << 8) | addr[3];
+  }
+  EIB_AddrType address_type () const
+  {
+    return (*npci & 0x80) ? GroupAddress : IndividualAddress;
+  }
+  EIB_Priority priority () const
+  {
+    return static_cast<EIB_Priority>((*ctrl >> 2) & 0x3);
+  }
+  uint8_t hop_count () const
+  {
+    return (*npci >> 4) & 0x07;
+  }
+  bool repeated () const
+  {
+    return has_repeat && !(*ctrl & 0x20);
+  }
+
+  /** the LSDU, or as much of it as there is */
+  const uint8_t *lsdu () const
+  {
+    return lsdu_;
+  }
+  size_t lsdu_len () const
+  {
+    return lsdu_len_;
+  }
+  /** first octet of the LSDU; -1 if there is none */
+  int tpci () const
+  {
+    return lsdu_len_ >= 1 ? lsdu_[0] : -1;
+  }
+  /** the 10-bit APCI; -1 if the LSDU is too short */
+  int apci () const
+  {
+    return lsdu_len_ >= 2 ? ((lsdu_[0] & 0x03) << 8) | lsdu_[1] : -1;
+  }
+
+  /** length of the TP1 frame for this one */
+  size_t CM_TP1_size () const
+  {
+    return lsdu_len_ + (lsdu_len_ <= 0x10 ? 7 : 8);
+  }
+  /**
+   * Encode as TP1 frame, like L_Data_to_CM_TP1() would after decoding.
+   * @return the frame's length; 0 if it's not complete, or doesn't fit
+   */
+  size_t to_CM_TP1 (uint8_t *buf, size_t max) const;
+  /** decode into @l; @return false if it's not complete */
+  bool to_L_Data (L_Data_PDU &l) const;
+
+private:
+  const uint8_t *data;
+  size_t len;
+  Format format;
+
+  /** control field with priority and repeat flag; nullptr: not valid */
+  const uint8_t *ctrl = nullptr;
+  /** octet with address type and hop count */
+  const uint8_t *npci = nullptr;
+  /** source, then destination address */
+  const uint8_t *addr = nullptr;
+  const uint8_t *lsdu_ = nullptr;
+  size_t lsdu_len_ = 0;
+  bool full = false;
+  /** cEMI only has a repeat flag in L_Data.ind */
+  bool has_repeat = true;
+  /** PDU only: ctrl, addresses and npci, as in a TP1 standard frame */
+  uint8_t hdr[6] = {};
+};
+
+#endif
+
+/** @} */
@@ -24,6 +24,10 @@
 #include <sys/un.h>
 #include <unistd.h>
 
+#ifdef HAVE_SHMRING
+#include "busmonring.h"
+#endif
+
 LocalServer::LocalServer (BaseRouter& r, IniSectionPtr& s)
   : NetServer (r,s)
 {
@@ -35,77 +39,109 @@ LocalServer::setup()
 {
   path = cfg->value("path","/run/knx");
   ignore_when_systemd = cfg->value("systemd-ignore",(path == "/run/knx"));
+  seqpacket = cfg->value("seqpacket",true);
+  shm_slots = cfg->value("shm-slots",4096);
+  shm_recsize = cfg->value("shm-record-size",64);
   if (!NetServer::setup())
     return false;
   return true;
 }
 
-void
-LocalServer::start()
+int
+LocalServer::open_socket (const std::string& p, int type)
 {
-  if (ignore_when_systemd && static_cast<Router &>(router).using_systemd)
-    {
-      may_fail = true;
-      stopped();
-      return;
-    }
-
   struct sockaddr_un addr;
-  TRACEPRINTF (t, 8, "OpenLocalSocket %s", path);
+  int sfd;
+
+  TRACEPRINTF (t, 8, "OpenLocalSocket %s", p);
   addr.sun_family = AF_LOCAL;
-  strncpy (addr.sun_path, path.c_str(), sizeof (addr.sun_path) - 1);
+  strncpy (addr.sun_path, p.c_str(), sizeof (addr.sun_path) - 1);
+  addr.sun_path[sizeof (addr.sun_path) - 1] = 0;
 
-  fd = socket (AF_LOCAL, SOCK_STREAM, 0);
-  if (fd == -1)
+  sfd = socket (AF_LOCAL, type, 0);
+  if (sfd == -1)
     {
-      ERRORPRINTF (t, E_ERROR | 15, "OpenLocalSocket %s: socket: %s", path, strerror(errno));
-      goto ex3;
+      ERRORPRINTF (t, E_ERROR | 15, "OpenLocalSocket %s: socket: %s", p, strerror(errno));
+      return -1;
     }
 
-  if (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) == -1)
+  if (bind (sfd, (struct sockaddr *) &addr, sizeof (addr)) == -1)
     {
       /*
        * dead file?
        */
       if (errno == EADDRINUSE)
         {
-          if (connect(fd, (struct sockaddr *) &addr, sizeof (addr)) == 0)
+          if (connect(sfd, (struct sockaddr *) &addr, sizeof (addr)) == 0)
             {
 ex:
-              ERRORPRINTF (t, E_ERROR | 16, "OpenLocalSocket %s: bind: %s", path, strerror(errno));
+              ERRORPRINTF (t, E_ERROR | 16, "OpenLocalSocket %s: bind: %s", p, strerror(errno));
               goto ex2;
             }
           else if (errno == ECONNREFUSED)
             {
-              ::unlink (path.c_str());
-              if (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) == -1)
+              ::unlink (p.c_str());
+              if (bind (sfd, (struct sockaddr *) &addr, sizeof (addr)) == -1)
                 goto ex;
             }
           else
             {
-              ERRORPRINTF (t, E_ERROR | 18, "Existing socket %s: connect: %s", path, strerror(errno));
+              ERRORPRINTF (t, E_ERROR | 18, "Existing socket %s: connect: %s", p, strerror(errno));
               goto ex2;
             }
         }
     }
 
-  if (listen (fd, 10) == -1)
+  if (listen (sfd, 10) == -1)
     {
-      ERRORPRINTF (t, E_ERROR | 17, "OpenLocalSocket %s: listen: %s", path, strerror(errno));
+      ERRORPRINTF (t, E_ERROR | 17, "OpenLocalSocket %s: listen: %s", p, strerror(errno));
       goto ex2;
     }
+  return sfd;
+
+ex2:
+  close (sfd);
+  return -1;
+}
 
-  this->path = path;
+void
+LocalServer::start()
+{
+  if (ignore_when_systemd && static_cast<Router &>(router).using_systemd)
+    {
+      may_fail = true;
+      stopped();
+      return;
+    }
+
+  fd = open_socket (path, SOCK_STREAM);
+  if (fd == -1)
+    {
+      NetServer::stop();
+      return;
+    }
   TRACEPRINTF (t, 8, "LocalSocket opened");
+
+  if (seqpacket)
+    {
+      seqfd = open_socket (path + SEQPACKET_SUFFIX, SOCK_SEQPACKET);
+      if (seqfd == -1)
+        ERRORPRINTF (t, E_WARNING | 137, "%s: continuing without packet socket", path);
+      else
+        TRACEPRINTF (t, 8, "LocalSocket %s%s opened", path, SEQPACKET_SUFFIX);
+    }
+
   NetServer::start();
-  return;
+}
 
-ex2:
-  close (fd);
-  fd = -1;
-ex3:
-  NetServer::stop();
-  return;
+BusmonRingPtr
+LocalServer::busmonitor_ring()
+{
+#ifdef HAVE_SHMRING
+  if (!ring && shm_slots)
+    ring = BusmonRingPtr(new BusmonRing(static_cast<Router &>(router), t, shm_slots, shm_recsize));
+#endif
+  return ring;
 }
 
 void
@@ -118,7 +154,14 @@ LocalServer::stop()
       if (path.size())
         ::unlink (path.c_str());
     }
+  if (seqfd >= 0)
+    {
+      close(seqfd);
+      seqfd = -1;
+      ::unlink ((path + SEQPACKET_SUFFIX).c_str());
+    }
   NetServer::stop();
+  ring = nullptr;
 }
 
 LocalServer::~LocalServer ()
@@ -129,5 +172,7 @@ LocalServer::~LocalServer ()
       if (path.size())
         ::unlink (path.c_str());
     }
+  if (seqfd >= 0)
+    ::unlink ((path + SEQPACKET_SUFFIX).c_str());
 }
 
@@ -28,6 +28,9 @@
 
 #include "server.h"
 
+/** the SOCK_SEQPACKET socket lives next to the stream socket */
+#define SEQPACKET_SUFFIX ".seq"
+
 /** implements a server listening on a unix domain socket */
 SERVER_(LocalServer,NetServer,knxd_unix)
 {
@@ -39,8 +42,19 @@ public:
   void start();
   void stop();
 
+  BusmonRingPtr busmonitor_ring();
+
 private:
   std::string path;
+  /** also listen on path+SEQPACKET_SUFFIX */
+  bool seqpacket;
+
+  int open_socket (const std::string& p, int type);
+
+  /** size of the shared-memory vbusmonitor ring; 0: disabled */
+  unsigned shm_slots;
+  unsigned shm_recsize;
+  BusmonRingPtr ring;
 };
 
 #endif
@@ -181,6 +181,8 @@ FDdriver::~FDdriver ()
 
   if (fd != -1)
     {
+      if (thread)
+        thread->stop();
       sendbuf.stop(true);
       recvbuf.stop(true);
       close (fd);
@@ -191,13 +193,27 @@ void
 FDdriver::send_Data(CArray &c)
 {
   CArray *cp = new CArray(c);
-  sendbuf.write(cp);
+  if (thread)
+    thread->send(cp);
+  else
+    sendbuf.write(cp);
 }
 
 void
 FDdriver::start()
 {
-  setup_buffers();
+  if (thread)
+    {
+      if (!thread->start(fd))
+        {
+          close(fd);
+          fd = -1;
+          stopped();
+          return;
+        }
+    }
+  else
+    setup_buffers();
   LowLevelDriver::start();
 }
 
@@ -206,6 +222,8 @@ FDdriver::stop()
 {
   if (fd >= -1)
     {
+      if (thread)
+        thread->stop();
       sendbuf.stop(true);
       recvbuf.stop(true);
 
@@ -218,6 +236,7 @@ FDdriver::stop()
 size_t
 FDdriver::read_cb(uint8_t *buf, size_t len)
 {
+  RxTime rt(rx_clock());
   CArray c(buf,len);
   recv_Data(c);
   return len;
@@ -270,6 +270,21 @@ protected:
 };
 
 
+/** Reads and writes a device in a thread of its own, instead of the
+ * event loop doing it. */
+class FDthread
+{
+public:
+  virtual ~FDthread () = default;
+
+  /** take over the open device; false if the thread can't be started */
+  virtual bool start (int fd) = 0;
+  /** stop using the device; it's closed afterwards */
+  virtual void stop () = 0;
+  /** queue data for writing; takes ownership */
+  virtual void send (CArray *c) = 0;
+};
+
 /** base driver for talking to file descriptors */
 class FDdriver:public LowLevelDriver
 {
@@ -280,6 +295,10 @@ public:
   void start();
   void stop();
 
+  /** if set, the device is handed to this thread when it has been opened,
+   * and not read or written by the event loop */
+  FDthread *thread = nullptr;
+
 protected:
   /** device connection */
   int fd = -1;
@@ -20,12 +20,30 @@
 #include "lpdu.h"
 
 #include <cstdio>
+#include <ctime>
 
 #include "cm_tp1.h"
 #include "tpdu.h"
 
 /* L_Data */
 
+void L_Data_PDU::clear ()
+{
+  ack_request = 0;
+  address_type = IndividualAddress;
+  destination_address = 0;
+  frame_format = 0;
+  octet_count = 0;
+  priority = PRIO_LOW;
+  source_address = 0;
+  lsdu.clear ();
+  l_status = 0;
+  repeated = false;
+  valid_checksum = true;
+  valid_length = true;
+  hop_count = 0x06;
+}
+
 std::string L_Data_PDU::Decode (TracePtr tr) const
 {
   assert (lsdu.size() >= 1);
@@ -62,7 +80,8 @@ std::string L_Data_PDU::Decode (TracePtr tr) const
         FormatEIBAddr (destination_address));
   s += " hops: ";
   addHex (s, hop_count);
-  TPDUPtr d = TPDU::fromPacket (address_type, destination_address, lsdu, tr);
+  TPDUBuf tbuf;
+  TPDU *d = TPDU::decode (address_type, destination_address, lsdu, tbuf, tr);
   s += d->Decode (tr);
   return s;
 }
@@ -94,13 +113,23 @@ std::string L_Poll_Update_PDU::Decode (TracePtr) const
   return s;
 }
 
+uint64_t RxTime::current = 0;
+
+uint64_t
+rx_clock ()
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_REALTIME, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
 /* L_Busmon */
 
 L_Busmon_PDU::L_Busmon_PDU () : LPDU()
 {
-  struct timeval tv;
-  gettimeofday(&tv,NULL);
-  time_stamp = tv.tv_sec*65536 + tv.tv_usec/(1000000/65536+1);
+  uint32_t sec = rx_time / 1000000000;
+  uint32_t usec = (rx_time % 1000000000) / 1000;
+  time_stamp = sec*65536 + usec/(1000000/65536+1);
   l_status = 0;
 }
 
@@ -115,8 +144,11 @@ L_Busmon_PDU::Decode (TracePtr tr) const
   C_ITER (i,lpdu)
   addHex (s, *i);
   s += ":";
-  LDataPtr l = CM_TP1_to_L_Data (lpdu, tr);
-  s += l->Decode (tr);
+  L_Data_PDU l;
+  if (CM_TP1_to_L_Data (lpdu.data(), lpdu.size(), l))
+    s += l.Decode (tr);
+  else
+    s += "unparseable";
   return s;
 }
 
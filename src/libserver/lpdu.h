@@ -68,13 +68,46 @@ enum LPDU_Type
   L_Management,
 };
 
+/** CLOCK_REALTIME in nanoseconds */
+uint64_t rx_clock ();
+
+/**
+ * Reception time of the data a driver is processing right now.
+ * Drivers create one of these on the stack while they hand received data
+ * up the stack, so that frames created meanwhile get the time the data
+ * arrived instead of the time they happened to be parsed.
+ */
+class RxTime
+{
+public:
+  RxTime (uint64_t t) : prev(current)
+  {
+    current = t;
+  }
+  ~RxTime ()
+  {
+    current = prev;
+  }
+  /** 0: not within a driver's receive path */
+  static uint64_t current;
+
+private:
+  uint64_t prev;
+};
+
 /** represents a Layer 2 frame */
 class LPDU
 {
 public:
-  LPDU () = default;
+  LPDU ()
+  {
+    rx_time = RxTime::current ? RxTime::current : rx_clock();
+  }
   virtual ~LPDU () = default;
 
+  /** reception time, nanoseconds since the epoch */
+  uint64_t rx_time;
+
   /** decode content as string */
   virtual std::string Decode (TracePtr tr) const = 0;
   /** get frame type */
@@ -117,6 +150,9 @@ public:
 
   L_Data_PDU () = default;
 
+  /** reset all fields except rx_time, keeping the LSDU's allocation */
+  void clear ();
+
   virtual std::string Decode (TracePtr tr) const override;
   virtual LPDU_Type getType () const override
   {
@@ -224,6 +260,11 @@ public:
   std::string& name;
   /** callback: a bus monitor frame has been received */
   virtual void send_L_Busmonitor (LBusmonPtr l) = 0;
+  /** is this raw frame of interest? Asked before the frame is copied. */
+  virtual bool want_L_Busmonitor (const CArray &)
+  {
+    return true;
+  }
 };
 
 /* L_Service_Information */
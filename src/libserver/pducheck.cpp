@@ -0,0 +1,394 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Consistency check of the APDU and TPDU decoders.
+ *
+ * For every APCI (resp. TPCI, address type and kind of destination) and
+ * a range of lengths, random packets are decoded both onto the heap and
+ * into an APDUBuf/TPDUBuf; both must agree on type, text and encoding.
+ * The encoding is then decoded again, which must give the same PDU.
+ * Encoding into a CArray, into a re-used CArray and into a buffer must
+ * give the same octets. An LDataView of an L_Data_PDU, and a copy of
+ * that view, must show the PDU's fields. Busmonitor filter tests, "!="
+ * included, must fail on frames which lack the tested field.
+ *
+ * With -t, the time and heap allocations needed for decoding, and for
+ * building an L_Data PDU, are printed: the old way, via a CArray per
+ * layer, and in place.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include <ctime>
+#include <new>
+#include <unistd.h>
+#include "config.h"
+#include "inifile.h"
+#include "apdu.h"
+#include "tpdu.h"
+#include "lpdu.h"
+#include "ldataview.h"
+#ifdef HAVE_BUSMONITOR
+#include "busmonfilter.h"
+#endif
+
+static unsigned long allocs = 0;
+
+void *
+operator new (size_t n)
+{
+  allocs++;
+  void *p = malloc (n ? n : 1);
+  if (!p)
+    throw std::bad_alloc ();
+  return p;
+}
+
+void
+operator delete (void *p) noexcept
+{
+  free (p);
+}
+
+void
+operator delete (void *p, size_t) noexcept
+{
+  free (p);
+}
+
+/** aborts program with a printf like message */
+void
+die (const char *msg, ...)
+{
+  va_list ap;
+  va_start (ap, msg);
+  vprintf (msg, ap);
+  printf ("\n");
+  va_end (ap);
+
+  exit (1);
+}
+
+static TracePtr t;
+static unsigned errors = 0;
+static uint32_t seed = 1;
+static volatile unsigned sink;
+
+static uint8_t
+rnd ()
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+
+static std::string
+hex (const CArray &c)
+{
+  std::string s;
+  char b[4];
+  for (auto x : c)
+    {
+      snprintf (b, sizeof (b), "%02x", x);
+      s += b;
+    }
+  return s;
+}
+
+static void
+fail (const char *what, int type, const CArray &c, const std::string &a,
+      const std::string &b)
+{
+  if (++errors <= 20)
+    printf ("%s %04x %s:\n  %s\n  %s\n", what, type, hex (c).c_str(), a.c_str(), b.c_str());
+}
+
+/** the encoding into a re-used CArray and into a buffer must be @p */
+template<class PDU>
+static bool
+same_encoding (const PDU *a, const CArray &p)
+{
+  static CArray re;
+  uint8_t buf[256];
+  a->ToPacket (re);
+  if (re != p)
+    return false;
+  if (p.size() > sizeof (buf))
+    return true;
+  size_t len = a->ToPacket (buf, sizeof (buf));
+  if (len != p.size() || memcmp (buf, p.data(), len))
+    return false;
+  return p.size() == 0 || a->ToPacket (buf, p.size() - 1) == 0;
+}
+
+static void
+check_apdu (const CArray &c)
+{
+  APDUBuf buf;
+  APDUPtr a = APDU::fromPacket (c, t);
+  APDU *b = APDU::decode (c, buf, t);
+  std::string s = a->Decode (t);
+  CArray p = a->ToPacket ();
+  if (a->getType () != b->getType () || s != b->Decode (t) || p != b->ToPacket ())
+    fail ("APDU heap/stack", a->getType (), c, s, b->Decode (t));
+  if (!same_encoding (a.get (), p))
+    fail ("APDU encoding", a->getType (), c, hex (p), "");
+
+  b = APDU::decode (p, buf, t);
+  if (b->getType () != a->getType () || b->ToPacket () != p)
+    fail ("APDU round trip", a->getType (), c, hex (p), hex (b->ToPacket ()));
+}
+
+static void
+check_tpdu (EIB_AddrType type, eibaddr_t dest, const CArray &c)
+{
+  TPDUBuf buf;
+  TPDUPtr a = TPDU::fromPacket (type, dest, c, t);
+  TPDU *b = TPDU::decode (type, dest, c, buf, t);
+  std::string s = a->Decode (t);
+  CArray p = a->ToPacket ();
+  if (a->getType () != b->getType () || s != b->Decode (t) || p != b->ToPacket ())
+    fail ("TPDU heap/stack", a->getType (), c, s, b->Decode (t));
+  if (!same_encoding (a.get (), p))
+    fail ("TPDU encoding", a->getType (), c, hex (p), "");
+
+  b = TPDU::decode (type, dest, p, buf, t);
+  if (b->getType () != a->getType () || b->ToPacket () != p)
+    fail ("TPDU round trip", a->getType (), c, hex (p), hex (b->ToPacket ()));
+}
+
+/** @v must show the fields of @l */
+static bool
+same_fields (const LDataView &v, const L_Data_PDU &l)
+{
+  L_Data_PDU m;
+  if (!v.to_L_Data (m))
+    return false;
+  return v.source () == l.source_address &&
+         v.destination () == l.destination_address &&
+         v.address_type () == l.address_type &&
+         v.priority () == l.priority && v.hop_count () == l.hop_count &&
+         v.repeated () == l.repeated && v.tpci () == l.lsdu[0] &&
+         m.lsdu == l.lsdu && m.source_address == l.source_address &&
+         m.destination_address == l.destination_address &&
+         m.address_type == l.address_type && m.priority == l.priority &&
+         m.hop_count == l.hop_count && m.repeated == l.repeated;
+}
+
+static void
+check_view (EIB_AddrType type, eibaddr_t dest, const CArray &c)
+{
+  L_Data_PDU l;
+  l.lsdu = c;
+  l.address_type = type;
+  l.destination_address = dest;
+  l.source_address = (rnd () << 8) | rnd ();
+  l.priority = static_cast<EIB_Priority>(rnd () & 3);
+  l.hop_count = rnd () & 7;
+  l.repeated = rnd () & 1;
+
+  LDataView *v = new LDataView (l);
+  LDataView w (*v);
+  if (!same_fields (*v, l))
+    fail ("LDataView", l.lsdu[0], c, l.Decode (t), "");
+  delete v;
+  if (!same_fields (w, l))
+    fail ("LDataView copy", l.lsdu[0], c, l.Decode (t), "");
+}
+
+#ifdef HAVE_BUSMONITOR
+/** @return the number of filter checks */
+static unsigned
+check_filter ()
+{
+  /* 1.1.5 to 1/0/1: GroupValue_Write 1, GroupValue_Read; an ACK */
+  static const uint8_t wr[] = { 0xbc, 0x11, 0x05, 0x08, 0x01, 0xe1, 0x00, 0x81, 0x3e };
+  static const uint8_t rd[] = { 0xbc, 0x11, 0x05, 0x08, 0x01, 0xe1, 0x00, 0x00, 0xbf };
+  static const uint8_t ack[] = { 0xcc };
+  static const struct
+  {
+    const char *expr;
+    bool wr, rd, ack;
+  } tests[] =
+  {
+    { "apci == write", true, false, false },
+    { "apci != write", false, true, false },
+    { "!(apci == write)", false, true, true },
+    { "src != 1.1.5", false, false, false },
+    { "src != 1.1.6", true, true, false },
+    { "data[2] != 0", false, false, false },
+    { "data[1] & 0x3f != 0", true, false, false },
+    { "group && apci != read", true, false, false },
+  };
+
+  for (auto &x : tests)
+    {
+      BusmonFilter f;
+      std::string err;
+      if (!f.compile (x.expr, err))
+        {
+          printf ("filter '%s': %s\n", x.expr, err.c_str ());
+          errors++;
+          continue;
+        }
+      if (f.match (wr, sizeof (wr)) != x.wr || f.match (rd, sizeof (rd)) != x.rd
+          || f.match (ack, sizeof (ack)) != x.ack)
+        {
+          printf ("filter '%s': write %d read %d ack %d\n", x.expr,
+                  f.match (wr, sizeof (wr)), f.match (rd, sizeof (rd)),
+                  f.match (ack, sizeof (ack)));
+          errors++;
+        }
+    }
+  return sizeof (tests) / sizeof (tests[0]);
+}
+#endif
+
+static double
+now ()
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+report (const char *what, unsigned count, double t_old, double t_new,
+        unsigned long a_old, unsigned long a_new)
+{
+  printf ("%-24s %7.1f ns %4.1f allocs  %7.1f ns %4.1f allocs  %5.2fx\n", what,
+          t_old * 1e9 / count, (double) a_old / count,
+          t_new * 1e9 / count, (double) a_new / count, t_old / t_new);
+}
+
+static void
+bench_decode (const char *what, const CArray &c, unsigned count)
+{
+  unsigned long a0 = allocs;
+  double t0 = now ();
+  for (unsigned i = 0; i < count; i++)
+    sink += APDU::fromPacket (c, t)->getType ();
+  double t1 = now ();
+  unsigned long a1 = allocs;
+  APDUBuf buf;
+  for (unsigned i = 0; i < count; i++)
+    sink += APDU::decode (c, buf, t)->getType ();
+  double t2 = now ();
+  report (what, count, t1 - t0, t2 - t1, a1 - a0, allocs - a1);
+}
+
+/** T_Data_Group with @a in a new L_Data_PDU, as GroupCache::Read sends it */
+static void
+bench_encode (const char *what, const APDU &a, unsigned count)
+{
+  T_Data_Group_PDU tpdu;
+  unsigned long a0 = allocs;
+  double t0 = now ();
+  for (unsigned i = 0; i < count; i++)
+    {
+      LDataPtr l = LDataPtr (new L_Data_PDU ());
+      tpdu.tsdu = a.ToPacket ();
+      l->lsdu = tpdu.ToPacket ();
+      sink += l->lsdu[1];
+    }
+  double t1 = now ();
+  unsigned long a1 = allocs;
+  for (unsigned i = 0; i < count; i++)
+    {
+      LDataPtr l = LDataPtr (new L_Data_PDU ());
+      tpdu.ToPacket (a, l->lsdu);
+      sink += l->lsdu[1];
+    }
+  double t2 = now ();
+  report (what, count, t1 - t0, t2 - t1, a1 - a0, allocs - a1);
+}
+
+int
+main (int ac, char *ag[])
+{
+  unsigned count = 0;
+  int opt;
+  while ((opt = getopt (ac, ag, "t:")) != -1)
+    switch (opt)
+      {
+      case 't':
+        count = atoi (optarg);
+        break;
+      default:
+        die ("usage: %s [-t count]", ag[0]);
+      }
+
+  IniData ini;
+  t = TracePtr(new Trace(ini["main"], "pducheck"));
+
+  unsigned n = 0;
+  for (unsigned apci = 0; apci < 1024; apci++)
+    for (unsigned len = 0; len < 24; len++)
+      for (int rep = 0; rep < 3; rep++, n++)
+        {
+          CArray c;
+          c.resize (len);
+          for (auto &x : c)
+            x = rnd ();
+          if (len >= 1)
+            c[0] = (c[0] & 0xfc) | (apci >> 8);
+          if (len >= 2)
+            c[1] = apci & 0xff;
+          check_apdu (c);
+        }
+
+  for (unsigned tpci = 0; tpci < 256; tpci++)
+    for (unsigned len = 1; len < 6; len++)
+      for (int g = 0; g < 2; g++)
+        for (int d = 0; d < 2; d++, n++)
+          {
+            CArray c;
+            c.resize (len);
+            for (auto &x : c)
+              x = rnd ();
+            c[0] = tpci;
+            check_tpdu (g ? GroupAddress : IndividualAddress, d ? 0x1234 : 0, c);
+            check_view (g ? GroupAddress : IndividualAddress, d ? 0x1234 : 0, c);
+          }
+
+#ifdef HAVE_BUSMONITOR
+  n += check_filter ();
+#endif
+  printf ("%u packets, %u errors\n", n, errors);
+
+  if (count)
+    {
+      static const uint8_t gv[] = { 0x00, 0x81 };
+      static const uint8_t pv[] = { 0x03, 0xd5, 0x00, 0x0b, 0x10, 0x01 };
+      printf ("%u decodes each; heap, APDUBuf\n", count);
+      bench_decode ("A_GroupValue_Write", CArray (gv, sizeof (gv)), count);
+      bench_decode ("A_PropertyValue_Read", CArray (pv, sizeof (pv)), count);
+
+      A_GroupValue_Read_PDU r;
+      A_PropertyValue_Read_PDU p;
+      p.property_id = 0x0b;
+      p.nr_of_elem = 1;
+      p.start_index = 1;
+      printf ("%u L_Data PDUs each; via CArrays, in place\n", count);
+      bench_encode ("A_GroupValue_Read", r, count);
+      bench_encode ("A_PropertyValue_Read", p, count);
+    }
+  return errors != 0;
+}
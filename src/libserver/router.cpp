@@ -19,6 +19,7 @@
 
 #include "router.h"
 
+#include <cstring>
 #include <iostream>
 #include <math.h>
 #include <sys/socket.h>
@@ -198,6 +199,17 @@ Router::setup()
 
   force_broadcast = s->value("force-broadcast", false);
   unknown_ok = s->value("unknown-ok", false);
+  {
+    int bq = s->value("busy-queue", 10);
+    int mq = s->value("max-queue", 0);
+    if (bq < 0 || mq < 0)
+      {
+        ERRORPRINTF (t, E_ERROR | 142, "busy-queue and max-queue must be >=0");
+        goto ex;
+      }
+    busy_queue = bq;
+    max_queue = mq;
+  }
 
   start_timeout = s->value("timeout",0);
   if (std::isnan(start_timeout) || start_timeout < 0)
@@ -593,6 +605,10 @@ Router::state_trigger_cb (ev::async &, int)
       r_high->started();
       start_timer.stop();
     }
+
+  /* a link which died while sending won't call send_Next() */
+  if (want_up && some_running)
+    send_Next();
 }
 
 void
@@ -776,7 +792,12 @@ Router::recv_L_Busmonitor (LBusmonPtr l)
 void
 Router::queue_L_Data (LDataPtr l)
 {
-  if (some_running || want_up)
+  if (max_queue && buf.size() >= max_queue)
+    {
+      lost++;
+      TRACEPRINTF (t, 3, "Queue: discard (full) %s", l->Decode (t));
+    }
+  else if (some_running || want_up)
     {
       buf.emplace (std::move(l));
       if (running_signal)
@@ -1038,14 +1059,19 @@ Router::trigger_cb (ev::async &, int)
   while (!buf.empty() && low_send_more)
     {
       LDataPtr l1 = buf.get ();
+      uint8_t frame[CM_TP1_MAX_FRAME];
+      size_t len;
 
       if (vbusmonitor.size())
         {
+          RxTime rt(l1->rx_time);
           LBusmonPtr l2 = LBusmonPtr(new L_Busmon_PDU ());
-          l2->lpdu.set (L_Data_to_CM_TP1 (l1));
+          len = L_Data_to_CM_TP1 (*l1, frame, sizeof (frame));
+          l2->lpdu.set (frame, len);
 
           ITER(i,vbusmonitor)
-          i->cb->send_L_Busmonitor (LBusmonPtr(new L_Busmon_PDU (*l2)));
+          if (i->cb->want_L_Busmonitor (l2->lpdu))
+            i->cb->send_L_Busmonitor (LBusmonPtr(new L_Busmon_PDU (*l2)));
         }
       if (!l1->hop_count)
         {
@@ -1055,22 +1081,24 @@ Router::trigger_cb (ev::async &, int)
       if (l1->hop_count < 7 || !force_broadcast)
         l1->hop_count--;
 
-      if (l1->repeated)
-        {
-          CArray d1 = L_Data_to_CM_TP1 (l1);
+      /* a repeated frame looks the same as the ones we remember */
+      {
+        bool repeated = l1->repeated;
+        l1->repeated = 1;
+        len = L_Data_to_CM_TP1 (*l1, frame, sizeof (frame));
+        l1->repeated = 0;
+        if (repeated)
           ITER (i,ignore)
-          if (d1 == i->data)
+          if (i->data.size() == len && !memcmp (frame, i->data.data(), len))
             {
               TRACEPRINTF (t, 9, "Drop: %s", l1->Decode (t));
               goto next;
             }
-        }
-      l1->repeated = 1;
+      }
       ignore.push_back((IgnoreInfo)
       {
-        .data = L_Data_to_CM_TP1 (l1), .end = getTime () + 1000000
+        .data = CArray (frame, len), .end = getTime () + 1000000
       });
-      l1->repeated = 0;
 
       if (l1->address_type == IndividualAddress
           && l1->destination_address == this->addr)
@@ -1173,7 +1201,8 @@ Router::mtrigger_cb (ev::async &, int)
 
       TRACEPRINTF (t, 3, "RecvMon %s", l1->Decode (t));
       ITER (i, busmonitor)
-      i->cb->send_L_Busmonitor (LBusmonPtr(new L_Busmon_PDU (*l1)));
+      if (i->cb->want_L_Busmonitor (l1->lpdu))
+        i->cb->send_L_Busmonitor (LBusmonPtr(new L_Busmon_PDU (*l1)));
     }
 }
 
@@ -158,6 +158,20 @@ public:
   /** flag whether systemd has passed us any file descriptors */
   bool using_systemd = false;
 
+  /** flow control: a queue holding this many frames is backed up */
+  unsigned busy_queue = 10;
+  /** flow control: drop frames beyond this many (0: unbounded) */
+  unsigned max_queue = 0;
+  /** links whose queue is backed up, see QueueFilter */
+  unsigned congested_links = 0;
+  /** frames dropped because a queue was full */
+  unsigned long lost = 0;
+  /** is our own queue, or any link's, backed up? */
+  bool congested()
+  {
+    return busy_queue && (buf.size() >= busy_queue || congested_links);
+  }
+
   bool isIdle()
   {
     return !some_running;
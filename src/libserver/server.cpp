@@ -33,6 +33,7 @@ NetServer::stop_()
   TRACEPRINTF (t, 8, "StopServer");
 
   io.stop();
+  seq_io.stop();
   cleanup.stop();
   while(!cleanup_q.empty())
     cleanup_q.pop();
@@ -46,6 +47,11 @@ NetServer::stop_()
       close (fd);
       fd = -1;
     }
+  if (seqfd > -1)
+    {
+      close (seqfd);
+      seqfd = -1;
+    }
 }
 
 void
@@ -101,6 +107,12 @@ NetServer::start()
   set_non_blocking(fd);
   io.set<NetServer, &NetServer::io_cb>(this);
   io.start(fd,ev::READ);
+  if (seqfd != -1)
+    {
+      set_non_blocking(seqfd);
+      seq_io.set<NetServer, &NetServer::io_cb>(this);
+      seq_io.start(seqfd,ev::READ);
+    }
   cleanup.set<NetServer, &NetServer::cleanup_cb>(this);
   cleanup.start();
 
@@ -108,15 +120,16 @@ NetServer::start()
 }
 
 void
-NetServer::io_cb (ev::io &, int)
+NetServer::io_cb (ev::io &w, int)
 {
   int cfd;
-  cfd = accept (fd, NULL,NULL);
+  bool packet = (&w == &seq_io);
+  cfd = accept (w.fd, NULL,NULL);
   if (cfd != -1)
     {
-      TRACEPRINTF (t, 8, "New Connection");
+      TRACEPRINTF (t, 8, "New %sConnection", packet ? "Packet " : "");
       setupConnection (cfd);
-      ClientConnPtr c = std::shared_ptr<ClientConnection>(new ClientConnection (std::static_pointer_cast<NetServer>(shared_from_this()), cfd));
+      ClientConnPtr c = std::shared_ptr<ClientConnection>(new ClientConnection (std::static_pointer_cast<NetServer>(shared_from_this()), cfd, packet));
       if (!c->setup())
         return;
       c->start();
@@ -132,6 +145,14 @@ NetServer::setup()
 {
   if (!Server::setup())
     return false;
+  max_output = cfg->value("max-output",1024*1024);
+  output_budget.limit = cfg->value("max-output-total",0);
+  std::string pol = cfg->value("output-overflow","disconnect");
+  if (!parse_sb_policy(pol, output_policy))
+    {
+      ERRORPRINTF (t, E_ERROR | 138, "%s: unknown output-overflow policy '%s'", name(), pol);
+      return false;
+    }
   if (!static_cast<Router&>(router).hasClientAddrs())
     return false;
   if (!static_cast<Router &>(router).checkStack(cfg))
@@ -27,11 +27,14 @@
 #define SERVER_H
 
 #include "common.h"
+#include "iobuf.h"
 #include "link.h"
 #include "router.h"
 
 class ClientConnection;
 using ClientConnPtr = std::shared_ptr<ClientConnection>;
+class BusmonRing;
+using BusmonRingPtr = std::shared_ptr<BusmonRing>;
 
 /** implements the frontend (but opens no connection) */
 class NetServer: public Server
@@ -42,12 +45,27 @@ public:
   virtual ~NetServer ();
   bool ignore_when_systemd = false;
 
+  /** shared-memory vbusmonitor ring, if this server can hand one out */
+  virtual BusmonRingPtr busmonitor_ring()
+  {
+    return nullptr;
+  }
+
 protected:
   NetServer (BaseRouter& l3, IniSectionPtr& s);
 
   /** server socket */
   int fd;
 
+  /** output budget of each client connection; 0: unlimited */
+  size_t max_output;
+  /** what to do when a budget is exceeded */
+  SB_POLICY output_policy;
+  /** output budget of all client connections together */
+  SendBudget output_budget;
+  /** optional SOCK_SEQPACKET server socket */
+  int seqfd = -1;
+
   virtual void setupConnection (int cfd);
 
   bool setup();
@@ -59,6 +77,7 @@ protected:
 
 private:
   ev::io io;
+  ev::io seq_io;
   void io_cb (ev::io &w, int revents);
 
   /** open client connections*/
@@ -21,61 +21,161 @@
 
 #include "apdu.h"
 
-TPDUPtr
-TPDU::fromPacket (const EIB_AddrType address_type, const eibaddr_t destination_address, const CArray & c, TracePtr tr)
+#include <new>
+
+/*
+ * TPCI dispatch, per address type, expanded at compile time into a
+ * table that indexes tpdu_makers.
+ */
+enum TPDU_kind : uint8_t
+{
+  K_Unknown,
+  K_Data_Broadcast,
+  K_Data_Group,
+  K_Data_Tag_Group,
+  K_Data_Individual,
+  K_Data_Connected,
+  K_Connect,
+  K_Disconnect,
+  K_ACK,
+  K_NAK,
+};
+
+static constexpr uint8_t
+tpdu_kind (bool group, uint8_t tpci)
+{
+  return group ?
+         ((tpci & 0xFC) == 0x00 ? K_Data_Group : // or Broadcast, see below
+          (tpci & 0xFC) == 0x04 ? K_Data_Tag_Group :
+          K_Unknown) :
+         ((tpci & 0xFC) == 0x00 ? K_Data_Individual :
+          (tpci & 0xC0) == 0x40 ? K_Data_Connected :
+          tpci == 0x80 ? K_Connect :
+          tpci == 0x81 ? K_Disconnect :
+          (tpci & 0xC3) == 0xC2 ? K_ACK :
+          (tpci & 0xC3) == 0xC3 ? K_NAK :
+          K_Unknown);
+}
+
+#define TPCI_1(g,n) tpdu_kind (g, n)
+#define TPCI_4(g,n) TPCI_1 (g, n), TPCI_1 (g, n + 1), TPCI_1 (g, n + 2), TPCI_1 (g, n + 3)
+#define TPCI_16(g,n) TPCI_4 (g, n), TPCI_4 (g, n + 4), TPCI_4 (g, n + 8), TPCI_4 (g, n + 12)
+#define TPCI_64(g,n) TPCI_16 (g, n), TPCI_16 (g, n + 16), TPCI_16 (g, n + 32), TPCI_16 (g, n + 48)
+#define TPCI_256(g) TPCI_64 (g, 0), TPCI_64 (g, 64), TPCI_64 (g, 128), TPCI_64 (g, 192)
+
+/** [address type][TPCI] */
+static constexpr uint8_t tpci_kinds[2][256] =
+{
+  { TPCI_256 (false) },
+  { TPCI_256 (true) },
+};
+
+#undef TPCI_1
+#undef TPCI_4
+#undef TPCI_16
+#undef TPCI_64
+#undef TPCI_256
+
+/** construct a T in @where, or on the heap if that's nullptr */
+template<class T>
+static TPDU *
+make_tpdu (void *where)
+{
+  static_assert (sizeof (T) <= TPDUBuf::SIZE, "TPDUBuf is too small");
+  static_assert (alignof (T) <= alignof (std::max_align_t), "TPDUBuf is misaligned");
+  if (where)
+    return new (where) T ();
+  return new T ();
+}
+
+static TPDU *(* const tpdu_makers[]) (void *) =
+{
+  make_tpdu<T_Unknown_PDU>,
+  make_tpdu<T_Data_Broadcast_PDU>, // @todo T_Data_SystemBroadcast
+  make_tpdu<T_Data_Group_PDU>,
+  make_tpdu<T_Data_Tag_Group_PDU>,
+  make_tpdu<T_Data_Individual_PDU>,
+  make_tpdu<T_Data_Connected_PDU>,
+  make_tpdu<T_Connect_PDU>,
+  make_tpdu<T_Disconnect_PDU>,
+  make_tpdu<T_ACK_PDU>,
+  make_tpdu<T_NAK_PDU>,
+};
+
+static TPDU *
+make_tpdu (const EIB_AddrType address_type, const eibaddr_t destination_address, const CSpan & c, void *where, TracePtr tr)
 {
-  TPDUPtr t;
   if (c.size() >= 1)
     {
-      if (address_type == GroupAddress)
-        {
-          if ((c[0] & 0xFC) == 0x00)
-            {
-              if (destination_address == 0)
-                t = TPDUPtr(new T_Data_Broadcast_PDU ()); // @todo T_Data_SystemBroadcast
-              else
-                t = TPDUPtr(new T_Data_Group_PDU ());
-            }
-          else if ((c[0] & 0xFC) == 0x04)
-            t = TPDUPtr(new T_Data_Tag_Group_PDU ());
-        }
-      else
+      uint8_t kind = tpci_kinds[address_type == GroupAddress][c[0]];
+      if (kind == K_Data_Group && destination_address == 0)
+        kind = K_Data_Broadcast;
+      if (kind != K_Unknown)
         {
-          if ((c[0] & 0xFC) == 0x00)
-            t = TPDUPtr(new T_Data_Individual_PDU ());
-          else if ((c[0] & 0xC0) == 0x40)
-            t = TPDUPtr(new T_Data_Connected_PDU ());
-          else if (c[0] == 0x80)
-            t = TPDUPtr(new T_Connect_PDU ());
-          else if (c[0] == 0x81)
-            t = TPDUPtr(new T_Disconnect_PDU ());
-          else if ((c[0] & 0xC3) == 0xC2)
-            t = TPDUPtr(new T_ACK_PDU ());
-          else if ((c[0] & 0xC3) == 0xC3)
-            t = TPDUPtr(new T_NAK_PDU ());
+          TPDU *t = tpdu_makers[kind] (where);
+          if (t->init (c, tr))
+            return t;
+          if (where)
+            t->~TPDU ();
+          else
+            delete t;
         }
     }
-  if (t && t->init (c, tr))
-    return t;
-
-  t = TPDUPtr(new T_Unknown_PDU ());
+  TPDU *t = make_tpdu<T_Unknown_PDU> (where);
   t->init (c, tr);
   return t;
 }
 
+TPDUPtr
+TPDU::fromPacket (const EIB_AddrType address_type, const eibaddr_t destination_address, const CSpan & c, TracePtr tr)
+{
+  return TPDUPtr (make_tpdu (address_type, destination_address, c, nullptr, tr));
+}
+
+TPDU *
+TPDU::decode (const EIB_AddrType address_type, const eibaddr_t destination_address, const CSpan & c, TPDUBuf & buf, TracePtr tr)
+{
+  buf.reset ();
+  buf.tpdu = make_tpdu (address_type, destination_address, c, buf.mem, tr);
+  return buf.tpdu;
+}
+
+CArray
+TPDU::ToPacket () const
+{
+  CArray pdu;
+  ToPacket (pdu);
+  return pdu;
+}
+
+void
+TPDU::ToPacket (CArray & pdu) const
+{
+  PDUWriter w (pdu);
+  encode (w);
+}
+
+size_t
+TPDU::ToPacket (uint8_t *buf, size_t max) const
+{
+  PDUWriter w (buf, max);
+  encode (w);
+  return w.fits () ? w.size () : 0;
+}
 
 /* T_Unknown */
 
 bool
-T_Unknown_PDU::init (const CArray & c, TracePtr)
+T_Unknown_PDU::init (const CSpan & c, TracePtr)
 {
-  pdu = c;
+  pdu.set (c.data(), c.size());
   return true;
 }
 
-CArray T_Unknown_PDU::ToPacket () const
+void
+T_Unknown_PDU::encode (PDUWriter & w) const
 {
-  return pdu;
+  w.setpart (pdu.data(), 0, pdu.size());
 }
 
 std::string T_Unknown_PDU::Decode (TracePtr) const
@@ -94,27 +194,28 @@ std::string T_Unknown_PDU::Decode (TracePtr) const
 /* T_Data_Broadcast */
 
 bool
-T_Data_Broadcast_PDU::init (const CArray & c, TracePtr)
+T_Data_Broadcast_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 1)
     return false;
 
-  tsdu = c;
+  tsdu.set (c.data(), c.size());
   return true;
 }
 
-CArray T_Data_Broadcast_PDU::ToPacket () const
+void
+T_Data_Broadcast_PDU::encode (PDUWriter & pdu) const
 {
   assert (tsdu.size() > 0);
 
-  CArray pdu (tsdu);
+  pdu.setpart (tsdu.data(), 0, tsdu.size());
   pdu[0] = pdu[0] & 0x03;
-  return pdu;
 }
 
 std::string T_Data_Broadcast_PDU::Decode (TracePtr tr) const
 {
-  APDUPtr a = APDU::fromPacket (tsdu, tr);
+  APDUBuf abuf;
+  APDU *a = APDU::decode (tsdu, abuf, tr);
   std::string s ("T_Data_Broadcast ");
   s += a->Decode (tr);
   return s;
@@ -123,27 +224,28 @@ std::string T_Data_Broadcast_PDU::Decode (TracePtr tr) const
 /* T_Data_SystemBroadcast */
 
 bool
-T_Data_SystemBroadcast_PDU::init (const CArray & c, TracePtr)
+T_Data_SystemBroadcast_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 1)
     return false;
 
-  tsdu = c;
+  tsdu.set (c.data(), c.size());
   return true;
 }
 
-CArray T_Data_SystemBroadcast_PDU::ToPacket () const
+void
+T_Data_SystemBroadcast_PDU::encode (PDUWriter & pdu) const
 {
   assert (tsdu.size() > 0);
 
-  CArray pdu (tsdu);
+  pdu.setpart (tsdu.data(), 0, tsdu.size());
   pdu[0] = pdu[0] & 0x03;
-  return pdu;
 }
 
 std::string T_Data_SystemBroadcast_PDU::Decode (TracePtr tr) const
 {
-  APDUPtr a = APDU::fromPacket (tsdu, tr);
+  APDUBuf abuf;
+  APDU *a = APDU::decode (tsdu, abuf, tr);
   std::string s ("T_Data_SystemBroadcast ");
   s += a->Decode (tr);
   return s;
@@ -152,27 +254,28 @@ std::string T_Data_SystemBroadcast_PDU::Decode (TracePtr tr) const
 /* T_Data_Group */
 
 bool
-T_Data_Group_PDU::init (const CArray & c, TracePtr)
+T_Data_Group_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 1)
     return false;
 
-  tsdu = c;
+  tsdu.set (c.data(), c.size());
   return true;
 }
 
-CArray T_Data_Group_PDU::ToPacket () const
+void
+T_Data_Group_PDU::encode (PDUWriter & pdu) const
 {
   assert (tsdu.size() > 0);
 
-  CArray pdu (tsdu);
+  pdu.setpart (tsdu.data(), 0, tsdu.size());
   pdu[0] = pdu[0] & 0x03;
-  return pdu;
 }
 
 std::string T_Data_Group_PDU::Decode (TracePtr tr) const
 {
-  APDUPtr a = APDU::fromPacket (tsdu, tr);
+  APDUBuf abuf;
+  APDU *a = APDU::decode (tsdu, abuf, tr);
   std::string s ("T_Data_Group ");
   s += a->Decode (tr);
   return s;
@@ -181,27 +284,28 @@ std::string T_Data_Group_PDU::Decode (TracePtr tr) const
 /* T_Data_Tag_Group */
 
 bool
-T_Data_Tag_Group_PDU::init (const CArray & c, TracePtr)
+T_Data_Tag_Group_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 1)
     return false;
 
-  tsdu = c;
+  tsdu.set (c.data(), c.size());
   return true;
 }
 
-CArray T_Data_Tag_Group_PDU::ToPacket () const
+void
+T_Data_Tag_Group_PDU::encode (PDUWriter & pdu) const
 {
   assert (tsdu.size() > 0);
 
-  CArray pdu (tsdu);
-  pdu[0] = pdu[0] & 0x03;
-  return pdu;
+  pdu.setpart (tsdu.data(), 0, tsdu.size());
+  pdu[0] = (pdu[0] & 0x03) | 0x04;
 }
 
 std::string T_Data_Tag_Group_PDU::Decode (TracePtr tr) const
 {
-  APDUPtr a = APDU::fromPacket (tsdu, tr);
+  APDUBuf abuf;
+  APDU *a = APDU::decode (tsdu, abuf, tr);
   std::string s ("T_Data_Tag_Group ");
   s += a->Decode (tr);
   return s;
@@ -210,27 +314,28 @@ std::string T_Data_Tag_Group_PDU::Decode (TracePtr tr) const
 /* T_Data_Individual */
 
 bool
-T_Data_Individual_PDU::init (const CArray & c, TracePtr)
+T_Data_Individual_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 1)
     return false;
 
-  tsdu = c;
+  tsdu.set (c.data(), c.size());
   return true;
 }
 
-CArray T_Data_Individual_PDU::ToPacket () const
+void
+T_Data_Individual_PDU::encode (PDUWriter & pdu) const
 {
   assert (tsdu.size() > 0);
 
-  CArray pdu (tsdu);
+  pdu.setpart (tsdu.data(), 0, tsdu.size());
   pdu[0] = pdu[0] & 0x03;
-  return pdu;
 }
 
 std::string T_Data_Individual_PDU::Decode (TracePtr tr) const
 {
-  APDUPtr a = APDU::fromPacket (tsdu, tr);
+  APDUBuf abuf;
+  APDU *a = APDU::decode (tsdu, abuf, tr);
   std::string s ("T_Data_Individual ");
   s += a->Decode (tr);
   return s;
@@ -239,31 +344,32 @@ std::string T_Data_Individual_PDU::Decode (TracePtr tr) const
 /* T_Data_Connected */
 
 bool
-T_Data_Connected_PDU::init (const CArray & c, TracePtr)
+T_Data_Connected_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() < 1)
     return false;
 
-  tsdu = c;
+  tsdu.set (c.data(), c.size());
   sequence_number = (c[0] >> 2) & 0x0f;
   return true;
 }
 
-CArray T_Data_Connected_PDU::ToPacket () const
+void
+T_Data_Connected_PDU::encode (PDUWriter & pdu) const
 {
   assert (tsdu.size() > 0);
   assert ((sequence_number & 0xf0) == 0);
 
-  CArray pdu (tsdu);
+  pdu.setpart (tsdu.data(), 0, tsdu.size());
   pdu[0] = 0x40 | ((sequence_number & 0x0f) << 2) | (pdu[0] & 0x03);
-  return pdu;
 }
 
 std::string T_Data_Connected_PDU::Decode (TracePtr tr) const
 {
   assert ((sequence_number & 0xf0) == 0);
 
-  APDUPtr a = APDU::fromPacket (tsdu, tr);
+  APDUBuf abuf;
+  APDU *a = APDU::decode (tsdu, abuf, tr);
   std::string s ("T_Data_Connected serno:");
   addHex (s, sequence_number);
   s += a->Decode (tr);
@@ -273,19 +379,18 @@ std::string T_Data_Connected_PDU::Decode (TracePtr tr) const
 /* T_Connect */
 
 bool
-T_Connect_PDU::init (const CArray & c, TracePtr)
+T_Connect_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 1)
     return false;
   return true;
 }
 
-CArray T_Connect_PDU::ToPacket () const
+void
+T_Connect_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(1);
   pdu[0] = 0x80;
-  return pdu;
 }
 
 std::string T_Connect_PDU::Decode (TracePtr) const
@@ -296,19 +401,18 @@ std::string T_Connect_PDU::Decode (TracePtr) const
 /* T_Disconnect */
 
 bool
-T_Disconnect_PDU::init (const CArray & c, TracePtr)
+T_Disconnect_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 1)
     return false;
   return true;
 }
 
-CArray T_Disconnect_PDU::ToPacket () const
+void
+T_Disconnect_PDU::encode (PDUWriter & pdu) const
 {
-  CArray pdu;
   pdu.resize(1);
   pdu[0] = 0x81;
-  return pdu;
 }
 
 std::string T_Disconnect_PDU::Decode (TracePtr) const
@@ -319,7 +423,7 @@ std::string T_Disconnect_PDU::Decode (TracePtr) const
 /* T_ACK */
 
 bool
-T_ACK_PDU::init (const CArray & c, TracePtr)
+T_ACK_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 1)
     return false;
@@ -328,14 +432,13 @@ T_ACK_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray T_ACK_PDU::ToPacket () const
+void
+T_ACK_PDU::encode (PDUWriter & pdu) const
 {
   assert ((sequence_number & 0xf0) == 0);
 
-  CArray pdu;
   pdu.resize(1);
   pdu[0] = 0xC2 | ((sequence_number & 0x0f) << 2);
-  return pdu;
 }
 
 std::string T_ACK_PDU::Decode (TracePtr) const
@@ -349,7 +452,7 @@ std::string T_ACK_PDU::Decode (TracePtr) const
 
 /* T_NAK  */
 
-bool T_NAK_PDU::init (const CArray & c, TracePtr)
+bool T_NAK_PDU::init (const CSpan & c, TracePtr)
 {
   if (c.size() != 1)
     return false;
@@ -358,14 +461,13 @@ bool T_NAK_PDU::init (const CArray & c, TracePtr)
   return true;
 }
 
-CArray T_NAK_PDU::ToPacket () const
+void
+T_NAK_PDU::encode (PDUWriter & pdu) const
 {
   assert ((sequence_number & 0xf0) == 0);
 
-  CArray pdu;
   pdu.resize(1);
   pdu[0] = 0xC3 | ((sequence_number & 0x0f) << 2);
-  return pdu;
 }
 
 std::string T_NAK_PDU::Decode (TracePtr) const
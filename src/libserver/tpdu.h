@@ -27,8 +27,10 @@
 #ifndef TPDU_H
 #define TPDU_H
 
+#include <cstddef>
 #include <memory>
 
+#include "apdu.h"
 #include "npdu.h"
 
 /** enumaration of TPDU types */
@@ -60,6 +62,7 @@ enum TPDU_Type
 
 class TPDU;
 using TPDUPtr = std::unique_ptr<TPDU>;
+class TPDUBuf;
 
 /** represents a TPDU */
 class TPDU
@@ -67,15 +70,64 @@ class TPDU
 public:
   virtual ~TPDU () = default;
 
-  virtual bool init (const CArray & c, TracePtr tr) = 0;
+  virtual bool init (const CSpan & c, TracePtr tr) = 0;
+  /** encode into @pdu */
+  virtual void encode (PDUWriter & pdu) const = 0;
   /** convert to character array */
-  virtual CArray ToPacket () const = 0;
+  CArray ToPacket () const;
+  /** encode into @pdu, e.g. an L_Data PDU's LSDU, re-using its storage */
+  void ToPacket (CArray & pdu) const;
+  /**
+   * Encode into @buf.
+   * @return the TPDU's length; 0 if it doesn't fit into @max octets
+   */
+  size_t ToPacket (uint8_t *buf, size_t max) const;
   /** decode content as string */
   virtual std::string Decode (TracePtr tr) const = 0;
   /** gets TPDU type */
   virtual TPDU_Type getType () const = 0;
   /** converts character array to a TPDU */
-  static TPDUPtr fromPacket (const EIB_AddrType address_type, const eibaddr_t destination_address, const CArray & c, TracePtr tr);
+  static TPDUPtr fromPacket (const EIB_AddrType address_type, const eibaddr_t destination_address, const CSpan & c, TracePtr tr);
+  /**
+   * Like fromPacket, but the TPDU is constructed in @buf instead of being
+   * allocated. It lives until @buf is re-used or goes out of scope.
+   */
+  static TPDU *decode (const EIB_AddrType address_type, const eibaddr_t destination_address, const CSpan & c, TPDUBuf &buf, TracePtr tr);
+};
+
+/**
+ * Room for any TPDU, so that one can be decoded on the stack. As with
+ * APDUBuf, the TSDU is still copied into a CArray.
+ */
+class TPDUBuf
+{
+public:
+  TPDUBuf () = default;
+  TPDUBuf (const TPDUBuf &) = delete;
+  TPDUBuf &operator= (const TPDUBuf &) = delete;
+  ~TPDUBuf ()
+  {
+    reset ();
+  }
+
+  TPDU *get () const
+  {
+    return tpdu;
+  }
+  void reset ()
+  {
+    if (tpdu)
+      tpdu->~TPDU ();
+    tpdu = nullptr;
+  }
+
+  /** large enough for every TPDU class; checked in tpdu.cpp */
+  static const size_t SIZE = 48;
+
+private:
+  friend class TPDU;
+  alignas (alignof (std::max_align_t)) unsigned char mem[SIZE];
+  TPDU *tpdu = nullptr;
 };
 
 class T_Unknown_PDU:public TPDU
@@ -84,8 +136,8 @@ public:
   CArray pdu;
 
   T_Unknown_PDU () = default;
-  virtual bool init (const CArray & c, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & c, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual TPDU_Type getType () const override
   {
@@ -100,8 +152,14 @@ public:
   CArray tsdu;
 
   T_Data_Broadcast_PDU () = default;
-  virtual bool init (const CArray & c, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & c, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
+  using TPDU::ToPacket;
+  /** encode with @apdu as TSDU, instead of tsdu, directly into @pdu */
+  void ToPacket (const APDU & apdu, CArray & pdu) const
+  {
+    apdu.ToPacket (pdu, 0x00);
+  }
   virtual std::string Decode (TracePtr tr) const override;
   virtual TPDU_Type getType () const override
   {
@@ -116,8 +174,14 @@ public:
   CArray tsdu;
 
   T_Data_SystemBroadcast_PDU () = default;
-  virtual bool init (const CArray & c, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & c, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
+  using TPDU::ToPacket;
+  /** encode with @apdu as TSDU, instead of tsdu, directly into @pdu */
+  void ToPacket (const APDU & apdu, CArray & pdu) const
+  {
+    apdu.ToPacket (pdu, 0x00);
+  }
   virtual std::string Decode (TracePtr tr) const override;
   virtual TPDU_Type getType () const override
   {
@@ -132,8 +196,14 @@ public:
   CArray tsdu;
 
   T_Data_Group_PDU () = default;
-  virtual bool init (const CArray & c, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & c, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
+  using TPDU::ToPacket;
+  /** encode with @apdu as TSDU, instead of tsdu, directly into @pdu */
+  void ToPacket (const APDU & apdu, CArray & pdu) const
+  {
+    apdu.ToPacket (pdu, 0x00);
+  }
   virtual std::string Decode (TracePtr tr) const override;
   virtual TPDU_Type getType () const override
   {
@@ -148,8 +218,14 @@ public:
   CArray tsdu;
 
   T_Data_Tag_Group_PDU () = default;
-  virtual bool init (const CArray & c, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & c, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
+  using TPDU::ToPacket;
+  /** encode with @apdu as TSDU, instead of tsdu, directly into @pdu */
+  void ToPacket (const APDU & apdu, CArray & pdu) const
+  {
+    apdu.ToPacket (pdu, 0x04);
+  }
   virtual std::string Decode (TracePtr tr) const override;
   virtual TPDU_Type getType () const override
   {
@@ -164,8 +240,14 @@ public:
   CArray tsdu;
 
   T_Data_Individual_PDU () = default;
-  virtual bool init (const CArray & c, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & c, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
+  using TPDU::ToPacket;
+  /** encode with @apdu as TSDU, instead of tsdu, directly into @pdu */
+  void ToPacket (const APDU & apdu, CArray & pdu) const
+  {
+    apdu.ToPacket (pdu, 0x00);
+  }
   virtual std::string Decode (TracePtr tr) const override;
   virtual TPDU_Type getType () const override
   {
@@ -181,8 +263,14 @@ public:
   CArray tsdu;
 
   T_Data_Connected_PDU () = default;
-  virtual bool init (const CArray & c, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & c, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
+  using TPDU::ToPacket;
+  /** encode with @apdu as TSDU, instead of tsdu, directly into @pdu */
+  void ToPacket (const APDU & apdu, CArray & pdu) const
+  {
+    apdu.ToPacket (pdu, 0x40 | ((sequence_number & 0x0f) << 2));
+  }
   virtual std::string Decode (TracePtr tr) const override;
   virtual TPDU_Type getType () const override
   {
@@ -195,8 +283,8 @@ class T_Connect_PDU:public TPDU
 {
 public:
   T_Connect_PDU () = default;
-  virtual bool init (const CArray & c, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & c, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual TPDU_Type getType () const override
   {
@@ -210,8 +298,8 @@ class T_Disconnect_PDU:public TPDU
 public:
 
   T_Disconnect_PDU () = default;
-  virtual bool init (const CArray & c, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & c, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual TPDU_Type getType () const override
   {
@@ -226,8 +314,8 @@ public:
   uint8_t sequence_number = 0;
 
   T_ACK_PDU () = default;
-  virtual bool init (const CArray & c, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & c, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual TPDU_Type getType () const override
   {
@@ -242,8 +330,8 @@ public:
   uint8_t sequence_number = 0;
 
   T_NAK_PDU () = default;
-  virtual bool init (const CArray & c, TracePtr tr) override;
-  virtual CArray ToPacket () const override;
+  virtual bool init (const CSpan & c, TracePtr tr) override;
+  virtual void encode (PDUWriter & pdu) const override;
   virtual std::string Decode (TracePtr tr) const override;
   virtual TPDU_Type getType () const override
   {
@@ -28,6 +28,9 @@
 
 #include "usb.h"
 
+void usb_complete_send (struct libusb_transfer *transfer);
+void usb_complete_recv (struct libusb_transfer *transfer);
+
 USBEndpoint
 parseUSBEndpoint (IniSectionPtr s)
 {
@@ -155,10 +158,10 @@ USBLowLevelDriver::USBLowLevelDriver (LowLevelIface* p, IniSectionPtr& s) : LowL
 {
   t->setAuxName("usbL");
   send_timeout = cfg->value("send-timeout", 1000);
-  read_trigger.set<USBLowLevelDriver,&USBLowLevelDriver::read_trigger_cb>(this);
-  write_trigger.set<USBLowLevelDriver,&USBLowLevelDriver::write_trigger_cb>(this);
-  read_trigger.start();
-  write_trigger.start();
+  recv_transfers = cfg->value("recv-transfers", 4);
+  error_trigger.set<USBLowLevelDriver,&USBLowLevelDriver::error_trigger_cb>(this);
+  loop = nullptr;
+  d.dev = nullptr;
   reset();
 }
 
@@ -181,13 +184,25 @@ USBLowLevelDriver::start()
       ERRORPRINTF (t, E_FATAL | 107, "USBLowLevelDriver: setup not called");
       goto ex;
     }
+  if (d.dev == nullptr)
+    {
+      /* restarting: the device may have been re-plugged */
+      d = detectUSBEndpoint (loop->context, parseUSBEndpoint (cfg));
+      if (d.dev == nullptr)
+        {
+          ERRORPRINTF (t, E_ERROR | 183, "USBLowLevelDriver: device not found");
+          goto ex;
+        }
+    }
 
-  if ((res = libusb_open (d.dev, &dev))< 0)
+  res = libusb_open (d.dev, &dev);
+  libusb_unref_device (d.dev);
+  d.dev = nullptr;
+  if (res < 0)
     {
       ERRORPRINTF (t, E_ERROR | 28, "USBLowLevelDriver: init libusb: %s", libusb_error_name(res));
       goto ex;
     }
-  libusb_unref_device (d.dev);
   state = sStarted;
   TRACEPRINTF (t, 1, "Open");
   libusb_detach_kernel_driver (dev, d.interface);
@@ -211,13 +226,28 @@ USBLowLevelDriver::start()
 
   TRACEPRINTF (t, 1, "Opened");
 
-  recvh = libusb_alloc_transfer (0);
-  if (!recvh)
+  sendh = libusb_alloc_transfer (0);
+  if (!sendh)
     {
-      ERRORPRINTF (t, E_ERROR | 34, "Error AllocRecv: %s", strerror(errno));
+      ERRORPRINTF (t, E_ERROR | 102, "Error AllocSend: %s", strerror(errno));
       goto ex;
     }
-  StartUsbRecvTransfer();
+  recvbuf.assign (recv_transfers * 64, 0);
+  for (unsigned int i = 0; i < recv_transfers; i++)
+    {
+      struct libusb_transfer *x = libusb_alloc_transfer (0);
+      if (!x)
+        {
+          ERRORPRINTF (t, E_ERROR | 34, "Error AllocRecv: %s", strerror(errno));
+          goto ex;
+        }
+      libusb_fill_interrupt_transfer (x, dev, d.recvep, &recvbuf[i * 64], 64,
+                                      usb_complete_recv, this, 0);
+      recvh.push_back (x);
+    }
+  for (struct libusb_transfer *x : recvh)
+    if (!StartUsbRecvTransfer(x))
+      goto ex;
   state = sRunning;
   started();
   return;
@@ -229,36 +259,47 @@ void
 USBLowLevelDriver::abort_send()
 {
   int res;
-  if (sendh == nullptr)
+  if (!sending)
     return;
 
   if ((res = libusb_cancel_transfer (sendh)) < 0)
     {
       ERRORPRINTF (t, E_ERROR | 99, "cancel %lx: %s", (unsigned long) sendh, libusb_error_name(res));
-      sendh = nullptr; // XXX does this make sense?
+      sending = false; // XXX does this make sense?
       out.clear();
       return;
     }
-  while (sendh)
+  while (sending)
     ev_run(EV_DEFAULT_ EVRUN_ONCE);
 }
 
+void
+USBLowLevelDriver::free_transfers()
+{
+  for (struct libusb_transfer *x : recvh)
+    libusb_free_transfer (x);
+  recvh.clear();
+  if (sendh)
+    libusb_free_transfer (sendh);
+  sendh = nullptr;
+}
+
 void
 USBLowLevelDriver::stop_()
 {
   TRACEPRINTF (t, 1, "Close");
   stopping = true;
+  error_trigger.stop();
 
   if (state > sClaimed)
     state = sClaimed;
-  if (sendh)
+  if (sending)
     libusb_cancel_transfer (sendh);
-  if (recvh)
-    libusb_cancel_transfer (recvh);
-  if (state > sClaimed)
-    state = sClaimed;
-  while (sendh || recvh)
+  for (struct libusb_transfer *x : recvh)
+    libusb_cancel_transfer (x);
+  while (sending || recv_pending)
     ev_run(EV_DEFAULT_ EVRUN_ONCE);
+  free_transfers();
 
   TRACEPRINTF (t, 1, "Release");
   if (state > sStarted)
@@ -268,8 +309,6 @@ USBLowLevelDriver::stop_()
     }
   if (state > sNone)
     libusb_close (dev);
-  delete loop;
-  loop = nullptr;
   reset();
 }
 
@@ -283,17 +322,34 @@ USBLowLevelDriver::stop()
 USBLowLevelDriver::~USBLowLevelDriver ()
 {
   stop();
-  read_trigger.stop();
-  write_trigger.stop();
+  error_trigger.stop();
+  if (d.dev)
+    libusb_unref_device (d.dev);
+  delete loop;
+}
+
+void
+USBLowLevelDriver::error_later()
+{
+  error_trigger.start(0, 0);
+}
+
+/* Not all filters above us pass stop() down, so release the device
+ * here; otherwise a restart would find it still "running". */
+void
+USBLowLevelDriver::error_trigger_cb(ev::timer &, int)
+{
+  stop_();
+  errored();
 }
 
 void
 USBLowLevelDriver::send_Data (CArray& l)
 {
-  if (sendh != nullptr)
+  if (sending)
     {
       ERRORPRINTF (t, E_FATAL | 108, "Send while buffer not empty");
-      errored(); // XXX signal async
+      error_later();
       return;
     }
   out = l;
@@ -311,40 +367,26 @@ usb_complete_send (struct libusb_transfer *transfer)
 void
 USBLowLevelDriver::CompleteSend(struct libusb_transfer *transfer)
 {
-  if (transfer != sendh)
-    ERRORPRINTF (t, E_WARNING | 121, "SendComp %lx %lx",(unsigned long)transfer,(unsigned long)sendh);
   assert(transfer == sendh);
+  sending = false;
 
-  TRACEPRINTF (t, 10, "SendCB %lx", (unsigned long) sendh);
-  write_trigger.send();
-}
-
-void
-USBLowLevelDriver::write_trigger_cb(ev::async &, int)
-{
   TRACEPRINTF (t, 10, "SendComplete %lx %d", (unsigned long)sendh, sendh->actual_length);
-  if (sendh == nullptr)
+  if (stopping || sendh->status == LIBUSB_TRANSFER_CANCELLED)
     return;
   if (sendh->status == LIBUSB_TRANSFER_COMPLETED)
     {
-      libusb_free_transfer (sendh);
       send_retry = 0;
-      sendh = nullptr;
       send_Next();
       return;
     }
   if (sendh->status == LIBUSB_TRANSFER_TIMED_OUT && ++send_retry < 3)
     {
       ERRORPRINTF (t, E_WARNING | 122, "SendError %lx timeout, retrying", (unsigned long)sendh);
-      libusb_free_transfer (sendh);
-      sendh = nullptr;
       do_send();
       return;
     }
   ERRORPRINTF (t, E_ERROR | 35, "SendError %lx status %d", (unsigned long)sendh, sendh->status);
-  sendh = nullptr;
-  errored(); // TODO probably needs to be an async error
-  return;
+  error_later();
 }
 
 void
@@ -365,70 +407,54 @@ usb_complete_recv (struct libusb_transfer *transfer)
 void
 USBLowLevelDriver::CompleteReceive(struct libusb_transfer *transfer)
 {
-  assert (transfer == recvh);
-  TRACEPRINTF (t, 10, "RecvCB %lx", (unsigned long) recvh);
-  read_trigger.send();
-}
-
-void
-USBLowLevelDriver::read_trigger_cb(ev::async &, int)
-{
-  TRACEPRINTF (t, 10, "RecvComplete %lx %d", (unsigned long) recvh, recvh->actual_length);
-  if (recvh == nullptr)
+  recv_pending--;
+  TRACEPRINTF (t, 10, "RecvComplete %lx %d", (unsigned long) transfer, transfer->actual_length);
+  if (stopping || transfer->status == LIBUSB_TRANSFER_CANCELLED)
     return;
 
-  if (recvh->status != LIBUSB_TRANSFER_COMPLETED)
+  if (transfer->status != LIBUSB_TRANSFER_COMPLETED)
     {
-      ERRORPRINTF (t, E_WARNING | 123, "RecvError %d", recvh->status);
-      recvh = nullptr;
-      errored();
+      ERRORPRINTF (t, E_WARNING | 123, "RecvError %d", transfer->status);
+      error_later();
       return;
     }
-  else
-    HandleReceiveUsb();
+  HandleReceiveUsb(transfer->buffer);
 
-  if (state > sNone && !stopping)
-    StartUsbRecvTransfer();
-  else
-    {
-      libusb_free_transfer (recvh);
-      recvh = nullptr;
-    }
+  if (state > sNone && !stopping && !StartUsbRecvTransfer(transfer))
+    error_later();
 }
 
 
-void
-USBLowLevelDriver::StartUsbRecvTransfer()
+bool
+USBLowLevelDriver::StartUsbRecvTransfer(struct libusb_transfer *x)
 {
-  libusb_fill_interrupt_transfer (recvh, dev, d.recvep, recvbuf,
-                                  sizeof (recvbuf), usb_complete_recv,
-                                  this, 0);
-  int res = libusb_submit_transfer (recvh);
+  int res = libusb_submit_transfer (x);
   if (res)
     {
       ERRORPRINTF (t, E_ERROR | 100, "Error StartRecv: %s", libusb_error_name(res));
-      errored();
-      return;
+      return false;
     }
-  TRACEPRINTF (t, 10, "StartRecv");
+  recv_pending++;
+  TRACEPRINTF (t, 10, "StartRecv %lx", (unsigned long) x);
+  return true;
 }
 
-inline bool is_connection_state(uint8_t *recvbuf)
+inline bool is_connection_state(const uint8_t *recvbuf)
 {
   uint8_t wanted[] = { 0x01,0x13,0x0A,0x00,0x08,0x00,0x02,0x0F,0x04,0x00,0x00,0x03 };
   return !memcmp(recvbuf, wanted, sizeof(wanted));
 }
 
-bool get_connection_state(uint8_t *recvbuf)
+bool get_connection_state(const uint8_t *recvbuf)
 {
   return recvbuf[12] & 0x1;
 }
 
 void
-USBLowLevelDriver::HandleReceiveUsb()
+USBLowLevelDriver::HandleReceiveUsb(const uint8_t *recvbuf)
 {
   CArray res;
-  res.set (recvbuf, sizeof (recvbuf));
+  res.set (recvbuf, 64);
   t->TracePacket (0, "RecvUSB", res);
   master->recv_Data (res);
 
@@ -453,7 +479,7 @@ USBLowLevelDriver::HandleReceiveUsb()
         {
           state = sRunning;
           ERRORPRINTF(t, E_ERROR | 101, "No connection");
-          stop(); // XXX TODO signal async error instead
+          error_later();
         }
     }
 }
@@ -461,19 +487,13 @@ USBLowLevelDriver::HandleReceiveUsb()
 void
 USBLowLevelDriver::do_send()
 {
-  if (sendh || state < sClaimed || !out.size())
+  if (sending || !sendh || state < sClaimed || !out.size())
     return;
 
   t->TracePacket (0, "SendUSB", out);
   memset (sendbuf, 0, sizeof (sendbuf));
   memcpy (sendbuf, out.data(),
           (out.size() > sizeof (sendbuf) ? sizeof (sendbuf) : out.size()));
-  sendh = libusb_alloc_transfer (0);
-  if (!sendh)
-    {
-      ERRORPRINTF (t, E_ERROR | 102, "Error AllocSend: %s", strerror(errno));
-      return;
-    }
   libusb_fill_interrupt_transfer (sendh, dev, d.sendep, sendbuf,
                                   sizeof (sendbuf), usb_complete_send,
                                   this, send_timeout);
@@ -483,13 +503,24 @@ USBLowLevelDriver::do_send()
       ERRORPRINTF (t, E_ERROR | 37, "Error StartSend: %s", libusb_error_name(res));
       return;
     }
+  sending = true;
+  loop->timer();
   TRACEPRINTF (t, 0, "StartSend %lx", (unsigned long)sendh);
 }
 
 bool
 USBLowLevelDriver::setup()
 {
-  loop = new USBLoop (t);
+  if (recv_transfers < 1 || recv_transfers > 32)
+    {
+      ERRORPRINTF (t, E_ERROR | 169, "recv-transfers must be between 1 and 32");
+      return false;
+    }
+  /* filters above us may call this more than once */
+  if (loop == nullptr)
+    loop = new USBLoop (t);
+  if (d.dev)
+    return true;
 
   if (!loop->context)
     {
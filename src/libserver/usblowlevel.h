@@ -26,6 +26,7 @@
 #ifndef EIB_USB_H
 #define EIB_USB_H
 
+#include <vector>
 #include <libusb.h>
 
 #include "lowlevel.h"
@@ -93,24 +94,32 @@ private:
   UState state = sNone;
   bool stopping = false;
   uint8_t sendbuf[64];
-  uint8_t recvbuf[64];
-  bool startUsbRecvTransferFailed = false;
+
+  /** Receive transfers. Several are queued so that the next HID report
+   * can arrive while the previous one is being processed. */
+  std::vector<struct libusb_transfer *> recvh;
+  std::vector<uint8_t> recvbuf;
+  unsigned int recv_transfers = 4;
+  /** submitted receive transfers */
+  unsigned int recv_pending = 0;
 
   struct libusb_transfer *sendh = 0;
-  struct libusb_transfer *recvh = 0;
+  /** sendh is submitted */
+  bool sending = false;
 
-  void StartUsbRecvTransfer();
-  void HandleReceiveUsb();
+  bool StartUsbRecvTransfer(struct libusb_transfer *recvh);
+  void HandleReceiveUsb(const uint8_t *buf);
   virtual void reset();
   void do_send();
   void do_send_Next();
   void stop_();
+  void free_transfers();
 
-  // need to do the trigger callbacks outside of libusb
-  ev::async read_trigger;
-  void read_trigger_cb(ev::async &w, int revents);
-  ev::async write_trigger;
-  void write_trigger_cb(ev::async &w, int revents);
+  /* Transfer callbacks run within libusb's event handling. Errors are
+   * reported from the main loop, as they may tear the driver down. */
+  ev::timer error_trigger;
+  void error_trigger_cb(ev::timer &w, int revents);
+  void error_later();
 };
 
 #endif
@@ -0,0 +1,163 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Loopback throughput of EIBNetIPSocket: one socket sends routing
+ * indications to another, keeping a window of datagrams in flight, and
+ * the received datagram rate is reported for a batch size of 1 (one
+ * system call per datagram) and for the requested batch size.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "eibnetip.h"
+
+/** aborts program with a printf like message */
+void
+die (const char *msg, ...)
+{
+  va_list ap;
+  va_start (ap, msg);
+  vprintf (msg, ap);
+  printf ("\n");
+  va_end (ap);
+
+  exit (1);
+}
+
+static EIBNetIPSocket *tx;
+static unsigned count = 200000;
+static unsigned window = 256;
+static unsigned sent, received, lost;
+static ev_tstamp last;
+
+static void
+fill ()
+{
+  EIBNetIPPacket p;
+  p.service = ROUTING_INDICATION;
+  /* cEMI L_Data.ind, 1.1.1 -> 1/2/3, GroupValue_Write 1 */
+  static const uint8_t cemi[] = { 0x29, 0x00, 0xbc, 0xe0, 0x11, 0x01, 0x0a, 0x03, 0x01, 0x00, 0x81 };
+  p.data.set (cemi, sizeof (cemi));
+
+  while (sent < count && sent - received - lost < window)
+    {
+      tx->Send (p);
+      sent++;
+    }
+}
+
+static void
+recv_me (EIBNetIPPacket *p)
+{
+  delete p;
+  received++;
+  last = ev_now (EV_DEFAULT);
+  if (received + lost >= count)
+    ev_break (EV_DEFAULT_ EVBREAK_ALL);
+  else if (sent - received - lost < window / 2)
+    fill ();
+}
+
+static void
+idle_me (EV_P_ ev_timer *w, int)
+{
+  /* whatever is still in flight after a quiet period got lost */
+  if (ev_now (EV_DEFAULT) - last < 0.1)
+    return;
+  lost = sent - received;
+  if (sent >= count)
+    ev_break (EV_DEFAULT_ EVBREAK_ALL);
+  else
+    fill ();
+}
+
+static void
+run (unsigned batch, TracePtr t)
+{
+  struct sockaddr_in a;
+  memset (&a, 0, sizeof (a));
+  a.sin_family = AF_INET;
+  a.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+
+  EIBNetIPSocket *rx = new EIBNetIPSocket (a, 0, t);
+  tx = new EIBNetIPSocket (a, 0, t);
+  rx->set_batch (batch, batch);
+  tx->set_batch (batch, batch);
+  if (!rx->init () || !tx->init ())
+    die ("socket initialisation failed");
+  rx->recvall = 1;
+  rx->on_recv.set<recv_me>();
+  tx->sendaddr = a;
+  tx->sendaddr.sin_port = rx->port ();
+
+  ev_timer idle;
+  ev_timer_init (&idle, idle_me, 0.1, 0.1);
+  ev_timer_start (EV_DEFAULT_ &idle);
+
+  sent = received = lost = 0;
+  ev_now_update (EV_DEFAULT);
+  ev_tstamp start = ev_time ();
+  last = ev_now (EV_DEFAULT);
+  fill ();
+  ev_run (EV_DEFAULT_ 0);
+  ev_tstamp end = ev_time ();
+  ev_timer_stop (EV_DEFAULT_ &idle);
+
+  printf ("batch %3u: %u datagrams in %.3f s, %.0f/s, %u lost\n",
+          batch, received, end - start, received / (end - start), lost);
+  delete tx;
+  delete rx;
+}
+
+int
+main (int ac, char *ag[])
+{
+  unsigned batch = 16;
+  int c;
+
+  while ((c = getopt (ac, ag, "n:b:w:")) != -1)
+    switch (c)
+      {
+      case 'n':
+        count = atoi (optarg);
+        break;
+      case 'b':
+        batch = atoi (optarg);
+        break;
+      case 'w':
+        window = atoi (optarg);
+        break;
+      default:
+        die ("usage: %s [-n count] [-b batch] [-w window]", ag[0]);
+      }
+  if (!count || !batch || !window)
+    die ("count, batch and window must be positive");
+
+  IniData ini;
+  TracePtr t = TracePtr(new Trace(ini["main"], "eibnetbench"));
+
+  run (1, t);
+  run (batch, t);
+  return 0;
+}
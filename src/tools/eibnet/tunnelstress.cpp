@@ -0,0 +1,410 @@
+/*
+    EIBD eib bus access and management daemon
+    Copyright (C) 2005-2011 Martin Koegler <mkoegler@auto.tuwien.ac.at>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Tunnel stress test for knxd's ets_router server.
+ *
+ * Opens up to 255 tunnels, then has every tunnel send group writes while
+ * acknowledging everything knxd sends back (confirmations, and every
+ * other tunnel's telegrams). Reports throughput and the latency from
+ * sending an L_Data.req to receiving its L_Data.con.
+ *
+ * Over UDP, all tunnels share one socket and a tunnel sends its next
+ * request when the previous one has been ACKed. With -t, each tunnel
+ * gets its own TCP connection (the server needs "tcp=true"); there are
+ * no ACKs, so up to -w requests per tunnel are unconfirmed at any time.
+ * Running both against a local knxd compares the two transports.
+ *
+ * knxd needs enough client addresses, e.g. "client-addrs=1.2.1:255".
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "eibnetip.h"
+
+/** aborts program with a printf like message */
+void
+die (const char *msg, ...)
+{
+  va_list ap;
+  va_start (ap, msg);
+  vprintf (msg, ap);
+  printf ("\n");
+  va_end (ap);
+
+  exit (1);
+}
+
+struct Tunnel
+{
+  bool open = false;
+  uint8_t sno = 0;
+  /** UDP: waiting for the ACK of request sno */
+  bool unacked = false;
+  unsigned sent = 0;
+  unsigned confirmed = 0;
+  /** send times of unconfirmed requests */
+  std::deque<ev_tstamp> t_sent;
+  EIBNetIPStream *stream = nullptr;
+};
+
+/** one TCP connection, before we know its channel */
+struct Conn
+{
+  EIBNetIPStream *stream;
+  void recv_cb (EIBNetIPPacket *p);
+  void error_cb ();
+};
+
+static bool tcp = false;
+static EIBNetIPSocket *sock;
+static std::vector<Conn *> conns;
+static struct sockaddr_in server;
+static struct sockaddr_in local;
+static Tunnel tunnels[256];
+static unsigned want = 255, count = 100, window = 1;
+static unsigned n_open, n_answered, n_pending, n_ind, n_retry, n_conf;
+static ev_tstamp start, load_start;
+static std::vector<double> lat;
+static ev_tstamp last;
+static enum { CONNECTING, RUNNING, CLOSING } phase;
+static TracePtr t;
+
+static void
+send_pkt (uint8_t ch, EIBNetIPPacket p)
+{
+  if (tcp)
+    tunnels[ch].stream->Send (p);
+  else
+    sock->Send (p, server);
+}
+
+static void
+send_req (uint8_t ch, bool repeat = false)
+{
+  /* cEMI L_Data.req, source filled in by knxd -> 1/2/3, GroupValue_Write 1 */
+  static const uint8_t cemi[] = { 0x11, 0x00, 0xbc, 0xe0, 0x00, 0x00, 0x0a, 0x03, 0x01, 0x00, 0x81 };
+  Tunnel &tn = tunnels[ch];
+  EIBnet_TunnelRequest r;
+  r.channel = ch;
+  r.seqno = tn.sno;
+  r.CEMI.set (cemi, sizeof (cemi));
+  if (!repeat)
+    {
+      tn.t_sent.push_back (ev_time ());
+      tn.sent++;
+    }
+  send_pkt (ch, r.ToPacket ());
+  if (tcp)
+    tn.sno++;
+  else
+    tn.unacked = true;
+}
+
+/** send as much as the transport allows */
+static void
+fill (uint8_t ch)
+{
+  Tunnel &tn = tunnels[ch];
+  while (!tn.unacked && tn.sent < count && tn.sent - tn.confirmed < window)
+    send_req (ch);
+}
+
+static void
+disconnect_all ()
+{
+  phase = CLOSING;
+  for (unsigned ch = 1; ch < 256; ch++)
+    if (tunnels[ch].open)
+      {
+        EIBnet_DisconnectRequest r;
+        r.caddr = local;
+        r.tcp = tcp;
+        r.channel = ch;
+        send_pkt (ch, r.ToPacket ());
+      }
+}
+
+static void
+start_load ()
+{
+  phase = RUNNING;
+  load_start = ev_time ();
+  for (unsigned ch = 1; ch < 256; ch++)
+    if (tunnels[ch].open)
+      {
+        n_pending++;
+        fill (ch);
+      }
+}
+
+static void
+recv_me (EIBNetIPPacket *p, EIBNetIPStream *from)
+{
+  last = ev_now (EV_DEFAULT);
+  if (p->service == CONNECTION_RESPONSE)
+    {
+      EIBnet_ConnectResponse r;
+      if (!parseEIBnet_ConnectResponse (*p, r) && !r.status && !tunnels[r.channel].open)
+        {
+          tunnels[r.channel].open = true;
+          tunnels[r.channel].stream = from;
+          n_open++;
+        }
+      if (++n_answered == want && n_open)
+        {
+          printf ("%u tunnels open after %.3f s\n", n_open, ev_time () - start);
+          start_load ();
+        }
+    }
+  else if (p->service == TUNNEL_RESPONSE)
+    {
+      EIBnet_TunnelACK r;
+      if (!parseEIBnet_TunnelACK (*p, r) && tunnels[r.channel].open)
+        {
+          Tunnel &tn = tunnels[r.channel];
+          if (r.seqno == tn.sno && tn.unacked)
+            {
+              tn.unacked = false;
+              tn.sno++;
+              fill (r.channel);
+            }
+        }
+    }
+  else if (p->service == TUNNEL_REQUEST)
+    {
+      EIBnet_TunnelRequest r;
+      if (!parseEIBnet_TunnelRequest (*p, r))
+        {
+          if (!tcp)
+            {
+              EIBnet_TunnelACK a;
+              a.channel = r.channel;
+              a.seqno = r.seqno;
+              sock->Send (a.ToPacket (), server);
+            }
+          Tunnel &tn = tunnels[r.channel];
+          if (r.CEMI.size() && r.CEMI[0] == 0x2E && !tn.t_sent.empty ())
+            {
+              lat.push_back (ev_time () - tn.t_sent.front ());
+              tn.t_sent.pop_front ();
+              tn.confirmed++;
+              n_conf++;
+              if (tn.confirmed == count)
+                {
+                  if (--n_pending == 0)
+                    disconnect_all ();
+                }
+              else
+                fill (r.channel);
+            }
+          else
+            n_ind++;
+        }
+    }
+  else if (p->service == DISCONNECT_RESPONSE)
+    {
+      EIBnet_DisconnectResponse r;
+      if (!parseEIBnet_DisconnectResponse (*p, r) && tunnels[r.channel].open)
+        {
+          tunnels[r.channel].open = false;
+          if (--n_open == 0)
+            ev_break (EV_DEFAULT_ EVBREAK_ALL);
+        }
+    }
+  else if (p->service == DISCONNECT_REQUEST)
+    die ("knxd closed a tunnel");
+  delete p;
+}
+
+static void
+recv_udp (EIBNetIPPacket *p)
+{
+  recv_me (p, nullptr);
+}
+
+void
+Conn::recv_cb (EIBNetIPPacket *p)
+{
+  recv_me (p, stream);
+}
+
+void
+Conn::error_cb ()
+{
+  if (phase != CLOSING)
+    die ("TCP connection to knxd lost");
+}
+
+static void
+connect_all ()
+{
+  EIBnet_ConnectRequest r;
+  r.caddr = local;
+  r.daddr = local;
+  r.tcp = tcp;
+  r.CRI.resize (3);
+  r.CRI[0] = 0x04;
+  r.CRI[1] = 0x02;
+  r.CRI[2] = 0x00;
+  for (unsigned i = 0; i < want; i++)
+    if (tcp)
+      {
+        Conn *c = new Conn;
+        c->stream = EIBNetIPStream::connect (server, t);
+        if (!c->stream)
+          die ("TCP connection failed");
+        c->stream->on_recv.set<Conn,&Conn::recv_cb>(c);
+        c->stream->on_error.set<Conn,&Conn::error_cb>(c);
+        c->stream->start ();
+        c->stream->Send (r.ToPacket ());
+        conns.push_back (c);
+      }
+    else
+      sock->Send (r.ToPacket (), server);
+}
+
+static void
+idle_me (EV_P_ ev_timer *w, int)
+{
+  ev_tstamp now = ev_now (EV_DEFAULT);
+  if (now - last < 0.5)
+    return;
+  switch (phase)
+    {
+    case CONNECTING:
+      if (!n_open)
+        die ("no tunnel could be opened");
+      printf ("%u tunnels open, %u requests unanswered\n", n_open, want - n_answered);
+      last = now;
+      start_load ();
+      break;
+    case RUNNING:
+      if (tcp)
+        die ("TCP: %u requests unconfirmed", n_pending);
+      /* an ACK got lost; repeat the request, knxd will re-ACK */
+      for (unsigned ch = 1; ch < 256; ch++)
+        if (tunnels[ch].open && tunnels[ch].unacked)
+          {
+            n_retry++;
+            send_req (ch, true);
+          }
+      last = now;
+      break;
+    case CLOSING:
+      ev_break (EV_DEFAULT_ EVBREAK_ALL);
+      break;
+    }
+}
+
+int
+main (int ac, char *ag[])
+{
+  int c;
+
+  while ((c = getopt (ac, ag, "n:c:w:t")) != -1)
+    switch (c)
+      {
+      case 'n':
+        want = atoi (optarg);
+        break;
+      case 'c':
+        count = atoi (optarg);
+        break;
+      case 'w':
+        window = atoi (optarg);
+        break;
+      case 't':
+        tcp = true;
+        break;
+      default:
+        die ("usage: %s [-t] [-n tunnels] [-c requests] [-w window] host[:port]", ag[0]);
+      }
+  if (optind != ac - 1)
+    die ("usage: %s [-t] [-n tunnels] [-c requests] [-w window] host[:port]", ag[0]);
+  if (!want || want > 255 || !count || !window)
+    die ("1..255 tunnels, at least one request, and a window, please");
+
+  std::string host = ag[optind];
+  int port = 3671;
+  size_t colon = host.find (':');
+  if (colon != std::string::npos)
+    {
+      port = atoi (host.c_str () + colon + 1);
+      host.erase (colon);
+    }
+
+  IniData ini;
+  t = TracePtr(new Trace(ini["main"], "tunnelstress"));
+
+  if (!GetHostIP (t, &server, host))
+    die ("%s: not resolvable", host.c_str ());
+  server.sin_port = htons (port);
+  if (!GetSourceAddress (t, &server, &local))
+    die ("no route to %s", host.c_str ());
+  local.sin_port = 0;
+
+  if (!tcp)
+    {
+      sock = new EIBNetIPSocket (local, 0, t);
+      sock->set_batch (64, 64);
+      if (!sock->init ())
+        die ("socket initialisation failed");
+      sock->recvall = 1;
+      sock->on_recv.set<recv_udp>();
+      local.sin_port = sock->port ();
+    }
+
+  ev_timer idle;
+  ev_timer_init (&idle, idle_me, 0.1, 0.1);
+  ev_timer_start (EV_DEFAULT_ &idle);
+
+  ev_now_update (EV_DEFAULT);
+  last = ev_now (EV_DEFAULT);
+  start = ev_time ();
+  phase = CONNECTING;
+  connect_all ();
+  ev_run (EV_DEFAULT_ 0);
+  ev_tstamp end = ev_time ();
+
+  if (lat.empty ())
+    die ("no requests were confirmed");
+  std::sort (lat.begin (), lat.end ());
+  size_t n = lat.size ();
+  printf ("%s: %u requests confirmed in %.3f s, %.0f/s; %u indications, %u repeated\n",
+          tcp ? "TCP" : "UDP", n_conf, end - load_start, n_conf / (end - load_start),
+          n_ind, n_retry);
+  printf ("confirmation latency ms: min %.3f p50 %.3f p90 %.3f p99 %.3f max %.3f\n",
+          lat[0] * 1e3, lat[n / 2] * 1e3, lat[n * 9 / 10] * 1e3,
+          lat[n * 99 / 100] * 1e3, lat[n - 1] * 1e3);
+  for (Conn *cn : conns)
+    {
+      delete cn->stream;
+      delete cn;
+    }
+  delete sock;
+  return 0;
+}
@@ -413,11 +413,12 @@ vbusmonitor1time\n");
     }
   else if (strcmp (prog, "busmonitor1") == 0)
     {
-      if (ac != 2)
-        die ("usage: %s url", prog);
+      if (ac != 2 && ac != 3)
+        die ("usage: %s url [filter]", prog);
       con = open_con(ag[1]);
 
-      if (EIBOpenBusmonitorText (con) == -1)
+      if ((ac == 3 ? EIBOpenBusmonitorTextFilter (con, strlen (ag[2]), (uint8_t *) ag[2])
+           : EIBOpenBusmonitorText (con)) == -1)
         die ("Open Busmonitor failed");
       while (1)
         {
@@ -431,11 +432,12 @@ vbusmonitor1time\n");
     }
   else if (strcmp (prog, "busmonitor2") == 0)
     {
-      if (ac != 2)
-        die ("usage: %s url", prog);
+      if (ac != 2 && ac != 3)
+        die ("usage: %s url [filter]", prog);
       con = open_con(ag[1]);
 
-      if (EIBOpenBusmonitor (con) == -1)
+      if ((ac == 3 ? EIBOpenBusmonitorFilter (con, strlen (ag[2]), (uint8_t *) ag[2])
+           : EIBOpenBusmonitor (con)) == -1)
         die ("Open Busmonitor failed");
       while (1)
         {
@@ -1401,11 +1403,12 @@ lp0:
     }
   else if (strcmp (prog, "vbusmonitor1") == 0)
     {
-      if (ac != 2)
-        die ("usage: %s url", prog);
+      if (ac != 2 && ac != 3)
+        die ("usage: %s url [filter]", prog);
       con = open_con(ag[1]);
 
-      if (EIBOpenVBusmonitorText (con) == -1)
+      if ((ac == 3 ? EIBOpenVBusmonitorTextFilter (con, strlen (ag[2]), (uint8_t *) ag[2])
+           : EIBOpenVBusmonitorText (con)) == -1)
         die ("Open Busmonitor failed");
 
       while (1)
@@ -1492,11 +1495,12 @@ lp1:
     }
   else if (strcmp (prog, "vbusmonitor2") == 0)
     {
-      if (ac != 2)
-        die ("usage: %s url", prog);
+      if (ac != 2 && ac != 3)
+        die ("usage: %s url [filter]", prog);
       con = open_con(ag[1]);
 
-      if (EIBOpenVBusmonitor (con) == -1)
+      if ((ac == 3 ? EIBOpenVBusmonitorFilter (con, strlen (ag[2]), (uint8_t *) ag[2])
+           : EIBOpenVBusmonitor (con)) == -1)
         die ("Open Busmonitor failed");
 
       while (1)
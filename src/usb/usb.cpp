@@ -23,16 +23,16 @@
 #include "usb.h"
 #include "types.h"
 
-static void pollfd_added_cb (int, short, void *user_data)
+static void pollfd_added_cb (int fd, short events, void *user_data)
 {
   USBLoop *loop = static_cast<USBLoop *>(user_data);
-  loop->setup();
+  loop->add_fd(fd, events);
 }
 
-static void pollfd_removed_cb (int, void *user_data)
+static void pollfd_removed_cb (int fd, void *user_data)
 {
   USBLoop *loop = static_cast<USBLoop *>(user_data);
-  loop->setup();
+  loop->remove_fd(fd);
 }
 
 USBLoop::USBLoop (TracePtr tr)
@@ -58,48 +58,64 @@ USBLoop::USBLoop (TracePtr tr)
 #endif
 
   tm.set<USBLoop, &USBLoop::timer_cb>(this);
+  need_timer = !libusb_pollfds_handle_timeouts (context);
   libusb_set_pollfd_notifiers (context, pollfd_added_cb,pollfd_removed_cb, this);
   setup();
-  TRACEPRINTF (t, 10, "USBLoop-Create");
+  TRACEPRINTF (t, 10, "USBLoop-Create%s", need_timer ? ", with timer" : "");
 }
 
 void USBLoop::timer()
 {
   struct timeval tv;
+  if (!need_timer)
+    return;
   if (libusb_get_next_timeout (context, &tv) > 0)
     tm.start(tv.tv_sec+tv.tv_usec/1000000., 0);
+  else
+    tm.stop();
+}
+
+void USBLoop::add_fd(int fd, short events)
+{
+  int what = 0;
+  if (events & POLLIN)
+    what |= ev::READ;
+  if (events & POLLOUT)
+    what |= ev::WRITE;
+  if (!what)
+    return;
+
+  ev::io *io = new ev::io();
+  io->set<USBLoop, &USBLoop::io_cb>(this);
+  io->start(fd,what);
+  fds.push_back(io);
+  TRACEPRINTF (t, 10, "USBLoop watch %d:%d", fd, what);
+}
+
+/* This may happen within io_cb() of the same watcher, which therefore
+ * must not touch it after handling libusb's events. */
+void USBLoop::remove_fd(int fd)
+{
+  for (auto i = fds.begin(); i != fds.end(); )
+    if ((*i)->fd == fd)
+      {
+        (*i)->stop();
+        delete *i;
+        i = fds.erase(i);
+        TRACEPRINTF (t, 10, "USBLoop unwatch %d", fd);
+      }
+    else
+      i++;
 }
 
 void USBLoop::setup()
 {
-  ITER(i,fds)
-  {
-    (*i)->stop();
-    delete *i;
-  }
-  fds.clear();
   const struct libusb_pollfd **usb_fds = libusb_get_pollfds(context);
-  const struct libusb_pollfd **orig_usb_fds = usb_fds;
-  for(const struct libusb_pollfd *it = *usb_fds; it != NULL; it = *++usb_fds)
-    {
-      if (it->events & POLLIN)
-        {
-          ev::io *io = new ev::io();
-          io->set<USBLoop, &USBLoop::io_cb>(this);
-          io->start(it->fd,ev::READ);
-          fds.push_back(io);
-          TRACEPRINTF (t, 10, "USBLoop read %d",it->fd);
-        }
-      if (it->events & POLLOUT)
-        {
-          ev::io *io = new ev::io();
-          io->set<USBLoop, &USBLoop::io_cb>(this);
-          io->start(it->fd,ev::WRITE);
-          fds.push_back(io);
-          TRACEPRINTF (t, 10, "USBLoop write %d",it->fd);
-        }
-    }
-  free(orig_usb_fds);
+  if (!usb_fds)
+    return;
+  for(const struct libusb_pollfd **it = usb_fds; *it != NULL; it++)
+    add_fd((*it)->fd, (*it)->events);
+  free(usb_fds);
 }
 
 USBLoop::~USBLoop ()
@@ -119,7 +135,7 @@ void
 USBLoop::timer_cb (ev::timer &, int)
 {
   struct timeval tv1 = {0,0};
-  libusb_handle_events_timeout (context, &tv1);
+  libusb_handle_events_timeout_completed (context, &tv1, nullptr);
   timer();
 }
 
@@ -128,7 +144,7 @@ USBLoop::io_cb (ev::io &, int)
 {
   // TRACEPRINTF (t, 10, "USBLoop hit %d", w.fd);
   struct timeval tv1 = {0,0};
-  libusb_handle_events_timeout (context, &tv1);
+  libusb_handle_events_timeout_completed (context, &tv1, nullptr);
   timer();
 }
 
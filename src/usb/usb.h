@@ -25,13 +25,22 @@
 
 #include "trace.h"
 
+/**
+ * Runs libusb's events from the main loop.
+ *
+ * libusb's file descriptors are watched as libusb adds and removes them,
+ * and transfer callbacks run from within io_cb(), i.e. on the main loop.
+ * A timer is only used if libusb can't handle its timeouts via one of
+ * its descriptors (it can on Linux), and only while a timeout is pending.
+ */
 class USBLoop
 {
   TracePtr t;
 
   std::vector < ev::io * > fds;
   ev::timer tm;
-  void timer();
+  /** libusb's timeouts need a timer of ours */
+  bool need_timer = false;
 
   void timer_cb (ev::timer &w, int revents);
   void io_cb (ev::io &w, int revents);
@@ -43,6 +52,10 @@ public:
   virtual ~USBLoop ();
 
   void setup();
+  void add_fd (int fd, short events);
+  void remove_fd (int fd);
+  /** Call after submitting a transfer with a timeout */
+  void timer();
 };
 
 #endif